@@ -18,6 +18,7 @@ __all__ = [
     'CuckooHashTable',
     'CuckooHashTableConfig',
     'CuckooHashTableCreator',
+    'FrozenHashTable',
     'RedisTable',
     'RedisTableConfig',
     'RedisTableCreator',
@@ -52,7 +53,11 @@ from tensorflow_recommenders_addons.dynamic_embedding.python.ops.dynamic_embeddi
     RedisTableCreator,
 )
 from tensorflow_recommenders_addons.dynamic_embedding.python.ops.cuckoo_hashtable_ops import (
-    CuckooHashTable,)
+    CuckooHashTable,
+    reshard_table_files,
+)
+from tensorflow_recommenders_addons.dynamic_embedding.python.ops.frozen_hashtable_ops import (
+    FrozenHashTable,)
 from tensorflow_recommenders_addons.dynamic_embedding.python.ops.redis_table_ops import (
     RedisTable,)
 from tensorflow_recommenders_addons.dynamic_embedding.python.ops.dynamic_embedding_ops import (
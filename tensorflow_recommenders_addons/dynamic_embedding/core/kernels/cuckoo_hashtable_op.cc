@@ -17,13 +17,24 @@ limitations under the License.
 
 #include "tensorflow_recommenders_addons/dynamic_embedding/core/kernels/cuckoo_hashtable_op.h"
 
+#include <algorithm>
+#include <atomic>
+#include <memory>
 #include <string>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 #include "tensorflow/core/kernels/lookup_table_op.h"
+#include "tensorflow/core/lib/random/random.h"
+#include "tensorflow/core/profiler/lib/traceme.h"
+#include "tensorflow/core/profiler/lib/traceme_encode.h"
 #include "tensorflow/core/util/work_sharder.h"
 #include "tensorflow_recommenders_addons/dynamic_embedding/core/kernels/lookup_impl/lookup_table_op_cpu.h"
+#include "tensorflow_recommenders_addons/dynamic_embedding/core/kernels/lookup_impl/lookup_table_op_cpu_change_log.h"
+#include "tensorflow_recommenders_addons/dynamic_embedding/core/kernels/lookup_impl/lookup_table_op_cpu_numa.h"
+#include "tensorflow_recommenders_addons/dynamic_embedding/core/kernels/lookup_impl/lookup_table_op_cpu_reshard.h"
+#include "tensorflow_recommenders_addons/dynamic_embedding/core/utils/table_metrics.h"
 #include "tensorflow_recommenders_addons/dynamic_embedding/core/utils/types.h"
 #include "tensorflow_recommenders_addons/dynamic_embedding/core/utils/utils.h"
 
@@ -39,29 +50,60 @@ template <class K, class V>
 struct LaunchTensorsFind<CPUDevice, K, V> {
   explicit LaunchTensorsFind(int64 value_dim) : value_dim_(value_dim) {}
 
-  void launch(OpKernelContext* context, cpu::TableWrapperBase<K, V>* table,
-              const Tensor& key, Tensor* value, const Tensor& default_value) {
+  // Returns the number of keys missing from the table.
+  int64 launch(OpKernelContext* context, cpu::TableWrapperBase<K, V>* table,
+               const Tensor& key, Tensor* value, const Tensor& default_value) {
     const auto key_flat = key.flat<K>();
     cpu::Tensor2D<V> value_flat = value->flat_inner_dims<V, 2>();
     cpu::ConstTensor2D<V> default_flat = default_value.flat_inner_dims<V, 2>();
     int64 total = value_flat.size();
     int64 default_total = default_flat.size();
     bool is_full_default = (total == default_total);
+    std::atomic<int64> misses(0);
+
+    if (auto* numa_table = cpu::AsNumaTable(table)) {
+      numa_table->RunShards(
+          key_flat.data(), key_flat.size(),
+          [&](cpu::TableWrapperBase<K, V>* part, const int64* indices,
+              int64 count) {
+            int64 shard_misses = 0;
+            for (int64 j = 0; j < count; ++j) {
+              const int64 i = indices[j];
+              bool exist = false;
+              part->find(key_flat(i), value_flat, default_flat, exist,
+                         value_dim_, is_full_default, i);
+              shard_misses += !exist;
+            }
+            misses.fetch_add(shard_misses, std::memory_order_relaxed);
+          });
+      return misses.load();
+    }
 
     auto shard = [this, table, key_flat, &value_flat, &default_flat,
-                  &is_full_default](int64 begin, int64 end) {
+                  &is_full_default, &misses](int64 begin, int64 end) {
+      profiler::TraceMe trace(
+          [&] {
+            return profiler::TraceMeEncode("CuckooFindShard",
+                                           {{"keys", end - begin}});
+          },
+          profiler::TraceMeLevel::kInfo);
+      int64 shard_misses = 0;
       for (int64 i = begin; i < end; ++i) {
         if (i >= key_flat.size()) {
           break;
         }
-        table->find(key_flat(i), value_flat, default_flat, value_dim_,
+        bool exist = false;
+        table->find(key_flat(i), value_flat, default_flat, exist, value_dim_,
                     is_full_default, i);
+        shard_misses += !exist;
       }
+      misses.fetch_add(shard_misses, std::memory_order_relaxed);
     };
     auto& worker_threads = *context->device()->tensorflow_cpu_worker_threads();
     int64 slices = static_cast<int64>(total / worker_threads.num_threads) + 1;
     Shard(worker_threads.num_threads, worker_threads.workers, total, slices,
           shard);
+    return misses.load();
   }
 
  private:
@@ -88,8 +130,24 @@ struct LaunchTensorsFindWithExists<CPUDevice, K, V> {
     int64 default_total = default_flat.size();
     bool is_full_default = (total == default_total);
 
+    if (auto* numa_table = cpu::AsNumaTable(table)) {
+      numa_table->Run(key_flat.data(), key_flat.size(),
+                      [&](cpu::TableWrapperBase<K, V>* part, int64 i) {
+                        part->find(key_flat(i), value_flat, default_flat,
+                                   exists_flat(i), value_dim_, is_full_default,
+                                   i);
+                      });
+      return;
+    }
+
     auto shard = [this, table, key_flat, &value_flat, &default_flat,
                   &exists_flat, &is_full_default](int64 begin, int64 end) {
+      profiler::TraceMe trace(
+          [&] {
+            return profiler::TraceMeEncode("CuckooFindWithExistsShard",
+                                           {{"keys", end - begin}});
+          },
+          profiler::TraceMeLevel::kInfo);
       for (int64 i = begin; i < end; ++i) {
         if (i >= key_flat.size()) {
           break;
@@ -121,7 +179,22 @@ struct LaunchTensorsInsert<CPUDevice, K, V> {
     int64 total = key_flat.size();
     const auto value_flat = values.flat_inner_dims<V, 2>();
 
+    if (auto* numa_table = cpu::AsNumaTable(table)) {
+      numa_table->Run(key_flat.data(), total,
+                      [&](cpu::TableWrapperBase<K, V>* part, int64 i) {
+                        part->insert_or_assign(key_flat(i), value_flat,
+                                               value_dim_, i);
+                      });
+      return;
+    }
+
     auto shard = [this, &table, key_flat, &value_flat](int64 begin, int64 end) {
+      profiler::TraceMe trace(
+          [&] {
+            return profiler::TraceMeEncode("CuckooInsertShard",
+                                           {{"keys", end - begin}});
+          },
+          profiler::TraceMeLevel::kInfo);
       for (int64 i = begin; i < end; ++i) {
         if (i >= key_flat.size()) {
           break;
@@ -170,8 +243,24 @@ struct LaunchTensorsAccum<CPUDevice, K, V> {
     const auto values_or_deltas_flat = values_or_deltas.flat_inner_dims<V, 2>();
     const auto exist_flat = exists.flat<bool>();
 
+    if (auto* numa_table = cpu::AsNumaTable(table)) {
+      numa_table->Run(key_flat.data(), total,
+                      [&](cpu::TableWrapperBase<K, V>* part, int64 i) {
+                        part->insert_or_accum(key_flat(i),
+                                              values_or_deltas_flat,
+                                              exist_flat(i), value_dim_, i);
+                      });
+      return;
+    }
+
     auto shard = [this, &table, key_flat, &values_or_deltas_flat, &exist_flat](
                      int64 begin, int64 end) {
+      profiler::TraceMe trace(
+          [&] {
+            return profiler::TraceMeEncode("CuckooAccumShard",
+                                           {{"keys", end - begin}});
+          },
+          profiler::TraceMeLevel::kInfo);
       for (int64 i = begin; i < end; ++i) {
         if (i >= key_flat.size()) {
           break;
@@ -214,57 +303,153 @@ class CuckooHashTableOfTensors final : public LookupInterface {
       init_size_ = env_var;
     }
     runtime_dim_ = value_shape_.dim_size(0);
-    cpu::CreateTable(init_size_, runtime_dim_, &table_);
+    metrics_.reset(
+        new TableMetrics("cuckoo_hashtable", TableMetricsName(*kernel)));
+    shrink_load_factor_ = cpu::ShrinkLoadFactorFromEnv();
+    numa_partitions_ = cpu::NumaPartitionsFromEnv();
+    Publish(NewTable());
+    OP_REQUIRES_OK(ctx, GetNodeAttr(kernel->def(), "hot_swap", &hot_swap_));
+    OP_REQUIRES_OK(
+        ctx, GetNodeAttr(kernel->def(), "memory_budget", &memory_budget_));
+
+    int64 change_log_capacity = 0;
+    OP_REQUIRES_OK(ctx, GetNodeAttr(kernel->def(), "change_log_capacity",
+                                    &change_log_capacity));
+    if (change_log_capacity > 0) {
+      OP_REQUIRES_OK(ctx, cpu::CreateChangeLog(change_log_capacity,
+                                               runtime_dim_, &change_log_));
+    }
   }
 
-  ~CuckooHashTableOfTensors() { delete table_; }
+  ~CuckooHashTableOfTensors() {
+    {
+      mutex_lock l(rehash_mu_);
+      while (rehash_scheduled_) rehash_done_.wait(l);
+    }
+  }
 
-  size_t size() const override { return table_->size(); }
+  size_t size() const override { return Current()->size(); }
 
   Status Find(OpKernelContext* ctx, const Tensor& key, Tensor* value,
               const Tensor& default_value) override {
+    profiler::TraceMe trace([&] {
+      return profiler::TraceMeEncode(
+          "CuckooHashTableFind",
+          {{"keys", key.NumElements()}, {"bytes", value->TotalBytes()}});
+    });
+    const uint64 start_micros = TableMetrics::NowMicros();
     int64 value_dim = value_shape_.dim_size(0);
 
+    auto table = Current();
     LaunchTensorsFind<CPUDevice, K, V> launcher(value_dim);
-    launcher.launch(ctx, table_, key, value, default_value);
+    const int64 misses =
+        launcher.launch(ctx, table.get(), key, value, default_value);
+    metrics_->RecordFind(key.NumElements(), misses, start_micros);
 
     return Status::OK();
   }
 
   Status FindWithExists(OpKernelContext* ctx, const Tensor& key, Tensor* value,
                         const Tensor& default_value, Tensor& exists) {
+    profiler::TraceMe trace([&] {
+      return profiler::TraceMeEncode(
+          "CuckooHashTableFindWithExists",
+          {{"keys", key.NumElements()}, {"bytes", value->TotalBytes()}});
+    });
+    const uint64 start_micros = TableMetrics::NowMicros();
     int64 value_dim = value_shape_.dim_size(0);
 
+    auto table = Current();
     LaunchTensorsFindWithExists<CPUDevice, K, V> launcher(value_dim);
-    launcher.launch(ctx, table_, key, value, default_value, exists);
+    launcher.launch(ctx, table.get(), key, value, default_value, exists);
+    const auto exists_flat = exists.flat<bool>();
+    const int64 misses =
+        std::count(exists_flat.data(), exists_flat.data() + exists_flat.size(),
+                   false);
+    metrics_->RecordFind(key.NumElements(), misses, start_micros);
 
     return Status::OK();
   }
 
   Status DoInsert(bool clear, OpKernelContext* ctx, const Tensor& keys,
                   const Tensor& values) {
+    profiler::TraceMe trace([&] {
+      return profiler::TraceMeEncode(
+          "CuckooHashTableInsert",
+          {{"keys", keys.NumElements()}, {"bytes", values.TotalBytes()},
+           {"clear", clear}});
+    });
+    const uint64 start_micros = TableMetrics::NowMicros();
     int64 value_dim = value_shape_.dim_size(0);
 
-    if (clear) {
-      table_->clear();
+    // A hot swap table is cleared by loading into a new version.
+    const bool swap = clear && hot_swap_;
+    auto table = swap ? NewTable() : Current();
+    int64 reserved_keys = 0;
+    if (!clear) {
+      TF_RETURN_IF_ERROR(ReserveMemoryBudget(table, keys, &reserved_keys));
     }
-
-    LaunchTensorsInsert<CPUDevice, K, V> launcher(value_dim);
-    launcher.launch(ctx, table_, keys, values);
+    auto insert = [&]() {
+      if (clear && !swap) {
+        table->clear();
+      }
+      LaunchTensorsInsert<CPUDevice, K, V> launcher(value_dim);
+      launcher.launch(ctx, table.get(), keys, values);
+      if (swap) Publish(table);
+    };
+    if (change_log_ == nullptr) {
+      insert();
+    } else {
+      mutex_lock l(*change_log_->mu());
+      insert();
+      if (clear) change_log_->AppendClear();
+      change_log_->Append(cpu::ChangeOp::kUpsert, keys.flat<K>().data(),
+                          values.flat<V>().data(), nullptr,
+                          keys.NumElements());
+    }
+    ReleaseMemoryBudget(reserved_keys);
+    MaybeScheduleRehash(ctx, table);
+    RecordInsert(keys.NumElements(), start_micros);
 
     return Status::OK();
   }
 
   Status DoAccum(bool clear, OpKernelContext* ctx, const Tensor& keys,
                  const Tensor& values_or_deltas, const Tensor& exists) {
+    profiler::TraceMe trace([&] {
+      return profiler::TraceMeEncode(
+          "CuckooHashTableAccum",
+          {{"keys", keys.NumElements()},
+           {"bytes", values_or_deltas.TotalBytes()}});
+    });
+    const uint64 start_micros = TableMetrics::NowMicros();
     int64 value_dim = value_shape_.dim_size(0);
 
-    if (clear) {
-      table_->clear();
+    auto table = Current();
+    int64 reserved_keys = 0;
+    if (!clear) {
+      TF_RETURN_IF_ERROR(ReserveMemoryBudget(table, keys, &reserved_keys));
     }
-
-    LaunchTensorsAccum<CPUDevice, K, V> launcher(value_dim);
-    launcher.launch(ctx, table_, keys, values_or_deltas, exists);
+    auto accum = [&]() {
+      if (clear) {
+        table->clear();
+      }
+      LaunchTensorsAccum<CPUDevice, K, V> launcher(value_dim);
+      launcher.launch(ctx, table.get(), keys, values_or_deltas, exists);
+    };
+    if (change_log_ == nullptr) {
+      accum();
+    } else {
+      mutex_lock l(*change_log_->mu());
+      accum();
+      if (clear) change_log_->AppendClear();
+      change_log_->Append(cpu::ChangeOp::kAccum, keys.flat<K>().data(),
+                          values_or_deltas.flat<V>().data(),
+                          exists.flat<bool>().data(), keys.NumElements());
+    }
+    ReleaseMemoryBudget(reserved_keys);
+    MaybeScheduleRehash(ctx, table);
+    RecordInsert(keys.NumElements(), start_micros);
 
     return Status::OK();
   }
@@ -275,17 +460,103 @@ class CuckooHashTableOfTensors final : public LookupInterface {
   }
 
   Status Remove(OpKernelContext* ctx, const Tensor& keys) override {
+    profiler::TraceMe trace([&] {
+      return profiler::TraceMeEncode(
+          "CuckooHashTableRemove", {{"keys", keys.NumElements()}});
+    });
+    const uint64 start_micros = TableMetrics::NowMicros();
     const auto key_flat = keys.flat<K>();
 
-    // mutex_lock l(mu_);
-    for (int64 i = 0; i < key_flat.size(); ++i) {
-      table_->erase(tensorflow::lookup::SubtleMustCopyIfIntegral(key_flat(i)));
+    auto table = Current();
+    auto remove = [&]() {
+      if (auto* numa_table = cpu::AsNumaTable(table.get())) {
+        numa_table->Run(key_flat.data(), key_flat.size(),
+                        [&](cpu::TableWrapperBase<K, V>* part, int64 i) {
+                          part->erase(
+                              tensorflow::lookup::SubtleMustCopyIfIntegral(
+                                  key_flat(i)));
+                        });
+      } else {
+        for (int64 i = 0; i < key_flat.size(); ++i) {
+          table->erase(
+              tensorflow::lookup::SubtleMustCopyIfIntegral(key_flat(i)));
+        }
+      }
+    };
+    if (change_log_ == nullptr) {
+      remove();
+    } else {
+      mutex_lock l(*change_log_->mu());
+      remove();
+      change_log_->Append(cpu::ChangeOp::kRemove, key_flat.data(), nullptr,
+                          nullptr, key_flat.size());
+    }
+
+    const size_t capacity = table->capacity();
+    if (shrink_load_factor_ > 0 && capacity > 0 &&
+        table->size() < shrink_load_factor_ * capacity) {
+      // A shrink halves the bucket array at least, so the table has to fit
+      // in half of it: allow up to twice the trigger load factor.
+      const float max_load_factor = 2 * shrink_load_factor_;
+      Shrink(max_load_factor > kShrinkMaxLoadFactor ? max_load_factor
+                                                    : kShrinkMaxLoadFactor);
     }
+    metrics_->RecordRemove(key_flat.size(), start_micros);
+    metrics_->MaybeRecordSize(
+        [&]() { return std::pair<int64, int64>(size(), MemoryUsed()); });
     return Status::OK();
   }
 
+  // Rehashes the table into a smaller bucket array, see
+  // TableWrapperBase::shrink_to_fit. The table never shrinks below init_size.
+  bool Shrink(float max_load_factor) {
+    return Current()->shrink_to_fit(init_size_, max_load_factor);
+  }
+
   Status Clear(OpKernelContext* ctx) {
-    table_->clear();
+    auto table = Current();
+    if (change_log_ == nullptr) {
+      table->clear();
+    } else {
+      mutex_lock l(*change_log_->mu());
+      table->clear();
+      change_log_->AppendClear();
+    }
+    return Status::OK();
+  }
+
+  // Writes the changes recorded since the last drain to filepath, see
+  // cpu::ChangeLog::Drain.
+  Status DrainChangeLog(const string& filepath, uint64* first_seq,
+                        uint64* count, uint64* dropped) {
+    if (change_log_ == nullptr) {
+      return errors::FailedPrecondition(
+          "The table was created without a change log, set "
+          "change_log_capacity to record one.");
+    }
+    profiler::TraceMe trace([&] {
+      return profiler::TraceMeEncode("CuckooHashTableDrainChangeLog",
+                                     {{"filepath", filepath}});
+    });
+    return change_log_->Drain(filepath, first_seq, count, dropped);
+  }
+
+  // Applies a drained change log, see cpu::ReplayChangeLog. Replays are
+  // serialized and remember the last applied sequence, so replaying a file
+  // twice is harmless.
+  Status ReplayChangeLog(OpKernelContext* ctx, const string& filepath,
+                         uint64* last_seq, uint64* missing) {
+    profiler::TraceMe trace([&] {
+      return profiler::TraceMeEncode("CuckooHashTableReplayChangeLog",
+                                     {{"filepath", filepath}});
+    });
+    mutex_lock l(replay_mu_);
+    auto table = Current();
+    TF_RETURN_IF_ERROR(cpu::ReplayChangeLog(ctx, table.get(), runtime_dim_,
+                                            filepath, &replayed_seq_,
+                                            missing));
+    *last_seq = replayed_seq_;
+    MaybeScheduleRehash(ctx, table);
     return Status::OK();
   }
 
@@ -299,21 +570,102 @@ class CuckooHashTableOfTensors final : public LookupInterface {
     return DoInsert(true, ctx, keys, values);
   }
 
+  double RehashProgress() const { return Current()->rehash_progress(); }
+
+  // Samples up to n entries uniformly at random, with replacement, see
+  // cpu::TableWrapperBase::sample. The cost grows with n, not with the size
+  // of the table, unless the table is nearly empty.
+  Status Sample(OpKernelContext* ctx, int64 n, uint64 seed, bool with_values) {
+    const int64 value_dim = value_shape_.dim_size(0);
+    auto table = Current();
+    const int64 expected = std::min<int64>(n, table->size());
+    std::vector<K> keys;
+    std::vector<V> values;
+    keys.reserve(expected);
+    if (with_values) values.reserve(expected * value_dim);
+    table->sample(n, n * kSampleProbesPerKey, seed,
+                  [&](const K& key, const V* value) {
+                    keys.push_back(key);
+                    if (with_values) {
+                      values.insert(values.end(), value, value + value_dim);
+                    }
+                  });
+
+    const int64 sampled = keys.size();
+    Tensor* keys_tensor;
+    TF_RETURN_IF_ERROR(
+        ctx->allocate_output("keys", TensorShape({sampled}), &keys_tensor));
+    Tensor* values_tensor;
+    TF_RETURN_IF_ERROR(ctx->allocate_output(
+        "values", TensorShape({with_values ? sampled : 0, value_dim}),
+        &values_tensor));
+    std::copy(keys.begin(), keys.end(), keys_tensor->flat<K>().data());
+    std::copy(values.begin(), values.end(), values_tensor->flat<V>().data());
+    return Status::OK();
+  }
+
+  // Reads the counters of the table since the last reset, see
+  // cpu::TableStatistics. A reset, or a new version of the table, starts
+  // the counters over from the current reading.
+  void Stats(bool per_lock, bool reset, cpu::TableStatistics* stats) {
+    auto table = Current();
+    cpu::TableStatistics total;
+    table->statistics(/*per_lock=*/true, &total);
+    *stats = total;
+    {
+      mutex_lock l(stats_mu_);
+      if (stats_table_.lock() == table) stats->Subtract(stats_baseline_);
+      if (reset) {
+        stats_baseline_ = std::move(total);
+        stats_table_ = table;
+      }
+    }
+    if (!per_lock) {
+      stats->lock_acquisitions_per_lock.clear();
+      stats->contended_acquisitions_per_lock.clear();
+      stats->contended_spins_per_lock.clear();
+    }
+  }
+
   Status ExportValues(OpKernelContext* ctx) override {
+    profiler::TraceMe trace([&] {
+      return profiler::TraceMeEncode(
+          "CuckooHashTableExport", {{"keys", size()}});
+    });
     int64 value_dim = value_shape_.dim_size(0);
-    return table_->export_values(ctx, value_dim);
+    return Current()->export_values(ctx, value_dim);
   }
 
   Status SaveToHDFS(OpKernelContext* ctx, const string& filepath,
-                    const size_t buffer_size) {
+                    const size_t buffer_size, cpu::SnapshotCodec codec) {
+    profiler::TraceMe trace([&] {
+      return profiler::TraceMeEncode(
+          "CuckooHashTableSaveToHDFS",
+          {{"keys", size()}, {"filepath", filepath}});
+    });
     int64 value_dim = value_shape_.dim_size(0);
-    return table_->save_to_hdfs(ctx, value_dim, filepath, buffer_size);
+    return Current()->save_to_hdfs(ctx, value_dim, filepath, buffer_size,
+                                   codec);
   }
 
   Status LoadFromHDFS(OpKernelContext* ctx, const string& filepath,
                       const size_t buffer_size) {
+    profiler::TraceMe trace([&] {
+      return profiler::TraceMeEncode(
+          "CuckooHashTableLoadFromHDFS", {{"filepath", filepath}});
+    });
     int64 value_dim = value_shape_.dim_size(0);
-    return table_->load_from_hdfs(ctx, value_dim, filepath, buffer_size);
+    if (!hot_swap_) {
+      return Current()->load_from_hdfs(ctx, value_dim, filepath, buffer_size);
+    }
+    // The file replaces the table, as a restore does, so it is loaded
+    // straight into an empty next version. Changes made to the current
+    // version meanwhile are not carried over.
+    auto table = NewTable();
+    TF_RETURN_IF_ERROR(
+        table->load_from_hdfs(ctx, value_dim, filepath, buffer_size));
+    Publish(table);
+    return Status::OK();
   }
 
   DataType key_dtype() const override { return DataTypeToEnum<K>::v(); }
@@ -324,17 +676,224 @@ class CuckooHashTableOfTensors final : public LookupInterface {
 
   TensorShape value_shape() const override { return value_shape_; }
 
-  int64 MemoryUsed() const override {
-    int64 ret = 0;
-    ret = (int64)table_->size();
-    return sizeof(CuckooHashTableOfTensors) + ret;
-  }
+  int64 MemoryUsed() const override { return MemoryUsed(*Current()); }
 
  private:
+  using TablePtr = std::shared_ptr<cpu::TableWrapperBase<K, V>>;
+
+  void RecordInsert(int64 keys, uint64 start_micros) {
+    metrics_->RecordInsert(keys, start_micros);
+    metrics_->MaybeRecordSize(
+        [&]() { return std::pair<int64, int64>(size(), MemoryUsed()); });
+  }
+
+  int64 MemoryUsed(const cpu::TableWrapperBase<K, V>& table) const {
+    return sizeof(CuckooHashTableOfTensors) + table.allocated_bytes() +
+           table.heap_bytes() +
+           (change_log_ ? change_log_->MemoryUsed() : 0);
+  }
+
+  // Fails an insert of keys that could take the table over memory_budget
+  // bytes, counting the bucket arrays alive while the table doubles. Every
+  // key is first assumed new, the missing ones are only counted when that
+  // goes over the budget. The new keys stay reserved until
+  // ReleaseMemoryBudget, so concurrent inserts cannot all pass the check
+  // against the same free memory.
+  //
+  // Measuring the table walks its heap allocations, so the measure is cached
+  // and only taken again on a resize, on a new version of the table, after
+  // kBudgetRefreshKeys inserted keys or before failing an insert.
+  Status ReserveMemoryBudget(const TablePtr& table, const Tensor& keys,
+                             int64* reserved_keys) {
+    if (memory_budget_ <= 0) return Status::OK();
+    const auto key_flat = keys.flat<K>();
+    mutex_lock l(budget_mu_);
+    if (budget_.table != table.get() ||
+        budget_.capacity != table->capacity() ||
+        budget_.inserted_keys >= kBudgetRefreshKeys) {
+      MeasureMemoryBudget(*table);
+    }
+    int64 new_keys = key_flat.size();
+    if (ProjectedBytes(new_keys) > memory_budget_) {
+      MeasureMemoryBudget(*table);
+      if (ProjectedBytes(new_keys) > memory_budget_) {
+        new_keys = 0;
+        for (int64 i = 0; i < key_flat.size(); ++i) {
+          if (!table->contains(key_flat(i))) ++new_keys;
+        }
+        const int64 bytes = ProjectedBytes(new_keys);
+        if (new_keys > 0 && bytes > memory_budget_) {
+          return errors::ResourceExhausted(
+              "Inserting ", new_keys, " new keys would take the table to ",
+              bytes, " bytes, over its memory_budget of ", memory_budget_,
+              " bytes.");
+        }
+      }
+    }
+    budget_.reserved_keys += new_keys;
+    *reserved_keys = new_keys;
+    return Status::OK();
+  }
+
+  // Turns the keys reserved by ReserveMemoryBudget into inserted keys, which
+  // the cached measure counts as new until it is taken again.
+  void ReleaseMemoryBudget(int64 reserved_keys) {
+    if (memory_budget_ <= 0) return;
+    mutex_lock l(budget_mu_);
+    budget_.reserved_keys -= reserved_keys;
+    budget_.inserted_keys += reserved_keys;
+  }
+
+  void MeasureMemoryBudget(const cpu::TableWrapperBase<K, V>& table)
+      TF_EXCLUSIVE_LOCKS_REQUIRED(budget_mu_) {
+    budget_.table = &table;
+    budget_.capacity = table.capacity();
+    budget_.size = table.size();
+    budget_.bucket_bytes = table.allocated_bytes();
+    budget_.other_bytes = MemoryUsed(table) - budget_.bucket_bytes;
+    budget_.heap_per_key =
+        budget_.size > 0 ? table.heap_bytes() / budget_.size : 0;
+    budget_.inserted_keys = 0;
+  }
+
+  // Bytes of the table measured last after new_keys more keys, on top of
+  // the inserted and reserved ones.
+  int64 ProjectedBytes(int64 new_keys) const
+      TF_EXCLUSIVE_LOCKS_REQUIRED(budget_mu_) {
+    const int64 added_keys =
+        budget_.inserted_keys + budget_.reserved_keys + new_keys;
+    int64 bucket_bytes = budget_.bucket_bytes;
+    int64 peak_bytes = bucket_bytes;
+    for (double capacity = budget_.capacity;
+         capacity > 0 && budget_.size + added_keys > capacity * kMaxLoadFactor;
+         capacity *= 2) {
+      // The old buckets live until all of them are migrated.
+      peak_bytes = 3 * bucket_bytes;
+      bucket_bytes *= 2;
+    }
+    return budget_.other_bytes + peak_bytes + added_keys * budget_.heap_per_key;
+  }
+
+  // Frees a version of the table. The last user of a version replaced by
+  // Publish may be a lookup, which should not pay for freeing it, so those
+  // are freed on another thread; any other version is freed in place.
+  struct TableDeleter {
+    std::shared_ptr<std::atomic<bool>> retired =
+        std::make_shared<std::atomic<bool>>(false);
+
+    void operator()(cpu::TableWrapperBase<K, V>* table) const {
+      if (retired->load(std::memory_order_acquire)) {
+        Env::Default()->SchedClosure([table]() { delete table; });
+      } else {
+        delete table;
+      }
+    }
+  };
+
+  TablePtr NewTable() const {
+    cpu::TableWrapperBase<K, V>* table = nullptr;
+    if (numa_partitions_ > 0) {
+      table = new cpu::TableWrapperNuma<K, V>(init_size_, runtime_dim_,
+                                              numa_partitions_);
+    } else {
+      cpu::CreateTable(init_size_, runtime_dim_, &table);
+    }
+    return TablePtr(table, TableDeleter());
+  }
+
+  // The current version of the table. Operations pin the version they start
+  // with, so a hot swap never frees a table in use.
+  TablePtr Current() const {
+    tf_shared_lock l(table_mu_);
+    return table_;
+  }
+
+  void Publish(TablePtr table) {
+    {
+      mutex_lock l(table_mu_);
+      table_.swap(table);
+    }
+    if (table != nullptr) {
+      std::get_deleter<TableDeleter>(table)->retired->store(
+          true, std::memory_order_release);
+    }
+  }
+
+  // When the table doubles, its buckets are migrated lazily by the operations
+  // taking each lock stripe. Stripes nobody touches would be left to the next
+  // doubling, which migrates them while holding all the locks, so the rest is
+  // moved in small chunks on the worker threads meanwhile. Every chunk is
+  // its own closure, queued behind the ops already waiting for a worker.
+  void MaybeScheduleRehash(OpKernelContext* ctx, const TablePtr& table) {
+    if (table->rehash_progress() >= 1.0) return;
+    {
+      mutex_lock l(rehash_mu_);
+      if (rehash_scheduled_) return;
+      rehash_scheduled_ = true;
+    }
+    ScheduleRehashChunk(
+        ctx->device()->tensorflow_cpu_worker_threads()->workers, table);
+  }
+
+  void ScheduleRehashChunk(thread::ThreadPool* pool, TablePtr table) {
+    pool->Schedule([this, pool, table]() {
+      if (table->rehash_pending(kRehashStripesPerChunk) > 0) {
+        ScheduleRehashChunk(pool, table);
+        return;
+      }
+      mutex_lock l(rehash_mu_);
+      rehash_scheduled_ = false;
+      rehash_done_.notify_all();
+    });
+  }
+
+  static constexpr size_t kRehashStripesPerChunk = 1024;
+  // Load factor above which a table is expected to double, cuckoo paths
+  // start failing around it with 4 slots per bucket.
+  static constexpr double kMaxLoadFactor = 0.9;
+  // Random slots probed per requested sample before giving up, enough for
+  // tables down to a few percent full.
+  static constexpr int64 kSampleProbesPerKey = 64;
+  // Lowest max_load_factor of an automatic shrink, leaving room for inserts
+  // before the table has to double again.
+  static constexpr float kShrinkMaxLoadFactor = 0.5;
+  // Inserted keys after which the memory_budget measure is taken again.
+  static constexpr int64 kBudgetRefreshKeys = 1 << 16;
+
   TensorShape value_shape_;
   size_t runtime_dim_;
-  cpu::TableWrapperBase<K, V>* table_ = nullptr;
+  mutable mutex table_mu_;
+  TablePtr table_ TF_GUARDED_BY(table_mu_);
   size_t init_size_;
+  int numa_partitions_ = 0;
+  bool hot_swap_ = false;
+  int64 memory_budget_ = 0;
+  float shrink_load_factor_ = 0;
+  // The table as last measured by MeasureMemoryBudget, and the keys added
+  // since.
+  struct MemoryBudget {
+    const void* table = nullptr;
+    size_t capacity = 0;
+    int64 size = 0;
+    int64 bucket_bytes = 0;
+    int64 other_bytes = 0;
+    int64 heap_per_key = 0;
+    int64 inserted_keys = 0;
+    int64 reserved_keys = 0;
+  };
+  mutex budget_mu_;
+  MemoryBudget budget_ TF_GUARDED_BY(budget_mu_);
+  mutex rehash_mu_;
+  condition_variable rehash_done_;
+  bool rehash_scheduled_ TF_GUARDED_BY(rehash_mu_) = false;
+  std::unique_ptr<cpu::ChangeLog<K, V>> change_log_;
+  mutex replay_mu_;
+  uint64 replayed_seq_ TF_GUARDED_BY(replay_mu_) = 0;
+  std::unique_ptr<TableMetrics> metrics_;
+  mutex stats_mu_;
+  std::weak_ptr<cpu::TableWrapperBase<K, V>> stats_table_
+      TF_GUARDED_BY(stats_mu_);
+  cpu::TableStatistics stats_baseline_ TF_GUARDED_BY(stats_mu_);
 };
 
 }  // namespace lookup
@@ -589,6 +1148,206 @@ class HashTableAccumOp : public HashTableOpKernel {
   }
 };
 
+// Op that rehashes the table into a smaller bucket array.
+template <class K, class V>
+class HashTableShrinkOp : public HashTableOpKernel {
+ public:
+  explicit HashTableShrinkOp(OpKernelConstruction* ctx)
+      : HashTableOpKernel(ctx) {
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("max_load_factor", &max_load_factor_));
+    OP_REQUIRES(ctx, max_load_factor_ > 0 && max_load_factor_ <= 1,
+                errors::InvalidArgument("max_load_factor must be in (0, 1], ",
+                                        "got ", max_load_factor_));
+  }
+
+  void Compute(OpKernelContext* ctx) override {
+    LookupInterface* table;
+    OP_REQUIRES_OK(ctx, GetTable(ctx, &table));
+    core::ScopedUnref unref_me(table);
+
+    lookup::CuckooHashTableOfTensors<K, V>* table_cuckoo =
+        (lookup::CuckooHashTableOfTensors<K, V>*)table;
+    int64 memory_used_before = 0;
+    if (ctx->track_allocations()) {
+      memory_used_before = table->MemoryUsed();
+    }
+    Tensor* out;
+    OP_REQUIRES_OK(ctx, ctx->allocate_output("shrunk", TensorShape({}), &out));
+    out->scalar<bool>()() = table_cuckoo->Shrink(max_load_factor_);
+    if (ctx->track_allocations()) {
+      ctx->record_persistent_memory_allocation(table->MemoryUsed() -
+                                               memory_used_before);
+    }
+  }
+
+ private:
+  float max_load_factor_;
+};
+
+// Op that returns the fraction of the last doubling of the table which has
+// been migrated to the new buckets.
+template <class K, class V>
+class HashTableRehashProgressOp : public HashTableOpKernel {
+ public:
+  using HashTableOpKernel::HashTableOpKernel;
+
+  void Compute(OpKernelContext* ctx) override {
+    LookupInterface* table;
+    OP_REQUIRES_OK(ctx, GetTable(ctx, &table));
+    core::ScopedUnref unref_me(table);
+
+    lookup::CuckooHashTableOfTensors<K, V>* table_cuckoo =
+        (lookup::CuckooHashTableOfTensors<K, V>*)table;
+
+    Tensor* out;
+    OP_REQUIRES_OK(ctx,
+                   ctx->allocate_output("progress", TensorShape({}), &out));
+    out->scalar<float>()() = static_cast<float>(table_cuckoo->RehashProgress());
+  }
+};
+
+// Op that moves the change log of a table to a file.
+template <class K, class V>
+class HashTableDrainChangeLogOp : public HashTableOpKernel {
+ public:
+  using HashTableOpKernel::HashTableOpKernel;
+
+  void Compute(OpKernelContext* ctx) override {
+    LookupInterface* table;
+    OP_REQUIRES_OK(ctx, GetTable(ctx, &table));
+    core::ScopedUnref unref_me(table);
+
+    const Tensor& ftensor = ctx->input(1);
+    OP_REQUIRES(ctx, TensorShapeUtils::IsScalar(ftensor.shape()),
+                errors::InvalidArgument("filepath must be scalar."));
+    string filepath = string(ftensor.scalar<tstring>()().data());
+
+    lookup::CuckooHashTableOfTensors<K, V>* table_cuckoo =
+        (lookup::CuckooHashTableOfTensors<K, V>*)table;
+    uint64 first_seq = 0;
+    uint64 count = 0;
+    uint64 dropped = 0;
+    OP_REQUIRES_OK(ctx, table_cuckoo->DrainChangeLog(filepath, &first_seq,
+                                                     &count, &dropped));
+
+    Tensor* out;
+    OP_REQUIRES_OK(ctx, ctx->allocate_output("first_sequence", TensorShape({}),
+                                             &out));
+    out->scalar<int64>()() = static_cast<int64>(first_seq);
+    OP_REQUIRES_OK(ctx, ctx->allocate_output("count", TensorShape({}), &out));
+    out->scalar<int64>()() = static_cast<int64>(count);
+    OP_REQUIRES_OK(ctx, ctx->allocate_output("dropped", TensorShape({}), &out));
+    out->scalar<int64>()() = static_cast<int64>(dropped);
+  }
+};
+
+// Op that applies a drained change log to a table.
+template <class K, class V>
+class HashTableReplayChangeLogOp : public HashTableOpKernel {
+ public:
+  using HashTableOpKernel::HashTableOpKernel;
+
+  void Compute(OpKernelContext* ctx) override {
+    LookupInterface* table;
+    OP_REQUIRES_OK(ctx, GetTable(ctx, &table));
+    core::ScopedUnref unref_me(table);
+
+    const Tensor& ftensor = ctx->input(1);
+    OP_REQUIRES(ctx, TensorShapeUtils::IsScalar(ftensor.shape()),
+                errors::InvalidArgument("filepath must be scalar."));
+    string filepath = string(ftensor.scalar<tstring>()().data());
+
+    lookup::CuckooHashTableOfTensors<K, V>* table_cuckoo =
+        (lookup::CuckooHashTableOfTensors<K, V>*)table;
+    uint64 last_seq = 0;
+    uint64 missing = 0;
+    OP_REQUIRES_OK(ctx, table_cuckoo->ReplayChangeLog(ctx, filepath, &last_seq,
+                                                      &missing));
+
+    Tensor* out;
+    OP_REQUIRES_OK(
+        ctx, ctx->allocate_output("last_sequence", TensorShape({}), &out));
+    out->scalar<int64>()() = static_cast<int64>(last_seq);
+    OP_REQUIRES_OK(ctx, ctx->allocate_output("missing", TensorShape({}), &out));
+    out->scalar<int64>()() = static_cast<int64>(missing);
+  }
+};
+
+// Op that reads the internal counters of the table.
+template <class K, class V>
+class HashTableStatsOp : public HashTableOpKernel {
+ public:
+  explicit HashTableStatsOp(OpKernelConstruction* ctx)
+      : HashTableOpKernel(ctx) {
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("per_lock", &per_lock_));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("reset", &reset_));
+  }
+
+  void Compute(OpKernelContext* ctx) override {
+    LookupInterface* table;
+    OP_REQUIRES_OK(ctx, GetTable(ctx, &table));
+    core::ScopedUnref unref_me(table);
+
+    lookup::CuckooHashTableOfTensors<K, V>* table_cuckoo =
+        (lookup::CuckooHashTableOfTensors<K, V>*)table;
+    lookup::cpu::TableStatistics stats;
+    table_cuckoo->Stats(per_lock_, reset_, &stats);
+
+    const double size = stats.size;
+    const double capacity = stats.capacity;
+    const double lookups = stats.hits + stats.misses;
+    const std::vector<std::pair<string, double>> scalars = {
+        {"size", size},
+        {"capacity", capacity},
+        {"bucket_count", stats.bucket_count},
+        {"load_factor", capacity > 0 ? size / capacity : 0},
+        {"memory_bytes", table_cuckoo->MemoryUsed()},
+        {"lock_acquisitions", stats.lock_acquisitions},
+        {"contended_acquisitions", stats.contended_acquisitions},
+        {"contended_spins", stats.contended_spins},
+        {"hits", stats.hits},
+        {"misses", stats.misses},
+        {"hit_ratio", lookups > 0 ? stats.hits / lookups : 0},
+        {"cuckoo_failures", stats.cuckoo_failures},
+        {"resizes", stats.resizes},
+        {"resize_seconds", stats.resize_seconds},
+    };
+
+    const int64 num_scalars = scalars.size();
+    Tensor* names;
+    OP_REQUIRES_OK(ctx, ctx->allocate_output(
+                            "names", TensorShape({num_scalars}), &names));
+    Tensor* values;
+    OP_REQUIRES_OK(ctx,
+                   ctx->allocate_output("values", names->shape(), &values));
+    for (size_t i = 0; i < scalars.size(); ++i) {
+      names->flat<tstring>()(i) = scalars[i].first;
+      values->flat<double>()(i) = scalars[i].second;
+    }
+    OP_REQUIRES_OK(ctx, OutputVector(ctx, "cuckoo_path_depths",
+                                     stats.cuckoo_path_depths));
+    OP_REQUIRES_OK(ctx, OutputVector(ctx, "lock_acquisitions",
+                                     stats.lock_acquisitions_per_lock));
+    OP_REQUIRES_OK(ctx, OutputVector(ctx, "contended_acquisitions",
+                                     stats.contended_acquisitions_per_lock));
+    OP_REQUIRES_OK(ctx, OutputVector(ctx, "contended_spins",
+                                     stats.contended_spins_per_lock));
+  }
+
+ private:
+  static Status OutputVector(OpKernelContext* ctx, const string& name,
+                             const std::vector<int64>& vec) {
+    Tensor* out;
+    TF_RETURN_IF_ERROR(ctx->allocate_output(
+        name, TensorShape({static_cast<int64>(vec.size())}), &out));
+    std::copy(vec.begin(), vec.end(), out->flat<int64>().data());
+    return Status::OK();
+  }
+
+  bool per_lock_;
+  bool reset_;
+};
+
 // Op that returns the size of the given table.
 class HashTableSizeOp : public HashTableOpKernel {
  public:
@@ -605,6 +1364,43 @@ class HashTableSizeOp : public HashTableOpKernel {
   }
 };
 
+// Op that samples random entries of the table.
+template <class K, class V>
+class HashTableSampleOp : public HashTableOpKernel {
+ public:
+  explicit HashTableSampleOp(OpKernelConstruction* ctx)
+      : HashTableOpKernel(ctx) {
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("with_values", &with_values_));
+  }
+
+  void Compute(OpKernelContext* ctx) override {
+    LookupInterface* table;
+    OP_REQUIRES_OK(ctx, GetTable(ctx, &table));
+    core::ScopedUnref unref_me(table);
+
+    const Tensor& n_tensor = ctx->input(1);
+    const Tensor& seed_tensor = ctx->input(2);
+    OP_REQUIRES(ctx,
+                TensorShapeUtils::IsScalar(n_tensor.shape()) &&
+                    TensorShapeUtils::IsScalar(seed_tensor.shape()),
+                errors::InvalidArgument("n and seed must be scalars."));
+    const int64 n = n_tensor.scalar<int64>()();
+    OP_REQUIRES(ctx, n >= 0,
+                errors::InvalidArgument("n must be non-negative, got ", n));
+    // As for the random ops, a zero seed draws a fresh sample every time.
+    int64 seed = seed_tensor.scalar<int64>()();
+    if (seed == 0) seed = random::New64();
+
+    lookup::CuckooHashTableOfTensors<K, V>* table_cuckoo =
+        (lookup::CuckooHashTableOfTensors<K, V>*)table;
+    OP_REQUIRES_OK(ctx, table_cuckoo->Sample(ctx, n, static_cast<uint64>(seed),
+                                             with_values_));
+  }
+
+ private:
+  bool with_values_;
+};
+
 // Op that outputs tensors of all keys and all values.
 class HashTableExportOp : public HashTableOpKernel {
  public:
@@ -628,6 +1424,9 @@ class HashTableSaveToHDFSOp : public HashTableOpKernel {
     int64 signed_buffer_size = 0;
     ctx->GetAttr("buffer_size", &signed_buffer_size);
     buffer_size_ = static_cast<size_t>(signed_buffer_size);
+    string compression;
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("compression", &compression));
+    OP_REQUIRES_OK(ctx, lookup::cpu::ParseSnapshotCodec(compression, &codec_));
   }
 
   void Compute(OpKernelContext* ctx) override {
@@ -642,11 +1441,13 @@ class HashTableSaveToHDFSOp : public HashTableOpKernel {
 
     lookup::CuckooHashTableOfTensors<K, V>* table_cuckoo =
         (lookup::CuckooHashTableOfTensors<K, V>*)table;
-    OP_REQUIRES_OK(ctx, table_cuckoo->SaveToHDFS(ctx, filepath, buffer_size_));
+    OP_REQUIRES_OK(
+        ctx, table_cuckoo->SaveToHDFS(ctx, filepath, buffer_size_, codec_));
   }
 
  private:
   size_t buffer_size_;
+  lookup::cpu::SnapshotCodec codec_;
 };
 
 // Clear the table and insert data.
@@ -667,7 +1468,7 @@ class HashTableImportOp : public HashTableOpKernel {
     const Tensor& values = ctx->input(2);
     OP_REQUIRES_OK(ctx, table->CheckKeyAndValueTensorsForImport(keys, values));
 
-    int memory_used_before = 0;
+    int64 memory_used_before = 0;
     if (ctx->track_allocations()) {
       memory_used_before = table->MemoryUsed();
     }
@@ -710,6 +1511,83 @@ class HashTableLoadFromHDFSOp : public HashTableOpKernel {
   size_t buffer_size_;
 };
 
+// Redistribute the files saved by the shards of a table into num_shards new
+// files, without loading the table.
+template <class K, class V>
+class HashTableReshardOp : public OpKernel {
+ public:
+  explicit HashTableReshardOp(OpKernelConstruction* ctx) : OpKernel(ctx) {
+    OP_REQUIRES(ctx,
+                !std::is_same<K, tstring>::value &&
+                    !std::is_same<V, tstring>::value,
+                errors::InvalidArgument(
+                    "Resharding does not support string keys or values."));
+    int64 value_dim = 0;
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("value_dim", &value_dim));
+    value_bytes_ = static_cast<size_t>(value_dim) * sizeof(V);
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("num_shards", &num_shards_));
+    string partition;
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("partition", &partition));
+    OP_REQUIRES_OK(ctx,
+                   lookup::cpu::ParseReshardPartition(partition, &partition_));
+    string compression;
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("compression", &compression));
+    OP_REQUIRES_OK(ctx, lookup::cpu::ParseSnapshotCodec(compression, &codec_));
+    int64 signed_buffer_size = 0;
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("buffer_size", &signed_buffer_size));
+    buffer_size_ = static_cast<size_t>(signed_buffer_size);
+  }
+
+  void Compute(OpKernelContext* ctx) override {
+    const Tensor& input_files = ctx->input(0);
+    OP_REQUIRES(ctx, TensorShapeUtils::IsVector(input_files.shape()),
+                errors::InvalidArgument("input_files must be a vector."));
+    const Tensor& prefix = ctx->input(1);
+    OP_REQUIRES(ctx, TensorShapeUtils::IsScalar(prefix.shape()),
+                errors::InvalidArgument("output_prefix must be scalar."));
+    const string output_prefix = string(prefix.scalar<tstring>()().data());
+
+    std::vector<string> inputs;
+    for (const auto& filepath : input_files.vec<tstring>()) {
+      inputs.emplace_back(filepath.data(), filepath.size());
+    }
+
+    auto worker_threads = ctx->device()->tensorflow_cpu_worker_threads();
+    std::vector<uint64> shard_counts;
+    profiler::TraceMe trace([&] {
+      return profiler::TraceMeEncode(
+          "CuckooHashTableReshard",
+          {{"input_files", inputs.size()}, {"num_shards", num_shards_}});
+    });
+    OP_REQUIRES_OK(
+        ctx, lookup::cpu::ReshardFiles<K>(
+                 inputs, output_prefix, num_shards_, partition_, value_bytes_,
+                 codec_, buffer_size_, worker_threads->workers, &shard_counts));
+
+    Tensor* output_files;
+    OP_REQUIRES_OK(ctx, ctx->allocate_output("output_files",
+                                             TensorShape({num_shards_}),
+                                             &output_files));
+    Tensor* counts;
+    OP_REQUIRES_OK(ctx, ctx->allocate_output(
+                            "counts", TensorShape({num_shards_}), &counts));
+    auto output_files_flat = output_files->vec<tstring>();
+    auto counts_flat = counts->vec<int64>();
+    for (int m = 0; m < num_shards_; ++m) {
+      output_files_flat(m) =
+          lookup::cpu::ReshardOutputFile(output_prefix, m, num_shards_);
+      counts_flat(m) = static_cast<int64>(shard_counts[m]);
+    }
+  }
+
+ private:
+  size_t value_bytes_;
+  int num_shards_;
+  lookup::cpu::ReshardPartition partition_;
+  lookup::cpu::SnapshotCodec codec_;
+  size_t buffer_size_;
+};
+
 REGISTER_KERNEL_BUILDER(
     Name(PREFIX_OP_NAME(CuckooHashTableFind)).Device(DEVICE_CPU),
     HashTableFindOp);
@@ -762,7 +1640,45 @@ REGISTER_KERNEL_BUILDER(
                               .Device(DEVICE_CPU)                             \
                               .TypeConstraint<key_dtype>("key_dtype")         \
                               .TypeConstraint<value_dtype>("value_dtype"),    \
-                          HashTableLoadFromHDFSOp<key_dtype, value_dtype>);
+                          HashTableLoadFromHDFSOp<key_dtype, value_dtype>);   \
+  REGISTER_KERNEL_BUILDER(                                                    \
+      Name(PREFIX_OP_NAME(CuckooHashTableRehashProgress))                     \
+          .Device(DEVICE_CPU)                                                 \
+          .TypeConstraint<key_dtype>("key_dtype")                             \
+          .TypeConstraint<value_dtype>("value_dtype"),                        \
+      HashTableRehashProgressOp<key_dtype, value_dtype>);                     \
+  REGISTER_KERNEL_BUILDER(Name(PREFIX_OP_NAME(CuckooHashTableShrink))         \
+                              .Device(DEVICE_CPU)                             \
+                              .TypeConstraint<key_dtype>("key_dtype")         \
+                              .TypeConstraint<value_dtype>("value_dtype"),    \
+                          HashTableShrinkOp<key_dtype, value_dtype>);         \
+  REGISTER_KERNEL_BUILDER(                                                    \
+      Name(PREFIX_OP_NAME(CuckooHashTableDrainChangeLog))                     \
+          .Device(DEVICE_CPU)                                                 \
+          .TypeConstraint<key_dtype>("key_dtype")                             \
+          .TypeConstraint<value_dtype>("value_dtype"),                        \
+      HashTableDrainChangeLogOp<key_dtype, value_dtype>);                     \
+  REGISTER_KERNEL_BUILDER(                                                    \
+      Name(PREFIX_OP_NAME(CuckooHashTableReplayChangeLog))                    \
+          .Device(DEVICE_CPU)                                                 \
+          .TypeConstraint<key_dtype>("key_dtype")                             \
+          .TypeConstraint<value_dtype>("value_dtype"),                        \
+      HashTableReplayChangeLogOp<key_dtype, value_dtype>);                    \
+  REGISTER_KERNEL_BUILDER(Name(PREFIX_OP_NAME(CuckooHashTableReshard))        \
+                              .Device(DEVICE_CPU)                             \
+                              .TypeConstraint<key_dtype>("key_dtype")         \
+                              .TypeConstraint<value_dtype>("value_dtype"),    \
+                          HashTableReshardOp<key_dtype, value_dtype>);        \
+  REGISTER_KERNEL_BUILDER(Name(PREFIX_OP_NAME(CuckooHashTableSample))         \
+                              .Device(DEVICE_CPU)                             \
+                              .TypeConstraint<key_dtype>("key_dtype")         \
+                              .TypeConstraint<value_dtype>("value_dtype"),    \
+                          HashTableSampleOp<key_dtype, value_dtype>);         \
+  REGISTER_KERNEL_BUILDER(Name(PREFIX_OP_NAME(CuckooHashTableStats))          \
+                              .Device(DEVICE_CPU)                             \
+                              .TypeConstraint<key_dtype>("key_dtype")         \
+                              .TypeConstraint<value_dtype>("value_dtype"),    \
+                          HashTableStatsOp<key_dtype, value_dtype>);
 
 REGISTER_KERNEL(int32, double);
 REGISTER_KERNEL(int32, float);
@@ -0,0 +1,381 @@
+/* Copyright 2021 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#define EIGEN_USE_THREADS
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "tensorflow/core/kernels/lookup_table_op.h"
+#include "tensorflow/core/util/work_sharder.h"
+#include "tensorflow_recommenders_addons/dynamic_embedding/core/kernels/cuckoo_hashtable_op.h"
+#include "tensorflow_recommenders_addons/dynamic_embedding/core/kernels/lookup_impl/lookup_table_op_cpu_compressed.h"
+#include "tensorflow_recommenders_addons/dynamic_embedding/core/kernels/lookup_impl/lookup_table_op_cpu_frozen.h"
+#include "tensorflow_recommenders_addons/dynamic_embedding/core/utils/types.h"
+#include "tensorflow_recommenders_addons/dynamic_embedding/core/utils/utils.h"
+
+namespace tensorflow {
+namespace recommenders_addons {
+namespace lookup {
+
+// A read-only table for serving. The content is replaced as a whole by
+// `ImportValues` (checkpoint restore or explicit build) or `Load`, and
+// lookups only take a shared lock once per batch to pin the current image.
+template <class K, class V>
+class FrozenHashTableOfTensors final : public LookupInterface {
+ private:
+  using FrozenTable = cpu::FrozenTable<K, V>;
+
+ public:
+  FrozenHashTableOfTensors(OpKernelContext* ctx, OpKernel* kernel) {
+    OP_REQUIRES_OK(ctx,
+                   GetNodeAttr(kernel->def(), "value_shape", &value_shape_));
+    OP_REQUIRES_OK(ctx,
+                   GetNodeAttr(kernel->def(), "load_factor", &load_factor_));
+    OP_REQUIRES(
+        ctx, TensorShapeUtils::IsVector(value_shape_),
+        errors::InvalidArgument("Default value must be a vector, got shape ",
+                                value_shape_.DebugString()));
+    runtime_dim_ = value_shape_.dim_size(0);
+    std::unique_ptr<FrozenTable> empty;
+    OP_REQUIRES_OK(ctx, FrozenTable::Build(nullptr, nullptr, 0, runtime_dim_,
+                                           load_factor_, &empty));
+    table_ = std::move(empty);
+  }
+
+  size_t size() const override { return Current()->size(); }
+
+  Status Find(OpKernelContext* ctx, const Tensor& key, Tensor* value,
+              const Tensor& default_value) override {
+    return DoFind(ctx, key, value, default_value, nullptr);
+  }
+
+  Status FindWithExists(OpKernelContext* ctx, const Tensor& key, Tensor* value,
+                        const Tensor& default_value, Tensor& exists) {
+    return DoFind(ctx, key, value, default_value, &exists);
+  }
+
+  Status Insert(OpKernelContext* ctx, const Tensor& keys,
+                const Tensor& values) override {
+    return errors::Unimplemented(
+        "FrozenHashTable is read-only, use ImportValues or Load instead.");
+  }
+
+  Status Remove(OpKernelContext* ctx, const Tensor& keys) override {
+    return errors::Unimplemented("FrozenHashTable is read-only.");
+  }
+
+  Status ImportValues(OpKernelContext* ctx, const Tensor& keys,
+                      const Tensor& values) override {
+    std::unique_ptr<FrozenTable> table;
+    TF_RETURN_IF_ERROR(FrozenTable::Build(
+        reinterpret_cast<const K*>(keys.tensor_data().data()),
+        reinterpret_cast<const V*>(values.tensor_data().data()),
+        keys.NumElements(), runtime_dim_, load_factor_, &table));
+    Publish(std::move(table));
+    return Status::OK();
+  }
+
+  Status ExportValues(OpKernelContext* ctx) override {
+    auto table = Current();
+    const int64 size = static_cast<int64>(table->size());
+    Tensor* keys;
+    Tensor* values;
+    TF_RETURN_IF_ERROR(
+        ctx->allocate_output("keys", TensorShape({size}), &keys));
+    TF_RETURN_IF_ERROR(ctx->allocate_output(
+        "values", TensorShape({size, runtime_dim_}), &values));
+    table->Dump(reinterpret_cast<K*>(keys->data()),
+                reinterpret_cast<V*>(values->data()));
+    return Status::OK();
+  }
+
+  // Loads a frozen image written by `Save` by mapping it read-only, or builds
+  // one from a record file or compressed snapshot written by
+  // `CuckooHashTable.save_to_hdfs`. A record file is mapped and placed into
+  // the image directly; a snapshot is decompressed into buffers sized from
+  // its record count first.
+  Status Load(OpKernelContext* ctx, const string& filepath) {
+    Env* env = Env::Default();
+    std::unique_ptr<FrozenTable> table;
+    std::unique_ptr<RandomAccessFile> file;
+    TF_RETURN_IF_ERROR(env->NewRandomAccessFile(filepath, &file));
+    uint64 file_size = 0;
+    TF_RETURN_IF_ERROR(env->GetFileSize(filepath, &file_size));
+    bool compressed = false;
+    TF_RETURN_IF_ERROR(cpu::IsCompressedSnapshot(file.get(), &compressed));
+    if (FrozenTable::IsImage(env, filepath)) {
+      TF_RETURN_IF_ERROR(FrozenTable::Map(env, filepath, runtime_dim_, &table));
+    } else if (compressed) {
+      uint64 records_hint = 0;
+      TF_RETURN_IF_ERROR(cpu::CompressedSnapshotRecordsHint(
+          file.get(), file_size, &records_hint));
+      // Bounded by the file, so that a corrupt count cannot reserve more
+      // memory than its records plausibly take.
+      records_hint = std::min(records_hint, file_size);
+      std::vector<K> keys;
+      std::vector<V> values;
+      keys.reserve(records_hint);
+      values.reserve(records_hint * runtime_dim_);
+      auto* pool = ctx->device()->tensorflow_cpu_worker_threads()->workers;
+      TF_RETURN_IF_ERROR(cpu::ReadCompressedSnapshot<K>(
+          file.get(), file_size, sizeof(V) * runtime_dim_, pool,
+          [&](const K* block_keys, const char* block_values, int64 n) {
+            keys.insert(keys.end(), block_keys, block_keys + n);
+            const V* v = reinterpret_cast<const V*>(block_values);
+            values.insert(values.end(), v, v + n * runtime_dim_);
+            return Status::OK();
+          }));
+      TF_RETURN_IF_ERROR(FrozenTable::Build(keys.data(), values.data(),
+                                            static_cast<int64>(keys.size()),
+                                            runtime_dim_, load_factor_,
+                                            &table));
+    } else {
+      const uint64 record_len = sizeof(K) + sizeof(V) * runtime_dim_;
+      if (file_size % record_len != 0) {
+        return errors::DataLoss("File ", filepath, " of ", file_size,
+                                " bytes is not a sequence of ", record_len,
+                                " bytes records.");
+      }
+      const int64 num = static_cast<int64>(file_size / record_len);
+      std::unique_ptr<ReadOnlyMemoryRegion> region;
+      if (num > 0) {
+        TF_RETURN_IF_ERROR(
+            env->NewReadOnlyMemoryRegionFromFile(filepath, &region));
+      }
+      TF_RETURN_IF_ERROR(FrozenTable::BuildFromRecords(
+          num > 0 ? static_cast<const char*>(region->data()) : nullptr, num,
+          runtime_dim_, load_factor_, &table));
+    }
+    LOG(INFO) << "FrozenHashTable loaded " << table->size() << " keys from "
+              << filepath << (table->is_mapped() ? " (mapped)" : "")
+              << ", capacity=" << table->capacity()
+              << ", bytes=" << table->bytes();
+    Publish(std::move(table));
+    return Status::OK();
+  }
+
+  Status Save(OpKernelContext* ctx, const string& filepath) {
+    return Current()->Save(Env::Default(), filepath);
+  }
+
+  DataType key_dtype() const override { return DataTypeToEnum<K>::v(); }
+
+  DataType value_dtype() const override { return DataTypeToEnum<V>::v(); }
+
+  TensorShape key_shape() const final { return TensorShape(); }
+
+  TensorShape value_shape() const override { return value_shape_; }
+
+  int64 MemoryUsed() const override {
+    auto table = Current();
+    // A mapped image lives in the page cache and is shared across processes.
+    return sizeof(FrozenHashTableOfTensors) +
+           (table->is_mapped() ? 0 : static_cast<int64>(table->bytes()));
+  }
+
+ private:
+  std::shared_ptr<const FrozenTable> Current() const {
+    tf_shared_lock l(mu_);
+    return table_;
+  }
+
+  void Publish(std::unique_ptr<FrozenTable> table) {
+    std::shared_ptr<const FrozenTable> next(std::move(table));
+    mutex_lock l(mu_);
+    table_.swap(next);
+  }
+
+  Status DoFind(OpKernelContext* ctx, const Tensor& key, Tensor* value,
+                const Tensor& default_value, Tensor* exists) {
+    auto table = Current();
+    const auto key_flat = key.flat<K>();
+    cpu::Tensor2D<V> value_flat = value->flat_inner_dims<V, 2>();
+    cpu::ConstTensor2D<V> default_flat = default_value.flat_inner_dims<V, 2>();
+    const bool is_full_default = (value_flat.size() == default_flat.size());
+    const int64 value_dim = runtime_dim_;
+    const int64 total = key_flat.size();
+    bool* exists_data = exists ? exists->flat<bool>().data() : nullptr;
+
+    auto shard = [&](int64 begin, int64 end) {
+      for (int64 i = begin; i < end; ++i) {
+        const V* found = table->find(key_flat(i));
+        if (found != nullptr) {
+          std::copy_n(found, value_dim, &value_flat(i, 0));
+        } else {
+          const int64 row = is_full_default ? i : 0;
+          for (int64 j = 0; j < value_dim; j++) {
+            value_flat(i, j) = default_flat(row, j);
+          }
+        }
+        if (exists_data != nullptr) exists_data[i] = (found != nullptr);
+      }
+    };
+    auto& worker_threads = *ctx->device()->tensorflow_cpu_worker_threads();
+    int64 slices = static_cast<int64>(total / worker_threads.num_threads) + 1;
+    Shard(worker_threads.num_threads, worker_threads.workers, total, slices,
+          shard);
+    return Status::OK();
+  }
+
+  TensorShape value_shape_;
+  int64 runtime_dim_;
+  float load_factor_;
+  mutable mutex mu_;
+  std::shared_ptr<const FrozenTable> table_ TF_GUARDED_BY(mu_);
+};
+
+}  // namespace lookup
+
+class FrozenHashTableOpKernel : public OpKernel {
+ public:
+  explicit FrozenHashTableOpKernel(OpKernelConstruction* ctx)
+      : OpKernel(ctx) {}
+
+ protected:
+  template <class K, class V>
+  Status GetFrozenTable(OpKernelContext* ctx,
+                        lookup::FrozenHashTableOfTensors<K, V>** table) {
+    const ResourceHandle& handle = HandleFromInput(ctx, 0);
+    LookupInterface* base = nullptr;
+    TF_RETURN_IF_ERROR(ctx->resource_manager()->Lookup<LookupInterface, false>(
+        handle.container(), handle.name(), &base));
+    *table = dynamic_cast<lookup::FrozenHashTableOfTensors<K, V>*>(base);
+    if (*table == nullptr) {
+      base->Unref();
+      return errors::InvalidArgument("Table ", handle.name(),
+                                     " is not a FrozenHashTable.");
+    }
+    return Status::OK();
+  }
+};
+
+// Table find op with return exists tensor.
+template <class K, class V>
+class FrozenHashTableFindWithExistsOp : public FrozenHashTableOpKernel {
+ public:
+  using FrozenHashTableOpKernel::FrozenHashTableOpKernel;
+
+  void Compute(OpKernelContext* ctx) override {
+    lookup::FrozenHashTableOfTensors<K, V>* table;
+    OP_REQUIRES_OK(ctx, GetFrozenTable(ctx, &table));
+    core::ScopedUnref unref_me(table);
+
+    const Tensor& key = ctx->input(1);
+    const Tensor& default_value = ctx->input(2);
+
+    TensorShape output_shape = key.shape();
+    output_shape.AppendShape(table->value_shape());
+
+    Tensor* values;
+    Tensor* exists;
+    OP_REQUIRES_OK(ctx, ctx->allocate_output("values", output_shape, &values));
+    OP_REQUIRES_OK(ctx, ctx->allocate_output("exists", key.shape(), &exists));
+
+    OP_REQUIRES_OK(
+        ctx, table->FindWithExists(ctx, key, values, default_value, *exists));
+  }
+};
+
+// Replace the table content with a frozen image or a save_to_hdfs file.
+template <class K, class V>
+class FrozenHashTableLoadOp : public FrozenHashTableOpKernel {
+ public:
+  using FrozenHashTableOpKernel::FrozenHashTableOpKernel;
+
+  void Compute(OpKernelContext* ctx) override {
+    lookup::FrozenHashTableOfTensors<K, V>* table;
+    OP_REQUIRES_OK(ctx, GetFrozenTable(ctx, &table));
+    core::ScopedUnref unref_me(table);
+
+    const Tensor& ftensor = ctx->input(1);
+    OP_REQUIRES(ctx, TensorShapeUtils::IsScalar(ftensor.shape()),
+                errors::InvalidArgument("filepath must be scalar."));
+    string filepath = string(ftensor.scalar<tstring>()().data());
+
+    int64 memory_used_before = 0;
+    if (ctx->track_allocations()) {
+      memory_used_before = table->MemoryUsed();
+    }
+    OP_REQUIRES_OK(ctx, table->Load(ctx, filepath));
+    if (ctx->track_allocations()) {
+      ctx->record_persistent_memory_allocation(table->MemoryUsed() -
+                                               memory_used_before);
+    }
+  }
+};
+
+// Write the frozen image so that it can be mapped by FrozenHashTableLoad.
+template <class K, class V>
+class FrozenHashTableSaveOp : public FrozenHashTableOpKernel {
+ public:
+  using FrozenHashTableOpKernel::FrozenHashTableOpKernel;
+
+  void Compute(OpKernelContext* ctx) override {
+    lookup::FrozenHashTableOfTensors<K, V>* table;
+    OP_REQUIRES_OK(ctx, GetFrozenTable(ctx, &table));
+    core::ScopedUnref unref_me(table);
+
+    const Tensor& ftensor = ctx->input(1);
+    OP_REQUIRES(ctx, TensorShapeUtils::IsScalar(ftensor.shape()),
+                errors::InvalidArgument("filepath must be scalar."));
+    string filepath = string(ftensor.scalar<tstring>()().data());
+
+    OP_REQUIRES_OK(ctx, table->Save(ctx, filepath));
+  }
+};
+
+// Register the custom op.
+#define REGISTER_KERNEL(key_dtype, value_dtype)                                \
+  REGISTER_KERNEL_BUILDER(                                                     \
+      Name(PREFIX_OP_NAME(FrozenHashTableOfTensors))                           \
+          .Device(DEVICE_CPU)                                                  \
+          .TypeConstraint<key_dtype>("key_dtype")                              \
+          .TypeConstraint<value_dtype>("value_dtype"),                         \
+      HashTableOp<lookup::FrozenHashTableOfTensors<key_dtype, value_dtype>,    \
+                  key_dtype, value_dtype>);                                    \
+  REGISTER_KERNEL_BUILDER(Name(PREFIX_OP_NAME(FrozenHashTableFindWithExists))  \
+                              .Device(DEVICE_CPU)                              \
+                              .TypeConstraint<key_dtype>("Tin")                \
+                              .TypeConstraint<value_dtype>("Tout"),            \
+                          FrozenHashTableFindWithExistsOp<key_dtype,           \
+                                                          value_dtype>);       \
+  REGISTER_KERNEL_BUILDER(Name(PREFIX_OP_NAME(FrozenHashTableLoad))            \
+                              .Device(DEVICE_CPU)                              \
+                              .TypeConstraint<key_dtype>("key_dtype")          \
+                              .TypeConstraint<value_dtype>("value_dtype"),     \
+                          FrozenHashTableLoadOp<key_dtype, value_dtype>);      \
+  REGISTER_KERNEL_BUILDER(Name(PREFIX_OP_NAME(FrozenHashTableSave))            \
+                              .Device(DEVICE_CPU)                              \
+                              .TypeConstraint<key_dtype>("key_dtype")          \
+                              .TypeConstraint<value_dtype>("value_dtype"),     \
+                          FrozenHashTableSaveOp<key_dtype, value_dtype>);
+
+REGISTER_KERNEL(int32, double);
+REGISTER_KERNEL(int32, float);
+REGISTER_KERNEL(int32, int32);
+REGISTER_KERNEL(int64, double);
+REGISTER_KERNEL(int64, float);
+REGISTER_KERNEL(int64, int32);
+REGISTER_KERNEL(int64, int64);
+REGISTER_KERNEL(int64, int8);
+REGISTER_KERNEL(int64, Eigen::half);
+
+#undef REGISTER_KERNEL
+
+}  // namespace recommenders_addons
+}  // namespace tensorflow
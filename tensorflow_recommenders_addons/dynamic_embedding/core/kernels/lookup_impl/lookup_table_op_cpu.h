@@ -16,7 +16,12 @@ limitations under the License.
 #ifndef TFRA_CORE_KERNELS_LOOKUP_TABLE_OP_CPU_H_
 #define TFRA_CORE_KERNELS_LOOKUP_TABLE_OP_CPU_H_
 
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <random>
 #include <typeindex>
+#include <vector>
 
 #include "tensorflow/core/framework/bounds_check.h"
 #include "tensorflow/core/framework/op_kernel.h"
@@ -29,6 +34,11 @@ limitations under the License.
 #include "tensorflow/core/lib/gtl/inlined_vector.h"
 #include "tensorflow/core/lib/io/buffered_inputstream.h"
 #include "tensorflow/core/lib/io/random_inputstream.h"
+#include "tensorflow/core/lib/strings/numbers.h"
+#include "tensorflow/core/platform/mem.h"
+#include "tensorflow/core/util/env_var.h"
+#include "tensorflow_recommenders_addons/dynamic_embedding/core/kernels/lookup_impl/lookup_table_op_cpu_allocator.h"
+#include "tensorflow_recommenders_addons/dynamic_embedding/core/kernels/lookup_impl/lookup_table_op_cpu_compressed.h"
 #include "tensorflow_recommenders_addons/dynamic_embedding/core/lib/cuckoo/cuckoohash_map.hh"
 #include "tensorflow_recommenders_addons/dynamic_embedding/core/lib/hadoop_file_system/hadoop_file_system.h"
 #include "tensorflow_recommenders_addons/dynamic_embedding/core/utils/types.h"
@@ -73,6 +83,25 @@ class DefaultValueArray<tstring, 2> final
   }
 };
 
+// Bytes an element of the table holds on the heap, outside of its slot.
+template <class T>
+inline int64 HeapBytes(const T&) {
+  return 0;
+}
+
+inline int64 HeapBytes(const tstring& s) {
+  return s.type() == tstring::LARGE ? s.capacity() + 1 : 0;
+}
+
+template <class V, size_t N>
+inline int64 HeapBytes(const DefaultValueArray<V, N>& value) {
+  int64 bytes = value.capacity() > N ? value.capacity() * sizeof(V) : 0;
+  if (std::is_same<V, tstring>::value) {
+    for (const auto& v : value) bytes += HeapBytes(v);
+  }
+  return bytes;
+}
+
 template <class V>
 using Tensor2D = typename tensorflow::TTypes<V, 2>::Tensor;
 
@@ -113,6 +142,102 @@ struct HybridHash<int32> {
   }
 };
 
+// Reads TFRA_HASHTABLE_REHASH_THREADS, the number of extra threads a table
+// spawns to rehash or resize all its buckets at once.
+inline size_t RehashThreadsFromEnv() {
+  int64 threads = 6;
+  Status status =
+      ReadInt64FromEnvVar("TFRA_HASHTABLE_REHASH_THREADS", 6, &threads);
+  if (!status.ok()) {
+    LOG(ERROR) << "Error parsing TFRA_HASHTABLE_REHASH_THREADS: " << status;
+  }
+  return static_cast<size_t>(std::max(threads, int64{0}));
+}
+
+// Reads TFRA_HASHTABLE_SHRINK_LOAD_FACTOR. When the load factor of a table
+// drops below it after a removal, the table shrinks automatically. 0 (the
+// default) disables automatic shrinking. Values from 0.5 on are rejected: the
+// halved bucket array would be full.
+inline float ShrinkLoadFactorFromEnv() {
+  string value;
+  Status status =
+      ReadStringFromEnvVar("TFRA_HASHTABLE_SHRINK_LOAD_FACTOR", "0", &value);
+  float load_factor = 0;
+  if (!status.ok() || !strings::safe_strtof(value.c_str(), &load_factor) ||
+      load_factor < 0 || load_factor >= 0.5) {
+    LOG(ERROR) << "Invalid TFRA_HASHTABLE_SHRINK_LOAD_FACTOR: " << value;
+    return 0;
+  }
+  return load_factor;
+}
+
+// Counters of the internals of a table, see cuckoohash_map::statistics.
+// Tables split into parts add the counters of all their parts.
+struct TableStatistics {
+  int64 size = 0;
+  int64 capacity = 0;
+  int64 bucket_count = 0;
+  int64 lock_acquisitions = 0;
+  int64 contended_acquisitions = 0;
+  int64 contended_spins = 0;
+  std::vector<int64> lock_acquisitions_per_lock;
+  std::vector<int64> contended_acquisitions_per_lock;
+  std::vector<int64> contended_spins_per_lock;
+  int64 hits = 0;
+  int64 misses = 0;
+  std::vector<int64> cuckoo_path_depths;
+  int64 cuckoo_failures = 0;
+  int64 resizes = 0;
+  double resize_seconds = 0;
+
+  template <class Stats>
+  void Add(const Stats& other) {
+    lock_acquisitions += other.lock_acquisitions;
+    contended_acquisitions += other.contended_acquisitions;
+    contended_spins += other.contended_spins;
+    AddVector(other.lock_acquisitions_per_lock, &lock_acquisitions_per_lock);
+    AddVector(other.contended_acquisitions_per_lock,
+              &contended_acquisitions_per_lock);
+    AddVector(other.contended_spins_per_lock, &contended_spins_per_lock);
+    hits += other.hits;
+    misses += other.misses;
+    AddVector(other.cuckoo_path_depths, &cuckoo_path_depths);
+    cuckoo_failures += other.cuckoo_failures;
+    resizes += other.resizes;
+    resize_seconds += other.resize_seconds;
+  }
+
+  // Removes the counters of an earlier reading, leaving the size as is.
+  void Subtract(const TableStatistics& earlier) {
+    TableStatistics negated;
+    negated.Add(earlier);
+    negated.Negate();
+    Add(negated);
+  }
+
+ private:
+  template <class T>
+  static void AddVector(const std::vector<T>& from, std::vector<int64>* to) {
+    if (to->size() < from.size()) to->resize(from.size(), 0);
+    for (size_t i = 0; i < from.size(); ++i) (*to)[i] += from[i];
+  }
+
+  void Negate() {
+    lock_acquisitions = -lock_acquisitions;
+    contended_acquisitions = -contended_acquisitions;
+    contended_spins = -contended_spins;
+    for (auto& v : lock_acquisitions_per_lock) v = -v;
+    for (auto& v : contended_acquisitions_per_lock) v = -v;
+    for (auto& v : contended_spins_per_lock) v = -v;
+    hits = -hits;
+    misses = -misses;
+    for (auto& v : cuckoo_path_depths) v = -v;
+    cuckoo_failures = -cuckoo_failures;
+    resizes = -resizes;
+    resize_seconds = -resize_seconds;
+  }
+};
+
 template <class K, class V>
 class TableWrapperBase {
  public:
@@ -133,32 +258,88 @@ class TableWrapperBase {
                     int64 value_dim, bool is_full_size_default,
                     int64 index) const {}
   virtual size_t size() const { return 0; }
+  // Number of slots in the bucket array.
+  virtual size_t capacity() const { return 0; }
+  // Bytes held by the bucket and lock arrays of the table.
+  virtual int64 allocated_bytes() const { return 0; }
+  // Bytes held by the keys and values on the heap, such as the values of
+  // more than 2 elements of the default tables or long string payloads.
+  virtual int64 heap_bytes() const { return 0; }
+  // Migrates up to max_stripes lock stripes left over by the last doubling of
+  // the table and returns the number of stripes left.
+  virtual size_t rehash_pending(size_t max_stripes) { return 0; }
+  // Fraction of the last doubling already migrated, 1.0 when none is pending.
+  virtual double rehash_progress() const { return 1.0; }
+  // Adds the counters of the table to stats, with those of every lock when
+  // per_lock is set.
+  virtual void statistics(bool per_lock, TableStatistics* stats) const {}
+  // Rehashes into the smallest bucket array holding at least min_size slots
+  // whose load factor stays at or below max_load_factor, if that is smaller
+  // than the current one. Returns whether the table shrank.
+  virtual bool shrink_to_fit(size_t min_size, double max_load_factor) {
+    return false;
+  }
   virtual void clear() {}
   virtual bool erase(const K& key) { return false; }
+  virtual bool contains(const K& key) const { return false; }
+  // Samples up to n entries uniformly at random, with replacement, giving up
+  // after max_probes random slots. fn receives each key and its value_dim
+  // values. Returns the number of entries sampled.
+  virtual int64 sample(int64 n, int64 max_probes, uint64 seed,
+                       const std::function<void(const K&, const V*)>& fn)
+      const {
+    return 0;
+  }
+  // Copies a consistent view of the table into newly allocated temporary
+  // tensors of shape [size] and [size, value_dim].
+  virtual Status export_values_to_tensors(OpKernelContext* ctx,
+                                          int64 value_dim, Tensor* keys,
+                                          Tensor* values) {
+    return errors::Unimplemented("export is not supported by this table.");
+  }
   virtual Status export_values(OpKernelContext* ctx, int64 value_dim) {
-    return Status::OK();
+    Tensor keys;
+    Tensor values;
+    TF_RETURN_IF_ERROR(
+        export_values_to_tensors(ctx, value_dim, &keys, &values));
+    TF_RETURN_IF_ERROR(ctx->set_output("keys", keys));
+    return ctx->set_output("values", values);
   }
+  // Saves the table as key/value records, or as a block-compressed snapshot
+  // when codec is not kNone. load_from_hdfs detects the format by itself.
   virtual Status save_to_hdfs(OpKernelContext* ctx, int64 value_dim,
-                              const string& filepath,
-                              const size_t buffer_size) {}
+                              const string& filepath, const size_t buffer_size,
+                              SnapshotCodec codec) {
+    return errors::Unimplemented(
+        "save_to_hdfs is not supported by this table.");
+  }
   virtual Status load_from_hdfs(OpKernelContext* ctx, int64 value_dim,
                                 const string& filepath,
-                                const size_t buffer_size) {}
+                                const size_t buffer_size) {
+    return errors::Unimplemented(
+        "load_from_hdfs is not supported by this table.");
+  }
 };
 
 template <class K, class V, size_t DIM>
 class TableWrapperOptimized final : public TableWrapperBase<K, V> {
  private:
   using ValueType = ValueArray<V, DIM>;
-  using Table = cuckoohash_map<K, ValueType, HybridHash<K>>;
+  using Allocator = TableAllocator<std::pair<const K, ValueType>>;
+  using Table = cuckoohash_map<K, ValueType, HybridHash<K>, std::equal_to<K>,
+                               Allocator>;
 
  public:
-  explicit TableWrapperOptimized(size_t init_size) : init_size_(init_size) {
-    table_ = new Table(init_size);
+  explicit TableWrapperOptimized(size_t init_size)
+      : init_size_(init_size), memory_(TableMemoryModeFromEnv()) {
+    table_ = new Table(init_size, HybridHash<K>(), std::equal_to<K>(),
+                       Allocator(&memory_));
+    table_->max_num_worker_threads(RehashThreadsFromEnv());
     LOG(INFO) << "HashTable on CPU is created on optimized mode:"
               << " K=" << std::type_index(typeid(K)).name()
               << ", V=" << std::type_index(typeid(V)).name() << ", DIM=" << DIM
-              << ", init_size=" << init_size_;
+              << ", init_size=" << init_size_
+              << ", allocator=" << TableMemoryModeName(memory_.mode());
   }
 
   ~TableWrapperOptimized() override { delete table_; }
@@ -217,41 +398,81 @@ class TableWrapperOptimized final : public TableWrapperBase<K, V> {
 
   size_t size() const override { return table_->size(); }
 
+  size_t capacity() const override { return table_->capacity(); }
+
+  int64 allocated_bytes() const override { return memory_.allocated_bytes(); }
+
+  size_t rehash_pending(size_t max_stripes) override {
+    return table_->rehash_pending(max_stripes);
+  }
+
+  double rehash_progress() const override { return table_->rehash_progress(); }
+
+  void statistics(bool per_lock, TableStatistics* stats) const override {
+    stats->size += table_->size();
+    stats->capacity += table_->capacity();
+    stats->bucket_count += table_->bucket_count();
+    stats->Add(table_->get_statistics(per_lock));
+  }
+
+  bool shrink_to_fit(size_t min_size, double max_load_factor) override {
+    const size_t n = std::max(
+        min_size, static_cast<size_t>(table_->size() / max_load_factor) + 1);
+    // A rehash only frees memory when it halves the bucket array at least.
+    if (n > table_->capacity() / 2) return false;
+    const size_t capacity = table_->capacity();
+    table_->reserve(n);
+    port::MallocExtension_ReleaseToSystem(std::numeric_limits<size_t>::max());
+    return table_->capacity() < capacity;
+  }
+
   void clear() override { table_->clear(); }
 
   bool erase(const K& key) override { return table_->erase(key); }
 
-  Status export_values(OpKernelContext* ctx, int64 value_dim) override {
-    auto lt = table_->lock_table();
-    int64 size = lt.size();
+  bool contains(const K& key) const override { return table_->contains(key); }
+
+  int64 sample(int64 n, int64 max_probes, uint64 seed,
+               const std::function<void(const K&, const V*)>& fn)
+      const override {
+    std::mt19937_64 rng(seed);
+    return table_->sample_fn(
+        n, max_probes, rng,
+        [&fn](const K& key, const ValueType& value) { fn(key, value.data()); });
+  }
+
+  Status export_values_to_tensors(OpKernelContext* ctx, int64 value_dim,
+                                  Tensor* keys, Tensor* values) override {
+    // Concurrent operations keep running while the snapshot is read.
+    auto snapshot = table_->snapshot();
+    int64 size = snapshot->size();
 
-    Tensor* keys;
-    Tensor* values;
     TF_RETURN_IF_ERROR(
-        ctx->allocate_output("keys", TensorShape({size}), &keys));
-    TF_RETURN_IF_ERROR(ctx->allocate_output(
-        "values", TensorShape({size, value_dim}), &values));
+        ctx->allocate_temp(DataTypeToEnum<K>::v(), TensorShape({size}), keys));
+    TF_RETURN_IF_ERROR(ctx->allocate_temp(
+        DataTypeToEnum<V>::v(), TensorShape({size, value_dim}), values));
 
     auto keys_data = keys->flat<K>();
     auto values_data = values->matrix<V>();
     int64 i = 0;
 
-    for (auto it = lt.begin(); it != lt.end(); ++it, ++i) {
-      K key = it->first;
-      ValueType value = it->second;
+    snapshot->complete([&](const K& key, const ValueType& value) {
       keys_data(i) = key;
       for (int64 j = 0; j < value_dim; j++) {
         values_data(i, j) = value.at(j);
       }
-    }
+      ++i;
+    });
+    DCHECK_EQ(i, size);
     return Status::OK();
   }
 
   Status save_to_hdfs(OpKernelContext* ctx, int64 value_dim,
-                      const string& filepath,
-                      const size_t buffer_size) override {
+                      const string& filepath, const size_t buffer_size,
+                      SnapshotCodec codec) override {
     size_t dim = static_cast<size_t>(value_dim);
-    auto lt = table_->lock_table();
+    // Concurrent operations keep running while the snapshot is written.
+    auto snapshot = table_->snapshot();
 
     HadoopFileSystem hdfs;
     std::unique_ptr<WritableFile> writer;
@@ -259,25 +480,42 @@ class TableWrapperOptimized final : public TableWrapperBase<K, V> {
     TF_RETURN_IF_ERROR(hdfs.NewWritableFile(tmp_file, &writer));
 
     const uint32 value_len = sizeof(V) * dim;
+    if (codec != SnapshotCodec::kNone) {
+      auto* pool = ctx->device()->tensorflow_cpu_worker_threads()->workers;
+      TF_RETURN_IF_ERROR(WriteCompressedSnapshot<K>(
+          writer.get(), codec, value_len, pool, [&](auto* compressed) {
+            Status status;
+            snapshot->complete([&](const K& k, const ValueType& value) {
+              if (!status.ok()) return;
+              status = compressed->Add(
+                  k, reinterpret_cast<const char*>(value.data()));
+            });
+            return status;
+          }));
+      TF_RETURN_IF_ERROR(writer->Close());
+      return hdfs.RenameFile(tmp_file, filepath);
+    }
+
     const uint32 record_len = sizeof(K) + value_len;
     uint64 pos = 0;
     uint8 content[buffer_size + record_len];
 
-    for (auto it = lt.begin(); it != lt.end(); ++it) {
-      K k = it->first;
-      std::memcpy(content + pos, reinterpret_cast<uint8*>(&k), sizeof(K));
-
-      const auto& jt = it->second.data();
-      std::memcpy(content + pos + sizeof(K), reinterpret_cast<uint8*>(jt),
-                  value_len);
+    Status status;
+    snapshot->complete([&](const K& k, const ValueType& value) {
+      if (!status.ok()) return;
+      std::memcpy(content + pos, reinterpret_cast<const uint8*>(&k),
+                  sizeof(K));
+      std::memcpy(content + pos + sizeof(K),
+                  reinterpret_cast<const uint8*>(value.data()), value_len);
 
       pos += record_len;
       if (pos > buffer_size) {
-        TF_RETURN_IF_ERROR(
-            writer->Append(StringPiece(reinterpret_cast<char*>(content), pos)));
+        status =
+            writer->Append(StringPiece(reinterpret_cast<char*>(content), pos));
         pos = 0;
       }
-    }
+    });
+    TF_RETURN_IF_ERROR(status);
 
     if (pos > 0) {
       TF_RETURN_IF_ERROR(
@@ -297,16 +535,36 @@ class TableWrapperOptimized final : public TableWrapperBase<K, V> {
     HadoopFileSystem hdfs;
     std::unique_ptr<RandomAccessFile> file;
     TF_RETURN_IF_ERROR(hdfs.NewRandomAccessFile(filepath, &file));
-    std::unique_ptr<io::RandomAccessInputStream> input_stream(
-        new io::RandomAccessInputStream(file.get()));
-    io::BufferedInputStream reader(input_stream.get(), buffer_size);
 
     uint64 file_size = 0;
     TF_RETURN_IF_ERROR(hdfs.GetFileSize(filepath, &file_size));
+    bool compressed = false;
+    TF_RETURN_IF_ERROR(IsCompressedSnapshot(file.get(), &compressed));
+    if (compressed) {
+      auto* pool = ctx->device()->tensorflow_cpu_worker_threads()->workers;
+      return ReadCompressedSnapshot<K>(
+          file.get(), file_size, sizeof(V) * dim, pool,
+          [this](const K* keys, const char* values, int64 n) {
+            const ValueType* value_vec =
+                reinterpret_cast<const ValueType*>(values);
+            for (int64 i = 0; i < n; ++i) {
+              table_->insert_or_assign(keys[i], value_vec[i]);
+            }
+            return Status::OK();
+          });
+    }
+    std::unique_ptr<io::RandomAccessInputStream> input_stream(
+        new io::RandomAccessInputStream(file.get()));
+    io::BufferedInputStream reader(input_stream.get(), buffer_size);
 
     tstring content;
     const uint32 value_len = sizeof(V) * dim;
     const uint32 record_len = sizeof(K) + value_len;
+    if (file_size % record_len != 0) {
+      return errors::DataLoss("File ", filepath, " of ", file_size,
+                              " bytes is not a sequence of ", record_len,
+                              " bytes records.");
+    }
     uint64 i = 0;
 
     while (i < file_size) {
@@ -322,6 +580,7 @@ class TableWrapperOptimized final : public TableWrapperBase<K, V> {
 
  private:
   size_t init_size_;
+  TableMemory memory_;
   Table* table_;
 };
 
@@ -329,15 +588,21 @@ template <class K, class V>
 class TableWrapperDefault final : public TableWrapperBase<K, V> {
  private:
   using ValueType = DefaultValueArray<V, 2>;
-  using Table = cuckoohash_map<K, ValueType, HybridHash<K>>;
+  using Allocator = TableAllocator<std::pair<const K, ValueType>>;
+  using Table = cuckoohash_map<K, ValueType, HybridHash<K>, std::equal_to<K>,
+                               Allocator>;
 
  public:
-  explicit TableWrapperDefault(size_t init_size) : init_size_(init_size) {
-    table_ = new Table(init_size);
+  explicit TableWrapperDefault(size_t init_size)
+      : init_size_(init_size), memory_(TableMemoryModeFromEnv()) {
+    table_ = new Table(init_size, HybridHash<K>(), std::equal_to<K>(),
+                       Allocator(&memory_));
+    table_->max_num_worker_threads(RehashThreadsFromEnv());
     LOG(INFO) << "HashTable on CPU is created on default mode:"
               << " K=" << std::type_index(typeid(K)).name()
               << ", V=" << std::type_index(typeid(V)).name()
-              << ", init_size=" << init_size_;
+              << ", init_size=" << init_size_
+              << ", allocator=" << TableMemoryModeName(memory_.mode());
   }
 
   ~TableWrapperDefault() override { delete table_; }
@@ -396,38 +661,95 @@ class TableWrapperDefault final : public TableWrapperBase<K, V> {
 
   size_t size() const override { return table_->size(); }
 
+  size_t capacity() const override { return table_->capacity(); }
+
+  int64 allocated_bytes() const override { return memory_.allocated_bytes(); }
+
+  int64 heap_bytes() const override {
+    // The values of a table are all built alike, so their heap is measured
+    // on a sample of the entries rather than by walking the whole table.
+    const int64 size = table_->size();
+    if (size == 0) return 0;
+    std::mt19937_64 rng(size);
+    int64 bytes = 0;
+    const int64 sampled = table_->sample_fn(
+        kHeapBytesSamples, kHeapBytesSamples * 64, rng,
+        [&bytes](const K& key, const ValueType& value) {
+          bytes += HeapBytes(key) + HeapBytes(value);
+        });
+    return sampled == 0 ? 0 : bytes * size / sampled;
+  }
+
+  size_t rehash_pending(size_t max_stripes) override {
+    return table_->rehash_pending(max_stripes);
+  }
+
+  double rehash_progress() const override { return table_->rehash_progress(); }
+
+  void statistics(bool per_lock, TableStatistics* stats) const override {
+    stats->size += table_->size();
+    stats->capacity += table_->capacity();
+    stats->bucket_count += table_->bucket_count();
+    stats->Add(table_->get_statistics(per_lock));
+  }
+
+  bool shrink_to_fit(size_t min_size, double max_load_factor) override {
+    const size_t n = std::max(
+        min_size, static_cast<size_t>(table_->size() / max_load_factor) + 1);
+    // A rehash only frees memory when it halves the bucket array at least.
+    if (n > table_->capacity() / 2) return false;
+    const size_t capacity = table_->capacity();
+    table_->reserve(n);
+    port::MallocExtension_ReleaseToSystem(std::numeric_limits<size_t>::max());
+    return table_->capacity() < capacity;
+  }
+
   void clear() override { table_->clear(); }
 
   bool erase(const K& key) override { return table_->erase(key); }
 
-  Status export_values(OpKernelContext* ctx, int64 value_dim) override {
-    auto lt = table_->lock_table();
-    int64 size = lt.size();
+  bool contains(const K& key) const override { return table_->contains(key); }
+
+  int64 sample(int64 n, int64 max_probes, uint64 seed,
+               const std::function<void(const K&, const V*)>& fn)
+      const override {
+    std::mt19937_64 rng(seed);
+    return table_->sample_fn(
+        n, max_probes, rng,
+        [&fn](const K& key, const ValueType& value) { fn(key, value.data()); });
+  }
+
+  Status export_values_to_tensors(OpKernelContext* ctx, int64 value_dim,
+                                  Tensor* keys, Tensor* values) override {
+    // Concurrent operations keep running while the snapshot is read.
+    auto snapshot = table_->snapshot();
+    int64 size = snapshot->size();
 
-    Tensor* keys;
-    Tensor* values;
     TF_RETURN_IF_ERROR(
-        ctx->allocate_output("keys", TensorShape({size}), &keys));
-    TF_RETURN_IF_ERROR(ctx->allocate_output(
-        "values", TensorShape({size, value_dim}), &values));
+        ctx->allocate_temp(DataTypeToEnum<K>::v(), TensorShape({size}), keys));
+    TF_RETURN_IF_ERROR(ctx->allocate_temp(
+        DataTypeToEnum<V>::v(), TensorShape({size, value_dim}), values));
 
     auto keys_data = keys->flat<K>();
     auto values_data = values->matrix<V>();
     int64 i = 0;
 
-    for (auto it = lt.begin(); it != lt.end(); ++it, ++i) {
-      K key = it->first;
-      ValueType value = it->second;
+    snapshot->complete([&](const K& key, const ValueType& value) {
       keys_data(i) = key;
       for (int64 j = 0; j < value_dim; j++) {
         values_data(i, j) = value.at(j);
       }
-    }
+      ++i;
+    });
+    DCHECK_EQ(i, size);
     return Status::OK();
   }
 
  private:
+  static constexpr int64 kHeapBytesSamples = 256;
+
   size_t init_size_;
+  TableMemory memory_;
   Table* table_;
 };
 
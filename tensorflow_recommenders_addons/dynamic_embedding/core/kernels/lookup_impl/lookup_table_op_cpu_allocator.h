@@ -0,0 +1,269 @@
+/* Copyright 2021 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TFRA_CORE_KERNELS_LOOKUP_TABLE_OP_CPU_ALLOCATOR_H_
+#define TFRA_CORE_KERNELS_LOOKUP_TABLE_OP_CPU_ALLOCATOR_H_
+
+#include <sys/mman.h>
+
+#include <atomic>
+#include <new>
+#include <string>
+#include <unordered_map>
+
+#include "tensorflow/core/framework/allocator.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/mem.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/util/env_var.h"
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+namespace tensorflow {
+namespace recommenders_addons {
+namespace lookup {
+namespace cpu {
+
+// Where the bucket and lock arrays of a CPU table are allocated from.
+enum class TableMemoryMode {
+  // Cache line aligned heap memory.
+  kDefault,
+  // 2MB aligned heap memory advised with MADV_HUGEPAGE for large arrays.
+  kTransparentHugePage,
+  // Explicit MAP_HUGETLB mappings from the 2MB or 1GB huge page pools for
+  // large arrays, falling back to kTransparentHugePage when the pool is empty.
+  kHugePage2MB,
+  kHugePage1GB,
+  // TensorFlow's cpu_allocator(), which is visible to TF allocator stats.
+  kTFAllocator,
+};
+
+inline const char* TableMemoryModeName(TableMemoryMode mode) {
+  switch (mode) {
+    case TableMemoryMode::kTransparentHugePage:
+      return "thp";
+    case TableMemoryMode::kHugePage2MB:
+      return "hugepage_2m";
+    case TableMemoryMode::kHugePage1GB:
+      return "hugepage_1g";
+    case TableMemoryMode::kTFAllocator:
+      return "tf";
+    default:
+      return "default";
+  }
+}
+
+// Reads TFRA_HASHTABLE_ALLOCATOR, one of "default", "thp", "hugepage_2m",
+// "hugepage_1g" or "tf".
+inline TableMemoryMode TableMemoryModeFromEnv() {
+  string name;
+  Status status =
+      ReadStringFromEnvVar("TFRA_HASHTABLE_ALLOCATOR", "default", &name);
+  if (!status.ok()) {
+    LOG(ERROR) << "Error parsing TFRA_HASHTABLE_ALLOCATOR: " << status;
+    return TableMemoryMode::kDefault;
+  }
+  for (auto mode :
+       {TableMemoryMode::kDefault, TableMemoryMode::kTransparentHugePage,
+        TableMemoryMode::kHugePage2MB, TableMemoryMode::kHugePage1GB,
+        TableMemoryMode::kTFAllocator}) {
+    if (name == TableMemoryModeName(mode)) return mode;
+  }
+  LOG(ERROR) << "Unknown TFRA_HASHTABLE_ALLOCATOR " << name
+             << ", using the default allocator.";
+  return TableMemoryMode::kDefault;
+}
+
+// Allocates and accounts the memory of one table.
+class TableMemory {
+ public:
+  static constexpr size_t kCacheLineSize = 64;
+  static constexpr size_t k2MB = size_t(1) << 21;
+  static constexpr size_t k1GB = size_t(1) << 30;
+
+  explicit TableMemory(TableMemoryMode mode) : mode_(mode) {}
+  ~TableMemory() {
+    if (allocated_bytes_.load() != 0) {
+      LOG(WARNING) << "TableMemory destroyed with " << allocated_bytes_.load()
+                   << " bytes still allocated.";
+    }
+  }
+
+  // The memory used by tables created without an explicit TableMemory.
+  static TableMemory* Default() {
+    static TableMemory* memory = new TableMemory(TableMemoryMode::kDefault);
+    return memory;
+  }
+
+  TableMemoryMode mode() const { return mode_; }
+
+  int64 allocated_bytes() const {
+    return allocated_bytes_.load(std::memory_order_relaxed);
+  }
+
+  void* Allocate(size_t bytes) {
+    void* ptr = nullptr;
+    switch (mode_) {
+      case TableMemoryMode::kTFAllocator:
+        ptr = cpu_allocator()->AllocateRaw(kCacheLineSize, bytes);
+        break;
+      case TableMemoryMode::kHugePage2MB:
+        ptr = MapHugePages(bytes, k2MB, 21);
+        if (ptr == nullptr) ptr = AllocateTransparentHugePage(bytes);
+        break;
+      case TableMemoryMode::kHugePage1GB:
+        ptr = MapHugePages(bytes, k1GB, 30);
+        if (ptr == nullptr) ptr = AllocateTransparentHugePage(bytes);
+        break;
+      case TableMemoryMode::kTransparentHugePage:
+        ptr = AllocateTransparentHugePage(bytes);
+        break;
+      default:
+        ptr = port::AlignedMalloc(bytes, kCacheLineSize);
+        break;
+    }
+    if (ptr != nullptr) {
+      allocated_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+    }
+    return ptr;
+  }
+
+  void Deallocate(void* ptr, size_t bytes) {
+    if (ptr == nullptr) return;
+    allocated_bytes_.fetch_sub(bytes, std::memory_order_relaxed);
+    if (mode_ == TableMemoryMode::kTFAllocator) {
+      cpu_allocator()->DeallocateRaw(ptr);
+      return;
+    }
+    if (mode_ == TableMemoryMode::kHugePage2MB ||
+        mode_ == TableMemoryMode::kHugePage1GB) {
+      size_t mapped_len = 0;
+      {
+        mutex_lock l(mu_);
+        auto it = mapped_.find(ptr);
+        if (it != mapped_.end()) {
+          mapped_len = it->second;
+          mapped_.erase(it);
+        }
+      }
+      if (mapped_len > 0) {
+        munmap(ptr, mapped_len);
+        return;
+      }
+    }
+    port::AlignedFree(ptr);
+  }
+
+ private:
+  void* AllocateTransparentHugePage(size_t bytes) {
+    if (bytes < k2MB) return port::AlignedMalloc(bytes, kCacheLineSize);
+    // Rounded up so that the advised range covers the tail of the array
+    // without reaching past the allocation.
+    const size_t len = RoundUp(bytes, k2MB);
+    void* ptr = port::AlignedMalloc(len, k2MB);
+#ifdef MADV_HUGEPAGE
+    if (ptr != nullptr) madvise(ptr, len, MADV_HUGEPAGE);
+#endif
+    return ptr;
+  }
+
+  void* MapHugePages(size_t bytes, size_t page_size, int page_shift) {
+#ifdef MAP_HUGETLB
+    // Small arrays such as the lock stripes of a small table would waste most
+    // of a huge page.
+    if (bytes < page_size / 2) return nullptr;
+    const size_t len = RoundUp(bytes, page_size);
+    void* ptr = mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB |
+                         (page_shift << MAP_HUGE_SHIFT),
+                     -1, 0);
+    if (ptr == MAP_FAILED) {
+      if (!warned_.exchange(true)) {
+        LOG(WARNING) << "Failed to map " << len << " bytes of "
+                     << (page_size >> 20)
+                     << "MB huge pages, check /proc/sys/vm/nr_hugepages. "
+                        "Falling back to transparent huge pages.";
+      }
+      return nullptr;
+    }
+    mutex_lock l(mu_);
+    mapped_[ptr] = len;
+    return ptr;
+#else
+    return nullptr;
+#endif
+  }
+
+  static size_t RoundUp(size_t bytes, size_t align) {
+    return (bytes + align - 1) / align * align;
+  }
+
+  const TableMemoryMode mode_;
+  std::atomic<int64> allocated_bytes_{0};
+  std::atomic<bool> warned_{false};
+  mutex mu_;
+  std::unordered_map<void*, size_t> mapped_ TF_GUARDED_BY(mu_);
+
+  TF_DISALLOW_COPY_AND_ASSIGN(TableMemory);
+};
+
+// A stateful std allocator forwarding to a TableMemory. Copies and rebinds
+// share the TableMemory, so all arrays of a cuckoohash_map are accounted
+// together.
+template <class T>
+class TableAllocator {
+ public:
+  using value_type = T;
+
+  TableAllocator() noexcept : memory_(TableMemory::Default()) {}
+  explicit TableAllocator(TableMemory* memory) noexcept : memory_(memory) {}
+  template <class U>
+  TableAllocator(const TableAllocator<U>& other) noexcept
+      : memory_(other.memory()) {}
+
+  T* allocate(size_t n) {
+    void* ptr = memory_->Allocate(n * sizeof(T));
+    if (ptr == nullptr) throw std::bad_alloc();
+    return static_cast<T*>(ptr);
+  }
+
+  void deallocate(T* ptr, size_t n) noexcept {
+    memory_->Deallocate(ptr, n * sizeof(T));
+  }
+
+  TableMemory* memory() const noexcept { return memory_; }
+
+ private:
+  TableMemory* memory_;
+};
+
+template <class T, class U>
+bool operator==(const TableAllocator<T>& lhs, const TableAllocator<U>& rhs) {
+  return lhs.memory() == rhs.memory();
+}
+
+template <class T, class U>
+bool operator!=(const TableAllocator<T>& lhs, const TableAllocator<U>& rhs) {
+  return !(lhs == rhs);
+}
+
+}  // namespace cpu
+}  // namespace lookup
+}  // namespace recommenders_addons
+}  // namespace tensorflow
+
+#endif  // TFRA_CORE_KERNELS_LOOKUP_TABLE_OP_CPU_ALLOCATOR_H_
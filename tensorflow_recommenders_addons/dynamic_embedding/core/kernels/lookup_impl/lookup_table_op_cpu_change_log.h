@@ -0,0 +1,386 @@
+/* Copyright 2021 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TFRA_CORE_KERNELS_LOOKUP_TABLE_OP_CPU_CHANGE_LOG_H_
+#define TFRA_CORE_KERNELS_LOOKUP_TABLE_OP_CPU_CHANGE_LOG_H_
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/lib/core/coding.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/util/work_sharder.h"
+#include "tensorflow_recommenders_addons/dynamic_embedding/core/kernels/lookup_impl/lookup_table_op_cpu.h"
+
+namespace tensorflow {
+namespace recommenders_addons {
+namespace lookup {
+namespace cpu {
+
+// Change log files written by ChangeLog::Drain start with a header:
+//   magic "TFRACDC1" | key bytes u32 | value bytes u32 |
+//   first sequence u64 | records u64 | dropped records u64
+// followed by the records, whose sequences are consecutive from the first
+// one:
+//   op u8 | key | value, for kUpsert, kAccum and kAccumInsert only
+// All integers are little endian.
+
+enum class ChangeOp : uint8 {
+  kUpsert = 0,
+  kRemove = 1,
+  // insert_or_accum with exist true and false respectively.
+  kAccum = 2,
+  kAccumInsert = 3,
+  kClear = 4,
+};
+
+constexpr char kChangeLogMagic[] = "TFRACDC1";
+constexpr size_t kChangeLogMagicBytes = 8;
+constexpr size_t kChangeLogHeaderBytes = kChangeLogMagicBytes + 2 * 4 + 3 * 8;
+
+inline bool ChangeOpHasValue(ChangeOp op) {
+  return op == ChangeOp::kUpsert || op == ChangeOp::kAccum ||
+         op == ChangeOp::kAccumInsert;
+}
+
+// Change logs hold integer keys and fixed size values only.
+template <class K, class V>
+struct ChangeLogSupported
+    : std::integral_constant<bool, std::is_integral<K>::value &&
+                                       !std::is_same<V, tstring>::value> {};
+
+// A bounded ring of the changes made to a table, numbered by a sequence
+// starting at 1. When more than `capacity` changes are made between two
+// drains, the oldest ones are overwritten and reported as dropped by the next
+// drain, after which a replica has to be rebuilt from a full export. Created
+// by CreateChangeLog, so only for the types of ChangeLogSupported.
+template <class K, class V>
+class ChangeLog {
+ public:
+  ChangeLog(size_t capacity, int64 value_dim)
+      : capacity_(capacity),
+        value_dim_(value_dim),
+        keys_(capacity),
+        ops_(capacity),
+        values_(capacity * value_dim) {}
+
+  // Serializes the table mutations with the appends recording them, so the
+  // order of the log is the order in which the table was changed.
+  mutex* mu() TF_LOCK_RETURNED(mu_) { return &mu_; }
+
+  // Records n changes. values holds n rows of value_dim and is only read for
+  // ops carrying a value, exists is only read for accumulations.
+  void Append(ChangeOp op, const K* keys, const V* values, const bool* exists,
+              int64 n) TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    int64 begin = 0;
+    if (static_cast<size_t>(n) > capacity_) {
+      // Only the last capacity_ changes of the batch survive, so the records
+      // still pending are overwritten along with the head of the batch.
+      begin = n - static_cast<int64>(capacity_);
+      dropped_ += (next_seq_ - first_seq_) + begin;
+      next_seq_ += begin;
+      first_seq_ = next_seq_;
+    }
+    for (int64 i = begin; i < n; ++i) {
+      ChangeOp record_op = op;
+      if (op == ChangeOp::kAccum && !exists[i]) {
+        record_op = ChangeOp::kAccumInsert;
+      }
+      const size_t slot = next_seq_ % capacity_;
+      ops_[slot] = record_op;
+      if (keys != nullptr) keys_[slot] = keys[i];
+      if (ChangeOpHasValue(record_op)) {
+        std::copy_n(values + i * value_dim_, value_dim_,
+                    &values_[slot * value_dim_]);
+      }
+      Advance();
+    }
+  }
+
+  void AppendClear() TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    ops_[next_seq_ % capacity_] = ChangeOp::kClear;
+    Advance();
+  }
+
+  // Moves the records not drained yet to `filepath` and returns their first
+  // sequence, count and the number of records dropped before them.
+  Status Drain(const string& filepath, uint64* first_seq, uint64* count,
+               uint64* dropped) TF_LOCKS_EXCLUDED(mu_) {
+    const size_t value_bytes = sizeof(V) * value_dim_;
+    // Copy the records out of the ring, at most two runs of slots, and
+    // serialize them after releasing mu_ so writers only wait for the copy.
+    std::vector<ChangeOp> ops;
+    std::vector<K> keys;
+    std::vector<V> values;
+    {
+      mutex_lock l(mu_);
+      *first_seq = first_seq_;
+      *count = next_seq_ - first_seq_;
+      *dropped = dropped_;
+      ops.reserve(*count);
+      keys.reserve(*count);
+      values.reserve(*count * value_dim_);
+      size_t slot = first_seq_ % capacity_;
+      uint64 left = *count;
+      while (left > 0) {
+        const size_t run = std::min<uint64>(left, capacity_ - slot);
+        ops.insert(ops.end(), ops_.begin() + slot, ops_.begin() + slot + run);
+        keys.insert(keys.end(), keys_.begin() + slot,
+                    keys_.begin() + slot + run);
+        values.insert(values.end(), values_.begin() + slot * value_dim_,
+                      values_.begin() + (slot + run) * value_dim_);
+        left -= run;
+        slot = 0;
+      }
+      first_seq_ = next_seq_;
+      dropped_ = 0;
+    }
+    string content;
+    content.reserve(kChangeLogHeaderBytes +
+                    *count * (1 + sizeof(K) + value_bytes));
+    content.append(kChangeLogMagic, kChangeLogMagicBytes);
+    core::PutFixed32(&content, sizeof(K));
+    core::PutFixed32(&content, static_cast<uint32>(value_bytes));
+    core::PutFixed64(&content, *first_seq);
+    core::PutFixed64(&content, *count);
+    core::PutFixed64(&content, *dropped);
+    for (size_t i = 0; i < ops.size(); ++i) {
+      content.push_back(static_cast<char>(ops[i]));
+      if (ops[i] == ChangeOp::kClear) continue;
+      content.append(reinterpret_cast<const char*>(&keys[i]), sizeof(K));
+      if (ChangeOpHasValue(ops[i])) {
+        content.append(reinterpret_cast<const char*>(&values[i * value_dim_]),
+                       value_bytes);
+      }
+    }
+    // The records are gone from the ring once copied, so a failed write
+    // shows up as a gap on the replica rather than as a duplicate.
+    Env* env = Env::Default();
+    const string tmp_file = filepath + ".tmp";
+    TF_RETURN_IF_ERROR(WriteStringToFile(env, tmp_file, content));
+    return env->RenameFile(tmp_file, filepath);
+  }
+
+  int64 MemoryUsed() const {
+    return sizeof(ChangeLog) + keys_.capacity() * sizeof(K) +
+           ops_.capacity() * sizeof(ChangeOp) + values_.capacity() * sizeof(V);
+  }
+
+ private:
+  void Advance() TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    ++next_seq_;
+    if (next_seq_ - first_seq_ > capacity_) {
+      ++first_seq_;
+      ++dropped_;
+    }
+  }
+
+  const size_t capacity_;
+  const int64 value_dim_;
+  mutex mu_;
+  uint64 next_seq_ TF_GUARDED_BY(mu_) = 1;
+  uint64 first_seq_ TF_GUARDED_BY(mu_) = 1;
+  uint64 dropped_ TF_GUARDED_BY(mu_) = 0;
+  std::vector<K> keys_ TF_GUARDED_BY(mu_);
+  std::vector<ChangeOp> ops_ TF_GUARDED_BY(mu_);
+  std::vector<V> values_ TF_GUARDED_BY(mu_);
+
+  TF_DISALLOW_COPY_AND_ASSIGN(ChangeLog);
+};
+
+template <class K, class V>
+typename std::enable_if<ChangeLogSupported<K, V>::value, Status>::type
+CreateChangeLog(size_t capacity, int64 value_dim,
+                std::unique_ptr<ChangeLog<K, V>>* change_log) {
+  change_log->reset(new ChangeLog<K, V>(capacity, value_dim));
+  return Status::OK();
+}
+
+template <class K, class V>
+typename std::enable_if<!ChangeLogSupported<K, V>::value, Status>::type
+CreateChangeLog(size_t capacity, int64 value_dim,
+                std::unique_ptr<ChangeLog<K, V>>* change_log) {
+  return errors::InvalidArgument(
+      "change_log_capacity only supports integer keys and fixed size "
+      "values.");
+}
+
+// Applies a file written by ChangeLog::Drain to table, skipping the records
+// up to *last_seq, which were applied by an earlier replay, and advancing it
+// to the last sequence of the file. *missing is set to the number of records
+// lost between the earlier replay and this file; a table which was never
+// replayed to is assumed to start from an export taken before the file.
+// Records are applied in parallel by partitioning on the key, so the changes
+// to every key keep their order, and clears wait for everything before them.
+template <class K, class V>
+typename std::enable_if<ChangeLogSupported<K, V>::value, Status>::type
+ReplayChangeLog(OpKernelContext* ctx, TableWrapperBase<K, V>* table,
+                int64 value_dim, const string& filepath, uint64* last_seq,
+                uint64* missing) {
+  string content;
+  TF_RETURN_IF_ERROR(ReadFileToString(Env::Default(), filepath, &content));
+  if (content.size() < kChangeLogHeaderBytes ||
+      std::memcmp(content.data(), kChangeLogMagic, kChangeLogMagicBytes) !=
+          0) {
+    return errors::InvalidArgument(filepath, " is not a change log.");
+  }
+  const char* p = content.data() + kChangeLogMagicBytes;
+  const uint32 key_bytes = core::DecodeFixed32(p);
+  const uint32 value_bytes = core::DecodeFixed32(p + 4);
+  const uint64 first_seq = core::DecodeFixed64(p + 8);
+  const uint64 count = core::DecodeFixed64(p + 16);
+  if (key_bytes != sizeof(K) || value_bytes != sizeof(V) * value_dim) {
+    return errors::InvalidArgument(
+        "Change log holds ", key_bytes, " byte keys and ", value_bytes,
+        " byte values, the table expects ", sizeof(K), " and ",
+        sizeof(V) * value_dim);
+  }
+  // Every record takes its op byte and every one with a value takes a full
+  // record, so the header must not size the buffers beyond what the file
+  // holds.
+  const uint64 record_bytes = content.size() - kChangeLogHeaderBytes;
+  if (count > record_bytes) {
+    return errors::DataLoss("Change log of ", content.size(),
+                            " bytes claims ", count, " records.");
+  }
+  const uint64 max_rows =
+      std::min<uint64>(count, record_bytes / (1 + key_bytes + value_bytes));
+
+  // Unpack the records not applied yet.
+  std::vector<ChangeOp> ops;
+  std::vector<K> keys;
+  std::vector<int64> rows;
+  Tensor values;
+  TF_RETURN_IF_ERROR(ctx->allocate_temp(
+      DataTypeToEnum<V>::v(),
+      TensorShape({static_cast<int64>(std::max<uint64>(max_rows, 1)),
+                   value_dim}),
+      &values));
+  char* values_data = reinterpret_cast<char*>(values.data());
+  ops.reserve(count);
+  keys.reserve(count);
+  rows.reserve(count);
+  const char* end = content.data() + content.size();
+  p = content.data() + kChangeLogHeaderBytes;
+  int64 num_rows = 0;
+  for (uint64 i = 0; i < count; ++i) {
+    if (p + 1 > end) return errors::DataLoss("Truncated change log.");
+    const ChangeOp op = static_cast<ChangeOp>(*p++);
+    if (op > ChangeOp::kClear) {
+      return errors::DataLoss("Unknown change log record ",
+                              static_cast<int>(op));
+    }
+    K key = K();
+    int64 row = -1;
+    if (op != ChangeOp::kClear) {
+      if (p + sizeof(K) > end) {
+        return errors::DataLoss("Truncated change log.");
+      }
+      std::memcpy(&key, p, sizeof(K));
+      p += sizeof(K);
+    }
+    if (ChangeOpHasValue(op)) {
+      if (p + value_bytes > end) {
+        return errors::DataLoss("Truncated change log.");
+      }
+      row = num_rows++;
+      std::memcpy(values_data + row * value_bytes, p, value_bytes);
+      p += value_bytes;
+    }
+    if (first_seq + i <= *last_seq) continue;
+    ops.push_back(op);
+    keys.push_back(key);
+    rows.push_back(row);
+  }
+
+  // Dropped records advance the first sequence of the next drain, so they
+  // show up as a gap after the last replayed record.
+  *missing = 0;
+  if (*last_seq > 0 && first_seq > *last_seq + 1) {
+    *missing = first_seq - *last_seq - 1;
+  }
+  if (count > 0) *last_seq = std::max(*last_seq, first_seq + count - 1);
+
+  const Tensor& const_values = values;
+  ConstTensor2D<V> values_flat = const_values.flat_inner_dims<V, 2>();
+  auto worker_threads = ctx->device()->tensorflow_cpu_worker_threads();
+  const int num_shards = std::max(1, worker_threads->num_threads);
+  const int64 total = static_cast<int64>(ops.size());
+  std::vector<std::vector<int64>> partitions(num_shards);
+  int64 begin = 0;
+  while (begin < total) {
+    if (ops[begin] == ChangeOp::kClear) {
+      table->clear();
+      ++begin;
+      continue;
+    }
+    // Partition the segment by key once; each partition keeps the order of
+    // its records.
+    for (auto& records : partitions) records.clear();
+    int64 stop = begin;
+    for (; stop < total && ops[stop] != ChangeOp::kClear; ++stop) {
+      partitions[static_cast<uint64>(HybridHash<K>{}(keys[stop])) %
+                 num_shards]
+          .push_back(stop);
+    }
+    auto shard = [&](int64 shard_begin, int64 shard_end) {
+      for (int64 s = shard_begin; s < shard_end; ++s) {
+        for (const int64 i : partitions[s]) {
+          switch (ops[i]) {
+            case ChangeOp::kUpsert:
+              table->insert_or_assign(keys[i], values_flat, value_dim,
+                                      rows[i]);
+              break;
+            case ChangeOp::kRemove:
+              table->erase(keys[i]);
+              break;
+            default:
+              table->insert_or_accum(keys[i], values_flat,
+                                     ops[i] == ChangeOp::kAccum, value_dim,
+                                     rows[i]);
+              break;
+          }
+        }
+      }
+    };
+    Shard(num_shards, worker_threads->workers, num_shards,
+          /*cost_per_unit=*/(stop - begin) / num_shards + 1000, shard);
+    begin = stop;
+  }
+  return Status::OK();
+}
+
+template <class K, class V>
+typename std::enable_if<!ChangeLogSupported<K, V>::value, Status>::type
+ReplayChangeLog(OpKernelContext* ctx, TableWrapperBase<K, V>* table,
+                int64 value_dim, const string& filepath, uint64* last_seq,
+                uint64* missing) {
+  return errors::Unimplemented(
+      "Change logs only support integer keys and fixed size values.");
+}
+
+}  // namespace cpu
+}  // namespace lookup
+}  // namespace recommenders_addons
+}  // namespace tensorflow
+
+#endif  // TFRA_CORE_KERNELS_LOOKUP_TABLE_OP_CPU_CHANGE_LOG_H_
@@ -0,0 +1,602 @@
+/* Copyright 2021 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TFRA_CORE_KERNELS_LOOKUP_TABLE_OP_CPU_COMPRESSED_H_
+#define TFRA_CORE_KERNELS_LOOKUP_TABLE_OP_CPU_COMPRESSED_H_
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <numeric>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "tensorflow/core/lib/core/coding.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/core/threadpool.h"
+#include "tensorflow/core/lib/hash/crc32c.h"
+#include "tensorflow/core/lib/io/inputstream_interface.h"
+#include "tensorflow/core/lib/io/zlib_compression_options.h"
+#include "tensorflow/core/lib/io/zlib_inputstream.h"
+#include "tensorflow/core/lib/io/zlib_outputbuffer.h"
+#include "tensorflow/core/platform/file_system.h"
+#include "tensorflow/core/platform/snappy.h"
+#include "tensorflow/core/util/work_sharder.h"
+
+namespace tensorflow {
+namespace recommenders_addons {
+namespace lookup {
+namespace cpu {
+
+// Block-compressed table snapshot files.
+//
+// A file starts with a header:
+//   magic "TFRACBLK" | version u32 | codec u32 | key bytes u32 |
+//   value bytes u32
+// followed by blocks of up to kSnapshotBlockBytes of values:
+//   records u32 | keys length u32 | values length u32 |
+//   uncompressed keys length u32 | masked crc32c u32 | keys | values
+// and ends with a block of 0 records whose keys length holds the low 32 bits
+// of the total number of records. Within a block records are sorted by key,
+// keys are stored as a zigzag varint followed by varint deltas, and both the
+// keys and the values are compressed with the codec. All integers are little
+// endian. Files written by save_to_hdfs without compression are plain
+// key/value records and have no header.
+
+enum class SnapshotCodec : uint32 {
+  kNone = 0,
+  kSnappy = 1,
+  kZlib = 2,
+};
+
+constexpr char kSnapshotMagic[] = "TFRACBLK";
+constexpr size_t kSnapshotMagicBytes = 8;
+constexpr uint32 kSnapshotVersion = 1;
+constexpr size_t kSnapshotHeaderBytes = kSnapshotMagicBytes + 4 * 4;
+constexpr size_t kSnapshotBlockHeaderBytes = 5 * 4;
+constexpr size_t kSnapshotBlockBytes = 1 << 20;
+
+// Records per block of values of value_bytes bytes.
+inline size_t SnapshotRecordsPerBlock(size_t value_bytes) {
+  return std::max<size_t>(256, kSnapshotBlockBytes / (value_bytes + 1));
+}
+
+inline Status ParseSnapshotCodec(const string& name, SnapshotCodec* codec) {
+  if (name.empty() || name == "none") {
+    *codec = SnapshotCodec::kNone;
+  } else if (name == "snappy") {
+    *codec = SnapshotCodec::kSnappy;
+  } else if (name == "zlib") {
+    *codec = SnapshotCodec::kZlib;
+  } else {
+    return errors::InvalidArgument("Unknown compression ", name,
+                                   ", expected none, snappy or zlib.");
+  }
+  return Status::OK();
+}
+
+namespace internal {
+
+constexpr size_t kZlibBufferBytes = 256 << 10;
+
+// Collects the output of a ZlibOutputBuffer in memory.
+class StringWritableFile final : public WritableFile {
+ public:
+  explicit StringWritableFile(string* dst) : dst_(dst) {}
+
+  Status Append(StringPiece data) override {
+    dst_->append(data.data(), data.size());
+    return Status::OK();
+  }
+  Status Close() override { return Status::OK(); }
+  Status Flush() override { return Status::OK(); }
+  Status Sync() override { return Status::OK(); }
+
+ private:
+  string* dst_;
+};
+
+// Feeds a ZlibInputStream from memory.
+class StringPieceInputStream final : public io::InputStreamInterface {
+ public:
+  explicit StringPieceInputStream(StringPiece data) : data_(data) {}
+
+  Status ReadNBytes(int64 bytes_to_read, tstring* result) override {
+    const size_t n =
+        std::min(static_cast<size_t>(bytes_to_read), data_.size() - pos_);
+    result->assign(data_.data() + pos_, n);
+    pos_ += n;
+    if (n < static_cast<size_t>(bytes_to_read)) {
+      return errors::OutOfRange("Reached the end of the block.");
+    }
+    return Status::OK();
+  }
+  int64 Tell() const override { return pos_; }
+  Status Reset() override {
+    pos_ = 0;
+    return Status::OK();
+  }
+
+ private:
+  StringPiece data_;
+  size_t pos_ = 0;
+};
+
+inline Status Compress(SnapshotCodec codec, StringPiece raw, string* out) {
+  out->clear();
+  switch (codec) {
+    case SnapshotCodec::kSnappy:
+      if (!port::Snappy_Compress(raw.data(), raw.size(), out)) {
+        return errors::Unimplemented(
+            "Snappy compression is not available in this build.");
+      }
+      return Status::OK();
+    case SnapshotCodec::kZlib: {
+      StringWritableFile file(out);
+      auto options = io::ZlibCompressionOptions::DEFAULT();
+      options.compression_level = Z_BEST_SPEED;
+      io::ZlibOutputBuffer zlib(&file, kZlibBufferBytes, kZlibBufferBytes,
+                                options);
+      TF_RETURN_IF_ERROR(zlib.Init());
+      TF_RETURN_IF_ERROR(zlib.Append(raw));
+      return zlib.Close();
+    }
+    default:
+      out->assign(raw.data(), raw.size());
+      return Status::OK();
+  }
+}
+
+inline Status Uncompress(SnapshotCodec codec, StringPiece in, size_t raw_len,
+                         string* out) {
+  switch (codec) {
+    case SnapshotCodec::kSnappy: {
+      size_t len = 0;
+      if (!port::Snappy_GetUncompressedLength(in.data(), in.size(), &len) ||
+          len != raw_len) {
+        return errors::DataLoss("Corrupted snappy block.");
+      }
+      out->resize(raw_len);
+      if (!port::Snappy_Uncompress(in.data(), in.size(), &(*out)[0])) {
+        return errors::DataLoss("Corrupted snappy block.");
+      }
+      return Status::OK();
+    }
+    case SnapshotCodec::kZlib: {
+      StringPieceInputStream input(in);
+      io::ZlibInputStream zlib(&input, kZlibBufferBytes, kZlibBufferBytes,
+                               io::ZlibCompressionOptions::DEFAULT());
+      tstring data;
+      Status status = zlib.ReadNBytes(raw_len, &data);
+      if (!status.ok()) {
+        return errors::DataLoss("Corrupted zlib block: ",
+                                status.error_message());
+      }
+      out->assign(data.data(), data.size());
+      return Status::OK();
+    }
+    default:
+      if (in.size() != raw_len) {
+        return errors::DataLoss("Corrupted snapshot block.");
+      }
+      out->assign(in.data(), in.size());
+      return Status::OK();
+  }
+}
+
+// Runs fn(i) for i in [0, n), one block per shard.
+inline void RunBlocks(thread::ThreadPool* pool, int n,
+                      const std::function<void(int)>& fn) {
+  if (pool == nullptr || n <= 1) {
+    for (int i = 0; i < n; ++i) fn(i);
+    return;
+  }
+  auto shard = [&fn](int64 begin, int64 end) {
+    for (int64 i = begin; i < end; ++i) fn(static_cast<int>(i));
+  };
+  Shard(pool->NumThreads(), pool, n, kSnapshotBlockBytes, shard);
+}
+
+}  // namespace internal
+
+// Writes records to a block-compressed snapshot file. Blocks are compressed
+// in parallel on the given pool, as many at a time as it has threads, and
+// written in order. Without a pool, each block is compressed on the calling
+// thread once it is full.
+template <class K>
+class CompressedSnapshotWriter {
+  static_assert(std::is_integral<K>::value,
+                "Compressed snapshots only support integer keys.");
+
+ public:
+  CompressedSnapshotWriter(WritableFile* file, SnapshotCodec codec,
+                           size_t value_bytes, thread::ThreadPool* pool)
+      : file_(file),
+        codec_(codec),
+        value_bytes_(value_bytes),
+        records_per_block_(SnapshotRecordsPerBlock(value_bytes)),
+        pool_(pool),
+        blocks_(pool == nullptr ? 1 : std::max(1, pool->NumThreads())) {}
+
+  Status WriteHeader() {
+    string header(kSnapshotMagic, kSnapshotMagicBytes);
+    core::PutFixed32(&header, kSnapshotVersion);
+    core::PutFixed32(&header, static_cast<uint32>(codec_));
+    core::PutFixed32(&header, sizeof(K));
+    core::PutFixed32(&header, static_cast<uint32>(value_bytes_));
+    return file_->Append(header);
+  }
+
+  Status Add(K key, const char* value) {
+    Block& block = blocks_[num_blocks_];
+    block.keys.push_back(key);
+    block.values.append(value, value_bytes_);
+    if (block.keys.size() == records_per_block_ &&
+        ++num_blocks_ == blocks_.size()) {
+      return Flush();
+    }
+    return Status::OK();
+  }
+
+  Status Finish() {
+    if (!blocks_[num_blocks_].keys.empty()) ++num_blocks_;
+    TF_RETURN_IF_ERROR(Flush());
+    string footer;
+    core::PutFixed32(&footer, 0);
+    core::PutFixed32(&footer, static_cast<uint32>(num_records_));
+    core::PutFixed32(&footer, 0);
+    core::PutFixed32(&footer, 0);
+    core::PutFixed32(&footer, 0);
+    return file_->Append(footer);
+  }
+
+ private:
+  struct Block {
+    std::vector<K> keys;
+    string values;
+    string output;
+    Status status;
+  };
+
+  Status Flush() {
+    internal::RunBlocks(pool_, static_cast<int>(num_blocks_),
+                        [this](int i) { Encode(&blocks_[i]); });
+    for (size_t i = 0; i < num_blocks_; ++i) {
+      Block& block = blocks_[i];
+      TF_RETURN_IF_ERROR(block.status);
+      TF_RETURN_IF_ERROR(file_->Append(block.output));
+      num_records_ += block.keys.size();
+      block.keys.clear();
+      block.values.clear();
+      block.output.clear();
+    }
+    num_blocks_ = 0;
+    return Status::OK();
+  }
+
+  void Encode(Block* block) const {
+    const size_t n = block->keys.size();
+    std::vector<uint32> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [block](uint32 a, uint32 b) {
+      return block->keys[a] < block->keys[b];
+    });
+
+    string keys;
+    string values;
+    values.resize(n * value_bytes_);
+    int64 prev = 0;
+    for (size_t i = 0; i < n; ++i) {
+      const int64 key = static_cast<int64>(block->keys[order[i]]);
+      if (i == 0) {
+        // Zigzag, so that negative keys stay short.
+        core::PutVarint64(&keys, (static_cast<uint64>(key) << 1) ^
+                                     static_cast<uint64>(key >> 63));
+      } else {
+        core::PutVarint64(&keys,
+                          static_cast<uint64>(key) - static_cast<uint64>(prev));
+      }
+      prev = key;
+      std::memcpy(&values[i * value_bytes_],
+                  &block->values[order[i] * value_bytes_], value_bytes_);
+    }
+
+    string packed_keys;
+    string packed_values;
+    block->status = internal::Compress(codec_, keys, &packed_keys);
+    if (!block->status.ok()) return;
+    block->status = internal::Compress(codec_, values, &packed_values);
+    if (!block->status.ok()) return;
+
+    uint32 crc = crc32c::Value(packed_keys.data(), packed_keys.size());
+    crc = crc32c::Extend(crc, packed_values.data(), packed_values.size());
+    string& out = block->output;
+    core::PutFixed32(&out, static_cast<uint32>(n));
+    core::PutFixed32(&out, static_cast<uint32>(packed_keys.size()));
+    core::PutFixed32(&out, static_cast<uint32>(packed_values.size()));
+    core::PutFixed32(&out, static_cast<uint32>(keys.size()));
+    core::PutFixed32(&out, crc32c::Mask(crc));
+    out.append(packed_keys);
+    out.append(packed_values);
+  }
+
+  WritableFile* file_;
+  const SnapshotCodec codec_;
+  const size_t value_bytes_;
+  const size_t records_per_block_;
+  thread::ThreadPool* pool_;
+  std::vector<Block> blocks_;
+  size_t num_blocks_ = 0;
+  uint64 num_records_ = 0;
+};
+
+// Reads a block-compressed snapshot file of file_size bytes, decompressing
+// blocks in parallel on the given pool, or one at a time on the calling
+// thread without one. Lengths read from the file are checked against the
+// rest of the file and the block size before anything is allocated, and a
+// corrupt file fails with DataLoss.
+template <class K>
+class CompressedSnapshotReader {
+  static_assert(std::is_integral<K>::value,
+                "Compressed snapshots only support integer keys.");
+
+ public:
+  CompressedSnapshotReader(RandomAccessFile* file, uint64 file_size,
+                           size_t value_bytes, thread::ThreadPool* pool)
+      : file_(file),
+        file_size_(file_size),
+        value_bytes_(value_bytes),
+        pool_(pool),
+        blocks_(pool == nullptr ? 1 : std::max(1, pool->NumThreads())) {}
+
+  // Calls fn(keys, values, n) for every block, in file order, with n keys and
+  // n * value_bytes bytes of values.
+  Status Read(
+      const std::function<Status(const K*, const char*, int64)>& fn) {
+    TF_RETURN_IF_ERROR(ReadHeader());
+    uint64 num_records = 0;
+    bool done = false;
+    while (!done) {
+      size_t num_blocks = 0;
+      for (; num_blocks < blocks_.size(); ++num_blocks) {
+        Block& block = blocks_[num_blocks];
+        TF_RETURN_IF_ERROR(ReadBlock(&block));
+        if (block.num_records == 0) {
+          if (block.keys_len != static_cast<uint32>(num_records + Pending(
+                                    num_blocks))) {
+            return errors::DataLoss("Snapshot record count mismatch.");
+          }
+          done = true;
+          break;
+        }
+      }
+      internal::RunBlocks(pool_, static_cast<int>(num_blocks),
+                          [this](int i) { Decode(&blocks_[i]); });
+      for (size_t i = 0; i < num_blocks; ++i) {
+        Block& block = blocks_[i];
+        TF_RETURN_IF_ERROR(block.status);
+        TF_RETURN_IF_ERROR(
+            fn(block.keys.data(), block.values.data(), block.num_records));
+        num_records += block.num_records;
+      }
+    }
+    return Status::OK();
+  }
+
+ private:
+  struct Block {
+    uint32 num_records = 0;
+    uint32 keys_len = 0;
+    uint32 values_len = 0;
+    uint32 raw_keys_len = 0;
+    uint32 crc = 0;
+    string payload;
+    std::vector<K> keys;
+    string values;
+    Status status;
+  };
+
+  uint64 Pending(size_t num_blocks) const {
+    uint64 n = 0;
+    for (size_t i = 0; i < num_blocks; ++i) n += blocks_[i].num_records;
+    return n;
+  }
+
+  Status ReadExactly(uint64 n, string* out) {
+    if (offset_ > file_size_ || n > file_size_ - offset_) {
+      return errors::DataLoss("Snapshot block of ", n, " bytes at offset ",
+                              offset_, " runs past the end of the file.");
+    }
+    out->resize(n);
+    StringPiece result;
+    Status status = file_->Read(offset_, n, &result, &(*out)[0]);
+    if (!status.ok() && !errors::IsOutOfRange(status)) return status;
+    if (result.size() != n) {
+      return errors::DataLoss("Truncated snapshot file at offset ", offset_);
+    }
+    if (result.data() != out->data()) out->assign(result.data(), n);
+    offset_ += n;
+    return Status::OK();
+  }
+
+  Status ReadHeader() {
+    string header;
+    TF_RETURN_IF_ERROR(ReadExactly(kSnapshotHeaderBytes, &header));
+    const char* p = header.data() + kSnapshotMagicBytes;
+    const uint32 version = core::DecodeFixed32(p);
+    codec_ = static_cast<SnapshotCodec>(core::DecodeFixed32(p + 4));
+    const uint32 key_bytes = core::DecodeFixed32(p + 8);
+    const uint32 value_bytes = core::DecodeFixed32(p + 12);
+    if (version != kSnapshotVersion) {
+      return errors::DataLoss("Unsupported snapshot version ", version);
+    }
+    if (codec_ != SnapshotCodec::kNone && codec_ != SnapshotCodec::kSnappy &&
+        codec_ != SnapshotCodec::kZlib) {
+      return errors::DataLoss("Unknown snapshot codec ",
+                              static_cast<uint32>(codec_));
+    }
+    if (key_bytes != sizeof(K) || value_bytes != value_bytes_) {
+      return errors::InvalidArgument(
+          "Snapshot holds ", key_bytes, " byte keys and ", value_bytes,
+          " byte values, the table expects ", sizeof(K), " and ",
+          value_bytes_);
+    }
+    return Status::OK();
+  }
+
+  Status ReadBlock(Block* block) {
+    string header;
+    TF_RETURN_IF_ERROR(ReadExactly(kSnapshotBlockHeaderBytes, &header));
+    const char* p = header.data();
+    block->num_records = core::DecodeFixed32(p);
+    block->keys_len = core::DecodeFixed32(p + 4);
+    block->values_len = core::DecodeFixed32(p + 8);
+    block->raw_keys_len = core::DecodeFixed32(p + 12);
+    block->crc = core::DecodeFixed32(p + 16);
+    if (block->num_records == 0) return Status::OK();
+    if (block->num_records > SnapshotRecordsPerBlock(value_bytes_) ||
+        block->raw_keys_len >
+            static_cast<uint64>(block->num_records) * core::kMaxVarint64Bytes) {
+      return errors::DataLoss("Corrupted snapshot block header at offset ",
+                              offset_ - kSnapshotBlockHeaderBytes);
+    }
+    return ReadExactly(static_cast<uint64>(block->keys_len) + block->values_len,
+                       &block->payload);
+  }
+
+  void Decode(Block* block) const {
+    const StringPiece packed_keys(block->payload.data(), block->keys_len);
+    const StringPiece packed_values(block->payload.data() + block->keys_len,
+                                    block->values_len);
+    if (crc32c::Unmask(block->crc) !=
+        crc32c::Value(block->payload.data(), block->payload.size())) {
+      block->status = errors::DataLoss("Snapshot block checksum mismatch.");
+      return;
+    }
+    string keys;
+    block->status =
+        internal::Uncompress(codec_, packed_keys, block->raw_keys_len, &keys);
+    if (!block->status.ok()) return;
+    block->status = internal::Uncompress(
+        codec_, packed_values, block->num_records * value_bytes_,
+        &block->values);
+    if (!block->status.ok()) return;
+
+    block->keys.resize(block->num_records);
+    StringPiece input(keys);
+    uint64 value = 0;
+    int64 key = 0;
+    for (uint32 i = 0; i < block->num_records; ++i) {
+      if (!core::GetVarint64(&input, &value)) {
+        block->status = errors::DataLoss("Corrupted snapshot keys.");
+        return;
+      }
+      key = i == 0 ? static_cast<int64>((value >> 1) ^ (~(value & 1) + 1))
+                   : static_cast<int64>(static_cast<uint64>(key) + value);
+      block->keys[i] = static_cast<K>(key);
+    }
+    if (!input.empty()) {
+      block->status = errors::DataLoss("Corrupted snapshot keys.");
+    }
+  }
+
+  RandomAccessFile* file_;
+  const uint64 file_size_;
+  const size_t value_bytes_;
+  thread::ThreadPool* pool_;
+  std::vector<Block> blocks_;
+  SnapshotCodec codec_ = SnapshotCodec::kNone;
+  uint64 offset_ = 0;
+};
+
+// Sets *compressed to whether the file starts with a snapshot header.
+inline Status IsCompressedSnapshot(RandomAccessFile* file, bool* compressed) {
+  char scratch[kSnapshotMagicBytes];
+  StringPiece result;
+  Status status = file->Read(0, kSnapshotMagicBytes, &result, scratch);
+  if (!status.ok() && !errors::IsOutOfRange(status)) return status;
+  *compressed =
+      result.size() == kSnapshotMagicBytes &&
+      std::memcmp(result.data(), kSnapshotMagic, kSnapshotMagicBytes) == 0;
+  return Status::OK();
+}
+
+// Sets *records to the record count in the last block of a snapshot file of
+// file_size bytes. The block only holds the low 32 bits of the count, so it
+// is a hint, e.g. for reserving memory, and the file is not checked.
+inline Status CompressedSnapshotRecordsHint(RandomAccessFile* file,
+                                            uint64 file_size, uint64* records) {
+  *records = 0;
+  if (file_size < kSnapshotHeaderBytes + kSnapshotBlockHeaderBytes) {
+    return Status::OK();
+  }
+  char scratch[kSnapshotBlockHeaderBytes];
+  StringPiece result;
+  Status status = file->Read(file_size - kSnapshotBlockHeaderBytes,
+                             kSnapshotBlockHeaderBytes, &result, scratch);
+  if (!status.ok() && !errors::IsOutOfRange(status)) return status;
+  if (result.size() == kSnapshotBlockHeaderBytes &&
+      core::DecodeFixed32(result.data()) == 0) {
+    *records = core::DecodeFixed32(result.data() + 4);
+  }
+  return Status::OK();
+}
+
+// Writes a snapshot file, calling produce(writer) to add the records.
+template <class K, class F>
+typename std::enable_if<std::is_integral<K>::value, Status>::type
+WriteCompressedSnapshot(WritableFile* file, SnapshotCodec codec,
+                        size_t value_bytes, thread::ThreadPool* pool,
+                        F produce) {
+  CompressedSnapshotWriter<K> writer(file, codec, value_bytes, pool);
+  TF_RETURN_IF_ERROR(writer.WriteHeader());
+  TF_RETURN_IF_ERROR(produce(&writer));
+  return writer.Finish();
+}
+
+template <class K, class F>
+typename std::enable_if<!std::is_integral<K>::value, Status>::type
+WriteCompressedSnapshot(WritableFile* file, SnapshotCodec codec,
+                        size_t value_bytes, thread::ThreadPool* pool,
+                        F produce) {
+  return errors::Unimplemented(
+      "Compressed snapshots only support integer keys.");
+}
+
+// Reads a snapshot file of file_size bytes, calling fn(keys, values, n) for
+// every block.
+template <class K, class F>
+typename std::enable_if<std::is_integral<K>::value, Status>::type
+ReadCompressedSnapshot(RandomAccessFile* file, uint64 file_size,
+                       size_t value_bytes, thread::ThreadPool* pool, F fn) {
+  CompressedSnapshotReader<K> reader(file, file_size, value_bytes, pool);
+  return reader.Read(fn);
+}
+
+template <class K, class F>
+typename std::enable_if<!std::is_integral<K>::value, Status>::type
+ReadCompressedSnapshot(RandomAccessFile* file, uint64 file_size,
+                       size_t value_bytes, thread::ThreadPool* pool, F fn) {
+  return errors::Unimplemented(
+      "Compressed snapshots only support integer keys.");
+}
+
+}  // namespace cpu
+}  // namespace lookup
+}  // namespace recommenders_addons
+}  // namespace tensorflow
+
+#endif  // TFRA_CORE_KERNELS_LOOKUP_TABLE_OP_CPU_COMPRESSED_H_
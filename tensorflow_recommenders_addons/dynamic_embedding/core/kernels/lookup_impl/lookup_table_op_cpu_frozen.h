@@ -0,0 +1,364 @@
+/* Copyright 2021 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TFRA_CORE_KERNELS_LOOKUP_TABLE_OP_CPU_FROZEN_H_
+#define TFRA_CORE_KERNELS_LOOKUP_TABLE_OP_CPU_FROZEN_H_
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/mem.h"
+#include "tensorflow_recommenders_addons/dynamic_embedding/core/kernels/lookup_impl/lookup_table_op_cpu.h"
+
+namespace tensorflow {
+namespace recommenders_addons {
+namespace lookup {
+namespace cpu {
+
+// Header of a frozen table image. The image is a single contiguous buffer:
+//
+//   | FrozenTableHeader | probe[capacity] | keys[capacity] | values[capacity] |
+//
+// Every section starts on a kFrozenTableAlignment boundary so the same bytes
+// can be produced in memory by `Build` or mapped read-only from a file.
+struct FrozenTableHeader {
+  uint64 magic;
+  uint32 version;
+  uint32 key_bytes;
+  uint32 value_bytes;
+  uint32 reserved;
+  uint64 value_dim;
+  uint64 capacity;
+  uint64 size;
+  uint64 probe_offset;
+  uint64 keys_offset;
+  uint64 values_offset;
+  uint64 total_bytes;
+};
+
+constexpr uint64 kFrozenTableMagic = 0x4e455a4f52464152ULL;  // "RAFROZEN"
+constexpr uint32 kFrozenTableVersion = 1;
+constexpr uint64 kFrozenTableAlignment = 64;
+// probe[i] == 0 marks an empty slot, otherwise it holds the Robin Hood probe
+// distance of the key stored in slot i plus one.
+constexpr uint32 kFrozenTableMaxProbe = 255;
+
+inline uint64 FrozenTableAlign(uint64 n) {
+  return (n + kFrozenTableAlignment - 1) & ~(kFrozenTableAlignment - 1);
+}
+
+// An immutable open-addressing table for serving. Keys and values are laid
+// out contiguously with Robin Hood linear probing, which keeps probe
+// sequences short at load factors around 0.95. Lookups take no locks. Only
+// fixed-size key and value types are supported.
+template <class K, class V>
+class FrozenTable {
+ public:
+  FrozenTable() = default;
+  ~FrozenTable() {
+    if (owned_ != nullptr) port::AlignedFree(owned_);
+  }
+
+  // Builds an in-memory image from `num` dense rows of `value_dim` values.
+  // Later duplicates of a key overwrite earlier ones.
+  static Status Build(const K* keys, const V* values, int64 num,
+                      int64 value_dim, float load_factor,
+                      std::unique_ptr<FrozenTable>* out) {
+    return Build(
+        num, value_dim, load_factor,
+        [keys, values, value_dim](int64 i, K* key, const char** value) {
+          *key = keys[i];
+          *value = reinterpret_cast<const char*>(values + i * value_dim);
+        },
+        out);
+  }
+
+  // Builds an in-memory image from `num` packed key/value records, as written
+  // by `CuckooHashTable.save_to_hdfs`. The records need not be aligned, so
+  // they can be read straight from a mapped file.
+  static Status BuildFromRecords(const char* records, int64 num,
+                                 int64 value_dim, float load_factor,
+                                 std::unique_ptr<FrozenTable>* out) {
+    const uint64 record_len = sizeof(K) + sizeof(V) * value_dim;
+    return Build(
+        num, value_dim, load_factor,
+        [records, record_len](int64 i, K* key, const char** value) {
+          const char* record = records + i * record_len;
+          std::memcpy(key, record, sizeof(K));
+          *value = record + sizeof(K);
+        },
+        out);
+  }
+
+  // Builds an in-memory image from `num` rows, calling row(i, &key, &value)
+  // for the key and the sizeof(V) * value_dim bytes of values of row i.
+  template <typename Row>
+  static Status Build(int64 num, int64 value_dim, float load_factor,
+                      const Row& row, std::unique_ptr<FrozenTable>* out) {
+    if (load_factor <= 0.0f || load_factor > 1.0f) {
+      return errors::InvalidArgument("load_factor must be in (0, 1], got ",
+                                     load_factor);
+    }
+    // Robin Hood bounds the probe length only statistically, so back off the
+    // load factor if a pathological key set overflows the probe counter.
+    for (float lf = load_factor; lf > 0.25f; lf -= 0.05f) {
+      std::unique_ptr<FrozenTable> table(new FrozenTable());
+      const uint64 capacity =
+          std::max<uint64>(1, static_cast<uint64>(num / lf) + 1);
+      table->Allocate(capacity, value_dim);
+      bool ok = true;
+      for (int64 i = 0; i < num && ok; ++i) {
+        K key;
+        const char* value;
+        row(i, &key, &value);
+        ok = table->Place(key, value);
+      }
+      if (ok) {
+        *out = std::move(table);
+        return Status::OK();
+      }
+      LOG(WARNING) << "FrozenTable probe length overflow at load_factor=" << lf
+                   << ", retrying with a lower load factor.";
+    }
+    return errors::Internal("Failed to build FrozenTable with ", num,
+                            " keys.");
+  }
+
+  // Maps an image written by `Save` without copying it. The pages are shared
+  // with every other process mapping the same file.
+  static Status Map(Env* env, const string& filepath, int64 value_dim,
+                    std::unique_ptr<FrozenTable>* out) {
+    std::unique_ptr<ReadOnlyMemoryRegion> region;
+    TF_RETURN_IF_ERROR(env->NewReadOnlyMemoryRegionFromFile(filepath, &region));
+    std::unique_ptr<FrozenTable> table(new FrozenTable());
+    TF_RETURN_IF_ERROR(table->Attach(static_cast<const char*>(region->data()),
+                                     region->length(), value_dim));
+    table->region_ = std::move(region);
+    *out = std::move(table);
+    return Status::OK();
+  }
+
+  // Returns true if `filepath` starts with a frozen table image header.
+  static bool IsImage(Env* env, const string& filepath) {
+    std::unique_ptr<RandomAccessFile> file;
+    if (!env->NewRandomAccessFile(filepath, &file).ok()) return false;
+    char scratch[sizeof(uint64)];
+    StringPiece result;
+    if (!file->Read(0, sizeof(uint64), &result, scratch).ok() ||
+        result.size() != sizeof(uint64)) {
+      return false;
+    }
+    uint64 magic;
+    std::memcpy(&magic, result.data(), sizeof(uint64));
+    return magic == kFrozenTableMagic;
+  }
+
+  Status Save(Env* env, const string& filepath) const {
+    std::unique_ptr<WritableFile> writer;
+    const string tmp_file = filepath + ".tmp";
+    TF_RETURN_IF_ERROR(env->NewWritableFile(tmp_file, &writer));
+    TF_RETURN_IF_ERROR(
+        writer->Append(StringPiece(base_, header_->total_bytes)));
+    TF_RETURN_IF_ERROR(writer->Close());
+    return env->RenameFile(tmp_file, filepath);
+  }
+
+  inline const V* find(const K& key) const {
+    const uint64 capacity = header_->capacity;
+    uint64 slot = Home(key);
+    for (uint32 dist = 1; dist <= kFrozenTableMaxProbe; ++dist) {
+      const uint8 p = probe_[slot];
+      // Robin Hood invariant: a resident closer to its home than we are to
+      // ours means the key cannot be further along the sequence.
+      if (p < dist) return nullptr;
+      if (keys_[slot] == key) return values_ + slot * header_->value_dim;
+      if (++slot == capacity) slot = 0;
+    }
+    return nullptr;
+  }
+
+  size_t size() const { return header_->size; }
+  uint64 capacity() const { return header_->capacity; }
+  uint64 bytes() const { return header_->total_bytes; }
+  bool is_mapped() const { return region_ != nullptr; }
+
+  // Writes all keys and values into dense row-major buffers of `size()` rows.
+  void Dump(K* keys, V* values) const {
+    const uint64 dim = header_->value_dim;
+    for (uint64 slot = 0, i = 0; slot < header_->capacity; ++slot) {
+      if (probe_[slot] == 0) continue;
+      keys[i] = keys_[slot];
+      std::memcpy(values + i * dim, values_ + slot * dim, dim * sizeof(V));
+      ++i;
+    }
+  }
+
+ private:
+  inline uint64 Home(const K& key) const {
+    // Always mix to 64 bits, the range reduction below uses the high bits.
+    const uint64 h =
+        static_cast<uint64>(HybridHash<int64>{}(static_cast<int64>(key)));
+    // Maps the hash onto [0, capacity) without requiring a power of two.
+    return static_cast<uint64>(
+        (static_cast<unsigned __int128>(h) * header_->capacity) >> 64);
+  }
+
+  void Allocate(uint64 capacity, int64 value_dim) {
+    const uint64 probe_offset = FrozenTableAlign(sizeof(FrozenTableHeader));
+    const uint64 keys_offset = FrozenTableAlign(probe_offset + capacity);
+    const uint64 values_offset =
+        FrozenTableAlign(keys_offset + capacity * sizeof(K));
+    const uint64 total_bytes = FrozenTableAlign(
+        values_offset + capacity * static_cast<uint64>(value_dim) * sizeof(V));
+    owned_ = static_cast<char*>(
+        port::AlignedMalloc(total_bytes, kFrozenTableAlignment));
+    std::memset(owned_, 0, total_bytes);
+
+    FrozenTableHeader* header = reinterpret_cast<FrozenTableHeader*>(owned_);
+    header->magic = kFrozenTableMagic;
+    header->version = kFrozenTableVersion;
+    header->key_bytes = sizeof(K);
+    header->value_bytes = sizeof(V);
+    header->value_dim = static_cast<uint64>(value_dim);
+    header->capacity = capacity;
+    header->size = 0;
+    header->probe_offset = probe_offset;
+    header->keys_offset = keys_offset;
+    header->values_offset = values_offset;
+    header->total_bytes = total_bytes;
+    Bind(owned_);
+  }
+
+  // Checks that the sections described by the header of the image at base lie
+  // within its length bytes, in order and aligned, before binding them.
+  Status Attach(const char* base, uint64 length, int64 value_dim) {
+    if (length < sizeof(FrozenTableHeader)) {
+      return errors::DataLoss("FrozenTable image is truncated.");
+    }
+    const FrozenTableHeader* header =
+        reinterpret_cast<const FrozenTableHeader*>(base);
+    if (header->magic != kFrozenTableMagic ||
+        header->version != kFrozenTableVersion) {
+      return errors::InvalidArgument("Not a FrozenTable image.");
+    }
+    if (header->key_bytes != sizeof(K) || header->value_bytes != sizeof(V) ||
+        header->value_dim != static_cast<uint64>(value_dim)) {
+      return errors::InvalidArgument(
+          "FrozenTable image does not match the table types, image has "
+          "key_bytes=",
+          header->key_bytes, ", value_bytes=", header->value_bytes,
+          ", value_dim=", header->value_dim);
+    }
+    if (header->total_bytes > length) {
+      return errors::DataLoss("FrozenTable image is truncated.");
+    }
+    const uint64 capacity = header->capacity;
+    const uint64 row_bytes = header->value_dim * sizeof(V);
+    const uint64 total_bytes = header->total_bytes;
+    auto aligned = [](uint64 offset) {
+      return offset % kFrozenTableAlignment == 0;
+    };
+    // Every bound is checked before the next one uses it, so no sum or
+    // product below overflows.
+    if (capacity == 0 || header->size > capacity ||
+        capacity > total_bytes / (1 + sizeof(K)) ||
+        (row_bytes > 0 && capacity > total_bytes / row_bytes) ||
+        !aligned(header->probe_offset) || !aligned(header->keys_offset) ||
+        !aligned(header->values_offset) ||
+        header->probe_offset < sizeof(FrozenTableHeader) ||
+        header->probe_offset > total_bytes ||
+        capacity > total_bytes - header->probe_offset ||
+        header->keys_offset < header->probe_offset + capacity ||
+        header->keys_offset > total_bytes ||
+        capacity * sizeof(K) > total_bytes - header->keys_offset ||
+        header->values_offset < header->keys_offset + capacity * sizeof(K) ||
+        header->values_offset > total_bytes ||
+        capacity * row_bytes > total_bytes - header->values_offset) {
+      return errors::DataLoss("FrozenTable image has a corrupted header.");
+    }
+    Bind(base);
+    return Status::OK();
+  }
+
+  void Bind(const char* base) {
+    base_ = base;
+    header_ = reinterpret_cast<const FrozenTableHeader*>(base);
+    probe_ = reinterpret_cast<const uint8*>(base + header_->probe_offset);
+    keys_ = reinterpret_cast<const K*>(base + header_->keys_offset);
+    values_ = reinterpret_cast<const V*>(base + header_->values_offset);
+  }
+
+  bool Place(K key, const char* value) {
+    FrozenTableHeader* header = reinterpret_cast<FrozenTableHeader*>(owned_);
+    uint8* probe = reinterpret_cast<uint8*>(owned_ + header->probe_offset);
+    K* keys = reinterpret_cast<K*>(owned_ + header->keys_offset);
+    V* values = reinterpret_cast<V*>(owned_ + header->values_offset);
+    const uint64 dim = header->value_dim;
+    const uint64 capacity = header->capacity;
+
+    gtl::InlinedVector<V, 16> carry(dim);
+    gtl::InlinedVector<V, 16> swap_buf(dim);
+    std::memcpy(carry.data(), value, dim * sizeof(V));
+    uint64 slot = Home(key);
+    for (uint32 dist = 1; dist <= kFrozenTableMaxProbe; ++dist) {
+      if (probe[slot] == 0) {
+        probe[slot] = static_cast<uint8>(dist);
+        keys[slot] = key;
+        std::memcpy(values + slot * dim, carry.data(), dim * sizeof(V));
+        ++header->size;
+        return true;
+      }
+      if (keys[slot] == key) {
+        std::memcpy(values + slot * dim, carry.data(), dim * sizeof(V));
+        return true;
+      }
+      if (probe[slot] < dist) {
+        // Steal the slot from the richer resident and keep placing it.
+        std::swap(keys[slot], key);
+        std::memcpy(swap_buf.data(), values + slot * dim, dim * sizeof(V));
+        std::memcpy(values + slot * dim, carry.data(), dim * sizeof(V));
+        carry.swap(swap_buf);
+        const uint32 resident_dist = probe[slot];
+        probe[slot] = static_cast<uint8>(dist);
+        dist = resident_dist;
+      }
+      if (++slot == capacity) slot = 0;
+    }
+    return false;
+  }
+
+  char* owned_ = nullptr;
+  std::unique_ptr<ReadOnlyMemoryRegion> region_;
+  const char* base_ = nullptr;
+  const FrozenTableHeader* header_ = nullptr;
+  const uint8* probe_ = nullptr;
+  const K* keys_ = nullptr;
+  const V* values_ = nullptr;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(FrozenTable);
+};
+
+}  // namespace cpu
+}  // namespace lookup
+}  // namespace recommenders_addons
+}  // namespace tensorflow
+
+#endif  // TFRA_CORE_KERNELS_LOOKUP_TABLE_OP_CPU_FROZEN_H_
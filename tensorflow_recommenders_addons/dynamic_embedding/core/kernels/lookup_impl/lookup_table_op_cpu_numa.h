@@ -0,0 +1,501 @@
+/* Copyright 2021 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TFRA_CORE_KERNELS_LOOKUP_TABLE_OP_CPU_NUMA_H_
+#define TFRA_CORE_KERNELS_LOOKUP_TABLE_OP_CPU_NUMA_H_
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "tensorflow/core/lib/core/blocking_counter.h"
+#include "tensorflow/core/lib/core/threadpool.h"
+#include "tensorflow/core/platform/cpu_info.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/numa.h"
+#include "tensorflow/core/profiler/lib/traceme.h"
+#include "tensorflow/core/profiler/lib/traceme_encode.h"
+#include "tensorflow/core/util/env_var.h"
+#include "tensorflow_recommenders_addons/dynamic_embedding/core/kernels/lookup_impl/lookup_table_op_cpu.h"
+
+namespace tensorflow {
+namespace recommenders_addons {
+namespace lookup {
+namespace cpu {
+
+// Returns the number of partitions requested by
+// TFRA_HASHTABLE_NUMA_PARTITIONS: 0 (default) disables partitioning, a
+// negative value creates one partition per NUMA node and a positive value
+// forces that many partitions, assigned to the NUMA nodes round-robin.
+inline int NumaPartitionsFromEnv() {
+  int64 num_partitions = 0;
+  Status status = ReadInt64FromEnvVar("TFRA_HASHTABLE_NUMA_PARTITIONS", 0,
+                                      &num_partitions);
+  if (!status.ok()) {
+    LOG(ERROR) << "Error parsing TFRA_HASHTABLE_NUMA_PARTITIONS: " << status;
+    return 0;
+  }
+  if (num_partitions < 0) {
+    return port::NUMAEnabled() ? port::NUMANumNodes() : 1;
+  }
+  return static_cast<int>(num_partitions);
+}
+
+// Returns the thread pool pinned to NUMA node `node`, created on first use
+// and shared by the partitions of all the tables for the life of the process,
+// so that the number of threads does not grow with the number of tables.
+// Without NUMA support there is a single unpinned pool.
+inline thread::ThreadPool* NumaNodePool(int node) {
+  static mutex* mu = new mutex;
+  static auto* pools = new std::vector<std::unique_ptr<thread::ThreadPool>>(
+      port::NUMAEnabled() ? port::NUMANumNodes() : 1);
+  mutex_lock l(*mu);
+  std::unique_ptr<thread::ThreadPool>& pool = (*pools)[node];
+  if (pool == nullptr) {
+    ThreadOptions options;
+    if (port::NUMAEnabled()) options.numa_node = node;
+    const int num_threads = std::max(
+        1, port::MaxParallelism() / static_cast<int>(pools->size()));
+    pool.reset(new thread::ThreadPool(
+        Env::Default(), options, "tfra_numa_node_" + std::to_string(node),
+        num_threads, /*low_latency_hint=*/true));
+  }
+  return pool.get();
+}
+
+// A table made of one sub-table per partition. Keys are assigned to
+// partitions by hash. Each partition runs on the pool of its NUMA node, see
+// NumaNodePool, the sub-table is created there so its buckets are first
+// touched by local memory, and batched operations are split by owning
+// partition and run on the local pool. Without NUMA support all partitions
+// share one unpinned pool, which keeps the mode usable (and testable) on
+// single-node machines.
+//
+// Exports and saves read a snapshot of each partition in turn, so every
+// partition is consistent but they are not all taken at the same moment.
+template <class K, class V>
+class TableWrapperNuma final : public TableWrapperBase<K, V> {
+ public:
+  TableWrapperNuma(size_t init_size, size_t runtime_dim, int num_partitions)
+      : num_partitions_(std::max(1, num_partitions)) {
+    const int num_nodes = port::NUMAEnabled() ? port::NUMANumNodes() : 1;
+    const size_t part_init_size =
+        std::max<size_t>(1, init_size / num_partitions_);
+
+    parts_.resize(num_partitions_, nullptr);
+    BlockingCounter counter(num_partitions_);
+    for (int p = 0; p < num_partitions_; ++p) {
+      pools_.push_back(NumaNodePool(p % num_nodes));
+      pools_[p]->Schedule([this, p, part_init_size, runtime_dim, &counter]() {
+        CreateTable(part_init_size, runtime_dim, &parts_[p]);
+        counter.DecrementCount();
+      });
+    }
+    counter.Wait();
+    LOG(INFO) << "HashTable on CPU is partitioned into " << num_partitions_
+              << " parts over " << num_nodes << " NUMA node(s), "
+              << pools_[0]->NumThreads() << " threads per node.";
+  }
+
+  ~TableWrapperNuma() override {
+    for (auto* part : parts_) delete part;
+  }
+
+  int num_partitions() const { return num_partitions_; }
+
+  // Calls fn(sub_table, i) for every i in [0, total), each on a thread local
+  // to the partition owning keys[i]. Blocks until all calls are done.
+  template <typename Fn>
+  void Run(const K* keys, int64 total, const Fn& fn) {
+    RunShards(keys, total,
+              [&fn](TableWrapperBase<K, V>* part, const int64* indices,
+                    int64 count) {
+                for (int64 j = 0; j < count; ++j) fn(part, indices[j]);
+              });
+  }
+
+  // As Run, but calls fn(sub_table, indices, count) once per shard of the
+  // keys of a partition, for state better kept per shard than per key.
+  // Every shard is scheduled on the pool of its node and only the caller
+  // waits, so the pools shared by all the tables never block on themselves.
+  template <typename Fn>
+  void RunShards(const K* keys, int64 total, const Fn& fn) {
+    std::vector<std::vector<int64>> indices(num_partitions_);
+    {
+      profiler::TraceMe trace([&] {
+        return profiler::TraceMeEncode("NumaPartitionKeys", {{"keys", total}});
+      });
+      for (auto& v : indices) v.reserve(total / num_partitions_ + 1);
+      for (int64 i = 0; i < total; ++i) {
+        indices[Partition(keys[i])].push_back(i);
+      }
+    }
+    std::vector<int64> shard_keys(num_partitions_);
+    int64 num_shards = 0;
+    for (int p = 0; p < num_partitions_; ++p) {
+      const int64 count = indices[p].size();
+      const int64 shards = std::min<int64>(
+          pools_[p]->NumThreads(),
+          (count + kMinShardKeys - 1) / kMinShardKeys);
+      if (shards == 0) continue;
+      shard_keys[p] = (count + shards - 1) / shards;
+      num_shards += (count + shard_keys[p] - 1) / shard_keys[p];
+    }
+    BlockingCounter counter(num_shards);
+    for (int p = 0; p < num_partitions_; ++p) {
+      const int64 count = indices[p].size();
+      for (int64 begin = 0; begin < count; begin += shard_keys[p]) {
+        const int64 end = std::min(count, begin + shard_keys[p]);
+        pools_[p]->Schedule([this, p, begin, end, &indices, &fn, &counter]() {
+          profiler::TraceMe trace(
+              [&] {
+                return profiler::TraceMeEncode(
+                    "NumaPartitionRun",
+                    {{"partition", p}, {"keys", end - begin}});
+              },
+              profiler::TraceMeLevel::kInfo);
+          fn(parts_[p], indices[p].data() + begin, end - begin);
+          counter.DecrementCount();
+        });
+      }
+    }
+    counter.Wait();
+  }
+
+  bool insert_or_assign(K key, ConstTensor2D<V>& value_flat, int64 value_dim,
+                        int64 index) override {
+    return parts_[Partition(key)]->insert_or_assign(key, value_flat, value_dim,
+                                                    index);
+  }
+
+  bool insert_or_accum(K key, ConstTensor2D<V>& value_or_delta_flat, bool exist,
+                       int64 value_dim, int64 index) override {
+    return parts_[Partition(key)]->insert_or_accum(key, value_or_delta_flat,
+                                                   exist, value_dim, index);
+  }
+
+  void find(const K& key, Tensor2D<V>& value_flat,
+            ConstTensor2D<V>& default_flat, int64 value_dim,
+            bool is_full_size_default, int64 index) const override {
+    parts_[Partition(key)]->find(key, value_flat, default_flat, value_dim,
+                                 is_full_size_default, index);
+  }
+
+  void find(const K& key, Tensor2D<V>& value_flat,
+            ConstTensor2D<V>& default_flat, bool& exist, int64 value_dim,
+            bool is_full_size_default, int64 index) const override {
+    parts_[Partition(key)]->find(key, value_flat, default_flat, exist,
+                                 value_dim, is_full_size_default, index);
+  }
+
+  size_t size() const override {
+    size_t size = 0;
+    for (auto* part : parts_) size += part->size();
+    return size;
+  }
+
+  int64 allocated_bytes() const override {
+    int64 bytes = 0;
+    for (auto* part : parts_) bytes += part->allocated_bytes();
+    return bytes;
+  }
+
+  int64 heap_bytes() const override {
+    int64 bytes = 0;
+    for (auto* part : parts_) bytes += part->heap_bytes();
+    return bytes;
+  }
+
+  size_t rehash_pending(size_t max_stripes) override {
+    size_t pending = 0;
+    for (auto* part : parts_) pending += part->rehash_pending(max_stripes);
+    return pending;
+  }
+
+  double rehash_progress() const override {
+    double progress = 1.0;
+    for (auto* part : parts_) {
+      progress = std::min(progress, part->rehash_progress());
+    }
+    return progress;
+  }
+
+  void statistics(bool per_lock, TableStatistics* stats) const override {
+    for (auto* part : parts_) part->statistics(per_lock, stats);
+  }
+
+  size_t capacity() const override {
+    size_t capacity = 0;
+    for (auto* part : parts_) capacity += part->capacity();
+    return capacity;
+  }
+
+  bool shrink_to_fit(size_t min_size, double max_load_factor) override {
+    // Rehash on the local pools, so the new buckets stay on their node.
+    const size_t part_min_size =
+        std::max<size_t>(1, min_size / num_partitions_);
+    std::vector<char> shrunk(num_partitions_, 0);
+    BlockingCounter counter(num_partitions_);
+    for (int p = 0; p < num_partitions_; ++p) {
+      pools_[p]->Schedule([this, p, part_min_size, max_load_factor, &shrunk,
+                           &counter]() {
+        shrunk[p] = parts_[p]->shrink_to_fit(part_min_size, max_load_factor);
+        counter.DecrementCount();
+      });
+    }
+    counter.Wait();
+    return std::find(shrunk.begin(), shrunk.end(), 1) != shrunk.end();
+  }
+
+  void clear() override {
+    for (auto* part : parts_) part->clear();
+  }
+
+  bool erase(const K& key) override {
+    return parts_[Partition(key)]->erase(key);
+  }
+
+  bool contains(const K& key) const override {
+    return parts_[Partition(key)]->contains(key);
+  }
+
+  int64 sample(int64 n, int64 max_probes, uint64 seed,
+               const std::function<void(const K&, const V*)>& fn)
+      const override {
+    // Spread the samples over the parts in proportion to their sizes, so the
+    // entries stay equally likely whatever part they live in.
+    std::vector<double> sizes(num_partitions_);
+    for (int p = 0; p < num_partitions_; ++p) sizes[p] = parts_[p]->size();
+    if (std::all_of(sizes.begin(), sizes.end(),
+                    [](double size) { return size == 0; })) {
+      return 0;
+    }
+    std::mt19937_64 rng(seed);
+    std::discrete_distribution<int> pick(sizes.begin(), sizes.end());
+    std::vector<int64> part_n(num_partitions_, 0);
+    for (int64 i = 0; i < n; ++i) ++part_n[pick(rng)];
+    int64 sampled = 0;
+    for (int p = 0; p < num_partitions_; ++p) {
+      if (part_n[p] == 0) continue;
+      sampled += parts_[p]->sample(part_n[p], max_probes * part_n[p] / n + 1,
+                                   rng(), fn);
+    }
+    return sampled;
+  }
+
+  Status export_values_to_tensors(OpKernelContext* ctx, int64 value_dim,
+                                  Tensor* keys, Tensor* values) override {
+    std::vector<Tensor> part_keys(num_partitions_);
+    std::vector<Tensor> part_values(num_partitions_);
+    int64 size = 0;
+    for (int p = 0; p < num_partitions_; ++p) {
+      TF_RETURN_IF_ERROR(parts_[p]->export_values_to_tensors(
+          ctx, value_dim, &part_keys[p], &part_values[p]));
+      size += part_keys[p].NumElements();
+    }
+    TF_RETURN_IF_ERROR(
+        ctx->allocate_temp(DataTypeToEnum<K>::v(), TensorShape({size}), keys));
+    TF_RETURN_IF_ERROR(ctx->allocate_temp(
+        DataTypeToEnum<V>::v(), TensorShape({size, value_dim}), values));
+    auto keys_data = keys->flat<K>();
+    auto values_data = values->matrix<V>();
+    int64 offset = 0;
+    for (int p = 0; p < num_partitions_; ++p) {
+      const auto part_keys_data = part_keys[p].flat<K>();
+      const auto part_values_data = part_values[p].matrix<V>();
+      for (int64 i = 0; i < part_keys_data.size(); ++i, ++offset) {
+        keys_data(offset) = part_keys_data(i);
+        for (int64 j = 0; j < value_dim; ++j) {
+          values_data(offset, j) = part_values_data(i, j);
+        }
+      }
+    }
+    return Status::OK();
+  }
+
+  Status save_to_hdfs(OpKernelContext* ctx, int64 value_dim,
+                      const string& filepath, const size_t buffer_size,
+                      SnapshotCodec codec) override {
+    TF_RETURN_IF_ERROR(CheckFixedSizeTypes());
+    HadoopFileSystem hdfs;
+    std::unique_ptr<WritableFile> writer;
+    const string tmp_file = filepath + ".tmp";
+    TF_RETURN_IF_ERROR(hdfs.NewWritableFile(tmp_file, &writer));
+
+    const size_t value_len = sizeof(V) * value_dim;
+    if (codec != SnapshotCodec::kNone) {
+      auto* pool = ctx->device()->tensorflow_cpu_worker_threads()->workers;
+      TF_RETURN_IF_ERROR(WriteCompressedSnapshot<K>(
+          writer.get(), codec, value_len, pool, [&](auto* compressed) {
+            for (int p = 0; p < num_partitions_; ++p) {
+              Tensor keys;
+              Tensor values;
+              TF_RETURN_IF_ERROR(parts_[p]->export_values_to_tensors(
+                  ctx, value_dim, &keys, &values));
+              const K* keys_data = reinterpret_cast<const K*>(keys.data());
+              const char* values_data = values.tensor_data().data();
+              for (int64 i = 0; i < keys.NumElements(); ++i) {
+                TF_RETURN_IF_ERROR(
+                    compressed->Add(keys_data[i], values_data + i * value_len));
+              }
+            }
+            return Status::OK();
+          }));
+      TF_RETURN_IF_ERROR(writer->Close());
+      return hdfs.RenameFile(tmp_file, filepath);
+    }
+
+    const size_t record_len = sizeof(K) + value_len;
+    std::vector<char> content;
+    content.reserve(buffer_size + record_len);
+    for (int p = 0; p < num_partitions_; ++p) {
+      Tensor keys;
+      Tensor values;
+      TF_RETURN_IF_ERROR(
+          parts_[p]->export_values_to_tensors(ctx, value_dim, &keys, &values));
+      const char* keys_data = keys.tensor_data().data();
+      const char* values_data = values.tensor_data().data();
+      for (int64 i = 0; i < keys.NumElements(); ++i) {
+        content.insert(content.end(), keys_data + i * sizeof(K),
+                       keys_data + (i + 1) * sizeof(K));
+        content.insert(content.end(), values_data + i * value_len,
+                       values_data + (i + 1) * value_len);
+        if (content.size() > buffer_size) {
+          TF_RETURN_IF_ERROR(
+              writer->Append(StringPiece(content.data(), content.size())));
+          content.clear();
+        }
+      }
+    }
+    if (!content.empty()) {
+      TF_RETURN_IF_ERROR(
+          writer->Append(StringPiece(content.data(), content.size())));
+    }
+    TF_RETURN_IF_ERROR(writer->Close());
+    return hdfs.RenameFile(tmp_file, filepath);
+  }
+
+  Status load_from_hdfs(OpKernelContext* ctx, int64 value_dim,
+                        const string& filepath,
+                        const size_t buffer_size) override {
+    TF_RETURN_IF_ERROR(CheckFixedSizeTypes());
+    HadoopFileSystem hdfs;
+    std::unique_ptr<RandomAccessFile> file;
+    TF_RETURN_IF_ERROR(hdfs.NewRandomAccessFile(filepath, &file));
+
+    uint64 file_size = 0;
+    TF_RETURN_IF_ERROR(hdfs.GetFileSize(filepath, &file_size));
+    bool compressed = false;
+    TF_RETURN_IF_ERROR(IsCompressedSnapshot(file.get(), &compressed));
+    if (compressed) {
+      auto* pool = ctx->device()->tensorflow_cpu_worker_threads()->workers;
+      return ReadCompressedSnapshot<K>(
+          file.get(), file_size, sizeof(V) * value_dim, pool,
+          [&](const K* keys, const char* values, int64 n) {
+            Tensor block;
+            TF_RETURN_IF_ERROR(ctx->allocate_temp(
+                DataTypeToEnum<V>::v(), TensorShape({n, value_dim}), &block));
+            std::memcpy(block.data(), values, n * sizeof(V) * value_dim);
+            const Tensor& const_block = block;
+            ConstTensor2D<V> values_flat = const_block.flat_inner_dims<V, 2>();
+            Run(keys, n, [&](TableWrapperBase<K, V>* part, int64 i) {
+              part->insert_or_assign(keys[i], values_flat, value_dim, i);
+            });
+            return Status::OK();
+          });
+    }
+    std::unique_ptr<io::RandomAccessInputStream> input_stream(
+        new io::RandomAccessInputStream(file.get()));
+    io::BufferedInputStream reader(input_stream.get(), buffer_size);
+
+    const size_t value_len = sizeof(V) * value_dim;
+    const size_t record_len = sizeof(K) + value_len;
+    if (file_size % record_len != 0) {
+      return errors::DataLoss("File ", filepath, " of ", file_size,
+                              " bytes is not a sequence of ", record_len,
+                              " bytes records.");
+    }
+    const int64 batch =
+        std::max<int64>(1, static_cast<int64>(buffer_size / record_len));
+    Tensor keys;
+    Tensor values;
+    TF_RETURN_IF_ERROR(ctx->allocate_temp(DataTypeToEnum<K>::v(),
+                                          TensorShape({batch}), &keys));
+    TF_RETURN_IF_ERROR(ctx->allocate_temp(
+        DataTypeToEnum<V>::v(), TensorShape({batch, value_dim}), &values));
+    K* keys_data = reinterpret_cast<K*>(keys.data());
+    char* values_data = reinterpret_cast<char*>(values.data());
+    const Tensor& const_values = values;
+    ConstTensor2D<V> values_flat = const_values.flat_inner_dims<V, 2>();
+
+    tstring content;
+    uint64 pos = 0;
+    while (pos < file_size) {
+      int64 n = 0;
+      for (; n < batch && pos < file_size; ++n, pos += record_len) {
+        TF_RETURN_IF_ERROR(reader.ReadNBytes(record_len, &content));
+        std::memcpy(&keys_data[n], content.data(), sizeof(K));
+        std::memcpy(values_data + n * value_len, content.data() + sizeof(K),
+                    value_len);
+      }
+      Run(keys_data, n,
+          [&](TableWrapperBase<K, V>* part, int64 i) {
+            part->insert_or_assign(keys_data[i], values_flat, value_dim, i);
+          });
+    }
+    return Status::OK();
+  }
+
+ private:
+  inline int Partition(const K& key) const {
+    // Sub-tables index buckets with the low bits of HybridHash, so partition
+    // on a remixed copy to keep every sub-table's buckets evenly used.
+    const uint64 h = static_cast<uint64>(HybridHash<K>{}(key));
+    return static_cast<int>(((h * UINT64_C(0x9e3779b97f4a7c15)) >> 32) %
+                            num_partitions_);
+  }
+
+  static Status CheckFixedSizeTypes() {
+    if (std::is_same<K, tstring>::value || std::is_same<V, tstring>::value) {
+      return errors::Unimplemented(
+          "save_to_hdfs and load_from_hdfs only support fixed size types.");
+    }
+    return Status::OK();
+  }
+
+  // Keys below which a partition is not split over more threads.
+  static constexpr int64 kMinShardKeys = 1024;
+
+  const int num_partitions_;
+  std::vector<TableWrapperBase<K, V>*> parts_;
+  // The pool of the node of every partition, see NumaNodePool.
+  std::vector<thread::ThreadPool*> pools_;
+};
+
+template <class K, class V>
+inline TableWrapperNuma<K, V>* AsNumaTable(TableWrapperBase<K, V>* table) {
+  return dynamic_cast<TableWrapperNuma<K, V>*>(table);
+}
+
+}  // namespace cpu
+}  // namespace lookup
+}  // namespace recommenders_addons
+}  // namespace tensorflow
+
+#endif  // TFRA_CORE_KERNELS_LOOKUP_TABLE_OP_CPU_NUMA_H_
@@ -0,0 +1,239 @@
+/* Copyright 2021 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TFRA_CORE_KERNELS_LOOKUP_TABLE_OP_CPU_RESHARD_H_
+#define TFRA_CORE_KERNELS_LOOKUP_TABLE_OP_CPU_RESHARD_H_
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/core/threadpool.h"
+#include "tensorflow/core/lib/io/buffered_inputstream.h"
+#include "tensorflow/core/lib/io/random_inputstream.h"
+#include "tensorflow/core/lib/strings/stringprintf.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/util/work_sharder.h"
+#include "tensorflow_recommenders_addons/dynamic_embedding/core/kernels/lookup_impl/lookup_table_op_cpu_compressed.h"
+
+namespace tensorflow {
+namespace recommenders_addons {
+namespace lookup {
+namespace cpu {
+
+// How keys are assigned to shards, matching the branches of
+// `dynamic_embedding.default_partition_fn` for integer keys.
+enum class ReshardPartition {
+  // keys mod num_shards, as a floor mod.
+  kMod,
+  // (keys & 0x7fffffff) mod num_shards, used for int64 keys on GPU builds.
+  kModInt32,
+};
+
+inline Status ParseReshardPartition(const string& name,
+                                    ReshardPartition* partition) {
+  if (name == "mod") {
+    *partition = ReshardPartition::kMod;
+  } else if (name == "mod_int32") {
+    *partition = ReshardPartition::kModInt32;
+  } else {
+    return errors::InvalidArgument("Unknown partition ", name,
+                                   ", expected mod or mod_int32.");
+  }
+  return Status::OK();
+}
+
+inline string ReshardOutputFile(const string& prefix, int shard,
+                                int num_shards) {
+  return strings::Printf("%s-%05d-of-%05d", prefix.c_str(), shard,
+                         num_shards);
+}
+
+namespace internal {
+
+// One output shard, appended to by all the threads reading inputs.
+template <class K>
+struct ReshardOutput {
+  mutex mu;
+  std::unique_ptr<WritableFile> file;
+  std::unique_ptr<CompressedSnapshotWriter<K>> compressed;
+  uint64 count = 0;
+};
+
+}  // namespace internal
+
+// Streams the records of `inputs`, each a file written by save_to_hdfs with
+// or without compression, into num_shards files named by ReshardOutputFile
+// and partitioned by `partition`. Inputs are read in parallel on `pool`, each
+// through a buffer of buffer_size bytes, and every reading thread keeps at
+// most about buffer_size bytes of records for the outputs, so memory does not
+// grow with the size of the table. counts[m] receives the number of records
+// written to shard m.
+template <class K>
+typename std::enable_if<std::is_integral<K>::value, Status>::type
+ReshardFiles(const std::vector<string>& inputs, const string& output_prefix,
+             int num_shards, ReshardPartition partition, size_t value_bytes,
+             SnapshotCodec codec, size_t buffer_size, thread::ThreadPool* pool,
+             std::vector<uint64>* counts) {
+  Env* env = Env::Default();
+  const size_t record_len = sizeof(K) + value_bytes;
+  const size_t flush_bytes =
+      std::max(record_len, buffer_size / num_shards / record_len * record_len);
+
+  std::vector<internal::ReshardOutput<K>> outputs(num_shards);
+  for (int m = 0; m < num_shards; ++m) {
+    auto& output = outputs[m];
+    const string tmp_file =
+        ReshardOutputFile(output_prefix, m, num_shards) + ".tmp";
+    TF_RETURN_IF_ERROR(env->NewWritableFile(tmp_file, &output.file));
+    if (codec != SnapshotCodec::kNone) {
+      // Full blocks are compressed by the thread filling them, so outputs
+      // compress in parallel without nesting work on the pool.
+      output.compressed.reset(new CompressedSnapshotWriter<K>(
+          output.file.get(), codec, value_bytes, /*pool=*/nullptr));
+      TF_RETURN_IF_ERROR(output.compressed->WriteHeader());
+    }
+  }
+
+  auto shard_of = [num_shards, partition](K key) -> int {
+    int64 k = static_cast<int64>(key);
+    if (partition == ReshardPartition::kModInt32) k &= 0x7fffffff;
+    int64 m = k % num_shards;
+    return static_cast<int>(m < 0 ? m + num_shards : m);
+  };
+
+  auto flush = [&outputs, record_len](int m, string* buffer) -> Status {
+    if (buffer->empty()) return Status::OK();
+    auto& output = outputs[m];
+    mutex_lock l(output.mu);
+    const uint64 n = buffer->size() / record_len;
+    if (output.compressed == nullptr) {
+      TF_RETURN_IF_ERROR(output.file->Append(*buffer));
+    } else {
+      const char* p = buffer->data();
+      for (uint64 i = 0; i < n; ++i, p += record_len) {
+        K key;
+        std::memcpy(&key, p, sizeof(K));
+        TF_RETURN_IF_ERROR(output.compressed->Add(key, p + sizeof(K)));
+      }
+    }
+    output.count += n;
+    buffer->clear();
+    return Status::OK();
+  };
+
+  auto reshard_input = [&](const string& filepath) -> Status {
+    std::vector<string> buffers(num_shards);
+    auto route = [&](const K& key, const char* value) -> Status {
+      const int m = shard_of(key);
+      string& buffer = buffers[m];
+      buffer.append(reinterpret_cast<const char*>(&key), sizeof(K));
+      buffer.append(value, value_bytes);
+      if (buffer.size() >= flush_bytes) return flush(m, &buffer);
+      return Status::OK();
+    };
+
+    std::unique_ptr<RandomAccessFile> file;
+    TF_RETURN_IF_ERROR(env->NewRandomAccessFile(filepath, &file));
+    bool compressed = false;
+    TF_RETURN_IF_ERROR(IsCompressedSnapshot(file.get(), &compressed));
+    uint64 file_size = 0;
+    TF_RETURN_IF_ERROR(env->GetFileSize(filepath, &file_size));
+    if (compressed) {
+      TF_RETURN_IF_ERROR(ReadCompressedSnapshot<K>(
+          file.get(), file_size, value_bytes, /*pool=*/nullptr,
+          [&](const K* keys, const char* values, int64 n) {
+            for (int64 i = 0; i < n; ++i) {
+              TF_RETURN_IF_ERROR(route(keys[i], values + i * value_bytes));
+            }
+            return Status::OK();
+          }));
+    } else {
+      if (file_size % record_len != 0) {
+        return errors::DataLoss("File ", filepath, " of ", file_size,
+                                " bytes is not a sequence of ", record_len,
+                                " bytes records.");
+      }
+      io::RandomAccessInputStream input_stream(file.get());
+      io::BufferedInputStream reader(&input_stream, buffer_size);
+      const uint64 chunk_records =
+          std::max<uint64>(1, buffer_size / record_len);
+      tstring content;
+      for (uint64 pos = 0; pos < file_size;) {
+        const uint64 n =
+            std::min<uint64>(chunk_records, (file_size - pos) / record_len);
+        TF_RETURN_IF_ERROR(reader.ReadNBytes(n * record_len, &content));
+        const char* p = content.data();
+        for (uint64 i = 0; i < n; ++i, p += record_len) {
+          K key;
+          std::memcpy(&key, p, sizeof(K));
+          TF_RETURN_IF_ERROR(route(key, p + sizeof(K)));
+        }
+        pos += n * record_len;
+      }
+    }
+    for (int m = 0; m < num_shards; ++m) {
+      TF_RETURN_IF_ERROR(flush(m, &buffers[m]));
+    }
+    return Status::OK();
+  };
+
+  std::vector<Status> statuses(inputs.size());
+  auto shard = [&](int64 begin, int64 end) {
+    for (int64 i = begin; i < end; ++i) {
+      statuses[i] = reshard_input(inputs[i]);
+    }
+  };
+  // Each input is a unit of work of its own.
+  Shard(pool->NumThreads(), pool, static_cast<int64>(inputs.size()),
+        /*cost_per_unit=*/1 << 30, shard);
+  for (const Status& status : statuses) {
+    TF_RETURN_IF_ERROR(status);
+  }
+
+  counts->resize(num_shards);
+  for (int m = 0; m < num_shards; ++m) {
+    auto& output = outputs[m];
+    if (output.compressed != nullptr) {
+      TF_RETURN_IF_ERROR(output.compressed->Finish());
+    }
+    TF_RETURN_IF_ERROR(output.file->Close());
+    const string filepath = ReshardOutputFile(output_prefix, m, num_shards);
+    TF_RETURN_IF_ERROR(env->RenameFile(filepath + ".tmp", filepath));
+    (*counts)[m] = output.count;
+  }
+  return Status::OK();
+}
+
+template <class K>
+typename std::enable_if<!std::is_integral<K>::value, Status>::type
+ReshardFiles(const std::vector<string>& inputs, const string& output_prefix,
+             int num_shards, ReshardPartition partition, size_t value_bytes,
+             SnapshotCodec codec, size_t buffer_size, thread::ThreadPool* pool,
+             std::vector<uint64>* counts) {
+  return errors::Unimplemented("Resharding only supports integer keys.");
+}
+
+}  // namespace cpu
+}  // namespace lookup
+}  // namespace recommenders_addons
+}  // namespace tensorflow
+
+#endif  // TFRA_CORE_KERNELS_LOOKUP_TABLE_OP_CPU_RESHARD_H_
@@ -0,0 +1,791 @@
+/* Copyright 2021 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#pragma once
+#include <hiredis/async.h>
+#include <hiredis/hiredis.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "redis_connection_util.hpp"
+#include "tensorflow/core/platform/env.h"
+
+namespace tensorflow {
+namespace recommenders_addons {
+namespace redis_connection {
+
+const static unsigned kRedisClusterSlots = 16384;
+
+// CRC16-CCITT (XMODEM), which Redis Cluster hashes keys with.
+inline uint16_t RedisCrc16(const char *buf, std::size_t len) {
+  uint16_t crc = 0;
+  for (std::size_t i = 0; i < len; ++i) {
+    crc ^= static_cast<uint16_t>(static_cast<unsigned char>(buf[i])) << 8;
+    for (int j = 0; j < 8; ++j) {
+      crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021)
+                           : static_cast<uint16_t>(crc << 1);
+    }
+  }
+  return crc;
+}
+
+// The cluster slot of a key, hashing only its hash tag when it has one.
+inline unsigned RedisHashSlot(const char *key, std::size_t len) {
+  const char *open = static_cast<const char *>(memchr(key, '{', len));
+  if (open != nullptr) {
+    const std::size_t rest = len - (open - key) - 1;
+    const char *close = static_cast<const char *>(memchr(open + 1, '}', rest));
+    if (close != nullptr && close != open + 1) {
+      return RedisCrc16(open + 1, close - open - 1) & (kRedisClusterSlots - 1);
+    }
+  }
+  return RedisCrc16(key, len) & (kRedisClusterSlots - 1);
+}
+
+// A blocking connection, authenticated when password is set.
+inline redisContext *RedisConnectBlocking(
+    const std::string &host, const int port, const std::string &user,
+    const std::string &password, const struct timeval &connect_timeout,
+    const struct timeval &command_timeout) {
+  redisContext *c =
+      redisConnectWithTimeout(host.c_str(), port, connect_timeout);
+  if (c == nullptr || c->err) {
+    LOG(WARNING) << "Can not connect to " << host << ":" << port << " -- "
+                 << (c == nullptr ? "out of memory" : c->errstr);
+    if (c != nullptr) redisFree(c);
+    return nullptr;
+  }
+  redisSetTimeout(c, command_timeout);
+  if (!password.empty()) {
+    std::unique_ptr<redisReply, ::sw::redis::ReplyDeleter> reply(
+        static_cast<redisReply *>(redisCommand(
+            c, "AUTH %s %s", user.c_str(), password.c_str())));
+    if (reply == nullptr || reply->type == REDIS_REPLY_ERROR) {
+      LOG(WARNING) << "Can not authenticate to " << host << ":" << port;
+      redisFree(c);
+      return nullptr;
+    }
+  }
+  return c;
+}
+
+// Reads the slot map of the Redis Cluster from the first host of params
+// which answers: the address of each master into masters, and for each slot
+// the index in masters of the master serving it into slot_masters.
+inline Status RedisLoadClusterSlots(
+    const Redis_Connection_Params &params,
+    const struct timeval &connect_timeout,
+    const struct timeval &command_timeout,
+    std::vector<std::pair<std::string, int>> *masters,
+    std::vector<int> *slot_masters) {
+  for (size_t i = 0; i < params.redis_host_ip.size(); ++i) {
+    redisContext *c = RedisConnectBlocking(
+        params.redis_host_ip[i], params.redis_host_port[i], params.redis_user,
+        params.redis_password, connect_timeout, command_timeout);
+    if (c == nullptr) continue;
+    std::unique_ptr<redisReply, ::sw::redis::ReplyDeleter> reply(
+        static_cast<redisReply *>(redisCommand(c, "CLUSTER SLOTS")));
+    redisFree(c);
+    if (reply == nullptr || reply->type != REDIS_REPLY_ARRAY) continue;
+    masters->clear();
+    slot_masters->assign(kRedisClusterSlots, 0);
+    for (size_t j = 0; j < reply->elements; ++j) {
+      const redisReply *range = reply->element[j];
+      if (range->type != REDIS_REPLY_ARRAY || range->elements < 3) continue;
+      const redisReply *master = range->element[2];
+      if (master->type != REDIS_REPLY_ARRAY || master->elements < 2) {
+        continue;
+      }
+      const std::pair<std::string, int> address(
+          std::string(master->element[0]->str, master->element[0]->len),
+          static_cast<int>(master->element[1]->integer));
+      int index = std::find(masters->begin(), masters->end(), address) -
+                  masters->begin();
+      if (index == static_cast<int>(masters->size())) {
+        masters->push_back(address);
+      }
+      for (long long slot = range->element[0]->integer;
+           slot <= range->element[1]->integer; ++slot) {
+        (*slot_masters)[slot] = index;
+      }
+    }
+    if (masters->empty()) continue;
+    return Status::OK();
+  }
+  return errors::Unavailable("Can not read the slots of the Redis Cluster.");
+}
+
+// Converts a timeout of params, in milliseconds, for hiredis.
+inline struct timeval RedisTimeval(const int millis) {
+  struct timeval tv;
+  tv.tv_sec = millis / 1000;
+  tv.tv_usec = (millis % 1000) * 1000;
+  return tv;
+}
+
+/*
+An event-driven Redis client owned by a table. redis_async_client_threads
+threads each run an epoll loop over their own hiredis async connection per
+Redis master, so any number of commands from any number of ops are written
+back to back on each connection and their replies are handed to callbacks as
+they arrive, without a thread waiting on each of them.
+
+A loop also parses the replies of its connections, so the commands of each
+Send are spread over the loops by storage slice: the commands of one storage
+slice go in order through one loop, and the replies of a large op are parsed
+by all the loops at once.
+
+Commands are routed by the hash key in argv[1]: to the only master in
+standalone and sentinel mode, and to the master serving its slot in cluster
+mode. A MOVED or ASK reply is passed to the callback like any other error and
+makes a second thread reload the slot map, which the loops route the next
+commands with once it is there, so that no loop ever blocks on it.
+Reads always go to the masters, regardless of redis_read_access_slave.
+
+The connections parse replies with their own redisReplyObjectFunctions: the
+elements of an array replying to a request with a sink are handed to the sink
+as they come off the socket, and every other reply is built by hiredis as
+usual.
+*/
+class RedisAsyncClient {
+ public:
+  // Receives the reply of a command, or nullptr when the command could not
+  // be sent or its connection was lost, or when its array reply went to the
+  // sink of the request. Runs on a loop thread, so it should only hand the
+  // reply over.
+  typedef std::function<void(
+      std::unique_ptr<redisReply, ::sw::redis::ReplyDeleter>)>
+      Callback;
+
+  struct Request {
+    RedisCommandArgs args;
+    Callback callback;
+    // Must stay valid until callback has run.
+    RedisReplySink *sink = nullptr;
+  };
+
+  explicit RedisAsyncClient(const Redis_Connection_Params &params)
+      : params_(params),
+        connect_timeout_(RedisTimeval(params.redis_connect_timeout)),
+        command_timeout_(RedisTimeval(params.redis_socket_timeout)) {}
+
+  ~RedisAsyncClient() {
+    if (refresher_.joinable()) {
+      {
+        std::lock_guard<std::mutex> lock(slots_mu_);
+        stop_refresher_ = true;
+      }
+      slots_cv_.notify_all();
+      refresher_.join();
+    }
+    loops_.clear();
+  }
+
+  // Finds the masters and starts the loops. The connections are opened by
+  // the loops when they are first used, and again after they are lost.
+  Status Start() {
+    switch (params_.redis_connection_mode) {
+      case ClusterMode: {
+        std::shared_ptr<SlotMap> slots;
+        TF_RETURN_IF_ERROR(LoadSlots(&slots));
+        slots_ = std::move(slots);
+        refresher_ = std::thread([this] { RefreshSlots(); });
+        break;
+      }
+      case SentinelMode:
+        TF_RETURN_IF_ERROR(LoadSentinelMaster());
+        break;
+      default:
+        master_ = std::make_pair(params_.redis_host_ip[0],
+                                 params_.redis_host_port[0]);
+        break;
+    }
+    const unsigned threads = params_.redis_async_client_threads;
+    if (threads == 0 || threads > 256) {
+      return errors::InvalidArgument(
+          "redis_async_client_threads should be between 1 and 256, got ",
+          threads, ".");
+    }
+    for (unsigned i = 0; i < threads; ++i) {
+      loops_.emplace_back(new EventLoop(this));
+      TF_RETURN_IF_ERROR(loops_.back()->Start());
+    }
+    return Status::OK();
+  }
+
+  // Queues requests to the loops, each of which sends its share in order.
+  // The requests of one storage slice are kept in order. The arguments of a
+  // request must stay valid until its callback has run.
+  void Send(std::vector<Request> *requests) {
+    const std::size_t first = next_loop_.fetch_add(1);
+    std::vector<std::vector<Request>> shares(loops_.size());
+    for (auto &request : *requests) {
+      shares[(first + request.args.bucket) % loops_.size()].emplace_back(
+          std::move(request));
+    }
+    requests->clear();
+    for (std::size_t i = 0; i < loops_.size(); ++i) {
+      if (!shares[i].empty()) loops_[i]->Send(&shares[i]);
+    }
+  }
+
+ private:
+  class EventLoop;
+
+  struct Node {
+    EventLoop *loop;
+    std::string host;
+    int port;
+    redisAsyncContext *ac = nullptr;
+    uint32_t events = 0;
+    uint64 deadline_micros = 0;
+    // The sinks of the commands waiting for a reply, in the order they were
+    // sent, and the one receiving the elements of the reply being parsed.
+    std::deque<RedisReplySink *> sinks;
+    RedisReplySink *parsing = nullptr;
+  };
+
+  // The masters of a Redis Cluster, and for each slot the index in masters
+  // of the master serving it.
+  struct SlotMap {
+    std::vector<std::pair<std::string, int>> masters;
+    std::vector<int> slot_masters;
+  };
+
+  // Reads the slot map with blocking connections, so never on a loop.
+  Status LoadSlots(std::shared_ptr<SlotMap> *slots) {
+    std::shared_ptr<SlotMap> loaded = std::make_shared<SlotMap>();
+    TF_RETURN_IF_ERROR(RedisLoadClusterSlots(params_, connect_timeout_,
+                                             command_timeout_,
+                                             &loaded->masters,
+                                             &loaded->slot_masters));
+    *slots = std::move(loaded);
+    return Status::OK();
+  }
+
+  // Runs on refresher_, reloading the slot map each time a MOVED or ASK
+  // reply asks for it.
+  void RefreshSlots() {
+    std::unique_lock<std::mutex> lock(slots_mu_);
+    while (true) {
+      slots_cv_.wait(lock,
+                     [this] { return stop_refresher_ || refresh_slots_; });
+      if (stop_refresher_) return;
+      refresh_slots_ = false;
+      lock.unlock();
+      std::shared_ptr<SlotMap> slots;
+      Status statu = LoadSlots(&slots);
+      if (!statu.ok()) {
+        LOG(WARNING) << "Keep the old Redis Cluster slots -- " << statu;
+      }
+      lock.lock();
+      if (statu.ok()) slots_ = std::move(slots);
+    }
+  }
+
+  void RequestSlotsRefresh() {
+    {
+      std::lock_guard<std::mutex> lock(slots_mu_);
+      refresh_slots_ = true;
+    }
+    slots_cv_.notify_one();
+  }
+
+  std::shared_ptr<const SlotMap> CurrentSlots() {
+    std::lock_guard<std::mutex> lock(slots_mu_);
+    return slots_;
+  }
+
+  Status LoadSentinelMaster() {
+    for (size_t i = 0; i < params_.redis_host_ip.size(); ++i) {
+      redisContext *c = RedisConnectBlocking(
+          params_.redis_host_ip[i], params_.redis_host_port[i],
+          params_.redis_sentinel_user, params_.redis_sentinel_password,
+          connect_timeout_, command_timeout_);
+      if (c == nullptr) continue;
+      std::unique_ptr<redisReply, ::sw::redis::ReplyDeleter> reply(
+          static_cast<redisReply *>(
+              redisCommand(c, "SENTINEL get-master-addr-by-name %s",
+                           params_.redis_master_name.c_str())));
+      redisFree(c);
+      if (reply == nullptr || reply->type != REDIS_REPLY_ARRAY ||
+          reply->elements != 2) {
+        continue;
+      }
+      master_ = std::make_pair(
+          std::string(reply->element[0]->str, reply->element[0]->len),
+          std::stoi(std::string(reply->element[1]->str,
+                                reply->element[1]->len)));
+      return Status::OK();
+    }
+    return errors::Unavailable("Can not find the Redis master ",
+                               params_.redis_master_name,
+                               " from the sentinels.");
+  }
+
+  // The reply functions of hiredis, copied out of a reader before it is
+  // freed.
+  static const redisReplyObjectFunctions *DefaultReplyFunctions() {
+    static const redisReplyObjectFunctions functions = [] {
+      redisReader *reader = redisReaderCreate();
+      const redisReplyObjectFunctions fn = *reader->fn;
+      redisReaderFree(reader);
+      return fn;
+    }();
+    return &functions;
+  }
+
+  // Stands for every object parsed into a sink. hiredis only passes it back
+  // to the reply functions and to OnReply, and only reads its type.
+  static redisReply *SinkReply() {
+    static redisReply *const reply = [] {
+      redisReply *reply = new redisReply();
+      reply->type = REDIS_REPLY_ARRAY;
+      return reply;
+    }();
+    return reply;
+  }
+
+  // Whether task belongs to a reply parsed into a sink. If so, sink is set
+  // to the sink receiving task, which is nullptr unless task is an element
+  // of the top level array.
+  static bool InSink(const redisReadTask *task, RedisReplySink **sink) {
+    if (task->parent == nullptr || task->parent->obj != SinkReply()) {
+      return false;
+    }
+    *sink = task->parent->parent == nullptr
+                ? static_cast<Node *>(task->privdata)->parsing
+                : nullptr;
+    return true;
+  }
+
+  static void *CreateString(const redisReadTask *task, char *str,
+                            size_t len) {
+    RedisReplySink *sink;
+    if (!InSink(task, &sink)) {
+      return DefaultReplyFunctions()->createString(task, str, len);
+    }
+    if (sink != nullptr) {
+      if (task->type == REDIS_REPLY_STRING) {
+        sink->OnString(task->idx, str, len);
+      } else {
+        sink->OnNil(task->idx);
+      }
+    }
+    return SinkReply();
+  }
+
+  static void *CreateArray(const redisReadTask *task, size_t elements) {
+    Node *node = static_cast<Node *>(task->privdata);
+    if (task->parent == nullptr && task->type == REDIS_REPLY_ARRAY &&
+        !node->sinks.empty() && node->sinks.front() != nullptr) {
+      RedisReplySink *sink = node->sinks.front();
+      node->parsing = sink->OnArray(elements) ? sink : nullptr;
+      return SinkReply();
+    }
+    RedisReplySink *sink;
+    if (!InSink(task, &sink)) {
+      return DefaultReplyFunctions()->createArray(task, elements);
+    }
+    if (sink != nullptr) sink->OnNil(task->idx);
+    return SinkReply();
+  }
+
+  static void *CreateInteger(const redisReadTask *task, long long value) {
+    RedisReplySink *sink;
+    if (!InSink(task, &sink)) {
+      return DefaultReplyFunctions()->createInteger(task, value);
+    }
+    if (sink != nullptr) sink->OnNil(task->idx);
+    return SinkReply();
+  }
+
+  static void *CreateDouble(const redisReadTask *task, double value, char *str,
+                            size_t len) {
+    RedisReplySink *sink;
+    if (!InSink(task, &sink)) {
+      return DefaultReplyFunctions()->createDouble(task, value, str, len);
+    }
+    if (sink != nullptr) sink->OnNil(task->idx);
+    return SinkReply();
+  }
+
+  static void *CreateNil(const redisReadTask *task) {
+    RedisReplySink *sink;
+    if (!InSink(task, &sink)) {
+      return DefaultReplyFunctions()->createNil(task);
+    }
+    if (sink != nullptr) sink->OnNil(task->idx);
+    return SinkReply();
+  }
+
+  static void *CreateBool(const redisReadTask *task, int value) {
+    RedisReplySink *sink;
+    if (!InSink(task, &sink)) {
+      return DefaultReplyFunctions()->createBool(task, value);
+    }
+    if (sink != nullptr) sink->OnNil(task->idx);
+    return SinkReply();
+  }
+
+  static void FreeObject(void *reply) {
+    if (reply != SinkReply()) DefaultReplyFunctions()->freeObject(reply);
+  }
+
+  static redisReplyObjectFunctions *ReplyFunctions() {
+    static redisReplyObjectFunctions functions = {
+        CreateString, CreateArray, CreateInteger, CreateDouble,
+        CreateNil,    CreateBool,  FreeObject};
+    return &functions;
+  }
+
+  // One epoll loop thread over its own connection per master.
+  class EventLoop {
+   public:
+    explicit EventLoop(RedisAsyncClient *client) : client_(client) {}
+
+    ~EventLoop() {
+      if (thread_.joinable()) {
+        stop_.store(true);
+        Wake();
+        thread_.join();
+      }
+      for (auto &node : nodes_) {
+        if (node->ac != nullptr) {
+          redisAsyncFree(node->ac);  // Fails the commands still in flight.
+        }
+      }
+      for (auto &request : requests_) {
+        request.callback(nullptr);
+      }
+      if (event_fd_ >= 0) close(event_fd_);
+      if (epoll_fd_ >= 0) close(epoll_fd_);
+    }
+
+    Status Start() {
+      if (client_->params_.redis_connection_mode != ClusterMode) {
+        NodeIndex(client_->master_.first, client_->master_.second);
+      }
+      epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+      event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+      if (epoll_fd_ < 0 || event_fd_ < 0) {
+        return errors::Internal("Can not create the Redis event loop: ",
+                                strerror(errno));
+      }
+      struct epoll_event event = {};
+      event.events = EPOLLIN;
+      event.data.ptr = nullptr;
+      if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, event_fd_, &event) != 0) {
+        return errors::Internal("Can not create the Redis event loop: ",
+                                strerror(errno));
+      }
+      thread_ = std::thread([this] { Loop(); });
+      return Status::OK();
+    }
+
+    void Send(std::vector<Request> *requests) {
+      {
+        std::lock_guard<std::mutex> lock(requests_mu_);
+        for (auto &request : *requests) {
+          requests_.emplace_back(std::move(request));
+        }
+      }
+      requests->clear();
+      Wake();
+    }
+
+   private:
+    int NodeIndex(const std::string &host, const int port) {
+      for (size_t i = 0; i < nodes_.size(); ++i) {
+        if (nodes_[i]->host == host && nodes_[i]->port == port) return i;
+      }
+      nodes_.emplace_back(new Node());
+      nodes_.back()->loop = this;
+      nodes_.back()->host = host;
+      nodes_.back()->port = port;
+      return nodes_.size() - 1;
+    }
+
+    // Points slot_nodes_ at the nodes of the latest slot map, when it
+    // changed since the last call.
+    void RouteSlots() {
+      std::shared_ptr<const SlotMap> slots = client_->CurrentSlots();
+      if (slots == nullptr || slots == routed_slots_) return;
+      std::vector<int> master_nodes;
+      for (const auto &master : slots->masters) {
+        master_nodes.push_back(NodeIndex(master.first, master.second));
+      }
+      slot_nodes_.resize(kRedisClusterSlots);
+      for (unsigned slot = 0; slot < kRedisClusterSlots; ++slot) {
+        slot_nodes_[slot] = master_nodes[slots->slot_masters[slot]];
+      }
+      routed_slots_ = std::move(slots);
+    }
+
+    Node *Route(const RedisCommandArgs &args) {
+      if (slot_nodes_.empty() || args.argc < 2) return nodes_[0].get();
+      return nodes_[slot_nodes_[RedisHashSlot(args.argv[1], args.argvlen[1])]]
+          .get();
+    }
+
+    void Connect(Node *node) {
+      const Redis_Connection_Params &params = client_->params_;
+      redisOptions options = {0};
+      REDIS_OPTIONS_SET_TCP(&options, node->host.c_str(), node->port);
+      options.connect_timeout = &client_->connect_timeout_;
+      options.command_timeout = &client_->command_timeout_;
+      options.options |= REDIS_OPT_NOAUTOFREEREPLIES;
+      redisAsyncContext *ac = redisAsyncConnectWithOptions(&options);
+      if (ac == nullptr || ac->err) {
+        LOG(ERROR) << "Can not connect to " << node->host << ":" << node->port
+                   << " -- " << (ac == nullptr ? "out of memory" : ac->errstr);
+        if (ac != nullptr) redisAsyncFree(ac);
+        return;
+      }
+      if (params.redis_connect_keep_alive) {
+        redisEnableKeepAlive(&ac->c);
+      }
+      ac->data = node;
+      ac->c.reader->fn = ReplyFunctions();
+      ac->c.reader->privdata = node;
+      ac->ev.data = node;
+      ac->ev.addRead = [](void *data) { AddEvents(data, EPOLLIN); };
+      ac->ev.delRead = [](void *data) { DelEvents(data, EPOLLIN); };
+      ac->ev.addWrite = [](void *data) { AddEvents(data, EPOLLOUT); };
+      ac->ev.delWrite = [](void *data) { DelEvents(data, EPOLLOUT); };
+      ac->ev.cleanup = [](void *data) {
+        Node *node = static_cast<Node *>(data);
+        SetEvents(node, 0);
+        node->sinks.clear();
+        node->parsing = nullptr;
+        node->ac = nullptr;
+        node->deadline_micros = 0;
+      };
+      ac->ev.scheduleTimer = [](void *data, struct timeval tv) {
+        static_cast<Node *>(data)->deadline_micros =
+            Env::Default()->NowMicros() + tv.tv_sec * 1000000 + tv.tv_usec;
+      };
+      redisAsyncSetConnectCallback(
+          ac, [](const redisAsyncContext *ac, int status) {
+            if (status != REDIS_OK) {
+              const Node *node = static_cast<const Node *>(ac->data);
+              LOG(ERROR) << "Can not connect to " << node->host << ":"
+                         << node->port << " -- " << ac->errstr;
+            }
+          });
+      redisAsyncSetDisconnectCallback(
+          ac, [](const redisAsyncContext *ac, int status) {
+            if (status != REDIS_OK) {
+              const Node *node = static_cast<const Node *>(ac->data);
+              LOG(WARNING) << "Lost the connection to " << node->host << ":"
+                           << node->port << " -- " << ac->errstr;
+            }
+          });
+      node->ac = ac;
+      if (!params.redis_password.empty() &&
+          redisAsyncCommand(ac, OnSetupReply, nullptr, "AUTH %s %s",
+                            params.redis_user.c_str(),
+                            params.redis_password.c_str()) == REDIS_OK) {
+        node->sinks.push_back(nullptr);
+      }
+      if (params.redis_db != 0 &&
+          params.redis_connection_mode != ClusterMode &&
+          redisAsyncCommand(ac, OnSetupReply, nullptr, "SELECT %d",
+                            params.redis_db) == REDIS_OK) {
+        node->sinks.push_back(nullptr);
+      }
+    }
+
+    static void SetEvents(Node *node, const uint32_t events) {
+      if (events == node->events || node->ac == nullptr) return;
+      struct epoll_event event = {};
+      event.events = events;
+      event.data.ptr = node;
+      const int op = node->events == 0
+                         ? EPOLL_CTL_ADD
+                         : (events == 0 ? EPOLL_CTL_DEL : EPOLL_CTL_MOD);
+      epoll_ctl(node->loop->epoll_fd_, op, node->ac->c.fd, &event);
+      node->events = events;
+    }
+
+    static void AddEvents(void *data, const uint32_t events) {
+      Node *node = static_cast<Node *>(data);
+      SetEvents(node, node->events | events);
+    }
+
+    static void DelEvents(void *data, const uint32_t events) {
+      Node *node = static_cast<Node *>(data);
+      SetEvents(node, node->events & ~events);
+    }
+
+    // Every reply, or failure, ends the command at the front of the sinks.
+    static void PopSink(const redisAsyncContext *ac) {
+      Node *node = static_cast<Node *>(ac->data);
+      if (!node->sinks.empty()) node->sinks.pop_front();
+      node->parsing = nullptr;
+    }
+
+    static void OnSetupReply(redisAsyncContext *ac, void *r, void *privdata) {
+      PopSink(ac);
+      std::unique_ptr<redisReply, ::sw::redis::ReplyDeleter> reply(
+          static_cast<redisReply *>(r));
+      if (reply != nullptr && reply->type == REDIS_REPLY_ERROR) {
+        LOG(ERROR) << "Redis connection setup failed -- " << reply->str;
+      }
+    }
+
+    static void OnReply(redisAsyncContext *ac, void *r, void *privdata) {
+      PopSink(ac);
+      std::unique_ptr<Callback> callback(static_cast<Callback *>(privdata));
+      std::unique_ptr<redisReply, ::sw::redis::ReplyDeleter> reply(
+          r == SinkReply() ? nullptr : static_cast<redisReply *>(r));
+      if (reply != nullptr && reply->type == REDIS_REPLY_ERROR &&
+          (strncmp(reply->str, "MOVED", 5) == 0 ||
+           strncmp(reply->str, "ASK", 3) == 0)) {
+        static_cast<Node *>(ac->data)->loop->client_->RequestSlotsRefresh();
+      }
+      (*callback)(std::move(reply));
+    }
+
+    void Wake() {
+      const uint64_t one = 1;
+      if (write(event_fd_, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        LOG(ERROR) << "Can not wake the Redis event loop: "
+                   << strerror(errno);
+      }
+    }
+
+    void DrainRequests() {
+      std::vector<Request> requests;
+      {
+        std::lock_guard<std::mutex> lock(requests_mu_);
+        requests.swap(requests_);
+      }
+      if (requests.empty()) return;
+      RouteSlots();
+      for (auto &request : requests) {
+        Node *node = Route(request.args);
+        if (node->ac == nullptr) Connect(node);
+        Callback *callback = new Callback(std::move(request.callback));
+        if (node->ac == nullptr ||
+            redisAsyncCommandArgv(node->ac, OnReply, callback,
+                                  request.args.argc, request.args.argv,
+                                  request.args.argvlen) != REDIS_OK) {
+          std::unique_ptr<Callback> failed(callback);
+          (*failed)(nullptr);
+          continue;
+        }
+        node->sinks.push_back(request.sink);
+      }
+    }
+
+    int NextTimeoutMillis() {
+      uint64 deadline = 0;
+      for (auto &node : nodes_) {
+        if (node->ac != nullptr && node->deadline_micros != 0 &&
+            (deadline == 0 || node->deadline_micros < deadline)) {
+          deadline = node->deadline_micros;
+        }
+      }
+      if (deadline == 0) return -1;
+      const uint64 now = Env::Default()->NowMicros();
+      if (deadline <= now) return 0;
+      return static_cast<int>((deadline - now + 999) / 1000);
+    }
+
+    void HandleTimeouts() {
+      const uint64 now = Env::Default()->NowMicros();
+      for (auto &node : nodes_) {
+        if (node->ac != nullptr && node->deadline_micros != 0 &&
+            node->deadline_micros <= now) {
+          node->deadline_micros = 0;
+          redisAsyncHandleTimeout(node->ac);
+        }
+      }
+    }
+
+    void Loop() {
+      const static int kMaxEvents = 64;
+      struct epoll_event events[kMaxEvents];
+      while (!stop_.load()) {
+        const int n = epoll_wait(epoll_fd_, events, kMaxEvents,
+                                 NextTimeoutMillis());
+        for (int i = 0; i < n; ++i) {
+          Node *node = static_cast<Node *>(events[i].data.ptr);
+          if (node == nullptr) {
+            uint64_t count;
+            while (read(event_fd_, &count, sizeof(count)) > 0) {
+            }
+            DrainRequests();
+            continue;
+          }
+          if (node->ac != nullptr &&
+              (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))) {
+            redisAsyncHandleRead(node->ac);
+          }
+          if (node->ac != nullptr && (events[i].events & EPOLLOUT)) {
+            redisAsyncHandleWrite(node->ac);
+          }
+        }
+        HandleTimeouts();
+      }
+    }
+
+    RedisAsyncClient *client_;
+    std::vector<std::unique_ptr<Node>> nodes_;
+    std::vector<int> slot_nodes_;  // Cluster mode only.
+    std::shared_ptr<const SlotMap> routed_slots_;
+    int epoll_fd_ = -1;
+    int event_fd_ = -1;
+    std::thread thread_;
+    std::atomic<bool> stop_{false};
+    std::mutex requests_mu_;
+    std::vector<Request> requests_;
+  };
+
+  Redis_Connection_Params params_;
+  struct timeval connect_timeout_;
+  struct timeval command_timeout_;
+  // The only master, outside cluster mode.
+  std::pair<std::string, int> master_;
+
+  // The latest slot map, swapped in by refresher_ in cluster mode.
+  std::mutex slots_mu_;
+  std::condition_variable slots_cv_;
+  std::shared_ptr<const SlotMap> slots_;
+  bool refresh_slots_ = false;
+  bool stop_refresher_ = false;
+  std::thread refresher_;
+
+  std::vector<std::unique_ptr<EventLoop>> loops_;
+  std::atomic<std::size_t> next_loop_{0};
+};
+
+}  // namespace redis_connection
+}  // namespace recommenders_addons
+}  // namespace tensorflow
@@ -24,6 +24,7 @@ limitations under the License.
 #include <iostream>
 
 #include "redis_connection_util.hpp"
+#include "redis_node_pipelines.hpp"
 #include "thread_pool.h"
 
 using sw::redis::ConnectionOptions;
@@ -45,6 +46,8 @@ class RedisWrapper<RedisInstance, K, V,
   ConnectionPoolOptions pool_opts;
   ThreadPool *network_worker_pool;
   std::exception_ptr error_ptr;
+  // Only with redis_pipeline_per_node.
+  std::unique_ptr<RedisNodePipelines> node_pipelines;
 
  public:
   std::shared_ptr<RedisInstance> redis_conn_read =
@@ -128,6 +131,7 @@ class RedisWrapper<RedisInstance, K, V,
           }
           if (redis_conn_read != nullptr && redis_conn_write != nullptr) {
             isRedisConnect = true;
+            StartNodePipelines();
             return Status::OK();
           }
         }
@@ -152,6 +156,20 @@ class RedisWrapper<RedisInstance, K, V,
     return Status::OK();
   }
 
+  // Falls back to one call per storage slice when the slot map can not be
+  // read.
+  void StartNodePipelines() {
+    if (!redis_connection_params.redis_pipeline_per_node) return;
+    node_pipelines.reset(new RedisNodePipelines(redis_connection_params));
+    Status statu = node_pipelines->Start();
+    if (!statu.ok()) {
+      LOG(WARNING) << "Can not pipeline the commands per Redis master, send "
+                      "them per storage slice instead -- "
+                   << statu;
+      node_pipelines.reset();
+    }
+  }
+
   static std::shared_ptr<RedisWrapper<RedisInstance, K, V>> get_instance() {
     std::shared_ptr<RedisWrapper<RedisInstance, K, V>> instance_ptr(
         new RedisWrapper<RedisInstance, K, V>());
@@ -166,6 +184,16 @@ class RedisWrapper<RedisInstance, K, V,
     if (bucket_context->ptrs->size() >= size_check) {
       ::sw::redis::StringView hkey((*bucket_context->ptrs)[1],
                                    (*bucket_context->sizes)[1]);
+      const std::vector<std::size_t> &sizes = *bucket_context->sizes;
+      profiler::TraceMe trace(
+          [&] {
+            return profiler::TraceMeEncode(
+                "RedisNetworkWait",
+                {{"slice", absl::string_view(hkey.data(), hkey.size())},
+                 {"argc", sizes.size()},
+                 {"bytes", ArgsBytes(sizes, sizes.size())}});
+          },
+          profiler::TraceMeLevel::kInfo);
       try {
         return redis_conn_read->command(cmd, hkey, bucket_context->ptrs.get(),
                                         bucket_context->sizes.get());
@@ -186,6 +214,16 @@ class RedisWrapper<RedisInstance, K, V,
     if (bucket_context->ptrs->size() >= size_check) {
       ::sw::redis::StringView hkey((*bucket_context->ptrs)[1],
                                    (*bucket_context->sizes)[1]);
+      const std::vector<std::size_t> &sizes = *bucket_context->sizes;
+      profiler::TraceMe trace(
+          [&] {
+            return profiler::TraceMeEncode(
+                "RedisNetworkWait",
+                {{"slice", absl::string_view(hkey.data(), hkey.size())},
+                 {"argc", sizes.size()},
+                 {"bytes", ArgsBytes(sizes, sizes.size())}});
+          },
+          profiler::TraceMeLevel::kInfo);
       try {
         return redis_conn_write->command(cmd, hkey, bucket_context->ptrs.get(),
                                          bucket_context->sizes.get());
@@ -199,6 +237,20 @@ class RedisWrapper<RedisInstance, K, V,
     return nullptr;
   }
 
+  // Sends the commands in the buckets of thread_context with at least
+  // size_check arguments, those of the storage slices served by one master
+  // pipelined on one connection and the masters in parallel, and returns
+  // the replies by bucket.
+  std::vector<std::unique_ptr<redisReply, ::sw::redis::ReplyDeleter>>
+  PipelineBuckets(ThreadContext *thread_context, const unsigned size_check) {
+    std::vector<RedisCommandArgs> commands;
+    BucketCommandArgs(thread_context, size_check, &commands);
+    std::vector<std::unique_ptr<redisReply, ::sw::redis::ReplyDeleter>> replies(
+        redis_connection_params.storage_hashes());
+    node_pipelines->Exec(commands, network_worker_pool, &replies);
+    return replies;
+  }
+
  public:
   virtual std::vector<std::string> GetKeyBucketsAndOptimizerParamsWithName(
       const std::string &keys_prefix_name,
@@ -241,7 +293,7 @@ class RedisWrapper<RedisInstance, K, V,
     long long cursor = 0;
     const redisReply *set_reply;
     keys_prefix_name_slices_in_redis.reserve(
-        redis_connection_params.storage_slice);
+        redis_connection_params.storage_hashes());
     for (size_t i = 0; i < ip_port_set.size(); ++i) {
       connection_options.host = ip_port_set[i].first;  // Required.
       connection_options.port =
@@ -259,12 +311,14 @@ class RedisWrapper<RedisInstance, K, V,
       reply_server.reset();
       cursor = 0;
       while (true) {
+        // The hashes of SubHashStorageMode go on after the hash tag, so the
+        // patterns do not end with it.
         if (only_get_buckets) {
           redis_command = "SCAN " + std::to_string(cursor) + " MATCH " +
-                          keys_prefix_name + "{[0123456789]*}";
+                          keys_prefix_name + "{[0123456789]*";
         } else {
           redis_command = "SCAN " + std::to_string(cursor) + " MATCH " +
-                          keys_prefix_name + "*{[0123456789]*}";
+                          keys_prefix_name + "*{[0123456789]*";
         }
         try {
           reply_server =
@@ -316,14 +370,14 @@ class RedisWrapper<RedisInstance, K, V,
                 << " existing in Redis cluster servers";
       return 0;
     } else if (keys_prefix_name_slices_in_redis.size() ==
-               redis_connection_params.storage_slice) {
+               redis_connection_params.storage_hashes()) {
       LOG(INFO) << "There is already a corresponding table " << keys_prefix_name
                 << " existing in Redis cluster servers";
       return 1;
     } else if (keys_prefix_name_slices_in_redis.size() <=
-               redis_connection_params.storage_slice) {
+               redis_connection_params.storage_hashes()) {
       LOG(WARNING) << "storage_slice in redis_connection_params which is "
-                   << redis_connection_params.storage_slice
+                   << redis_connection_params.storage_hashes()
                    << " is bigger than the slices number of this "
                    << keys_prefix_name
                    << " in the Redis Cluster servers which is "
@@ -331,7 +385,7 @@ class RedisWrapper<RedisInstance, K, V,
       return 2;
     } else {
       LOG(ERROR) << "storage_slice in redis_connection_params which is "
-                 << redis_connection_params.storage_slice
+                 << redis_connection_params.storage_hashes()
                  << " did not equal to the slices number of this "
                  << keys_prefix_name
                  << " in the Redis Cluster servers which is "
@@ -344,7 +398,7 @@ class RedisWrapper<RedisInstance, K, V,
   virtual std::vector<std::pair<unsigned, unsigned>> ClusterNodesSlots(
       bool full_slots) override {
     std::vector<std::pair<unsigned, unsigned>> cluster_slots;
-    cluster_slots.reserve(redis_connection_params.storage_slice);
+    cluster_slots.reserve(redis_connection_params.storage_hashes());
     auto cmd = [](::sw::redis::Connection &connection,
                   ::sw::redis::StringView hkey) {
       connection.send("CLUSTER NODES");
@@ -361,7 +415,7 @@ class RedisWrapper<RedisInstance, K, V,
     if (reply->type == REDIS_REPLY_STRING) {
       std::vector<std::vector<::sw::redis::StringView>> csv_table;
       std::vector<::sw::redis::StringView> csv_table_row;
-      csv_table.reserve(redis_connection_params.storage_slice * 2);
+      csv_table.reserve(redis_connection_params.storage_hashes() * 2);
       csv_table_row.reserve(10);
       const char *str_ptr = reply->str;
       const char *const str_ptr_begin = reply->str;
@@ -483,6 +537,10 @@ class RedisWrapper<RedisInstance, K, V,
       LOG(ERROR) << "RedisHandler error in HscanGetKeysValsInBucket for slices "
                  << keys_prefix_name_slice << " -- " << err.what();
     }
+    if (reply == nullptr || reply->type != REDIS_REPLY_ARRAY ||
+        reply->elements < 2) {
+      return nullptr;
+    }
     if (reply->element[0]->type == REDIS_REPLY_STRING) {
       // #define REDIS_REPLY_STRING 1
       *cursor = std::atoll(reply->element[0]->str);
@@ -615,7 +673,7 @@ class RedisWrapper<RedisInstance, K, V,
 
     size_t buf_len;
     volatile void *tem_aio_buf;
-    for (unsigned i = 0; i < redis_connection_params.storage_slice; ++i) {
+    for (unsigned i = 0; i < redis_connection_params.storage_hashes(); ++i) {
       redis_command = "DUMP " + keys_prefix_name_slices[i];
       reply.reset();
       try {
@@ -887,7 +945,7 @@ class RedisWrapper<RedisInstance, K, V,
       const std::vector<std::string> &keys_prefix_name_slices_old,
       const std::vector<std::string> &keys_prefix_name_slices_new) override {
     try {
-      for (unsigned i = 0; i < redis_connection_params.storage_slice; ++i) {
+      for (unsigned i = 0; i < redis_connection_params.storage_hashes(); ++i) {
         network_worker_pool->enqueue([this, &keys_prefix_name_slices_old,
                                       &keys_prefix_name_slices_new, i] {
           DoDuplicateInRedis(keys_prefix_name_slices_old[i],
@@ -905,37 +963,12 @@ class RedisWrapper<RedisInstance, K, V,
   }
 
  public:
-  /*
-  The structure of ptrs and sizes which for storing Redis command char
-sequence pointer and size of parameters. For example: vector<ThreadContext>
-(for multi-threads, index is thread id, also vector<vector<vector<const char
-*>>>)
-
-std::vector<ThreadContext> (better to be reserved before enter MXXX_COMMAND)
--------------upper var is outside of the MXXX_COMMAND function---------------
-      |
-      | Thread0 has its own ThreadContext
-      |
-every bucket has its own BucketContext for sending data---for locating reply-
-    |                                                      |
-    | std::vector<BucketContext>                           | std::vector
-    |                                                          <unsigned>
-    |
-    |
---char* point to the data and size_t indicates the length of data------------
-  |                    |
-  | std::vector        | std::vector
-  |  <const char*>     |  <std::size_t>
-  |                    |
-(Real Redis command sequence because m-cmd can only be used in same hash tag)
-
-  PS: vector bucket_locs is only allocated in Redis Cluster mode!
-  */
-  virtual std::vector<std::unique_ptr<redisReply, ::sw::redis::ReplyDeleter>>
-  MgetCommand(
+  // Fills the HMGET commands of keys [begin, max_i) into the buckets of
+  // thread_context, one per storage slice.
+  void FillMgetBuckets(
       const Tensor &keys, ThreadContext *thread_context, const int64_t begin,
       const int64_t max_i,
-      const std::vector<std::string> &keys_prefix_name_slices) override {
+      const std::vector<std::string> &keys_prefix_name_slices) {
     const int &&total = max_i - begin;
     const int &&argc = total + 2;
 
@@ -947,10 +980,10 @@ every bucket has its own BucketContext for sending data---for locating reply-
     const K *pk_raw =
         reinterpret_cast<const K *>(keys.tensor_data().data()) + begin;
 
-    const unsigned &storage_slice = redis_connection_params.storage_slice;
+    const unsigned storage_slice = redis_connection_params.storage_hashes();
     const unsigned &&vector_len =
         (static_cast<int64_t>(reinterpret_cast<int>(argc)) /
-         redis_connection_params.storage_slice) +
+         redis_connection_params.storage_hashes()) +
         2;
 
     thread_context->HandleReserve(storage_slice, vector_len, total);
@@ -975,13 +1008,110 @@ every bucket has its own BucketContext for sending data---for locating reply-
       thread_context->HandlePushBack(
           key_bucket_locs, KContentPointer<K>(pk_raw), KTypeSize<K>(pk_raw));
     }
+  }
+
+  // Fills the HMGETPACKED commands of keys [begin, max_i) into the buckets of
+  // thread_context, one per storage slice with any of the keys, which are
+  // copied back to back into its packed_keys.
+  void FillMgetPackedBuckets(
+      const Tensor &keys, ThreadContext *thread_context, const int64_t begin,
+      const int64_t max_i, const int64_t Velems_per_dim0,
+      const std::vector<std::string> &keys_prefix_name_slices) {
+    const int &&total = max_i - begin;
+
+    const static char *redis_command = "HMGETPACKED";
+    const static std::size_t &&redis_command_byte = 11;
+
+    const K *const pk_raw_end =
+        reinterpret_cast<const K *>(keys.tensor_data().data()) + max_i;
+    const K *pk_raw =
+        reinterpret_cast<const K *>(keys.tensor_data().data()) + begin;
+
+    const unsigned storage_slice = redis_connection_params.storage_hashes();
+    thread_context->HandleReserve(storage_slice, 5U, total);
+    thread_context->packed_keys.resize(storage_slice);
+    for (unsigned i = 0; i < storage_slice; ++i) {
+      thread_context->packed_keys[i].clear();
+    }
+
+    unsigned *pbucket_loc = thread_context->bucket_locs->data();
+    unsigned key_bucket_locs = 0;
+    for (; pk_raw != pk_raw_end; ++pk_raw) {
+      key_bucket_locs =
+          KBucketNum<K>(this->K_bucket_num_handle, pk_raw, storage_slice);
+      *pbucket_loc = key_bucket_locs;
+      ++pbucket_loc;
+      const char *pk_char = reinterpret_cast<const char *>(pk_raw);
+      thread_context->packed_keys[key_bucket_locs].insert(
+          thread_context->packed_keys[key_bucket_locs].end(), pk_char,
+          pk_char + sizeof(K));
+    }
+
+    thread_context->packed_key_bytes = std::to_string(sizeof(K));
+    thread_context->packed_value_bytes =
+        std::to_string(Velems_per_dim0 * sizeof(V));
+    for (unsigned i = 0; i < storage_slice; ++i) {
+      if (thread_context->packed_keys[i].empty()) continue;
+      thread_context->HandlePushBack(i, redis_command, redis_command_byte);
+      thread_context->HandlePushBack(i, keys_prefix_name_slices[i].data(),
+                                     keys_prefix_name_slices[i].size());
+      thread_context->HandlePushBack(i,
+                                     thread_context->packed_key_bytes.data(),
+                                     thread_context->packed_key_bytes.size());
+      thread_context->HandlePushBack(
+          i, thread_context->packed_value_bytes.data(),
+          thread_context->packed_value_bytes.size());
+      thread_context->HandlePushBack(i, thread_context->packed_keys[i].data(),
+                                     thread_context->packed_keys[i].size());
+    }
+  }
+
+  /*
+  The structure of ptrs and sizes which for storing Redis command char
+sequence pointer and size of parameters. For example: vector<ThreadContext>
+(for multi-threads, index is thread id, also vector<vector<vector<const char
+*>>>)
+
+std::vector<ThreadContext> (better to be reserved before enter MXXX_COMMAND)
+-------------upper var is outside of the MXXX_COMMAND function---------------
+      |
+      | Thread0 has its own ThreadContext
+      |
+every bucket has its own BucketContext for sending data---for locating reply-
+    |                                                      |
+    | std::vector<BucketContext>                           | std::vector
+    |                                                          <unsigned>
+    |
+    |
+--char* point to the data and size_t indicates the length of data------------
+  |                    |
+  | std::vector        | std::vector
+  |  <const char*>     |  <std::size_t>
+  |                    |
+(Real Redis command sequence because m-cmd can only be used in same hash tag)
+
+  PS: vector bucket_locs is only allocated in Redis Cluster mode!
+  */
+  virtual std::vector<std::unique_ptr<redisReply, ::sw::redis::ReplyDeleter>>
+  MgetCommand(
+      const Tensor &keys, ThreadContext *thread_context, const int64_t begin,
+      const int64_t max_i, const int64_t Velems_per_dim0,
+      const std::vector<std::string> &keys_prefix_name_slices) override {
+    const unsigned storage_slice = redis_connection_params.storage_hashes();
+    if (redis_connection_params.using_packed_commands) {
+      FillMgetPackedBuckets(keys, thread_context, begin, max_i,
+                            Velems_per_dim0, keys_prefix_name_slices);
+    } else {
+      FillMgetBuckets(keys, thread_context, begin, max_i,
+                      keys_prefix_name_slices);
+    }
 
     auto cmd = [](::sw::redis::Connection &connection,
                   const ::sw::redis::StringView hkey,
                   const std::vector<const char *> *ptrs_i,
                   const std::vector<std::size_t> *sizes_i) {
-      assert(strcmp(ptrs_i->front(), "HMGET") == 0);
-      assert(sizes_i->front() == 5);
+      assert(strcmp(ptrs_i->front(), "HMGET") == 0 ||
+             strcmp(ptrs_i->front(), "HMGETPACKED") == 0);
       assert(std::string(hkey.data()).compare(ptrs_i[1]) == 0);
 
       connection.send(static_cast<int>(ptrs_i->size()),
@@ -989,6 +1119,10 @@ every bucket has its own BucketContext for sending data---for locating reply-
                       sizes_i->data());
     };
 
+    if (node_pipelines) {
+      return PipelineBuckets(thread_context, 3U);
+    }
+
     std::vector<std::unique_ptr<redisReply, ::sw::redis::ReplyDeleter>> replies(
         storage_slice);
     std::vector<
@@ -1013,6 +1147,61 @@ every bucket has its own BucketContext for sending data---for locating reply-
     return replies;
   }
 
+  // Every storage slice with at least one key makes one command.
+  void BucketCommandArgs(ThreadContext *thread_context,
+                         const unsigned &size_check,
+                         std::vector<RedisCommandArgs> *commands) {
+    const unsigned storage_slice = redis_connection_params.storage_hashes();
+    for (unsigned i = 0; i < storage_slice; ++i) {
+      const std::unique_ptr<BucketContext> &bucket = thread_context->buckets[i];
+      if (bucket->ptrs->size() >= size_check) {
+        commands->push_back({i, static_cast<int>(bucket->ptrs->size()),
+                             bucket->ptrs->data(), bucket->sizes->data()});
+      }
+    }
+  }
+
+  virtual void MgetCommandArgs(
+      const Tensor &keys, ThreadContext *thread_context, const int64_t begin,
+      const int64_t max_i, const int64_t Velems_per_dim0,
+      const std::vector<std::string> &keys_prefix_name_slices,
+      std::vector<RedisCommandArgs> *commands) override {
+    if (redis_connection_params.using_packed_commands) {
+      FillMgetPackedBuckets(keys, thread_context, begin, max_i,
+                            Velems_per_dim0, keys_prefix_name_slices);
+    } else {
+      FillMgetBuckets(keys, thread_context, begin, max_i,
+                      keys_prefix_name_slices);
+    }
+    BucketCommandArgs(thread_context, 3U, commands);
+  }
+
+  virtual void MgetTensorSinks(
+      Tensor *values, const Tensor &default_value, Tensor *exists,
+      const bool is_full_default, ThreadContext *thread_context,
+      const int64_t begin, const int64_t max_i, const int64_t Velems_per_dim0,
+      std::vector<std::unique_ptr<RedisReplySink>> *sinks) override {
+    const unsigned storage_slice = redis_connection_params.storage_hashes();
+    const std::vector<unsigned> *bucket_locs =
+        thread_context->bucket_locs.get();
+    std::vector<std::vector<int64_t>> rows(storage_slice);
+    for (int64_t i = 0; i < (max_i - begin); ++i) {
+      rows[(*bucket_locs)[i]].push_back(begin + i);
+    }
+    sinks->clear();
+    for (unsigned i = 0; i < storage_slice; ++i) {
+      if (redis_connection_params.using_packed_commands) {
+        sinks->emplace_back(new PackedMgetTensorSink<V>(
+            values, default_value, exists, is_full_default, Velems_per_dim0,
+            std::move(rows[i])));
+      } else {
+        sinks->emplace_back(new MgetTensorSink<V>(
+            values, default_value, exists, is_full_default, Velems_per_dim0,
+            std::move(rows[i])));
+      }
+    }
+  }
+
   inline void CopyDefaultToTensor(const bool is_full_default, const V *pv_raw,
                                   const V *dft_raw,
                                   const V *const dft_raw_begin,
@@ -1046,16 +1235,29 @@ every bucket has its own BucketContext for sending data---for locating reply-
 
     const std::vector<unsigned> *bucket_locs =
         thread_context->bucket_locs.get();
-    const unsigned &storage_slice = redis_connection_params.storage_slice;
+    const unsigned storage_slice = redis_connection_params.storage_hashes();
     unsigned buckets_iters_nums[storage_slice];
     unsigned bucket_loc;
     memset(buckets_iters_nums, 0U, sizeof(buckets_iters_nums));
     redisReply *temp_reply;
     bool print_once[storage_slice];
     memset(print_once, false, sizeof(print_once));
+    const std::size_t value_bytes = Velems_per_dim0 * sizeof(V);
+    const char *packed_value;
     for (auto i = 0; i < (max_i - begin);
          ++i, pv_raw += Velems_per_dim0, dft_raw += Velems_per_dim0) {
       bucket_loc = (*bucket_locs)[i];
+      if (redis_connection_params.using_packed_commands) {
+        if (PackedReplyValue(reply[bucket_loc].get(),
+                             buckets_iters_nums[bucket_loc]++, value_bytes,
+                             &packed_value)) {
+          ReplyMemcpyToValTensor<V>(pv_raw, packed_value, Velems_per_dim0);
+        } else {
+          CopyDefaultToTensor(is_full_default, pv_raw, dft_raw, dft_raw_begin,
+                              Velems_per_dim0);
+        }
+        continue;
+      }
       if (reply[bucket_loc] != nullptr) {
         if (reply[bucket_loc]->type == REDIS_REPLY_ARRAY) {
           temp_reply =
@@ -1107,16 +1309,30 @@ every bucket has its own BucketContext for sending data---for locating reply-
 
     const std::vector<unsigned> *bucket_locs =
         thread_context->bucket_locs.get();
-    const unsigned &storage_slice = redis_connection_params.storage_slice;
+    const unsigned storage_slice = redis_connection_params.storage_hashes();
     unsigned buckets_iters_nums[storage_slice];
     unsigned bucket_loc;
     memset(buckets_iters_nums, 0U, sizeof(buckets_iters_nums));
     redisReply *temp_reply;
     bool print_once[storage_slice];
     memset(print_once, false, sizeof(print_once));
+    const std::size_t value_bytes = Velems_per_dim0 * sizeof(V);
+    const char *packed_value;
     for (int64_t i = 0, j = begin; i < (max_i - begin);
          ++i, ++j, pv_raw += Velems_per_dim0, dft_raw += Velems_per_dim0) {
       bucket_loc = (*bucket_locs)[i];
+      if (redis_connection_params.using_packed_commands) {
+        exists_flat(j) = PackedReplyValue(reply[bucket_loc].get(),
+                                          buckets_iters_nums[bucket_loc]++,
+                                          value_bytes, &packed_value);
+        if (exists_flat(j)) {
+          ReplyMemcpyToValTensor<V>(pv_raw, packed_value, Velems_per_dim0);
+        } else {
+          CopyDefaultToTensor(is_full_default, pv_raw, dft_raw, dft_raw_begin,
+                              Velems_per_dim0);
+        }
+        continue;
+      }
       if (reply[bucket_loc] != nullptr) {
         if (reply[bucket_loc]->type == REDIS_REPLY_ARRAY) {
           temp_reply =
@@ -1152,10 +1368,13 @@ every bucket has its own BucketContext for sending data---for locating reply-
     return Status::OK();
   }
 
-  virtual Status MsetCommand(
+  // Fills the HMSET commands of keys [begin, max_i) into the buckets of
+  // thread_context, one per storage slice.
+  void FillMsetBuckets(
       const Tensor &keys, const Tensor &values, ThreadContext *thread_context,
       const int64_t begin, const int64_t max_i, const int64_t Velems_per_dim0,
-      const std::vector<std::string> &keys_prefix_name_slices) override {
+      const std::vector<std::string> &keys_prefix_name_slices,
+      std::vector<std::vector<char>> *buff) {
     const int &&total = max_i - begin;
     const int &&argc = total * 2 + 2;
 
@@ -1172,10 +1391,10 @@ every bucket has its own BucketContext for sending data---for locating reply-
     const V *pv_raw = reinterpret_cast<const V *>(values.tensor_data().data()) +
                       begin * Velems_per_dim0;
 
-    const unsigned &storage_slice = redis_connection_params.storage_slice;
+    const unsigned storage_slice = redis_connection_params.storage_hashes();
     const unsigned &&vector_len =
         (static_cast<int64_t>(reinterpret_cast<int>(argc)) /
-         redis_connection_params.storage_slice) +
+         redis_connection_params.storage_hashes()) +
         2;
 
     thread_context->HandleReserve(storage_slice, vector_len, total);
@@ -1187,8 +1406,8 @@ every bucket has its own BucketContext for sending data---for locating reply-
     }
 
     VContentAndTypeSizeResult VCATS_temp;
-    // std::vector<char> for storage all string in one KV pair
-    std::vector<std::vector<char>> buff_temp(total);
+    std::vector<std::vector<char>> &buff_temp = *buff;
+    buff_temp.resize(total);
     unsigned key_bucket_locs = 0;
     for (int i = 0; pk_raw != pk_raw_end;
          ++i, ++pk_raw, pv_raw += Velems_per_dim0) {
@@ -1204,13 +1423,111 @@ every bucket has its own BucketContext for sending data---for locating reply-
       thread_context->HandlePushBack(
           key_bucket_locs, VCATS_temp.VContentPointer, VCATS_temp.VTypeSize);
     }
+  }
+
+  // Copies the keys [begin, max_i), with their values and, unless exists is
+  // null, their exists flags, back to back into the packed_keys,
+  // packed_values and packed_exists of the storage slices they belong to.
+  void GatherPackedBuckets(const Tensor &keys, const Tensor &values,
+                           const Tensor *exists, ThreadContext *thread_context,
+                           const int64_t begin, const int64_t max_i,
+                           const int64_t Velems_per_dim0) {
+    const K *const pk_raw_end =
+        reinterpret_cast<const K *>(keys.tensor_data().data()) + max_i;
+    const K *pk_raw =
+        reinterpret_cast<const K *>(keys.tensor_data().data()) + begin;
+
+    const std::size_t &&V_byte_size = Velems_per_dim0 * sizeof(V);
+    const char *pv_char = values.tensor_data().data() + begin * V_byte_size;
+    const char *pe_char =
+        exists ? exists->tensor_data().data() + begin * sizeof(bool) : nullptr;
+
+    const unsigned storage_slice = redis_connection_params.storage_hashes();
+    thread_context->packed_keys.resize(storage_slice);
+    thread_context->packed_values.resize(storage_slice);
+    thread_context->packed_exists.resize(storage_slice);
+    for (unsigned i = 0; i < storage_slice; ++i) {
+      thread_context->packed_keys[i].clear();
+      thread_context->packed_values[i].clear();
+      thread_context->packed_exists[i].clear();
+    }
+
+    unsigned key_bucket_locs = 0;
+    for (; pk_raw != pk_raw_end; ++pk_raw, pv_char += V_byte_size) {
+      key_bucket_locs =
+          KBucketNum<K>(this->K_bucket_num_handle, pk_raw, storage_slice);
+      const char *pk_char = reinterpret_cast<const char *>(pk_raw);
+      std::vector<char> &packed_keys =
+          thread_context->packed_keys[key_bucket_locs];
+      packed_keys.insert(packed_keys.end(), pk_char, pk_char + sizeof(K));
+      std::vector<char> &packed_values =
+          thread_context->packed_values[key_bucket_locs];
+      packed_values.insert(packed_values.end(), pv_char,
+                           pv_char + V_byte_size);
+      if (pe_char) {
+        thread_context->packed_exists[key_bucket_locs].push_back(*pe_char);
+        pe_char += sizeof(bool);
+      }
+    }
+
+    thread_context->packed_key_bytes = std::to_string(sizeof(K));
+    thread_context->packed_value_bytes = std::to_string(V_byte_size);
+  }
+
+  // Fills the HMSETPACKED commands of keys [begin, max_i) into the buckets of
+  // thread_context, one per storage slice with any of the keys.
+  void FillMsetPackedBuckets(
+      const Tensor &keys, const Tensor &values, ThreadContext *thread_context,
+      const int64_t begin, const int64_t max_i, const int64_t Velems_per_dim0,
+      const std::vector<std::string> &keys_prefix_name_slices) {
+    const static char *redis_command = "HMSETPACKED";
+    const static std::size_t &&redis_command_byte = 11;
+
+    const unsigned storage_slice = redis_connection_params.storage_hashes();
+    thread_context->HandleReserve(storage_slice, 6U, max_i - begin);
+    GatherPackedBuckets(keys, values, nullptr, thread_context, begin, max_i,
+                        Velems_per_dim0);
+
+    for (unsigned i = 0; i < storage_slice; ++i) {
+      if (thread_context->packed_keys[i].empty()) continue;
+      thread_context->HandlePushBack(i, redis_command, redis_command_byte);
+      thread_context->HandlePushBack(i, keys_prefix_name_slices[i].data(),
+                                     keys_prefix_name_slices[i].size());
+      thread_context->HandlePushBack(i,
+                                     thread_context->packed_key_bytes.data(),
+                                     thread_context->packed_key_bytes.size());
+      thread_context->HandlePushBack(
+          i, thread_context->packed_value_bytes.data(),
+          thread_context->packed_value_bytes.size());
+      thread_context->HandlePushBack(i, thread_context->packed_keys[i].data(),
+                                     thread_context->packed_keys[i].size());
+      thread_context->HandlePushBack(i,
+                                     thread_context->packed_values[i].data(),
+                                     thread_context->packed_values[i].size());
+    }
+  }
+
+  virtual Status MsetCommand(
+      const Tensor &keys, const Tensor &values, ThreadContext *thread_context,
+      const int64_t begin, const int64_t max_i, const int64_t Velems_per_dim0,
+      const std::vector<std::string> &keys_prefix_name_slices) override {
+    const unsigned storage_slice = redis_connection_params.storage_hashes();
+    // std::vector<char> for storage all string in one KV pair
+    std::vector<std::vector<char>> buff_temp;
+    if (redis_connection_params.using_packed_commands) {
+      FillMsetPackedBuckets(keys, values, thread_context, begin, max_i,
+                            Velems_per_dim0, keys_prefix_name_slices);
+    } else {
+      FillMsetBuckets(keys, values, thread_context, begin, max_i,
+                      Velems_per_dim0, keys_prefix_name_slices, &buff_temp);
+    }
 
     auto cmd = [](::sw::redis::Connection &connection,
                   const ::sw::redis::StringView &hkey,
                   const std::vector<const char *> *ptrs_i,
                   const std::vector<std::size_t> *sizes_i) {
-      assert(strcmp(ptrs_i->front(), "HMSET") == 0);
-      assert(sizes_i->front() == 5);
+      assert(strcmp(ptrs_i->front(), "HMSET") == 0 ||
+             strcmp(ptrs_i->front(), "HMSETPACKED") == 0);
       assert(std::string(hkey.data()).compare(ptrs_i[1]) == 0);
 
       connection.send(static_cast<int>(ptrs_i->size()),
@@ -1218,6 +1535,11 @@ every bucket has its own BucketContext for sending data---for locating reply-
                       sizes_i->data());
     };
 
+    if (node_pipelines) {
+      PipelineBuckets(thread_context, 4U);
+      return Status::OK();
+    }
+
     std::vector<
         std::future<std::unique_ptr<redisReply, ::sw::redis::ReplyDeleter>>>
         results;
@@ -1242,17 +1564,35 @@ every bucket has its own BucketContext for sending data---for locating reply-
     return Status::OK();
   }
 
-  virtual Status MaccumCommand(
+  virtual void MsetCommandArgs(
+      const Tensor &keys, const Tensor &values, ThreadContext *thread_context,
+      const int64_t begin, const int64_t max_i, const int64_t Velems_per_dim0,
+      const std::vector<std::string> &keys_prefix_name_slices,
+      std::vector<std::vector<char>> *buff,
+      std::vector<RedisCommandArgs> *commands) override {
+    if (redis_connection_params.using_packed_commands) {
+      FillMsetPackedBuckets(keys, values, thread_context, begin, max_i,
+                            Velems_per_dim0, keys_prefix_name_slices);
+    } else {
+      FillMsetBuckets(keys, values, thread_context, begin, max_i,
+                      Velems_per_dim0, keys_prefix_name_slices, buff);
+    }
+    BucketCommandArgs(thread_context, 4U, commands);
+  }
+
+  // Fills the HMACCUM commands of keys [begin, max_i) into the buckets of
+  // thread_context, one per storage slice.
+  void FillMaccumBuckets(
       const Tensor &keys, const Tensor &values_or_delta, const Tensor &exists,
       ThreadContext *thread_context, const int64_t begin, const int64_t max_i,
-      const int64_t Velems_per_dim0,
-      const std::vector<std::string> &keys_prefix_name_slices) override {
+      const int64_t Velems_per_dim0, const std::string &dTypestr,
+      const std::vector<std::string> &keys_prefix_name_slices,
+      std::vector<std::vector<char>> *buff) {
     const int &&total = max_i - begin;
     const int &&argc = total * 2 + 4;
 
     const static char *redis_command = "HMACCUM";
     const static std::size_t &&redis_command_byte = 7;
-    std::string dTypestr = DataTypeString(values_or_delta.dtype());
     size_t dTypeStrsize = dTypestr.size();
 
     const K *const pk_raw_end =
@@ -1266,10 +1606,10 @@ every bucket has its own BucketContext for sending data---for locating reply-
         reinterpret_cast<const V *>(values_or_delta.tensor_data().data()) +
         begin * Velems_per_dim0;
 
-    const unsigned &storage_slice = redis_connection_params.storage_slice;
+    const unsigned storage_slice = redis_connection_params.storage_hashes();
     const unsigned &&vector_len =
         (static_cast<int64_t>(reinterpret_cast<int>(argc)) /
-         redis_connection_params.storage_slice) +
+         redis_connection_params.storage_hashes()) +
         4;
 
     thread_context->HandleReserve(storage_slice, vector_len, total);
@@ -1282,8 +1622,8 @@ every bucket has its own BucketContext for sending data---for locating reply-
     }
 
     VContentAndTypeSizeResult VCATS_temp;
-    // std::vector<char> for storage all string in one KV pair
-    std::vector<std::vector<char>> buff_temp(total);
+    std::vector<std::vector<char>> &buff_temp = *buff;
+    buff_temp.resize(total);
     unsigned key_bucket_locs = 0;
     for (int i = 0; pk_raw != pk_raw_end;
          ++i, ++pk_raw, pv_raw += Velems_per_dim0) {
@@ -1306,13 +1646,71 @@ every bucket has its own BucketContext for sending data---for locating reply-
       thread_context->HandlePushBack(i, KContentPointer<bool>(pe_raw),
                                      total * KTypeSize<bool>(pe_raw));
     }
+  }
+
+  // Fills the HMACCUMPACKED commands of keys [begin, max_i) into the buckets
+  // of thread_context, one per storage slice with any of the keys.
+  void FillMaccumPackedBuckets(
+      const Tensor &keys, const Tensor &values_or_delta, const Tensor &exists,
+      ThreadContext *thread_context, const int64_t begin, const int64_t max_i,
+      const int64_t Velems_per_dim0, const std::string &dTypestr,
+      const std::vector<std::string> &keys_prefix_name_slices) {
+    const static char *redis_command = "HMACCUMPACKED";
+    const static std::size_t &&redis_command_byte = 13;
+
+    const unsigned storage_slice = redis_connection_params.storage_hashes();
+    thread_context->HandleReserve(storage_slice, 8U, max_i - begin);
+    GatherPackedBuckets(keys, values_or_delta, &exists, thread_context, begin,
+                        max_i, Velems_per_dim0);
+
+    for (unsigned i = 0; i < storage_slice; ++i) {
+      if (thread_context->packed_keys[i].empty()) continue;
+      thread_context->HandlePushBack(i, redis_command, redis_command_byte);
+      thread_context->HandlePushBack(i, keys_prefix_name_slices[i].data(),
+                                     keys_prefix_name_slices[i].size());
+      thread_context->HandlePushBack(i, dTypestr.data(), dTypestr.size());
+      thread_context->HandlePushBack(i,
+                                     thread_context->packed_key_bytes.data(),
+                                     thread_context->packed_key_bytes.size());
+      thread_context->HandlePushBack(
+          i, thread_context->packed_value_bytes.data(),
+          thread_context->packed_value_bytes.size());
+      thread_context->HandlePushBack(i, thread_context->packed_keys[i].data(),
+                                     thread_context->packed_keys[i].size());
+      thread_context->HandlePushBack(i,
+                                     thread_context->packed_values[i].data(),
+                                     thread_context->packed_values[i].size());
+      thread_context->HandlePushBack(i,
+                                     thread_context->packed_exists[i].data(),
+                                     thread_context->packed_exists[i].size());
+    }
+  }
+
+  virtual Status MaccumCommand(
+      const Tensor &keys, const Tensor &values_or_delta, const Tensor &exists,
+      ThreadContext *thread_context, const int64_t begin, const int64_t max_i,
+      const int64_t Velems_per_dim0,
+      const std::vector<std::string> &keys_prefix_name_slices) override {
+    const unsigned storage_slice = redis_connection_params.storage_hashes();
+    std::string dTypestr = DataTypeString(values_or_delta.dtype());
+    // std::vector<char> for storage all string in one KV pair
+    std::vector<std::vector<char>> buff_temp;
+    if (redis_connection_params.using_packed_commands) {
+      FillMaccumPackedBuckets(keys, values_or_delta, exists, thread_context,
+                              begin, max_i, Velems_per_dim0, dTypestr,
+                              keys_prefix_name_slices);
+    } else {
+      FillMaccumBuckets(keys, values_or_delta, exists, thread_context, begin,
+                        max_i, Velems_per_dim0, dTypestr,
+                        keys_prefix_name_slices, &buff_temp);
+    }
 
     auto cmd = [](::sw::redis::Connection &connection,
                   const ::sw::redis::StringView &hkey,
                   const std::vector<const char *> *ptrs_i,
                   const std::vector<std::size_t> *sizes_i) {
-      assert(strcmp(ptrs_i->front(), "HMACCUM") == 0);
-      assert(sizes_i->front() == redis_command_byte);
+      assert(strcmp(ptrs_i->front(), "HMACCUM") == 0 ||
+             strcmp(ptrs_i->front(), "HMACCUMPACKED") == 0);
       assert(std::string(hkey.data()).compare(ptrs_i[1]) == 0);
 
       connection.send(static_cast<int>(ptrs_i->size()),
@@ -1320,6 +1718,11 @@ every bucket has its own BucketContext for sending data---for locating reply-
                       sizes_i->data());
     };
 
+    if (node_pipelines) {
+      PipelineBuckets(thread_context, 6U);
+      return Status::OK();
+    }
+
     std::vector<
         std::future<std::unique_ptr<redisReply, ::sw::redis::ReplyDeleter>>>
         results;
@@ -1344,6 +1747,102 @@ every bucket has its own BucketContext for sending data---for locating reply-
     return Status::OK();
   }
 
+  // Fills the optimizer commands of keys [begin, max_i) into the buckets of
+  // thread_context, one per storage slice with any of the keys.
+  void FillSparseApplyBuckets(
+      const std::string &command, const Tensor &keys, const Tensor &grads,
+      const std::vector<std::vector<std::string>> &slot_slices,
+      const std::vector<std::string> &hyperparams, const std::string &dTypestr,
+      ThreadContext *thread_context, const int64_t begin, const int64_t max_i,
+      const int64_t Velems_per_dim0,
+      const std::vector<std::string> &keys_prefix_name_slices) {
+    const unsigned storage_slice = redis_connection_params.storage_hashes();
+    thread_context->HandleReserve(
+        storage_slice, 7 + slot_slices.size() + hyperparams.size(),
+        max_i - begin);
+    GatherPackedBuckets(keys, grads, nullptr, thread_context, begin, max_i,
+                        Velems_per_dim0);
+
+    for (unsigned i = 0; i < storage_slice; ++i) {
+      if (thread_context->packed_keys[i].empty()) continue;
+      thread_context->HandlePushBack(i, command.data(), command.size());
+      thread_context->HandlePushBack(i, keys_prefix_name_slices[i].data(),
+                                     keys_prefix_name_slices[i].size());
+      for (const std::vector<std::string> &slices : slot_slices) {
+        thread_context->HandlePushBack(i, slices[i].data(), slices[i].size());
+      }
+      thread_context->HandlePushBack(i, dTypestr.data(), dTypestr.size());
+      thread_context->HandlePushBack(i,
+                                     thread_context->packed_key_bytes.data(),
+                                     thread_context->packed_key_bytes.size());
+      thread_context->HandlePushBack(
+          i, thread_context->packed_value_bytes.data(),
+          thread_context->packed_value_bytes.size());
+      thread_context->HandlePushBack(i, thread_context->packed_keys[i].data(),
+                                     thread_context->packed_keys[i].size());
+      thread_context->HandlePushBack(i,
+                                     thread_context->packed_values[i].data(),
+                                     thread_context->packed_values[i].size());
+      for (const std::string &hyperparam : hyperparams) {
+        thread_context->HandlePushBack(i, hyperparam.data(),
+                                       hyperparam.size());
+      }
+    }
+  }
+
+  virtual Status SparseApplyCommand(
+      const std::string &command, const Tensor &keys, const Tensor &grads,
+      const std::vector<std::vector<std::string>> &slot_slices,
+      const std::vector<std::string> &hyperparams,
+      ThreadContext *thread_context, const int64_t begin, const int64_t max_i,
+      const int64_t Velems_per_dim0,
+      const std::vector<std::string> &keys_prefix_name_slices) override {
+    const unsigned storage_slice = redis_connection_params.storage_hashes();
+    std::string dTypestr = DataTypeString(grads.dtype());
+    FillSparseApplyBuckets(command, keys, grads, slot_slices, hyperparams,
+                           dTypestr, thread_context, begin, max_i,
+                           Velems_per_dim0, keys_prefix_name_slices);
+
+    auto cmd = [](::sw::redis::Connection &connection,
+                  const ::sw::redis::StringView &hkey,
+                  const std::vector<const char *> *ptrs_i,
+                  const std::vector<std::size_t> *sizes_i) {
+      assert(std::string(hkey.data()).compare(ptrs_i[1]) == 0);
+
+      connection.send(static_cast<int>(ptrs_i->size()),
+                      const_cast<const char **>(ptrs_i->data()),
+                      sizes_i->data());
+    };
+
+    if (node_pipelines) {
+      PipelineBuckets(thread_context, 8U);
+      return Status::OK();
+    }
+
+    std::vector<
+        std::future<std::unique_ptr<redisReply, ::sw::redis::ReplyDeleter>>>
+        results;
+    try {
+      for (unsigned i = 0; i < storage_slice; ++i) {
+        results.emplace_back(
+            network_worker_pool->enqueue([this, &cmd, thread_context, i] {
+              return PipeExecWrite(cmd, 8U, thread_context->buckets[i]);
+            }));
+      }
+      for (auto &&result : results) {
+        result.wait();
+      }
+      if (error_ptr) {
+        std::rethrow_exception(error_ptr);
+      }
+    } catch (const std::exception &err) {
+      error_ptr = nullptr;
+      return errors::Unknown(err.what());
+    }
+
+    return Status::OK();
+  }
+
   virtual Status DelCommand(
       const Tensor &keys, ThreadContext *thread_context, const int64_t begin,
       const int64_t max_i,
@@ -1359,10 +1858,10 @@ every bucket has its own BucketContext for sending data---for locating reply-
     const K *pk_raw =
         reinterpret_cast<const K *>(keys.tensor_data().data()) + begin;
 
-    const unsigned &storage_slice = redis_connection_params.storage_slice;
+    const unsigned storage_slice = redis_connection_params.storage_hashes();
     const unsigned &&vector_len =
         (static_cast<int64_t>(reinterpret_cast<int>(argc)) /
-         redis_connection_params.storage_slice) +
+         redis_connection_params.storage_hashes()) +
         2;
 
     thread_context->HandleReserve(storage_slice, vector_len, total);
@@ -1401,6 +1900,11 @@ every bucket has its own BucketContext for sending data---for locating reply-
                       sizes_i->data());
     };
 
+    if (node_pipelines) {
+      PipelineBuckets(thread_context, 3U);
+      return Status::OK();
+    }
+
     std::vector<
         std::future<std::unique_ptr<redisReply, ::sw::redis::ReplyDeleter>>>
         results;
@@ -226,14 +226,16 @@ class RedisWrapper<
     long long cursor = 0;
     const redisReply *set_reply;
     keys_prefix_name_slices_in_redis.reserve(
-        redis_connection_params.storage_slice);
+        redis_connection_params.storage_hashes());
     while (true) {
+      // The hashes of SubHashStorageMode go on after the hash tag, so the
+      // patterns do not end with it.
       if (only_get_buckets) {
         redis_command = "SCAN " + std::to_string(cursor) + " MATCH " +
-                        keys_prefix_name + "{[0123456789]*}";
+                        keys_prefix_name + "{[0123456789]*";
       } else {
         redis_command = "SCAN " + std::to_string(cursor) + " MATCH " +
-                        keys_prefix_name + "*{[0123456789]*}";
+                        keys_prefix_name + "*{[0123456789]*";
       }
       try {
         reply_server = redis_conn_read->command(cmd, redis_command.data());
@@ -282,14 +284,14 @@ class RedisWrapper<
                 << " existing in Redis server";
       return 0;
     } else if (keys_prefix_name_slices_in_redis.size() ==
-               redis_connection_params.storage_slice) {
+               redis_connection_params.storage_hashes()) {
       LOG(INFO) << "There is already a corresponding table " << keys_prefix_name
                 << " existing in Redis server";
       return 1;
     } else if (keys_prefix_name_slices_in_redis.size() <=
-               redis_connection_params.storage_slice) {
+               redis_connection_params.storage_hashes()) {
       LOG(WARNING) << "storage_slice in redis_connection_params which is "
-                   << redis_connection_params.storage_slice
+                   << redis_connection_params.storage_hashes()
                    << " is bigger than the slices number of this "
                    << keys_prefix_name
                    << " in the Redis Cluster servers which is "
@@ -297,7 +299,7 @@ class RedisWrapper<
       return 2;
     } else {
       LOG(WARNING) << "storage_slice in redis_connection_params which is "
-                   << redis_connection_params.storage_slice
+                   << redis_connection_params.storage_hashes()
                    << " did not equal to the slices number of this "
                    << keys_prefix_name
                    << " in the Redis Single servers which is "
@@ -367,6 +369,10 @@ class RedisWrapper<
       LOG(ERROR) << "RedisHandler error in HscanGetKeysValsInBucket for slices "
                  << keys_prefix_name_slice << " -- " << err.what();
     }
+    if (reply == nullptr || reply->type != REDIS_REPLY_ARRAY ||
+        reply->elements < 2) {
+      return nullptr;
+    }
     if (reply->element[0]->type == REDIS_REPLY_STRING) {
       // #define REDIS_REPLY_STRING 1
       *cursor = std::atoll(reply->element[0]->str);
@@ -498,7 +504,7 @@ class RedisWrapper<
 
     size_t buf_len;
     volatile void *tem_aio_buf;
-    for (unsigned i = 0; i < redis_connection_params.storage_slice; ++i) {
+    for (unsigned i = 0; i < redis_connection_params.storage_hashes(); ++i) {
       redis_command = "DUMP " + keys_prefix_name_slices[i];
       reply.reset();
       try {
@@ -770,7 +776,7 @@ class RedisWrapper<
       const std::vector<std::string> &keys_prefix_name_slices_old,
       const std::vector<std::string> &keys_prefix_name_slices_new) override {
     try {
-      for (unsigned i = 0; i < redis_connection_params.storage_slice; ++i) {
+      for (unsigned i = 0; i < redis_connection_params.storage_hashes(); ++i) {
         network_worker_pool->enqueue([this, &keys_prefix_name_slices_old,
                                       &keys_prefix_name_slices_new, i] {
           DoDuplicateInRedis(keys_prefix_name_slices_old[i],
@@ -788,37 +794,11 @@ class RedisWrapper<
   }
 
  public:
-  /*
-  The structure of ptrs and sizes which for storing Redis command char
-sequence pointer and size of parameters. For example: vector<ThreadContext>
-(for multi-threads, index is thread id, also vector<vector<vector<const char
-*>>>)
-
-std::vector<ThreadContext> (better to be reserved before enter MXXX_COMMAND)
--------------upper var is outside of the MXXX_COMMAND function---------------
-      |
-      | Thread0 has its own ThreadContext
-      |
-every bucket has its own BucketContext for sending data---for locating reply-
-    |                                                      |
-    | std::vector<BucketContext>                           | std::vector
-    |                                                          <unsigned>
-    |
-    |
---char* point to the data and size_t indicates the length of data------------
-  |                    |
-  | std::vector        | std::vector
-  |  <const char*>     |  <std::size_t>
-  |                    |
-(Real Redis command sequence because m-cmd can only be used in same hash tag)
-
-  PS: vector bucket_locs is only allocated in Redis Cluster mode!
-  */
-  virtual std::vector<std::unique_ptr<redisReply, ::sw::redis::ReplyDeleter>>
-  MgetCommand(
-      const Tensor &keys, ThreadContext *thread_context, const int64_t begin,
-      const int64_t max_i,
-      const std::vector<std::string> &keys_prefix_name_slices) override {
+  // Fills the HMGET command of keys [begin, max_i) into the first bucket of
+  // thread_context and returns its argc.
+  int FillMgetArgs(const Tensor &keys, ThreadContext *thread_context,
+                   const int64_t begin, const int64_t max_i,
+                   const std::vector<std::string> &keys_prefix_name_slices) {
     const int argc = (max_i - begin) + 2;
 
     const static char *redis_command = "HMGET";
@@ -857,6 +837,81 @@ every bucket has its own BucketContext for sending data---for locating reply-
     assert(ptrs_0->front() == redis_command);
     assert(sizes_0->front() == redis_command_byte);
 
+    return argc;
+  }
+
+  // Fills the HMGETPACKED command of keys [begin, max_i) into the first
+  // bucket of thread_context and returns its argc. The keys are sent straight
+  // from the tensor, where they already lie back to back.
+  int FillMgetPackedArgs(
+      const Tensor &keys, ThreadContext *thread_context, const int64_t begin,
+      const int64_t max_i, const int64_t Velems_per_dim0,
+      const std::vector<std::string> &keys_prefix_name_slices) {
+    const static char *redis_command = "HMGETPACKED";
+    const static std::size_t redis_command_byte = 11;
+
+    thread_context->HandleReserve(1U, 5U, 0);
+    thread_context->packed_key_bytes = std::to_string(sizeof(K));
+    thread_context->packed_value_bytes =
+        std::to_string(Velems_per_dim0 * sizeof(V));
+
+    thread_context->HandlePushBack(0, redis_command, redis_command_byte);
+    thread_context->HandlePushBack(0, keys_prefix_name_slices[0].data(),
+                                   keys_prefix_name_slices[0].size());
+    thread_context->HandlePushBack(0, thread_context->packed_key_bytes.data(),
+                                   thread_context->packed_key_bytes.size());
+    thread_context->HandlePushBack(0,
+                                   thread_context->packed_value_bytes.data(),
+                                   thread_context->packed_value_bytes.size());
+    thread_context->HandlePushBack(
+        0,
+        reinterpret_cast<const char *>(
+            reinterpret_cast<const K *>(keys.tensor_data().data()) + begin),
+        (max_i - begin) * sizeof(K));  // Direct access to Tensor data
+
+    return 5;
+  }
+
+  /*
+  The structure of ptrs and sizes which for storing Redis command char
+sequence pointer and size of parameters. For example: vector<ThreadContext>
+(for multi-threads, index is thread id, also vector<vector<vector<const char
+*>>>)
+
+std::vector<ThreadContext> (better to be reserved before enter MXXX_COMMAND)
+-------------upper var is outside of the MXXX_COMMAND function---------------
+      |
+      | Thread0 has its own ThreadContext
+      |
+every bucket has its own BucketContext for sending data---for locating reply-
+    |                                                      |
+    | std::vector<BucketContext>                           | std::vector
+    |                                                          <unsigned>
+    |
+    |
+--char* point to the data and size_t indicates the length of data------------
+  |                    |
+  | std::vector        | std::vector
+  |  <const char*>     |  <std::size_t>
+  |                    |
+(Real Redis command sequence because m-cmd can only be used in same hash tag)
+
+  PS: vector bucket_locs is only allocated in Redis Cluster mode!
+  */
+  virtual std::vector<std::unique_ptr<redisReply, ::sw::redis::ReplyDeleter>>
+  MgetCommand(
+      const Tensor &keys, ThreadContext *thread_context, const int64_t begin,
+      const int64_t max_i, const int64_t Velems_per_dim0,
+      const std::vector<std::string> &keys_prefix_name_slices) override {
+    const bool packed = redis_connection_params.using_packed_commands;
+    const int argc =
+        packed ? FillMgetPackedArgs(keys, thread_context, begin, max_i,
+                                    Velems_per_dim0, keys_prefix_name_slices)
+               : FillMgetArgs(keys, thread_context, begin, max_i,
+                              keys_prefix_name_slices);
+    std::vector<const char *> *ptrs_0 = thread_context->buckets[0]->ptrs.get();
+    std::vector<std::size_t> *sizes_0 = thread_context->buckets[0]->sizes.get();
+
     auto cmd = [](::sw::redis::Connection &connection, const int argc,
                   const std::vector<const char *> *ptrs_0,
                   const std::vector<std::size_t> *sizes_0) {
@@ -865,16 +920,61 @@ every bucket has its own BucketContext for sending data---for locating reply-
     };
 
     std::vector<std::unique_ptr<redisReply, ::sw::redis::ReplyDeleter>> reply;
+    profiler::TraceMe trace(
+        [&] {
+          return profiler::TraceMeEncode(
+              "RedisNetworkWait",
+              {{"command", packed ? "HMGETPACKED" : "HMGET"},
+               {"argc", argc},
+               {"bytes", ArgsBytes(*sizes_0, argc)}});
+        },
+        profiler::TraceMeLevel::kInfo);
     try {
       reply.push_back(redis_conn_read->command(cmd, argc, ptrs_0, sizes_0));
     } catch (const std::exception &err) {
       reply.push_back(nullptr);
-      LOG(ERROR) << "RedisHandler error in MGET_COMMAND for HMGET "
+      LOG(ERROR) << "RedisHandler error in MGET_COMMAND for "
+                 << (packed ? "HMGETPACKED " : "HMGET ")
                  << keys_prefix_name_slices[0] << " -- " << err.what();
     }
     return reply;
   }
 
+  virtual void MgetCommandArgs(
+      const Tensor &keys, ThreadContext *thread_context, const int64_t begin,
+      const int64_t max_i, const int64_t Velems_per_dim0,
+      const std::vector<std::string> &keys_prefix_name_slices,
+      std::vector<RedisCommandArgs> *commands) override {
+    const int argc =
+        redis_connection_params.using_packed_commands
+            ? FillMgetPackedArgs(keys, thread_context, begin, max_i,
+                                 Velems_per_dim0, keys_prefix_name_slices)
+            : FillMgetArgs(keys, thread_context, begin, max_i,
+                           keys_prefix_name_slices);
+    commands->push_back({0U, argc, thread_context->buckets[0]->ptrs->data(),
+                         thread_context->buckets[0]->sizes->data()});
+  }
+
+  virtual void MgetTensorSinks(
+      Tensor *values, const Tensor &default_value, Tensor *exists,
+      const bool is_full_default, ThreadContext *thread_context,
+      const int64_t begin, const int64_t max_i, const int64_t Velems_per_dim0,
+      std::vector<std::unique_ptr<RedisReplySink>> *sinks) override {
+    std::vector<int64_t> rows(max_i - begin);
+    std::iota(rows.begin(), rows.end(), begin);
+    sinks->clear();
+    if (redis_connection_params.using_packed_commands) {
+      sinks->emplace_back(new PackedMgetTensorSink<V>(
+          values, default_value, exists, is_full_default, Velems_per_dim0,
+          std::move(rows)));
+    } else {
+      sinks->emplace_back(new MgetTensorSink<V>(values, default_value, exists,
+                                                is_full_default,
+                                                Velems_per_dim0,
+                                                std::move(rows)));
+    }
+  }
+
   inline void CopyDefaultToTensor(const bool is_full_default, const V *pv_raw,
                                   const V *dft_raw,
                                   const V *const dft_raw_begin,
@@ -909,8 +1009,19 @@ every bucket has its own BucketContext for sending data---for locating reply-
 
     redisReply *temp_reply;
     bool print_once = false;
+    const std::size_t value_bytes = Velems_per_dim0 * sizeof(V);
+    const char *packed_value;
     for (auto i = 0; i < max_i - begin;
          ++i, pv_raw += Velems_per_dim0, dft_raw += Velems_per_dim0) {
+      if (redis_connection_params.using_packed_commands) {
+        if (PackedReplyValue(reply[0].get(), i, value_bytes, &packed_value)) {
+          ReplyMemcpyToValTensor<V>(pv_raw, packed_value, Velems_per_dim0);
+        } else {
+          CopyDefaultToTensor(is_full_default, pv_raw, dft_raw, dft_raw_begin,
+                              Velems_per_dim0);
+        }
+        continue;
+      }
       if (reply[0] != nullptr) {
         if (reply[0]->type == REDIS_REPLY_ARRAY) {
           temp_reply = reply[0]->element[i];
@@ -960,8 +1071,21 @@ every bucket has its own BucketContext for sending data---for locating reply-
 
     redisReply *temp_reply;
     bool print_once = false;
+    const std::size_t value_bytes = Velems_per_dim0 * sizeof(V);
+    const char *packed_value;
     for (int64_t i = 0, j = begin; i < max_i - begin;
          ++i, ++j, pv_raw += Velems_per_dim0, dft_raw += Velems_per_dim0) {
+      if (redis_connection_params.using_packed_commands) {
+        exists_flat(j) =
+            PackedReplyValue(reply[0].get(), i, value_bytes, &packed_value);
+        if (exists_flat(j)) {
+          ReplyMemcpyToValTensor<V>(pv_raw, packed_value, Velems_per_dim0);
+        } else {
+          CopyDefaultToTensor(is_full_default, pv_raw, dft_raw, dft_raw_begin,
+                              Velems_per_dim0);
+        }
+        continue;
+      }
       if (reply[0] != nullptr) {
         if (reply[0]->type == REDIS_REPLY_ARRAY) {
           temp_reply = reply[0]->element[i];
@@ -994,10 +1118,13 @@ every bucket has its own BucketContext for sending data---for locating reply-
     return Status::OK();
   }
 
-  virtual Status MsetCommand(
-      const Tensor &keys, const Tensor &values, ThreadContext *thread_context,
-      const int64_t begin, const int64_t max_i, const int64_t Velems_per_dim0,
-      const std::vector<std::string> &keys_prefix_name_slices) override {
+  // Fills the HMSET command of keys [begin, max_i) into the first bucket of
+  // thread_context and returns its argc.
+  int FillMsetArgs(const Tensor &keys, const Tensor &values,
+                   ThreadContext *thread_context, const int64_t begin,
+                   const int64_t max_i, const int64_t Velems_per_dim0,
+                   const std::vector<std::string> &keys_prefix_name_slices,
+                   std::vector<std::vector<char>> *buff) {
     const int &&total = max_i - begin;
     const int &&argc = total * 2 + 2;
 
@@ -1032,8 +1159,8 @@ every bucket has its own BucketContext for sending data---for locating reply-
     ++sizes_iter;
 
     VContentAndTypeSizeResult VCATS_temp;
-    // std::vector<char> for storage all string in one KV pair
-    std::vector<std::vector<char>> buff_temp(total);
+    std::vector<std::vector<char>> &buff_temp = *buff;
+    buff_temp.resize(total);
 
     for (int i = 0; pk_raw != pk_raw_end;
          ++i, ++pk_raw, pv_raw += Velems_per_dim0) {
@@ -1053,6 +1180,64 @@ every bucket has its own BucketContext for sending data---for locating reply-
     assert(ptrs_0->front() == redis_command);
     assert(sizes_0->front() == redis_command_byte);
 
+    return argc;
+  }
+
+  // Fills the HMSETPACKED command of keys [begin, max_i) into the first
+  // bucket of thread_context and returns its argc. The keys and the values
+  // are sent straight from their tensors.
+  int FillMsetPackedArgs(
+      const Tensor &keys, const Tensor &values, ThreadContext *thread_context,
+      const int64_t begin, const int64_t max_i, const int64_t Velems_per_dim0,
+      const std::vector<std::string> &keys_prefix_name_slices) {
+    const static char *redis_command = "HMSETPACKED";
+    const static std::size_t redis_command_byte = 11;
+
+    thread_context->HandleReserve(1U, 6U, 0);
+    thread_context->packed_key_bytes = std::to_string(sizeof(K));
+    thread_context->packed_value_bytes =
+        std::to_string(Velems_per_dim0 * sizeof(V));
+
+    thread_context->HandlePushBack(0, redis_command, redis_command_byte);
+    thread_context->HandlePushBack(0, keys_prefix_name_slices[0].data(),
+                                   keys_prefix_name_slices[0].size());
+    thread_context->HandlePushBack(0, thread_context->packed_key_bytes.data(),
+                                   thread_context->packed_key_bytes.size());
+    thread_context->HandlePushBack(0,
+                                   thread_context->packed_value_bytes.data(),
+                                   thread_context->packed_value_bytes.size());
+    // Direct access to Tensor data in TensorFlow
+    thread_context->HandlePushBack(
+        0,
+        reinterpret_cast<const char *>(
+            reinterpret_cast<const K *>(keys.tensor_data().data()) + begin),
+        (max_i - begin) * sizeof(K));
+    thread_context->HandlePushBack(
+        0,
+        reinterpret_cast<const char *>(
+            reinterpret_cast<const V *>(values.tensor_data().data()) +
+            begin * Velems_per_dim0),
+        (max_i - begin) * Velems_per_dim0 * sizeof(V));
+
+    return 6;
+  }
+
+  virtual Status MsetCommand(
+      const Tensor &keys, const Tensor &values, ThreadContext *thread_context,
+      const int64_t begin, const int64_t max_i, const int64_t Velems_per_dim0,
+      const std::vector<std::string> &keys_prefix_name_slices) override {
+    const bool packed = redis_connection_params.using_packed_commands;
+    // std::vector<char> for storage all string in one KV pair
+    std::vector<std::vector<char>> buff_temp;
+    const int argc =
+        packed ? FillMsetPackedArgs(keys, values, thread_context, begin, max_i,
+                                    Velems_per_dim0, keys_prefix_name_slices)
+               : FillMsetArgs(keys, values, thread_context, begin, max_i,
+                              Velems_per_dim0, keys_prefix_name_slices,
+                              &buff_temp);
+    std::vector<const char *> *ptrs_0 = thread_context->buckets[0]->ptrs.get();
+    std::vector<std::size_t> *sizes_0 = thread_context->buckets[0]->sizes.get();
+
     auto cmd = [](::sw::redis::Connection &connection, const int argc,
                   const std::vector<const char *> *ptrs_0,
                   const std::vector<std::size_t> *sizes_0) {
@@ -1060,10 +1245,20 @@ every bucket has its own BucketContext for sending data---for locating reply-
                       sizes_0->data());
     };
 
+    profiler::TraceMe trace(
+        [&] {
+          return profiler::TraceMeEncode(
+              "RedisNetworkWait",
+              {{"command", packed ? "HMSETPACKED" : "HMSET"},
+               {"argc", argc},
+               {"bytes", ArgsBytes(*sizes_0, argc)}});
+        },
+        profiler::TraceMeLevel::kInfo);
     try {
       redis_conn_write->command(cmd, argc, ptrs_0, sizes_0);
     } catch (const std::exception &err) {
-      LOG(ERROR) << "RedisHandler error in MSET_COMMAND for HMSET "
+      LOG(ERROR) << "RedisHandler error in MSET_COMMAND for "
+                 << (packed ? "HMSETPACKED " : "HMSET ")
                  << keys_prefix_name_slices[0] << " -- " << err.what();
       return errors::Unknown(err.what());
     }
@@ -1071,17 +1266,35 @@ every bucket has its own BucketContext for sending data---for locating reply-
     return Status::OK();
   }
 
-  virtual Status MaccumCommand(
-      const Tensor &keys, const Tensor &values_or_delta, const Tensor &exists,
-      ThreadContext *thread_context, const int64_t begin, const int64_t max_i,
-      const int64_t Velems_per_dim0,
-      const std::vector<std::string> &keys_prefix_name_slices) override {
+  virtual void MsetCommandArgs(
+      const Tensor &keys, const Tensor &values, ThreadContext *thread_context,
+      const int64_t begin, const int64_t max_i, const int64_t Velems_per_dim0,
+      const std::vector<std::string> &keys_prefix_name_slices,
+      std::vector<std::vector<char>> *buff,
+      std::vector<RedisCommandArgs> *commands) override {
+    const int argc =
+        redis_connection_params.using_packed_commands
+            ? FillMsetPackedArgs(keys, values, thread_context, begin, max_i,
+                                 Velems_per_dim0, keys_prefix_name_slices)
+            : FillMsetArgs(keys, values, thread_context, begin, max_i,
+                           Velems_per_dim0, keys_prefix_name_slices, buff);
+    commands->push_back({0U, argc, thread_context->buckets[0]->ptrs->data(),
+                         thread_context->buckets[0]->sizes->data()});
+  }
+
+  // Fills the HMACCUM command of keys [begin, max_i) into the first bucket of
+  // thread_context and returns its argc.
+  int FillMaccumArgs(const Tensor &keys, const Tensor &values_or_delta,
+                     const Tensor &exists, ThreadContext *thread_context,
+                     const int64_t begin, const int64_t max_i,
+                     const int64_t Velems_per_dim0, const std::string &dTypestr,
+                     const std::vector<std::string> &keys_prefix_name_slices,
+                     std::vector<std::vector<char>> *buff) {
     const int &&total = max_i - begin;
     const int &&argc = total * 2 + 4;
 
     const static char *redis_command = "HMACCUM";
     const static std::size_t redis_command_byte = 7;
-    std::string dTypestr = DataTypeString(values_or_delta.dtype());
 
     thread_context->HandleReserve(1U, argc, 0);
 
@@ -1116,8 +1329,8 @@ every bucket has its own BucketContext for sending data---for locating reply-
     ++sizes_iter;
 
     VContentAndTypeSizeResult VCATS_temp;
-    // std::vector<char> for storage all string in one KV pair
-    std::vector<std::vector<char>> buff_temp(total);
+    std::vector<std::vector<char>> &buff_temp = *buff;
+    buff_temp.resize(total);
 
     for (int i = 0; pk_raw != pk_raw_end;
          ++i, ++pk_raw, pv_raw += Velems_per_dim0) {
@@ -1142,6 +1355,76 @@ every bucket has its own BucketContext for sending data---for locating reply-
     assert(ptrs_0->front() == redis_command);
     assert(sizes_0->front() == redis_command_byte);
 
+    return argc;
+  }
+
+  // Fills the HMACCUMPACKED command of keys [begin, max_i) into the first
+  // bucket of thread_context and returns its argc. The keys, the values or
+  // deltas and the exists flags are sent straight from their tensors.
+  int FillMaccumPackedArgs(
+      const Tensor &keys, const Tensor &values_or_delta, const Tensor &exists,
+      ThreadContext *thread_context, const int64_t begin, const int64_t max_i,
+      const int64_t Velems_per_dim0, const std::string &dTypestr,
+      const std::vector<std::string> &keys_prefix_name_slices) {
+    const static char *redis_command = "HMACCUMPACKED";
+    const static std::size_t redis_command_byte = 13;
+
+    thread_context->HandleReserve(1U, 8U, 0);
+    thread_context->packed_key_bytes = std::to_string(sizeof(K));
+    thread_context->packed_value_bytes =
+        std::to_string(Velems_per_dim0 * sizeof(V));
+
+    thread_context->HandlePushBack(0, redis_command, redis_command_byte);
+    thread_context->HandlePushBack(0, keys_prefix_name_slices[0].data(),
+                                   keys_prefix_name_slices[0].size());
+    thread_context->HandlePushBack(0, dTypestr.data(), dTypestr.size());
+    thread_context->HandlePushBack(0, thread_context->packed_key_bytes.data(),
+                                   thread_context->packed_key_bytes.size());
+    thread_context->HandlePushBack(0,
+                                   thread_context->packed_value_bytes.data(),
+                                   thread_context->packed_value_bytes.size());
+    // Direct access to Tensor data in TensorFlow
+    thread_context->HandlePushBack(
+        0,
+        reinterpret_cast<const char *>(
+            reinterpret_cast<const K *>(keys.tensor_data().data()) + begin),
+        (max_i - begin) * sizeof(K));
+    thread_context->HandlePushBack(
+        0,
+        reinterpret_cast<const char *>(
+            reinterpret_cast<const V *>(values_or_delta.tensor_data().data()) +
+            begin * Velems_per_dim0),
+        (max_i - begin) * Velems_per_dim0 * sizeof(V));
+    thread_context->HandlePushBack(
+        0,
+        reinterpret_cast<const char *>(
+            reinterpret_cast<const bool *>(exists.tensor_data().data()) +
+            begin),
+        (max_i - begin) * sizeof(bool));
+
+    return 8;
+  }
+
+  virtual Status MaccumCommand(
+      const Tensor &keys, const Tensor &values_or_delta, const Tensor &exists,
+      ThreadContext *thread_context, const int64_t begin, const int64_t max_i,
+      const int64_t Velems_per_dim0,
+      const std::vector<std::string> &keys_prefix_name_slices) override {
+    const bool packed = redis_connection_params.using_packed_commands;
+    std::string dTypestr = DataTypeString(values_or_delta.dtype());
+    // std::vector<char> for storage all string in one KV pair
+    std::vector<std::vector<char>> buff_temp;
+    const int argc =
+        packed ? FillMaccumPackedArgs(keys, values_or_delta, exists,
+                                      thread_context, begin, max_i,
+                                      Velems_per_dim0, dTypestr,
+                                      keys_prefix_name_slices)
+               : FillMaccumArgs(keys, values_or_delta, exists, thread_context,
+                                begin, max_i, Velems_per_dim0, dTypestr,
+                                keys_prefix_name_slices, &buff_temp);
+    std::vector<const char *> *ptrs_0 = thread_context->buckets[0]->ptrs.get();
+    std::vector<std::size_t> *sizes_0 = thread_context->buckets[0]->sizes.get();
+
     auto cmd = [](::sw::redis::Connection &connection, const int argc,
                   const std::vector<const char *> *ptrs_0,
                   const std::vector<std::size_t> *sizes_0) {
@@ -1149,10 +1432,20 @@ every bucket has its own BucketContext for sending data---for locating reply-
                       sizes_0->data());
     };
 
+    profiler::TraceMe trace(
+        [&] {
+          return profiler::TraceMeEncode(
+              "RedisNetworkWait",
+              {{"command", packed ? "HMACCUMPACKED" : "HMACCUM"},
+               {"argc", argc},
+               {"bytes", ArgsBytes(*sizes_0, argc)}});
+        },
+        profiler::TraceMeLevel::kInfo);
     try {
       redis_conn_write->command(cmd, argc, ptrs_0, sizes_0);
     } catch (const std::exception &err) {
-      LOG(ERROR) << "RedisHandler error in MACCUM_COMMAND for HMACCUM "
+      LOG(ERROR) << "RedisHandler error in MACCUM_COMMAND for "
+                 << (packed ? "HMACCUMPACKED " : "HMACCUM ")
                  << keys_prefix_name_slices[0] << " -- " << err.what();
       return errors::Unknown(err.what());
     }
@@ -1160,6 +1453,95 @@ every bucket has its own BucketContext for sending data---for locating reply-
     return Status::OK();
   }
 
+  // Fills the optimizer command of keys [begin, max_i) into the first bucket
+  // of thread_context and returns its argc. The keys and the grads are sent
+  // straight from their tensors.
+  int FillSparseApplyArgs(
+      const std::string &command, const Tensor &keys, const Tensor &grads,
+      const std::vector<std::vector<std::string>> &slot_slices,
+      const std::vector<std::string> &hyperparams, const std::string &dTypestr,
+      ThreadContext *thread_context, const int64_t begin, const int64_t max_i,
+      const int64_t Velems_per_dim0,
+      const std::vector<std::string> &keys_prefix_name_slices) {
+    const int argc = 7 + slot_slices.size() + hyperparams.size();
+    thread_context->HandleReserve(1U, argc, 0);
+    thread_context->packed_key_bytes = std::to_string(sizeof(K));
+    thread_context->packed_value_bytes =
+        std::to_string(Velems_per_dim0 * sizeof(V));
+
+    thread_context->HandlePushBack(0, command.data(), command.size());
+    thread_context->HandlePushBack(0, keys_prefix_name_slices[0].data(),
+                                   keys_prefix_name_slices[0].size());
+    for (const std::vector<std::string> &slices : slot_slices) {
+      thread_context->HandlePushBack(0, slices[0].data(), slices[0].size());
+    }
+    thread_context->HandlePushBack(0, dTypestr.data(), dTypestr.size());
+    thread_context->HandlePushBack(0, thread_context->packed_key_bytes.data(),
+                                   thread_context->packed_key_bytes.size());
+    thread_context->HandlePushBack(0,
+                                   thread_context->packed_value_bytes.data(),
+                                   thread_context->packed_value_bytes.size());
+    // Direct access to Tensor data in TensorFlow
+    thread_context->HandlePushBack(
+        0,
+        reinterpret_cast<const char *>(
+            reinterpret_cast<const K *>(keys.tensor_data().data()) + begin),
+        (max_i - begin) * sizeof(K));
+    thread_context->HandlePushBack(
+        0,
+        reinterpret_cast<const char *>(
+            reinterpret_cast<const V *>(grads.tensor_data().data()) +
+            begin * Velems_per_dim0),
+        (max_i - begin) * Velems_per_dim0 * sizeof(V));
+    for (const std::string &hyperparam : hyperparams) {
+      thread_context->HandlePushBack(0, hyperparam.data(), hyperparam.size());
+    }
+
+    return argc;
+  }
+
+  virtual Status SparseApplyCommand(
+      const std::string &command, const Tensor &keys, const Tensor &grads,
+      const std::vector<std::vector<std::string>> &slot_slices,
+      const std::vector<std::string> &hyperparams,
+      ThreadContext *thread_context, const int64_t begin, const int64_t max_i,
+      const int64_t Velems_per_dim0,
+      const std::vector<std::string> &keys_prefix_name_slices) override {
+    std::string dTypestr = DataTypeString(grads.dtype());
+    const int argc = FillSparseApplyArgs(
+        command, keys, grads, slot_slices, hyperparams, dTypestr,
+        thread_context, begin, max_i, Velems_per_dim0, keys_prefix_name_slices);
+    std::vector<const char *> *ptrs_0 = thread_context->buckets[0]->ptrs.get();
+    std::vector<std::size_t> *sizes_0 = thread_context->buckets[0]->sizes.get();
+
+    auto cmd = [](::sw::redis::Connection &connection, const int argc,
+                  const std::vector<const char *> *ptrs_0,
+                  const std::vector<std::size_t> *sizes_0) {
+      connection.send(argc, const_cast<const char **>(ptrs_0->data()),
+                      sizes_0->data());
+    };
+
+    profiler::TraceMe trace(
+        [&] {
+          return profiler::TraceMeEncode(
+              "RedisNetworkWait",
+              {{"command", command},
+               {"argc", argc},
+               {"bytes", ArgsBytes(*sizes_0, argc)}});
+        },
+        profiler::TraceMeLevel::kInfo);
+    try {
+      redis_conn_write->command(cmd, argc, ptrs_0, sizes_0);
+    } catch (const std::exception &err) {
+      LOG(ERROR) << "RedisHandler error in SPARSE_APPLY_COMMAND for "
+                 << command << " " << keys_prefix_name_slices[0] << " -- "
+                 << err.what();
+      return errors::Unknown(err.what());
+    }
+
+    return Status::OK();
+  }
+
   virtual Status DelCommand(
       const Tensor &keys, ThreadContext *thread_context, const int64_t begin,
       const int64_t max_i,
@@ -1209,6 +1591,15 @@ every bucket has its own BucketContext for sending data---for locating reply-
                       sizes_0->data());
     };
 
+    profiler::TraceMe trace(
+        [&] {
+          return profiler::TraceMeEncode(
+              "RedisNetworkWait",
+              {{"command", "HDEL"},
+               {"argc", argc},
+               {"bytes", ArgsBytes(*sizes_0, argc)}});
+        },
+        profiler::TraceMeLevel::kInfo);
     try {
       /*auto reply=*/redis_conn_write->command(cmd, argc, ptrs_0, sizes_0);
     } catch (const std::exception &err) {
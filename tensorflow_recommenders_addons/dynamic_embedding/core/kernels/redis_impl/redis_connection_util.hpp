@@ -24,16 +24,25 @@ limitations under the License.
 
 #include <cmath>
 #include <iostream>
+#include <numeric>
 #include <sstream>
 
 #include "md5.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/profiler/lib/traceme.h"
+#include "tensorflow/core/profiler/lib/traceme_encode.h"
 
 namespace tensorflow {
 namespace recommenders_addons {
 namespace redis_connection {
 
+// Bytes of the first argc arguments of a command, for profiler events.
+inline std::size_t ArgsBytes(const std::vector<std::size_t> &sizes,
+                             const std::size_t argc) {
+  return std::accumulate(sizes.begin(), sizes.begin() + argc, std::size_t(0));
+}
+
 const static unsigned hardware_concurrency_ =
     std::thread::hardware_concurrency();
 
@@ -127,6 +136,8 @@ std::array<unsigned char, 16> MD5(const std::string &src) {
 
 enum Connection_Mode { ClusterMode = 0, SentinelMode = 1, StandaloneMode = 2 };
 
+enum Storage_Mode { HashStorageMode = 0, SubHashStorageMode = 1 };
+
 struct Redis_Connection_Params {
   int redis_connection_mode =
       1;  // ClusterMode = 0, SentinelMode = 1, StandaloneMode = 2
@@ -158,6 +169,14 @@ struct Redis_Connection_Params {
   unsigned storage_slice =
       1;  // For deciding bucket number, which usually is how
           // many Redis instance may be used in the trainning.
+  unsigned storage_mode =
+      0;  // HashStorageMode = 0 keeps each storage slice in one Redis hash.
+          // SubHashStorageMode = 1 splits each storage slice over
+          // storage_sub_slice hashes with hash tags of their own, so that no
+          // single hash of a large table becomes a hotspot for HSCAN, DUMP,
+          // RESTORE or expiry and the hashes spread over the whole cluster.
+  unsigned storage_sub_slice = 16;  // Hashes per storage slice in
+                                    // SubHashStorageMode.
   bool using_hash_storage_slice =
       false;  // If True, IDs will be calculated hash(CRC32) value and then MOD
               // to decide which bucket number they belong to. If False, only
@@ -192,6 +211,44 @@ struct Redis_Connection_Params {
   // table_store_mode = 0; Saving and restoring table into redis rdb file in
   // model_lib_abs_dir, table_store_mode = 1; Saving and restoring nothing,
   // keeping data in redis servers, table_store_mode = 2.
+  bool redis_async_client =
+      false;  // If True, lookups and inserts are pipelined on one event-driven
+              // connection per Redis master and the ops complete on reply,
+              // instead of blocking a thread per storage slice.
+  unsigned redis_async_client_threads =
+      4;  // The event loops of the asynchronous client, each with its own
+          // connection per Redis master. The replies are parsed on these
+          // threads, so more of them serve larger lookups.
+  bool redis_pipeline_per_node =
+      false;  // If True, in cluster mode the commands of all the storage
+              // slices served by one Redis master are pipelined on one
+              // connection, so an op waits one round trip per master rather
+              // than one per storage slice.
+  bool using_packed_commands =
+      false;  // If True, lookups, inserts and accumulates send all the keys
+              // and values of a storage slice packed into one argument each,
+              // with HMGETPACKED, HMSETPACKED and HMACCUMPACKED. It needs the
+              // BPV2 module in third_party/redis_module loaded in every Redis
+              // server.
+  unsigned long long near_cache_capacity =
+      0;  // Rows of the table kept in the memory of the process in front of
+          // Redis, so that lookups only read the missing keys from Redis. 0
+          // disables the cache.
+  int near_cache_ttl_in_seconds =
+      60;  // Age after which a cached row is read from Redis again, which
+           // bounds how stale a row updated by another worker may be. It
+           // will not take effect if it is less than or equal to zero.
+  bool near_cache_write_through =
+      true;  // If True, inserts also update the cached rows of their keys. If
+             // False, they drop them and the next lookup reads them again.
+  bool using_write_behind =
+      false;  // If True, inserts and accumulates are buffered in the process,
+              // repeated keys coalesced, and written to Redis in the
+              // background. Lookups in this process see the buffered writes.
+  int write_behind_interval_in_ms =
+      100;  // How often the buffered writes are flushed to Redis.
+  unsigned long long write_behind_max_keys =
+      65536;  // Number of buffered keys which makes a flush start at once.
 
   Redis_Connection_Params &operator=(const Redis_Connection_Params &x) {
     redis_connection_mode = x.redis_connection_mode;
@@ -217,6 +274,8 @@ struct Redis_Connection_Params {
     storage_slice_import =
         x.storage_slice_import >= 0 ? x.storage_slice_import : x.storage_slice;
     storage_slice = x.storage_slice;
+    storage_mode = x.storage_mode;
+    storage_sub_slice = x.storage_sub_slice;
     using_hash_storage_slice = x.using_hash_storage_slice;
     keys_sending_size = x.keys_sending_size;
     using_md5_prefix_name = x.using_md5_prefix_name;
@@ -230,8 +289,35 @@ struct Redis_Connection_Params {
     expire_model_tag_in_seconds = x.expire_model_tag_in_seconds;
     model_lib_abs_dir = check_dir(x.model_lib_abs_dir);
     table_store_mode = x.table_store_mode;
+    redis_async_client = x.redis_async_client;
+    redis_async_client_threads = x.redis_async_client_threads;
+    redis_pipeline_per_node = x.redis_pipeline_per_node;
+    using_packed_commands = x.using_packed_commands;
+    near_cache_capacity = x.near_cache_capacity;
+    near_cache_ttl_in_seconds = x.near_cache_ttl_in_seconds;
+    near_cache_write_through = x.near_cache_write_through;
+    using_write_behind = x.using_write_behind;
+    write_behind_interval_in_ms = x.write_behind_interval_in_ms;
+    write_behind_max_keys = x.write_behind_max_keys;
     return *this;
   }
+
+  // Redis hashes holding the table: one per storage slice, or
+  // storage_sub_slice per storage slice in SubHashStorageMode.
+  unsigned storage_hashes() const {
+    return storage_mode == SubHashStorageMode
+               ? storage_slice * storage_sub_slice
+               : storage_slice;
+  }
+
+  // As storage_hashes, for the table imported from model_tag_import.
+  unsigned storage_hashes_import() const {
+    const unsigned slices = storage_slice_import >= 0
+                                ? static_cast<unsigned>(storage_slice_import)
+                                : storage_slice;
+    return storage_mode == SubHashStorageMode ? slices * storage_sub_slice
+                                              : slices;
+  }
 };
 
 class BucketContext {
@@ -280,6 +366,14 @@ class ThreadContext {
   std::atomic<bool> thread_occupied{false};
   std::vector<std::unique_ptr<BucketContext>> buckets;
   std::unique_ptr<std::vector<unsigned>> bucket_locs;
+  // Arguments of the packed commands which the buckets point to: the byte
+  // sizes of a key and a value, and the keys, values and exists flags of
+  // each bucket back to back.
+  std::string packed_key_bytes;
+  std::string packed_value_bytes;
+  std::vector<std::vector<char>> packed_keys;
+  std::vector<std::vector<char>> packed_values;
+  std::vector<std::vector<char>> packed_exists;
 
   void HandleReserve(const unsigned storage_slice, const unsigned vector_len,
                      const int keys_num) {
@@ -322,6 +416,39 @@ class ThreadContext {
 
 typedef unsigned (*KBucketNumHandle)(uint32_t, const uint8_t *, size_t);
 
+// One command built into a ThreadContext without being sent, for the
+// asynchronous client and the pipelines per cluster master. bucket is the
+// index of its reply in the replies read by MgetToTensor.
+struct RedisCommandArgs {
+  unsigned bucket;
+  int argc;
+  const char **argv;
+  const std::size_t *argvlen;
+};
+
+// Receives the elements of the array replying to one command while the
+// asynchronous client parses it, so that hiredis never allocates a redisReply
+// or copies a string for them. idx is the index of an element in the array.
+class RedisReplySink {
+ public:
+  virtual ~RedisReplySink() {}
+
+  // Called before the elements. Returns false when the array does not have
+  // the expected number of elements, which are then ignored.
+  virtual bool OnArray(const std::size_t elements) = 0;
+
+  virtual void OnString(const std::size_t idx, const char *str,
+                        const std::size_t len) = 0;
+
+  // Called for a nil element, or any element which is not a string.
+  virtual void OnNil(const std::size_t idx) = 0;
+
+  // Whether all the expected elements have been received.
+  virtual bool Complete() const = 0;
+
+  virtual int64_t NilElements() const = 0;
+};
+
 class RedisVirtualWrapper {
  protected:
   Redis_Connection_Params redis_connection_params;
@@ -392,6 +519,33 @@ class RedisVirtualWrapper {
     return Status::OK();
   }
 
+  // Number of the keys replied by MgetCommand which were not found, where
+  // keys is the number of keys it was given.
+  int64_t MgetMisses(
+      const std::vector<std::unique_ptr<redisReply, ::sw::redis::ReplyDeleter>>
+          &replies,
+      const int64_t keys) const {
+    int64_t found = 0;
+    for (const auto &reply : replies) {
+      if (reply == nullptr || reply->type != REDIS_REPLY_ARRAY) continue;
+      if (redis_connection_params.using_packed_commands) {
+        if (reply->elements != 2 ||
+            reply->element[0]->type != REDIS_REPLY_STRING) {
+          continue;
+        }
+        for (size_t i = 0; i < reply->element[0]->len; ++i) {
+          found += __builtin_popcount(
+              static_cast<unsigned char>(reply->element[0]->str[i]));
+        }
+      } else {
+        for (size_t i = 0; i < reply->elements; ++i) {
+          found += reply->element[i]->type != REDIS_REPLY_NIL;
+        }
+      }
+    }
+    return keys - found;
+  }
+
   virtual Status Conn() = 0;
 
   virtual std::vector<std::string> GetKeyBucketsAndOptimizerParamsWithName(
@@ -436,8 +590,24 @@ class RedisVirtualWrapper {
   virtual std::vector<std::unique_ptr<redisReply, ::sw::redis::ReplyDeleter>>
   MgetCommand(const Tensor &keys, ThreadContext *thread_context,
               const int64_t begin, const int64_t max_i,
+              const int64_t Velems_per_dim0,
               const std::vector<std::string> &keys_prefix_name_slices) = 0;
 
+  virtual void MgetCommandArgs(
+      const Tensor &keys, ThreadContext *thread_context, const int64_t begin,
+      const int64_t max_i, const int64_t Velems_per_dim0,
+      const std::vector<std::string> &keys_prefix_name_slices,
+      std::vector<RedisCommandArgs> *commands) = 0;
+
+  // One sink per bucket of thread_context, decoding the reply to the command
+  // of that bucket made by MgetCommandArgs straight into the rows of values,
+  // as MgetToTensor or MgetToTensorWithExist would. exists may be nullptr.
+  virtual void MgetTensorSinks(
+      Tensor *values, const Tensor &default_value, Tensor *exists,
+      const bool is_full_default, ThreadContext *thread_context,
+      const int64_t begin, const int64_t max_i, const int64_t Velems_per_dim0,
+      std::vector<std::unique_ptr<RedisReplySink>> *sinks) = 0;
+
   virtual Status MgetToTensor(
       Tensor *values, const Tensor &default_value, const bool is_full_default,
       ThreadContext *thread_context,
@@ -459,12 +629,33 @@ class RedisVirtualWrapper {
       const int64_t begin, const int64_t max_i, const int64_t Velems_per_dim0,
       const std::vector<std::string> &keys_prefix_name_slices) = 0;
 
+  // buff holds the serialized string values the commands point to.
+  virtual void MsetCommandArgs(
+      const Tensor &keys, const Tensor &values, ThreadContext *thread_context,
+      const int64_t begin, const int64_t max_i, const int64_t Velems_per_dim0,
+      const std::vector<std::string> &keys_prefix_name_slices,
+      std::vector<std::vector<char>> *buff,
+      std::vector<RedisCommandArgs> *commands) = 0;
+
   virtual Status MaccumCommand(
       const Tensor &keys, const Tensor &values, const Tensor &exists,
       ThreadContext *thread_context, const int64_t begin, const int64_t max_i,
       const int64_t Velems_per_dim0,
       const std::vector<std::string> &keys_prefix_name_slices) = 0;
 
+  // Sends the optimizer command of the BPV2 module, HMSGD, HMADAGRAD or
+  // HMADAM, with the keys [begin, max_i) and their grads packed. slot_slices
+  // holds the storage slices of every slot table, which share the hash tags
+  // of keys_prefix_name_slices, and hyperparams the command's trailing
+  // arguments.
+  virtual Status SparseApplyCommand(
+      const std::string &command, const Tensor &keys, const Tensor &grads,
+      const std::vector<std::vector<std::string>> &slot_slices,
+      const std::vector<std::string> &hyperparams,
+      ThreadContext *thread_context, const int64_t begin, const int64_t max_i,
+      const int64_t Velems_per_dim0,
+      const std::vector<std::string> &keys_prefix_name_slices) = 0;
+
   virtual Status DelCommand(
       const Tensor &keys, ThreadContext *thread_context, const int64_t begin,
       const int64_t max_i,
@@ -702,6 +893,166 @@ void ReplyMemcpyToValTensor<tstring>(const tstring *const pv_raw,
   }
 }
 
+// Finds the value of the i-th key of an HMGETPACKED reply of value_bytes
+// values. Returns false when the key is missing or the reply is malformed.
+inline bool PackedReplyValue(const redisReply *reply, const std::size_t i,
+                             const std::size_t value_bytes, const char **str) {
+  if (reply == nullptr || reply->type != REDIS_REPLY_ARRAY ||
+      reply->elements != 2 || reply->element[0]->len <= i / 8 ||
+      reply->element[1]->len < (i + 1) * value_bytes) {
+    return false;
+  }
+  if (!((reply->element[0]->str[i / 8] >> (i % 8)) & 1)) return false;
+  *str = reply->element[1]->str + i * value_bytes;
+  return true;
+}
+
+template <typename T>
+bool ReplyFitsValTensor(const std::size_t byte_size,
+                        const int64_t Velems_per_dim0) {
+  return byte_size >= Velems_per_dim0 * sizeof(T);
+}
+
+template <>
+bool ReplyFitsValTensor<tstring>(const std::size_t byte_size,
+                                 const int64_t Velems_per_dim0) {
+  return true;  // The size of each string is read from the reply itself.
+}
+
+// Decodes an HMGET reply into the rows of values the keys of its command came
+// from, writing the default value and false into exists for the missing ones.
+template <typename V>
+class MgetTensorSink final : public RedisReplySink {
+ public:
+  MgetTensorSink(Tensor *values, const Tensor &default_value, Tensor *exists,
+                 const bool is_full_default, const int64_t Velems_per_dim0,
+                 std::vector<int64_t> &&rows)
+      : pv_raw_(reinterpret_cast<const V *>(values->tensor_data().data())),
+        dft_raw_(
+            reinterpret_cast<const V *>(default_value.tensor_data().data())),
+        exists_raw_(exists == nullptr ? nullptr : exists->flat<bool>().data()),
+        is_full_default_(is_full_default),
+        Velems_per_dim0_(Velems_per_dim0),
+        rows_(std::move(rows)) {}
+
+  bool OnArray(const std::size_t elements) override {
+    matched_ = (elements == rows_.size());
+    return matched_;
+  }
+
+  void OnString(const std::size_t idx, const char *str,
+                const std::size_t len) override {
+    if (!ReplyFitsValTensor<V>(len, Velems_per_dim0_)) {
+      OnNil(idx);
+      return;
+    }
+    const int64_t row = rows_[idx];
+    ReplyMemcpyToValTensor<V>(pv_raw_ + row * Velems_per_dim0_, str,
+                              Velems_per_dim0_);
+    if (exists_raw_ != nullptr) exists_raw_[row] = true;
+    ++received_;
+  }
+
+  void OnNil(const std::size_t idx) override {
+    const int64_t row = rows_[idx];
+    DefaultMemcpyToTensor<V>(
+        pv_raw_ + row * Velems_per_dim0_,
+        is_full_default_ ? dft_raw_ + row * Velems_per_dim0_ : dft_raw_,
+        Velems_per_dim0_);
+    if (exists_raw_ != nullptr) exists_raw_[row] = false;
+    ++nil_elements_;
+    ++received_;
+  }
+
+  bool Complete() const override {
+    return matched_ && received_ == rows_.size();
+  }
+
+  int64_t NilElements() const override { return nil_elements_; }
+
+ private:
+  const V *const pv_raw_;
+  const V *const dft_raw_;
+  bool *const exists_raw_;
+  const bool is_full_default_;
+  const int64_t Velems_per_dim0_;
+  const std::vector<int64_t> rows_;  // Indexed by the element of the reply.
+  bool matched_ = false;
+  std::size_t received_ = 0;
+  int64_t nil_elements_ = 0;
+};
+
+// Decodes an HMGETPACKED reply as MgetTensorSink decodes an HMGET one: the
+// bitmap of the keys found comes first, so the values are written to their
+// rows as soon as they are parsed.
+template <typename V>
+class PackedMgetTensorSink final : public RedisReplySink {
+ public:
+  PackedMgetTensorSink(Tensor *values, const Tensor &default_value,
+                       Tensor *exists, const bool is_full_default,
+                       const int64_t Velems_per_dim0,
+                       std::vector<int64_t> &&rows)
+      : pv_raw_(reinterpret_cast<const V *>(values->tensor_data().data())),
+        dft_raw_(
+            reinterpret_cast<const V *>(default_value.tensor_data().data())),
+        exists_raw_(exists == nullptr ? nullptr : exists->flat<bool>().data()),
+        is_full_default_(is_full_default),
+        Velems_per_dim0_(Velems_per_dim0),
+        rows_(std::move(rows)) {}
+
+  bool OnArray(const std::size_t elements) override {
+    matched_ = (elements == 2);
+    return matched_;
+  }
+
+  void OnString(const std::size_t idx, const char *str,
+                const std::size_t len) override {
+    if (idx == 0) {
+      if (len == (rows_.size() + 7) / 8) bitmap_.assign(str, str + len);
+      return;
+    }
+    const std::size_t value_bytes = Velems_per_dim0_ * sizeof(V);
+    if (bitmap_.size() != (rows_.size() + 7) / 8 ||
+        len != rows_.size() * value_bytes) {
+      return;
+    }
+    for (std::size_t i = 0; i < rows_.size(); ++i) {
+      const int64_t row = rows_[i];
+      const bool found = (bitmap_[i / 8] >> (i % 8)) & 1;
+      if (found) {
+        ReplyMemcpyToValTensor<V>(pv_raw_ + row * Velems_per_dim0_,
+                                  str + i * value_bytes, Velems_per_dim0_);
+      } else {
+        DefaultMemcpyToTensor<V>(
+            pv_raw_ + row * Velems_per_dim0_,
+            is_full_default_ ? dft_raw_ + row * Velems_per_dim0_ : dft_raw_,
+            Velems_per_dim0_);
+        ++nil_elements_;
+      }
+      if (exists_raw_ != nullptr) exists_raw_[row] = found;
+    }
+    decoded_ = true;
+  }
+
+  void OnNil(const std::size_t idx) override {}
+
+  bool Complete() const override { return matched_ && decoded_; }
+
+  int64_t NilElements() const override { return nil_elements_; }
+
+ private:
+  const V *const pv_raw_;
+  const V *const dft_raw_;
+  bool *const exists_raw_;
+  const bool is_full_default_;
+  const int64_t Velems_per_dim0_;
+  const std::vector<int64_t> rows_;  // Indexed by the key in the reply.
+  std::vector<char> bitmap_;
+  bool matched_ = false;
+  bool decoded_ = false;
+  int64_t nil_elements_ = 0;
+};
+
 }  // namespace redis_connection
 }  // namespace recommenders_addons
 }  // namespace tensorflow
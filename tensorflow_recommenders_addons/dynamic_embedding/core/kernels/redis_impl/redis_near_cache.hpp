@@ -0,0 +1,248 @@
+/* Copyright 2021 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#pragma once
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/hash.h"
+#include "tensorflow/core/platform/tstring.h"
+
+namespace tensorflow {
+namespace recommenders_addons {
+namespace redis_connection {
+
+struct NearCacheHash {
+  template <typename K>
+  size_t operator()(const K &key) const {
+    return std::hash<K>()(key);
+  }
+  size_t operator()(const tstring &key) const {
+    return Hash64(key.data(), key.size());
+  }
+};
+
+// A bounded in-process cache of the rows of one Redis table, so that the hot
+// keys of a lookup are not read from the Redis servers every step. Rows are
+// evicted by CLOCK when a shard is full and dropped once they are older than
+// the TTL, which bounds how stale a row written by another worker can be.
+// The keys are split over kShards shards, each behind its own mutex.
+//
+// Each shard counts the writes and erases of its rows in a generation. A
+// lookup takes the generations before it reads Redis and fills the cache
+// with Fill, which leaves out the rows of shards written since, so that a
+// fill never puts back a row older than a write that raced with it.
+template <typename K, typename V>
+class RedisNearCache {
+ public:
+  static constexpr uint64 kShards = 16;
+
+  using Generations = std::array<uint64, kShards>;
+
+  // capacity is the number of rows kept, dim the number of V in a row, and
+  // ttl_micros the age after which a row is dropped, or 0 to keep it until
+  // it is evicted.
+  RedisNearCache(const size_t capacity, const int64_t dim,
+                 const uint64 ttl_micros)
+      : dim_(dim), ttl_micros_(ttl_micros) {
+    // The first capacity % kShards shards take one more row, so that the
+    // shards hold capacity rows in all, and none when capacity < kShards.
+    for (uint64 i = 0; i < kShards; ++i) {
+      shards_[i].reset(new Shard(
+          capacity / kShards + (i < capacity % kShards ? 1 : 0), dim));
+    }
+  }
+
+  // Copies the rows of the cached keys among keys[0, n) into values, whose
+  // rows are dim values apart, and sets hits[i] for each of them. Returns
+  // the number of hits.
+  int64_t Find(const K *keys, const int64_t n, V *values, bool *hits) {
+    const uint64 now = Env::Default()->NowMicros();
+    int64_t found = 0;
+    for (int64_t i = 0; i < n; ++i) {
+      Shard &shard = ShardOf(keys[i]);
+      std::lock_guard<std::mutex> guard(shard.mu);
+      auto it = shard.index.find(keys[i]);
+      if (it == shard.index.end()) {
+        hits[i] = false;
+        continue;
+      }
+      const size_t slot = it->second;
+      if (ttl_micros_ > 0 && now - shard.stamps[slot] > ttl_micros_) {
+        shard.index.erase(it);
+        shard.Release(slot);
+        hits[i] = false;
+        continue;
+      }
+      std::copy_n(shard.Row(slot), dim_, values + i * dim_);
+      shard.referenced[slot] = true;
+      hits[i] = true;
+      ++found;
+    }
+    return found;
+  }
+
+  // Returns the generations of all the shards, to be passed to Fill.
+  Generations GetGenerations() {
+    Generations generations;
+    for (uint64 i = 0; i < kShards; ++i) {
+      std::lock_guard<std::mutex> guard(shards_[i]->mu);
+      generations[i] = shards_[i]->generation;
+    }
+    return generations;
+  }
+
+  // Caches the rows of keys[0, n) in values, which were just written.
+  void Insert(const K *keys, const V *values, const int64_t n) {
+    Put(keys, values, n, nullptr, nullptr);
+  }
+
+  // Caches the rows of keys[0, n) in values, which were read from Redis
+  // after generations was taken. Only the keys with which[i] set are
+  // cached, and none of a shard written or erased since generations.
+  void Fill(const K *keys, const V *values, const int64_t n,
+            const bool *which, const Generations &generations) {
+    Put(keys, values, n, which, &generations);
+  }
+
+  // Drops the rows of keys[0, n).
+  void Erase(const K *keys, const int64_t n) {
+    for (int64_t i = 0; i < n; ++i) {
+      Shard &shard = ShardOf(keys[i]);
+      std::lock_guard<std::mutex> guard(shard.mu);
+      ++shard.generation;
+      auto it = shard.index.find(keys[i]);
+      if (it != shard.index.end()) {
+        shard.Release(it->second);
+        shard.index.erase(it);
+      }
+    }
+  }
+
+  void Clear() {
+    for (auto &shard : shards_) {
+      std::lock_guard<std::mutex> guard(shard->mu);
+      ++shard->generation;
+      shard->index.clear();
+      shard->free_slots.clear();
+      shard->used = 0;
+      shard->hand = 0;
+    }
+  }
+
+ private:
+  void Put(const K *keys, const V *values, const int64_t n, const bool *which,
+           const Generations *generations) {
+    const uint64 now = Env::Default()->NowMicros();
+    for (int64_t i = 0; i < n; ++i) {
+      if (which != nullptr && !which[i]) continue;
+      const uint64 s = ShardIndexOf(keys[i]);
+      Shard &shard = *shards_[s];
+      std::lock_guard<std::mutex> guard(shard.mu);
+      if (generations == nullptr) {
+        ++shard.generation;
+      } else if ((*generations)[s] != shard.generation) {
+        continue;
+      }
+      if (shard.capacity == 0) continue;
+      size_t slot;
+      auto it = shard.index.find(keys[i]);
+      if (it != shard.index.end()) {
+        slot = it->second;
+      } else {
+        slot = shard.Acquire();
+        shard.keys[slot] = keys[i];
+        shard.index.emplace(keys[i], slot);
+      }
+      std::copy_n(values + i * dim_, dim_, shard.Row(slot));
+      shard.stamps[slot] = now;
+      shard.referenced[slot] = true;
+    }
+  }
+
+  struct Shard {
+    Shard(const size_t capacity, const int64_t dim)
+        : capacity(capacity),
+          dim(dim),
+          keys(capacity),
+          values(capacity * dim),
+          stamps(capacity),
+          referenced(capacity) {}
+
+    V *Row(const size_t slot) { return values.data() + slot * dim; }
+
+    // Puts back the slot of a dropped row, to be taken first by Acquire.
+    void Release(const size_t slot) {
+      referenced[slot] = false;
+      free_slots.push_back(slot);
+    }
+
+    // Returns a slot for a new row: a freed one, a never used one, or the
+    // first one found by the CLOCK hand that was not referenced since it
+    // last passed, which is evicted.
+    size_t Acquire() {
+      if (!free_slots.empty()) {
+        const size_t slot = free_slots.back();
+        free_slots.pop_back();
+        return slot;
+      }
+      if (used < capacity) return used++;
+      while (referenced[hand]) {
+        referenced[hand] = false;
+        hand = (hand + 1) % capacity;
+      }
+      const size_t slot = hand;
+      hand = (hand + 1) % capacity;
+      index.erase(keys[slot]);
+      return slot;
+    }
+
+    std::mutex mu;
+    const size_t capacity;
+    const int64_t dim;
+    std::unordered_map<K, size_t, NearCacheHash> index;
+    std::vector<K> keys;
+    std::vector<V> values;
+    std::vector<uint64> stamps;
+    std::vector<bool> referenced;
+    std::vector<size_t> free_slots;
+    size_t used = 0;
+    size_t hand = 0;
+    uint64 generation = 0;
+  };
+
+  uint64 ShardIndexOf(const K &key) {
+    // The hash of an integer is often the integer itself, so the bits are
+    // mixed before picking a shard.
+    const uint64 h =
+        static_cast<uint64>(NearCacheHash()(key)) * 0x9E3779B97F4A7C15ULL;
+    return (h >> 32) % kShards;
+  }
+
+  Shard &ShardOf(const K &key) { return *shards_[ShardIndexOf(key)]; }
+
+  const int64_t dim_;
+  const uint64 ttl_micros_;
+  std::unique_ptr<Shard> shards_[kShards];
+};
+
+}  // namespace redis_connection
+}  // namespace recommenders_addons
+}  // namespace tensorflow
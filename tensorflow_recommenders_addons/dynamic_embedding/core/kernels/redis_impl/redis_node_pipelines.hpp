@@ -0,0 +1,328 @@
+/* Copyright 2021 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#pragma once
+#include <hiredis/hiredis.h>
+
+#include <cstdlib>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "redis_async_client.hpp"
+#include "redis_connection_util.hpp"
+#include "thread_pool.h"
+
+namespace tensorflow {
+namespace recommenders_addons {
+namespace redis_connection {
+
+// How many times a command redirected by MOVED or ASK is sent again, as in
+// redis-plus-plus.
+const static int kRedisMaxRedirects = 5;
+
+/*
+Blocking connections to each master of a Redis Cluster, on which the commands
+of all the storage slices served by one master are pipelined: written back to
+back and their replies read after, so that an op waits one round trip per
+master rather than one per storage slice. The masters are sent to in parallel
+on the network worker pool, and each keeps a few idle connections for the
+next pipelines.
+
+Commands are routed by a cached slot map. A command answered with MOVED or
+ASK is sent again to the master named in the reply, preceded by ASKING for
+ASK, and a MOVED reply makes the slot map be read again, so that the next
+commands go straight to the new master. Commands always go to the masters,
+regardless of redis_read_access_slave.
+*/
+class RedisNodePipelines {
+ public:
+  typedef std::unique_ptr<redisReply, ::sw::redis::ReplyDeleter> Reply;
+
+  explicit RedisNodePipelines(const Redis_Connection_Params &params)
+      : params_(params),
+        connect_timeout_(RedisTimeval(params.redis_connect_timeout)),
+        command_timeout_(RedisTimeval(params.redis_socket_timeout)) {}
+
+  ~RedisNodePipelines() {
+    for (auto &node : nodes_) {
+      for (redisContext *c : node->idle) {
+        redisFree(c);
+      }
+    }
+  }
+
+  // Reads the slot map of the cluster.
+  Status Start() { return LoadSlots(); }
+
+  // Sends commands and moves the reply of each of them into
+  // (*replies)[command.bucket]. A reply is left nullptr when its command
+  // could not be sent, its connection was lost or it was redirected too many
+  // times; an error reply is logged and dropped, like the exceptions of the
+  // commands sent through redis-plus-plus.
+  void Exec(const std::vector<RedisCommandArgs> &commands, ThreadPool *pool,
+            std::vector<Reply> *replies) {
+    std::vector<Batch> batches;
+    {
+      std::lock_guard<std::mutex> guard(mu_);
+      for (const RedisCommandArgs &command : commands) {
+        Node *node = slot_nodes_[RedisHashSlot(command.argv[1],
+                                               command.argvlen[1])];
+        BatchOf(node, false, &batches)->commands.push_back(command);
+      }
+    }
+    for (int redirects = 0; !batches.empty(); ++redirects) {
+      std::vector<std::vector<Redirect>> batch_redirects(batches.size());
+      std::vector<std::future<void>> results;
+      for (size_t i = 1; i < batches.size(); ++i) {
+        results.emplace_back(pool->enqueue(
+            [this, &batches, &batch_redirects, replies, i] {
+              ExecBatch(batches[i], replies, &batch_redirects[i]);
+            }));
+      }
+      ExecBatch(batches[0], replies, &batch_redirects[0]);
+      for (auto &&result : results) {
+        result.wait();
+      }
+      batches.clear();
+      bool moved = false;
+      size_t redirected = 0;
+      for (const auto &redirect_list : batch_redirects) {
+        for (const Redirect &redirect : redirect_list) {
+          moved = moved || !redirect.ask;
+        }
+        redirected += redirect_list.size();
+      }
+      if (redirected == 0) break;
+      if (redirects == kRedisMaxRedirects) {
+        LOG(ERROR) << "Drop " << redirected
+                   << " Redis commands redirected too many times.";
+        break;
+      }
+      // Only one op reads the slot map again, the others just follow the
+      // redirects.
+      std::unique_lock<std::mutex> load_lock(load_mu_, std::try_to_lock);
+      if (moved && load_lock.owns_lock()) {
+        Status statu = LoadSlots();
+        if (!statu.ok()) {
+          LOG(WARNING) << "Can not read the slots of the Redis Cluster again "
+                          "after a MOVED reply -- "
+                       << statu;
+        }
+      }
+      std::lock_guard<std::mutex> guard(mu_);
+      for (const auto &redirect_list : batch_redirects) {
+        for (const Redirect &redirect : redirect_list) {
+          Node *node = NodeOf(redirect.host, redirect.port);
+          BatchOf(node, redirect.ask, &batches)
+              ->commands.push_back(redirect.command);
+        }
+      }
+    }
+  }
+
+ private:
+  struct Node {
+    std::string host;
+    int port;
+    std::mutex mu;
+    std::vector<redisContext *> idle;
+  };
+
+  // Commands pipelined to one master, each preceded by ASKING if asking.
+  struct Batch {
+    Node *node;
+    bool asking;
+    std::vector<RedisCommandArgs> commands;
+  };
+
+  // A command answered with MOVED, or with ASK if ask, and the address of
+  // the master it was redirected to.
+  struct Redirect {
+    RedisCommandArgs command;
+    bool ask;
+    std::string host;
+    int port;
+  };
+
+  // Must be called with mu_ held.
+  Node *NodeOf(const std::string &host, const int port) {
+    for (auto &node : nodes_) {
+      if (node->host == host && node->port == port) return node.get();
+    }
+    nodes_.emplace_back(new Node());
+    nodes_.back()->host = host;
+    nodes_.back()->port = port;
+    return nodes_.back().get();
+  }
+
+  static Batch *BatchOf(Node *node, const bool asking,
+                        std::vector<Batch> *batches) {
+    for (Batch &batch : *batches) {
+      if (batch.node == node && batch.asking == asking) return &batch;
+    }
+    batches->push_back({node, asking, {}});
+    return &batches->back();
+  }
+
+  // Reads the slot map, adding the masters not known yet. The masters which
+  // left the cluster are kept, but no slot routes to them.
+  Status LoadSlots() {
+    std::vector<std::pair<std::string, int>> masters;
+    std::vector<int> slot_masters;
+    TF_RETURN_IF_ERROR(RedisLoadClusterSlots(
+        params_, connect_timeout_, command_timeout_, &masters, &slot_masters));
+    std::lock_guard<std::mutex> guard(mu_);
+    std::vector<Node *> master_nodes;
+    for (const auto &master : masters) {
+      master_nodes.push_back(NodeOf(master.first, master.second));
+    }
+    slot_nodes_.resize(kRedisClusterSlots);
+    for (unsigned slot = 0; slot < kRedisClusterSlots; ++slot) {
+      slot_nodes_[slot] = master_nodes[slot_masters[slot]];
+    }
+    return Status::OK();
+  }
+
+  // Parses "MOVED <slot> <host>:<port>" or "ASK <slot> <host>:<port>".
+  static bool ParseRedirect(const redisReply *reply, Redirect *redirect) {
+    const std::string error(reply->str, reply->len);
+    if (error.compare(0, 6, "MOVED ") == 0) {
+      redirect->ask = false;
+    } else if (error.compare(0, 4, "ASK ") == 0) {
+      redirect->ask = true;
+    } else {
+      return false;
+    }
+    const size_t address = error.rfind(' ');
+    const size_t colon = error.rfind(':');
+    if (address == std::string::npos || colon == std::string::npos ||
+        colon < address) {
+      return false;
+    }
+    redirect->host = error.substr(address + 1, colon - address - 1);
+    redirect->port = std::atoi(error.c_str() + colon + 1);
+    return true;
+  }
+
+  // Pipelines the commands of batch to its master and moves their replies
+  // into replies, or into redirects for those redirected.
+  void ExecBatch(const Batch &batch, std::vector<Reply> *replies,
+                 std::vector<Redirect> *redirects) {
+    Node *node = batch.node;
+    profiler::TraceMe trace(
+        [&] {
+          return profiler::TraceMeEncode(
+              "RedisNetworkWait",
+              {{"node", node->host + ":" + std::to_string(node->port)},
+               {"commands", batch.commands.size()}});
+        },
+        profiler::TraceMeLevel::kInfo);
+    redisContext *c = Acquire(node);
+    if (c == nullptr) return;
+    for (const RedisCommandArgs &command : batch.commands) {
+      if ((batch.asking && redisAppendCommand(c, "ASKING") != REDIS_OK) ||
+          redisAppendCommandArgv(c, command.argc, command.argv,
+                                 command.argvlen) != REDIS_OK) {
+        LOG(ERROR) << "Can not pipeline the commands to " << node->host << ":"
+                   << node->port << " -- " << c->errstr;
+        redisFree(c);
+        return;
+      }
+    }
+    for (const RedisCommandArgs &command : batch.commands) {
+      void *r = nullptr;
+      if ((batch.asking && !GetReply(c, &r)) || !GetReply(c, &r)) {
+        LOG(ERROR) << "Lost the connection to " << node->host << ":"
+                   << node->port << " -- " << c->errstr;
+        redisFree(c);
+        return;
+      }
+      Reply reply(static_cast<redisReply *>(r));
+      if (reply->type == REDIS_REPLY_ERROR) {
+        Redirect redirect;
+        if (ParseRedirect(reply.get(), &redirect)) {
+          redirect.command = command;
+          redirects->push_back(std::move(redirect));
+          continue;
+        }
+        LOG(ERROR) << "RedisHandler error in pipeline to " << node->host
+                   << ":" << node->port << " for slices "
+                   << std::string(command.argv[1], command.argvlen[1])
+                   << " -- " << std::string(reply->str, reply->len);
+        continue;
+      }
+      (*replies)[command.bucket] = std::move(reply);
+    }
+    Release(node, c);
+  }
+
+  // Reads the next reply into *r, freeing the one already there.
+  static bool GetReply(redisContext *c, void **r) {
+    if (*r != nullptr) {
+      freeReplyObject(*r);
+      *r = nullptr;
+    }
+    return redisGetReply(c, r) == REDIS_OK;
+  }
+
+  redisContext *Acquire(Node *node) {
+    {
+      std::lock_guard<std::mutex> guard(node->mu);
+      if (!node->idle.empty()) {
+        redisContext *c = node->idle.back();
+        node->idle.pop_back();
+        return c;
+      }
+    }
+    redisContext *c =
+        RedisConnectBlocking(node->host, node->port, params_.redis_user,
+                             params_.redis_password, connect_timeout_,
+                             command_timeout_);
+    if (c != nullptr && params_.redis_connect_keep_alive) {
+      redisEnableKeepAlive(c);
+    }
+    return c;
+  }
+
+  // Keeps at most redis_conn_pool_size idle connections to a master.
+  void Release(Node *node, redisContext *c) {
+    {
+      std::lock_guard<std::mutex> guard(node->mu);
+      if (node->idle.size() <
+          static_cast<size_t>(params_.redis_conn_pool_size)) {
+        node->idle.push_back(c);
+        return;
+      }
+    }
+    redisFree(c);
+  }
+
+  const Redis_Connection_Params params_;
+  const struct timeval connect_timeout_;
+  const struct timeval command_timeout_;
+  std::mutex load_mu_;
+  // Guards nodes_, which only grows so that a Node stays valid, and
+  // slot_nodes_.
+  std::mutex mu_;
+  std::vector<std::unique_ptr<Node>> nodes_;
+  std::vector<Node *> slot_nodes_;
+};
+
+}  // namespace redis_connection
+}  // namespace recommenders_addons
+}  // namespace tensorflow
@@ -26,6 +26,8 @@ limitations under the License.
 #include "json.h"
 #include "redis_connection_util.hpp"
 #include "redis_slots_tab.h"
+#include "tensorflow/core/profiler/lib/traceme.h"
+#include "tensorflow/core/profiler/lib/traceme_encode.h"
 #include "tensorflow_recommenders_addons/dynamic_embedding/core/utils/types.h"
 #include "tensorflow_recommenders_addons/dynamic_embedding/core/utils/utils.h"
 
@@ -35,6 +37,13 @@ namespace redis_table {
 
 using namespace redis_connection;
 
+// Bytes of the values of keys [begin, end) in a batch.
+inline int64_t ValueBytes(const Tensor &values, const int64_t begin,
+                          const int64_t end,
+                          const int64_t &Velems_per_flat2_dim0) {
+  return (end - begin) * Velems_per_flat2_dim0 * DataTypeSize(values.dtype());
+}
+
 size_t SelectAvailableThreadContext(
     std::vector<ThreadContext *> &threads_context,
     std::mutex &threads_context_mutex) {
@@ -66,14 +75,32 @@ Status launchFindCore(std::shared_ptr<RedisVirtualWrapper> _table_instance,
                       const int64_t &Velems_per_flat2_dim0,
                       std::vector<ThreadContext *> &threads_Find,
                       std::mutex &threads_Find_mutex, const int64_t begin,
-                      const int64_t end) {
+                      const int64_t end,
+                      std::atomic<int64_t> *misses = nullptr) {
   size_t thread_context_id =
       SelectAvailableThreadContext(threads_Find, threads_Find_mutex);
 
-  auto reply =
-      _table_instance->MgetCommand(keys, threads_Find.at(thread_context_id),
-                                   begin, end, keys_prefix_name_slices);
+  std::vector<std::unique_ptr<redisReply, ::sw::redis::ReplyDeleter>> reply;
+  {
+    profiler::TraceMe trace([&] {
+      return profiler::TraceMeEncode("RedisMgetCommand",
+                                     {{"keys", end - begin}});
+    });
+    reply = _table_instance->MgetCommand(
+        keys, threads_Find.at(thread_context_id), begin, end,
+        Velems_per_flat2_dim0, keys_prefix_name_slices);
+  }
+  if (misses != nullptr) {
+    misses->fetch_add(_table_instance->MgetMisses(reply, end - begin),
+                      std::memory_order_relaxed);
+  }
 
+  profiler::TraceMe trace([&] {
+    return profiler::TraceMeEncode(
+        "RedisMgetToTensor",
+        {{"keys", end - begin},
+         {"bytes", ValueBytes(*values, begin, end, Velems_per_flat2_dim0)}});
+  });
   auto statu =
       _table_instance->MgetToTensor(values, default_value, is_full_default,
                                     threads_Find.at(thread_context_id), reply,
@@ -97,10 +124,23 @@ Status launchFindWithExistsCore(
   size_t thread_context_id =
       SelectAvailableThreadContext(threads_Find, threads_Find_mutex);
 
-  auto reply =
-      _table_instance->MgetCommand(keys, threads_Find.at(thread_context_id),
-                                   begin, end, keys_prefix_name_slices);
+  std::vector<std::unique_ptr<redisReply, ::sw::redis::ReplyDeleter>> reply;
+  {
+    profiler::TraceMe trace([&] {
+      return profiler::TraceMeEncode("RedisMgetCommand",
+                                     {{"keys", end - begin}});
+    });
+    reply = _table_instance->MgetCommand(
+        keys, threads_Find.at(thread_context_id), begin, end,
+        Velems_per_flat2_dim0, keys_prefix_name_slices);
+  }
 
+  profiler::TraceMe trace([&] {
+    return profiler::TraceMeEncode(
+        "RedisMgetToTensorWithExist",
+        {{"keys", end - begin},
+         {"bytes", ValueBytes(*values, begin, end, Velems_per_flat2_dim0)}});
+  });
   auto statu = _table_instance->MgetToTensorWithExist(
       values, default_value, exists, is_full_default,
       threads_Find.at(thread_context_id), reply, begin, end,
@@ -122,6 +162,12 @@ Status launchInsertCore(std::shared_ptr<RedisVirtualWrapper> _table_instance,
   size_t thread_context_id =
       SelectAvailableThreadContext(threads_Insert, threads_Insert_mutex);
 
+  profiler::TraceMe trace([&] {
+    return profiler::TraceMeEncode(
+        "RedisMsetCommand",
+        {{"keys", end - begin},
+         {"bytes", ValueBytes(values, begin, end, Velems_per_flat2_dim0)}});
+  });
   auto statu = _table_instance->MsetCommand(
       keys, values, threads_Insert.at(thread_context_id), begin, end,
       Velems_per_flat2_dim0, keys_prefix_name_slices);
@@ -143,6 +189,13 @@ Status launchAccumCore(std::shared_ptr<RedisVirtualWrapper> _table_instance,
   size_t thread_context_id =
       SelectAvailableThreadContext(threads_Insert, threads_Accum_mutex);
 
+  profiler::TraceMe trace([&] {
+    return profiler::TraceMeEncode(
+        "RedisMaccumCommand",
+        {{"keys", end - begin},
+         {"bytes",
+          ValueBytes(values_or_delta, begin, end, Velems_per_flat2_dim0)}});
+  });
   auto statu = _table_instance->MaccumCommand(
       keys, values_or_delta, exists, threads_Insert.at(thread_context_id),
       begin, end, Velems_per_flat2_dim0, keys_prefix_name_slices);
@@ -153,6 +206,36 @@ Status launchAccumCore(std::shared_ptr<RedisVirtualWrapper> _table_instance,
   return statu;
 }
 
+Status launchSparseApplyCore(
+    std::shared_ptr<RedisVirtualWrapper> _table_instance,
+    std::vector<std::string> &keys_prefix_name_slices,
+    const std::string &command, const Tensor &keys, const Tensor &grads,
+    const std::vector<std::vector<std::string>> &slot_slices,
+    const std::vector<std::string> &hyperparams,
+    const int64_t &Velems_per_flat2_dim0,
+    std::vector<ThreadContext *> &threads_Insert,
+    std::mutex &threads_Insert_mutex, const int64_t begin, const int64_t end) {
+  size_t thread_context_id =
+      SelectAvailableThreadContext(threads_Insert, threads_Insert_mutex);
+
+  profiler::TraceMe trace([&] {
+    return profiler::TraceMeEncode(
+        "RedisSparseApplyCommand",
+        {{"command", command},
+         {"keys", end - begin},
+         {"bytes", ValueBytes(grads, begin, end, Velems_per_flat2_dim0)}});
+  });
+  auto statu = _table_instance->SparseApplyCommand(
+      command, keys, grads, slot_slices, hyperparams,
+      threads_Insert.at(thread_context_id), begin, end, Velems_per_flat2_dim0,
+      keys_prefix_name_slices);
+
+  threads_Insert[thread_context_id]->thread_occupied.store(
+      false, std::memory_order_release);
+
+  return statu;
+}
+
 Status launchDeleteCore(std::shared_ptr<RedisVirtualWrapper> _table_instance,
                         std::vector<std::string> &keys_prefix_name_slices,
                         const Tensor &keys,
@@ -162,6 +245,9 @@ Status launchDeleteCore(std::shared_ptr<RedisVirtualWrapper> _table_instance,
   size_t thread_context_id =
       SelectAvailableThreadContext(threads_Delete, threads_Delete_mutex);
 
+  profiler::TraceMe trace([&] {
+    return profiler::TraceMeEncode("RedisDelCommand", {{"keys", end - begin}});
+  });
   auto statu =
       _table_instance->DelCommand(keys, threads_Delete.at(thread_context_id),
                                   begin, end, keys_prefix_name_slices);
@@ -358,6 +444,19 @@ Status ParseJsonConfig(const std::string *const redis_config_abs_dir,
           ? redis_connection_params->storage_slice_import
           : redis_connection_params->storage_slice;
 
+  ReadOneJsonToParams(storage_mode, integer);
+
+  ReadOneJsonToParams(storage_sub_slice, integer);
+
+  if (redis_connection_params->storage_mode == SubHashStorageMode) {
+    if (redis_connection_params->storage_sub_slice == 0) {
+      return errors::InvalidArgument("storage_sub_slice should be positive");
+    }
+  } else if (redis_connection_params->storage_mode != HashStorageMode) {
+    return errors::InvalidArgument(
+        "There are only two storage modes, which Hash=0/SubHash=1.");
+  }
+
   ReadOneJsonToParams(using_hash_storage_slice, boolean);
 
   ReadOneJsonToParams(keys_sending_size, integer);
@@ -380,6 +479,33 @@ Status ParseJsonConfig(const std::string *const redis_config_abs_dir,
 
   ReadStringOneJsonToParams(model_lib_abs_dir);
 
+  ReadOneJsonToParams(redis_async_client, boolean);
+
+  ReadOneJsonToParams(redis_async_client_threads, integer);
+
+  ReadOneJsonToParams(redis_pipeline_per_node, boolean);
+
+  ReadOneJsonToParams(using_packed_commands, boolean);
+
+  ReadOneJsonToParams(near_cache_capacity, integer);
+
+  ReadOneJsonToParams(near_cache_ttl_in_seconds, integer);
+
+  ReadOneJsonToParams(near_cache_write_through, boolean);
+
+  ReadOneJsonToParams(using_write_behind, boolean);
+
+  ReadOneJsonToParams(write_behind_interval_in_ms, integer);
+
+  ReadOneJsonToParams(write_behind_max_keys, integer);
+
+  // The sub-hashes of a storage slice carry hash tags of their own and land
+  // on different masters, so they are grouped by the node serving them.
+  if (redis_connection_params->storage_mode == SubHashStorageMode &&
+      redis_connection_params->redis_connection_mode == ClusterMode) {
+    redis_connection_params->redis_pipeline_per_node = true;
+  }
+
 #undef ReadOneJsonToParams
 #undef ReadStringOneJsonToParams
 #undef ReadArrayJsonToParams
@@ -494,6 +620,28 @@ std::vector<std::string> BuildKeysPrefixNameSlices(
   return keys_prefix_name_slices;
 }
 
+// Marks the hashes in names, which carry hash tags of their own, as the
+// sub_slice sub-hashes of names.size() / sub_slice storage slices. Hash i
+// holds the keys whose bucket number is i modulo names.size(), so a key stays
+// in the storage slice it has with one hash per slice, and it is suffixed with
+// its index among the sub-hashes of that slice.
+std::vector<std::string> BuildSubHashNames(
+    const std::vector<std::string> &names, const unsigned sub_slice) {
+  const size_t slices = names.size() / sub_slice;
+  std::vector<std::string> sub_names;
+  sub_names.reserve(names.size());
+  for (size_t i = 0; i < names.size(); ++i) {
+    sub_names.emplace_back(names[i] + '#' + std::to_string(i / slices));
+  }
+  return sub_names;
+}
+
+// Tells whether a hash of a table found in Redis belongs to a storage slice
+// split by SubHashStorageMode, whose hashes end after the hash tag.
+inline bool IsSubHashName(const std::string &name) {
+  return !name.empty() && name.back() != '}';
+}
+
 void CreateKeysPrefixNameHandle(
     const std::vector<std::pair<unsigned, unsigned>> cluster_slots,
     const Redis_Connection_Params *const redis_connection_params,
@@ -504,17 +652,25 @@ void CreateKeysPrefixNameHandle(
   keys_prefix_name_runtime = BuildKeysPrefixNameWithModelTag(
       redis_connection_params->model_tag_runtime,
       redis_connection_params->using_md5_prefix_name, embedding_name);
+  // Every hash of the table gets a hash tag of its own, so that the sub-hashes
+  // of a storage slice spread over the cluster as the slices do.
   keys_prefix_name_slices_runtime = BuildKeysPrefixNameSlices(
-      cluster_slots, redis_connection_params->storage_slice,
+      cluster_slots, redis_connection_params->storage_hashes(),
       redis_connection_params->redis_hash_tags_runtime,
       keys_prefix_name_runtime);
   keys_prefix_name_import = BuildKeysPrefixNameWithModelTag(
       redis_connection_params->model_tag_import,
       redis_connection_params->using_md5_prefix_name, embedding_name);
   keys_prefix_name_slices_import = BuildKeysPrefixNameSlices(
-      cluster_slots,
-      static_cast<unsigned>(redis_connection_params->storage_slice_import),
+      cluster_slots, redis_connection_params->storage_hashes_import(),
       redis_connection_params->redis_hash_tags_import, keys_prefix_name_import);
+  if (redis_connection_params->storage_mode == SubHashStorageMode) {
+    const unsigned sub_slice = redis_connection_params->storage_sub_slice;
+    keys_prefix_name_slices_runtime =
+        BuildSubHashNames(keys_prefix_name_slices_runtime, sub_slice);
+    keys_prefix_name_slices_import =
+        BuildSubHashNames(keys_prefix_name_slices_import, sub_slice);
+  }
 }
 
 }  // namespace redis_table
@@ -0,0 +1,441 @@
+/* Copyright 2021 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "redis_near_cache.hpp"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/platform/logging.h"
+
+namespace tensorflow {
+namespace recommenders_addons {
+namespace redis_connection {
+
+template <typename V>
+inline void AccumRow(V *row, const V *delta, const int64_t dim) {
+  for (int64_t j = 0; j < dim; ++j) {
+    row[j] += delta[j];
+  }
+}
+
+// Strings are never written behind, see RedisTableOfTensors.
+inline void AccumRow(tstring *row, const tstring *delta, const int64_t dim) {}
+
+// Buffers the inserts and accumulates of one Redis table and writes them in
+// the background, so that training steps do not wait on Redis for them.
+// Repeated writes of a key coalesce into one, which a flush sends with one
+// call of insert_fn for the rows set and one of accum_fn for the rest.
+//
+// An accumulate carries an exists flag, as in HMACCUM: with it the delta is
+// added to the row in Redis, without it the value is inserted if the key is
+// missing. Onto a pending set, an accumulate with the flag adds its delta and
+// one without it is dropped, since the key is not missing. A delta and a value
+// for a missing key pending together make a write which adds the delta if the
+// key is in Redis and inserts the value, with the deltas which came after it,
+// if not. A flush sends it as the delta, then the value for a missing key.
+//
+// Lookups see the pending writes through Overlay. A write which failed to
+// flush is put back under the writes made since, and retried.
+//
+// Overlay applies the writes of a flush under way too. Sets and inserts of
+// missing keys give the same row whether or not they are in Redis yet, but
+// a delta would be added twice by a lookup reading Redis after it landed.
+// So the accumulates onto existing rows leave the flush before they are
+// written, and a lookup racing with their write may miss them, never count
+// them twice.
+template <typename K, typename V>
+class RedisWriteBehind {
+ public:
+  using InsertFn = std::function<Status(const Tensor &keys,
+                                        const Tensor &values)>;
+  using AccumFn = std::function<Status(
+      const Tensor &keys, const Tensor &values_or_delta, const Tensor &exists)>;
+
+  // Pending writes are flushed every interval_micros, or as soon as there
+  // are max_keys of them.
+  RedisWriteBehind(const int64_t dim, const uint64 interval_micros,
+                   const size_t max_keys, InsertFn insert_fn,
+                   AccumFn accum_fn)
+      : dim_(dim),
+        interval_micros_(interval_micros),
+        max_keys_(std::max<size_t>(1, max_keys)),
+        insert_fn_(std::move(insert_fn)),
+        accum_fn_(std::move(accum_fn)),
+        pending_(dim),
+        flushing_(dim) {
+    flusher_ = std::thread([this]() { Run(); });
+  }
+
+  ~RedisWriteBehind() {
+    Status statu = Stop();
+    if (!statu.ok()) {
+      LOG(ERROR) << "Lost the pending writes to Redis -- " << statu;
+    }
+  }
+
+  // Stops the flusher and flushes what is left.
+  Status Stop() {
+    {
+      std::lock_guard<std::mutex> guard(mu_);
+      if (stopped_) return Status::OK();
+      stopped_ = true;
+    }
+    cv_.notify_all();
+    flusher_.join();
+    return Flush();
+  }
+
+  void Insert(const K *keys, const V *values, const int64_t n) {
+    Add(keys, values, nullptr, n);
+  }
+
+  void Accum(const K *keys, const V *values_or_delta, const bool *exists,
+             const int64_t n) {
+    Add(keys, values_or_delta, exists, n);
+  }
+
+  // Applies the pending writes of keys[0, n) to the rows looked up for them
+  // in Redis, and to exists.
+  void Overlay(const K *keys, V *values, bool *exists, const int64_t n) {
+    std::lock_guard<std::mutex> guard(mu_);
+    if (flushing_.Empty() && pending_.Empty()) return;
+    for (int64_t i = 0; i < n; ++i) {
+      flushing_.Apply(keys[i], values + i * dim_, exists + i);
+      pending_.Apply(keys[i], values + i * dim_, exists + i);
+    }
+  }
+
+  // Drops the pending writes of keys[0, n), and waits for a flush under way
+  // so that none lands after the keys are removed from Redis.
+  void Erase(const K *keys, const int64_t n) {
+    std::lock_guard<std::mutex> flush_guard(flush_mu_);
+    std::lock_guard<std::mutex> guard(mu_);
+    for (int64_t i = 0; i < n; ++i) {
+      pending_.Erase(keys[i]);
+    }
+  }
+
+  void Clear() {
+    std::lock_guard<std::mutex> flush_guard(flush_mu_);
+    std::lock_guard<std::mutex> guard(mu_);
+    pending_.Clear();
+  }
+
+  // Writes the pending writes to Redis and returns once they are there.
+  Status Flush() {
+    std::lock_guard<std::mutex> flush_guard(flush_mu_);
+    Rows accums(dim_);
+    {
+      std::lock_guard<std::mutex> guard(mu_);
+      if (pending_.Empty()) return Status::OK();
+      std::swap(pending_, flushing_);
+      flushing_.ExtractDeltas(&accums);
+    }
+    // flushing_ only changes under flush_mu_, so it is read without mu_.
+    // A value for a missing key may have to land after a delta of the key,
+    // so the rest waits until the deltas are written.
+    Status statu = Write(accums);
+    const bool accums_written = statu.ok();
+    if (accums_written) statu = Write(flushing_);
+    std::lock_guard<std::mutex> guard(mu_);
+    if (!accums_written) {
+      accums.Merge(flushing_);
+      accums.Merge(pending_);
+      std::swap(pending_, accums);
+    } else if (!statu.ok()) {
+      // The deltas are in Redis, so retrying them would add them twice.
+      flushing_.Merge(pending_);
+      std::swap(pending_, flushing_);
+    }
+    flushing_.Clear();
+    return statu;
+  }
+
+ private:
+  // kAccumOrInsert adds its delta to the row if the key is in Redis, and
+  // inserts its value if not.
+  enum Kind : char { kSet, kAccum, kAccumMissing, kAccumOrInsert };
+
+  // The pending writes of each key, in the order of their first write.
+  class Rows {
+   public:
+    explicit Rows(const int64_t dim) : dim_(dim) {}
+
+    bool Empty() const { return keys_.empty(); }
+    size_t Size() const { return keys_.size(); }
+
+    // Adds a write of kind, which is not kAccumOrInsert, after the pending
+    // one of the key.
+    void Add(const K &key, const V *row, const Kind kind) {
+      auto it = index_.find(key);
+      if (it == index_.end()) {
+        index_.emplace(key, keys_.size());
+        keys_.push_back(key);
+        kinds_.push_back(kind);
+        values_.insert(values_.end(), row, row + dim_);
+        return;
+      }
+      const size_t i = it->second;
+      V *old = values_.data() + i * dim_;
+      if (kind == kSet) {
+        std::copy_n(row, dim_, old);
+        kinds_[i] = kSet;
+        deltas_.erase(key);
+        return;
+      }
+      switch (kinds_[i]) {
+        case kSet:
+          if (kind == kAccum) AccumRow(old, row, dim_);
+          break;
+        case kAccum:
+          if (kind == kAccum) {
+            AccumRow(old, row, dim_);
+          } else {
+            deltas_[key].assign(old, old + dim_);
+            std::copy_n(row, dim_, old);
+            kinds_[i] = kAccumOrInsert;
+          }
+          break;
+        case kAccumMissing:
+          if (kind == kAccum) {
+            deltas_[key].assign(row, row + dim_);
+            AccumRow(old, row, dim_);
+            kinds_[i] = kAccumOrInsert;
+          }
+          break;
+        case kAccumOrInsert:
+          if (kind == kAccum) {
+            AccumRow(old, row, dim_);
+            AccumRow(deltas_[key].data(), row, dim_);
+          }
+          break;
+      }
+    }
+
+    void Apply(const K &key, V *row, bool *exists) const {
+      auto it = index_.find(key);
+      if (it == index_.end()) return;
+      const V *pending = values_.data() + it->second * dim_;
+      switch (kinds_[it->second]) {
+        case kSet:
+          std::copy_n(pending, dim_, row);
+          *exists = true;
+          break;
+        case kAccum:
+          if (*exists) AccumRow(row, pending, dim_);
+          break;
+        case kAccumMissing:
+          if (!*exists) {
+            std::copy_n(pending, dim_, row);
+            *exists = true;
+          }
+          break;
+        case kAccumOrInsert:
+          if (*exists) {
+            AccumRow(row, deltas_.at(key).data(), dim_);
+          } else {
+            std::copy_n(pending, dim_, row);
+            *exists = true;
+          }
+          break;
+      }
+    }
+
+    void Erase(const K &key) {
+      auto it = index_.find(key);
+      if (it == index_.end()) return;
+      const size_t i = it->second, last = keys_.size() - 1;
+      index_.erase(it);
+      deltas_.erase(key);
+      if (i != last) {
+        keys_[i] = keys_[last];
+        kinds_[i] = kinds_[last];
+        std::copy_n(values_.data() + last * dim_, dim_,
+                    values_.data() + i * dim_);
+        index_[keys_[i]] = i;
+      }
+      keys_.pop_back();
+      kinds_.pop_back();
+      values_.resize(last * dim_);
+    }
+
+    // Moves the deltas for keys in Redis into out, which must not hold
+    // their keys, and leaves the values for missing keys.
+    void ExtractDeltas(Rows *out) {
+      size_t kept = 0;
+      for (size_t i = 0; i < keys_.size(); ++i) {
+        if (kinds_[i] == kAccum) {
+          out->Add(keys_[i], values_.data() + i * dim_, kAccum);
+          index_.erase(keys_[i]);
+          continue;
+        }
+        if (kinds_[i] == kAccumOrInsert) {
+          auto delta = deltas_.find(keys_[i]);
+          out->Add(keys_[i], delta->second.data(), kAccum);
+          deltas_.erase(delta);
+          kinds_[i] = kAccumMissing;
+        }
+        if (kept != i) {
+          keys_[kept] = keys_[i];
+          kinds_[kept] = kinds_[i];
+          std::copy_n(values_.data() + i * dim_, dim_,
+                      values_.data() + kept * dim_);
+        }
+        index_[keys_[kept]] = kept;
+        ++kept;
+      }
+      keys_.resize(kept);
+      kinds_.resize(kept);
+      values_.resize(kept * dim_);
+    }
+
+    // Adds the writes of later on top of these ones.
+    void Merge(const Rows &later) {
+      for (size_t i = 0; i < later.keys_.size(); ++i) {
+        const K &key = later.keys_[i];
+        const V *row = later.values_.data() + i * dim_;
+        if (later.kinds_[i] == kAccumOrInsert) {
+          Add(key, later.deltas_.at(key).data(), kAccum);
+          Add(key, row, kAccumMissing);
+        } else {
+          Add(key, row, later.kinds_[i]);
+        }
+      }
+    }
+
+    void Clear() {
+      index_.clear();
+      deltas_.clear();
+      keys_.clear();
+      kinds_.clear();
+      values_.clear();
+    }
+
+    // Copies the writes of the kinds matched by accum into keys, values and,
+    // for the accumulates, exists. The rows hold no kAccumOrInsert, see
+    // ExtractDeltas.
+    void Gather(const bool accum, Tensor *keys, Tensor *values,
+                Tensor *exists) const {
+      int64_t n = 0;
+      for (const Kind kind : kinds_) {
+        if ((kind != kSet) == accum) ++n;
+      }
+      *keys = Tensor(DataTypeToEnum<K>::v(), TensorShape({n}));
+      *values = Tensor(DataTypeToEnum<V>::v(), TensorShape({n, dim_}));
+      if (accum) *exists = Tensor(DT_BOOL, TensorShape({n}));
+      K *pk = keys->flat<K>().data();
+      V *pv = values->flat<V>().data();
+      bool *pe = accum ? exists->flat<bool>().data() : nullptr;
+      for (size_t i = 0, j = 0; i < keys_.size(); ++i) {
+        if ((kinds_[i] != kSet) != accum) continue;
+        pk[j] = keys_[i];
+        std::copy_n(values_.data() + i * dim_, dim_, pv + j * dim_);
+        if (accum) pe[j] = kinds_[i] == kAccum;
+        ++j;
+      }
+    }
+
+   private:
+    int64_t dim_;
+    std::unordered_map<K, size_t, NearCacheHash> index_;
+    std::vector<K> keys_;
+    std::vector<Kind> kinds_;
+    std::vector<V> values_;
+    // The deltas of the kAccumOrInsert writes, whose values_ hold the value
+    // for a missing key.
+    std::unordered_map<K, std::vector<V>, NearCacheHash> deltas_;
+  };
+
+  void Add(const K *keys, const V *values, const bool *exists,
+           const int64_t n) {
+    bool full = false;
+    {
+      std::lock_guard<std::mutex> guard(mu_);
+      for (int64_t i = 0; i < n; ++i) {
+        const Kind kind =
+            exists == nullptr ? kSet : (exists[i] ? kAccum : kAccumMissing);
+        pending_.Add(keys[i], values + i * dim_, kind);
+      }
+      full = pending_.Size() >= max_keys_;
+    }
+    if (full) cv_.notify_one();
+  }
+
+  Status Write(const Rows &rows) {
+    Tensor keys, values, exists;
+    rows.Gather(false, &keys, &values, nullptr);
+    if (keys.NumElements() > 0) {
+      TF_RETURN_IF_ERROR(insert_fn_(keys, values));
+    }
+    rows.Gather(true, &keys, &values, &exists);
+    if (keys.NumElements() > 0) {
+      TF_RETURN_IF_ERROR(accum_fn_(keys, values, exists));
+    }
+    return Status::OK();
+  }
+
+  // After a failed flush the next one waits for the interval even if the
+  // buffer is full, rather than retrying at once.
+  void Run() {
+    bool failed = false;
+    std::unique_lock<std::mutex> lock(mu_);
+    while (!stopped_) {
+      cv_.wait_for(lock, std::chrono::microseconds(interval_micros_),
+                   [this, failed]() {
+                     return stopped_ ||
+                            (!failed && pending_.Size() >= max_keys_);
+                   });
+      if (stopped_) break;
+      lock.unlock();
+      Status statu = Flush();
+      failed = !statu.ok();
+      if (failed) {
+        LOG(WARNING) << "Fails to flush the pending writes to Redis, retry "
+                        "them later -- "
+                     << statu;
+      }
+      lock.lock();
+    }
+  }
+
+  const int64_t dim_;
+  const uint64 interval_micros_;
+  const size_t max_keys_;
+  InsertFn insert_fn_;
+  AccumFn accum_fn_;
+
+  // Taken before mu_ by whoever takes both.
+  std::mutex flush_mu_;
+  std::mutex mu_;
+  std::condition_variable cv_;
+  Rows pending_;
+  Rows flushing_;
+  bool stopped_ = false;
+  std::thread flusher_;
+};
+
+}  // namespace redis_connection
+}  // namespace recommenders_addons
+}  // namespace tensorflow
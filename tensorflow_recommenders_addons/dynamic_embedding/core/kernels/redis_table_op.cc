@@ -22,18 +22,27 @@ limitations under the License.
 #include <sys/types.h>
 #include <time.h>
 
+#include <algorithm>
+#include <atomic>
 #include <csignal>
+#include <functional>
 #include <mutex>
 #include <thread>
 #include <type_traits>
 #include <utility>
 
 #include "redis_impl/json.h"
+#include "redis_impl/redis_async_client.hpp"
 #include "redis_impl/redis_cluster_connection_pool.hpp"
 #include "redis_impl/redis_connection_pool.hpp"
+#include "redis_impl/redis_near_cache.hpp"
 #include "redis_impl/redis_table_op_util.hpp"
+#include "redis_impl/redis_write_behind.hpp"
 #include "tensorflow/core/kernels/lookup_table_op.h"
+#include "tensorflow/core/profiler/lib/traceme.h"
+#include "tensorflow/core/profiler/lib/traceme_encode.h"
 #include "tensorflow/core/util/work_sharder.h"
+#include "tensorflow_recommenders_addons/dynamic_embedding/core/utils/table_metrics.h"
 #include "tensorflow_recommenders_addons/dynamic_embedding/core/utils/types.h"
 #include "tensorflow_recommenders_addons/dynamic_embedding/core/utils/utils.h"
 
@@ -47,6 +56,9 @@ https://github.com/redis/redis/blob/be6ce8a92a9acbecfaaa6c57a45037fc1018fefe/src
 // constexpr int64_t multi_redis_cmd_max_argc = 1024 * 1024;
 static int64_t multi_redis_cmd_max_argc =
     128 * 8;  // For better parallelism performance
+// The cost of one storage slice for Shard when the round trips of the slices
+// are spread over the CPU worker threads, high enough for a shard each.
+static const int64_t kSliceRoundTripCost = 100000;
 
 using sw::redis::OptionalString;
 using sw::redis::Redis;
@@ -59,7 +71,8 @@ namespace redis_table {
 using namespace redis_connection;
 
 template <class K, class V>
-class RedisTableOfTensors final : public LookupInterface {
+class RedisTableOfTensors final : public LookupInterface,
+                                  public AsyncLookupInterface {
  private:
   TensorShape value_shape_;
   int64_t runtime_value_dim_;
@@ -72,6 +85,12 @@ class RedisTableOfTensors final : public LookupInterface {
   std::vector<std::string> keys_prefix_name_slices_import;
 
   std::shared_ptr<RedisVirtualWrapper> _table_instance = nullptr;
+  // Only set when redis_async_client is enabled in the config.
+  std::unique_ptr<RedisAsyncClient> async_client_;
+  // Only set when near_cache_capacity is not 0 in the config.
+  std::unique_ptr<RedisNearCache<K, V>> near_cache_;
+  // Only set when using_write_behind is enabled in the config.
+  std::unique_ptr<RedisWriteBehind<K, V>> write_behind_;
 
   std::vector<ThreadContext *> threads_Find;
   std::vector<ThreadContext *> threads_Insert;
@@ -96,7 +115,8 @@ class RedisTableOfTensors final : public LookupInterface {
                            const Tensor &keys, Tensor *values,
                            const Tensor &default_value, const int64_t &total,
                            const int64_t &Velems_per_flat2_dim0,
-                           std::vector<ThreadContext *> &threads_Find) {
+                           std::vector<ThreadContext *> &threads_Find,
+                           std::atomic<int64_t> *misses) {
     const bool is_full_default =
         (values->NumElements() == default_value.NumElements());
 
@@ -104,14 +124,14 @@ class RedisTableOfTensors final : public LookupInterface {
 
     auto shard = [this, &ctx, &total, &keys_prefix_name_slices, &keys, &values,
                   &default_value, &is_full_default, &Velems_per_flat2_dim0,
-                  &threads_Find](int64_t begin, int64_t end) {
+                  &threads_Find, misses](int64_t begin, int64_t end) {
       const int64_t max_i = std::min(total, end);
 
       OP_REQUIRES_OK(
-          ctx,
-          launchFindCore(_table_instance, keys_prefix_name_slices, keys, values,
-                         default_value, is_full_default, Velems_per_flat2_dim0,
-                         threads_Find, threads_Find_mutex, begin, max_i));
+          ctx, launchFindCore(_table_instance, keys_prefix_name_slices, keys,
+                              values, default_value, is_full_default,
+                              Velems_per_flat2_dim0, threads_Find,
+                              threads_Find_mutex, begin, max_i, misses));
     };
     int64_t slices_size = std::min(total, multi_redis_cmd_max_argc - 1);
     auto &worker_threads = *ctx->device()->tensorflow_cpu_worker_threads();
@@ -123,7 +143,8 @@ class RedisTableOfTensors final : public LookupInterface {
                   const Tensor &keys, Tensor *values,
                   const Tensor &default_value, const int64_t &total,
                   const int64_t &Velems_per_flat2_dim0,
-                  std::vector<ThreadContext *> &threads_Find) {
+                  std::vector<ThreadContext *> &threads_Find,
+                  std::atomic<int64_t> *misses) {
     const bool is_full_default =
         (values->NumElements() == default_value.NumElements());
 
@@ -131,7 +152,7 @@ class RedisTableOfTensors final : public LookupInterface {
         ctx,
         launchFindCore(_table_instance, keys_prefix_name_slices, keys, values,
                        default_value, is_full_default, Velems_per_flat2_dim0,
-                       threads_Find, threads_Find_mutex, 0, total));
+                       threads_Find, threads_Find_mutex, 0, total, misses));
   }
 
   void launchFindWithExists_parallel(
@@ -249,6 +270,35 @@ class RedisTableOfTensors final : public LookupInterface {
                              threads_Insert, threads_Insert_mutex, 0, total));
   }
 
+  void launchSparseApply(
+      OpKernelContext *ctx, const std::string &command, const Tensor &keys,
+      const Tensor &grads,
+      const std::vector<std::vector<std::string>> &slot_slices,
+      const std::vector<std::string> &hyperparams, const int64_t &total,
+      const int64_t &Velems_per_flat2_dim0) {
+    auto shard = [this, &ctx, &command, &keys, &grads, &slot_slices,
+                  &hyperparams, &total,
+                  &Velems_per_flat2_dim0](int64_t begin, int64_t end) {
+      const int64_t max_i = std::min(total, end);
+
+      OP_REQUIRES_OK(
+          ctx, launchSparseApplyCore(_table_instance, keys_prefix_name_slices,
+                                     command, keys, grads, slot_slices,
+                                     hyperparams, Velems_per_flat2_dim0,
+                                     threads_Insert, threads_Insert_mutex,
+                                     begin, max_i));
+    };
+    if (total < (multi_redis_cmd_max_argc - 1)) {
+      shard(0, total);
+      return;
+    }
+    // redis commmand args > multi_redis_cmd_max_argc
+    const int64_t max_parallelism = (total / multi_redis_cmd_max_argc) + 1;
+    int64_t slices_size = std::min(total, multi_redis_cmd_max_argc - 1);
+    auto &worker_threads = *ctx->device()->tensorflow_cpu_worker_threads();
+    Shard(max_parallelism, worker_threads.workers, total, slices_size, shard);
+  }
+
   void launchDelete_parallel(OpKernelContext *ctx,
                              std::vector<std::string> &keys_prefix_name_slices,
                              const Tensor &keys, const int64_t &total,
@@ -289,6 +339,7 @@ class RedisTableOfTensors final : public LookupInterface {
 
     OP_REQUIRES_OK(
         ctx, GetNodeAttr(kernel->def(), "embedding_name", &embedding_name));
+    metrics_.reset(new TableMetrics("redis_table", embedding_name));
 
     std::string redis_config_abs_dir_tem;
     OP_REQUIRES_OK(ctx, GetNodeAttr(kernel->def(), "redis_config_abs_dir",
@@ -361,13 +412,22 @@ class RedisTableOfTensors final : public LookupInterface {
       runtime_value_dim_ = default_value_total;
     }
 
+    if (redis_connection_params.using_packed_commands &&
+        (std::is_same<K, tstring>::value || std::is_same<V, tstring>::value)) {
+      LOG(WARNING) << "The packed Redis commands only take keys and values of "
+                      "fixed size, so the plain ones are used for the "
+                      "strings in "
+                   << embedding_name;
+      redis_connection_params.using_packed_commands = false;
+    }
+
     std::vector<std::pair<unsigned, unsigned>> cluster_slots;
 
     // creat redis instance
     switch (redis_connection_params.redis_connection_mode) {
       case ClusterMode: {
         multi_redis_cmd_max_argc = redis_connection_params.keys_sending_size *
-                                   redis_connection_params.storage_slice;
+                                   redis_connection_params.storage_hashes();
         _table_instance = RedisWrapper<RedisCluster, K, V>::get_instance();
         OP_REQUIRES_OK(ctx,
                        _table_instance->set_params(redis_connection_params));
@@ -440,8 +500,8 @@ class RedisTableOfTensors final : public LookupInterface {
     if (redis_connection_params.model_tag_import ==
             redis_connection_params.model_tag_runtime &&
         (keys_prefix_name_slices_import_sort != keys_prefix_name_slices_sort ||
-         redis_connection_params.storage_slice_import !=
-             static_cast<int>(redis_connection_params.storage_slice))) {
+         redis_connection_params.storage_hashes_import() !=
+             redis_connection_params.storage_hashes())) {
       auto keys_prefix_name_slices_redis =
           _table_instance->GetKeyBucketsAndOptimizerParamsWithName(
               keys_prefix_name_import, true);
@@ -453,7 +513,7 @@ class RedisTableOfTensors final : public LookupInterface {
                 << ". And remove the old one. Remember changing config file "
                    "next time!";
       if (keys_prefix_name_slices_redis.size() ==
-          redis_connection_params.storage_slice) {
+          redis_connection_params.storage_hashes()) {
         if (keys_prefix_name_slices_redis_sort ==
             keys_prefix_name_slices_import_sort) {
           OP_REQUIRES_OK(ctx, _table_instance->DuplicateInRedis(
@@ -494,7 +554,7 @@ class RedisTableOfTensors final : public LookupInterface {
                "in the setting. ";
         LOG(INFO) << "Try to recreate the embedding table "
                   << keys_prefix_name_import << " into the bucket number "
-                  << redis_connection_params.storage_slice << " for"
+                  << redis_connection_params.storage_hashes() << " for"
                   << keys_prefix_name;
         OP_REQUIRES_OK(ctx, ReCreateTableBuckets(ctx, keys_prefix_name_import));
       }
@@ -507,6 +567,28 @@ class RedisTableOfTensors final : public LookupInterface {
       }
     }
 
+    // Move the hashes the table has in Redis from the other storage_mode.
+    {
+      const bool sub_hash =
+          redis_connection_params.storage_mode == SubHashStorageMode;
+      std::vector<std::string> slices_in_redis =
+          _table_instance->GetKeyBucketsAndOptimizerParamsWithName(
+              keys_prefix_name, true);
+      std::vector<std::string> other_mode_slices;
+      for (auto &slice : slices_in_redis) {
+        if (IsSubHashName(slice) != sub_hash) {
+          other_mode_slices.emplace_back(std::move(slice));
+        }
+      }
+      if (!other_mode_slices.empty()) {
+        LOG(INFO) << "Move the " << other_mode_slices.size()
+                  << " hashes of the table " << keys_prefix_name
+                  << " stored in the other storage_mode into "
+                  << keys_prefix_name_slices.size() << " hashes.";
+        OP_REQUIRES_OK(ctx, MoveBucketsIntoTable(ctx, other_mode_slices));
+      }
+    }
+
     // remove expiring time of buckets
     OP_REQUIRES_OK(ctx, _table_instance->SetPersistBuckets(keys_prefix_name));
 
@@ -516,9 +598,51 @@ class RedisTableOfTensors final : public LookupInterface {
       threads_Insert.emplace_back(new ThreadContext());
       threads_Delete.emplace_back(new ThreadContext());
     }
+
+    if (redis_connection_params.redis_async_client) {
+      async_client_.reset(new RedisAsyncClient(redis_connection_params));
+      Status statu = async_client_->Start();
+      if (!statu.ok()) {
+        LOG(WARNING) << "Can not start the asynchronous Redis client, use the "
+                        "blocking one instead -- "
+                     << statu;
+        async_client_.reset();
+      }
+    }
+
+    if (redis_connection_params.near_cache_capacity > 0) {
+      near_cache_.reset(new RedisNearCache<K, V>(
+          redis_connection_params.near_cache_capacity, runtime_value_dim_,
+          redis_connection_params.near_cache_ttl_in_seconds > 0
+              ? redis_connection_params.near_cache_ttl_in_seconds * 1000000ULL
+              : 0));
+    }
+
+    if (redis_connection_params.using_write_behind) {
+      if (std::is_same<K, tstring>::value || std::is_same<V, tstring>::value) {
+        LOG(WARNING) << "Only keys and values of fixed size are written "
+                        "behind, so the strings in "
+                     << embedding_name << " are written to Redis at once.";
+      } else {
+        write_behind_.reset(new RedisWriteBehind<K, V>(
+            runtime_value_dim_,
+            std::max(redis_connection_params.write_behind_interval_in_ms, 1) *
+                1000ULL,
+            redis_connection_params.write_behind_max_keys,
+            [this](const Tensor &keys, const Tensor &values) {
+              return FlushInsert(keys, values);
+            },
+            [this](const Tensor &keys, const Tensor &values_or_delta,
+                   const Tensor &exists) {
+              return FlushAccum(keys, values_or_delta, exists);
+            }));
+      }
+    }
   }
 
   ~RedisTableOfTensors() {
+    // Flushes the pending writes while the connections are still up.
+    write_behind_.reset();
     if (_table_instance != nullptr && _table_instance->isRedisConnect == true) {
       _table_instance->SetExpireBuckets(keys_prefix_name);
     }
@@ -559,11 +683,18 @@ class RedisTableOfTensors final : public LookupInterface {
 
   Status ReCreateTableBuckets(OpKernelContext *ctx,
                               const std::string &keys_prefix_name_from) {
+    return MoveBucketsIntoTable(
+        ctx, _table_instance->GetKeyBucketsAndOptimizerParamsWithName(
+                 keys_prefix_name_from, false));
+  }
+
+  // Inserts the contents of the hashes keys_prefix_name_slices_in_redis into
+  // the hashes of this table, and removes those which are not among them.
+  Status MoveBucketsIntoTable(
+      OpKernelContext *ctx,
+      const std::vector<std::string> &keys_prefix_name_slices_in_redis) {
     std::unique_ptr<redisReply, ::sw::redis::ReplyDeleter> hscan_reply;
     const redisReply *kvs_reply;
-    std::vector<std::string> keys_prefix_name_slices_in_redis =
-        _table_instance->GetKeyBucketsAndOptimizerParamsWithName(
-            keys_prefix_name_from, false);
     Tensor keys_temp;
     const K *pk_raw;
     Tensor values_temp;
@@ -594,7 +725,7 @@ class RedisTableOfTensors final : public LookupInterface {
           if (hscan_reply == nullptr) {
             return errors::Unknown(
                 "Unknown errors happen when HscanGetKeysValsInBucket in "
-                "ReCreateTableBuckets");
+                "MoveBucketsIntoTable");
           }
           if (hscan_reply->type == REDIS_REPLY_ARRAY &&
               hscan_reply->elements > 1) {
@@ -626,7 +757,7 @@ class RedisTableOfTensors final : public LookupInterface {
 
           LOG(INFO) << "The cursor of scanning "
                     << keys_prefix_name_slices_in_redis[i]
-                    << " in ReCreateTableBuckets is " << cursor << " now.";
+                    << " in MoveBucketsIntoTable is " << cursor << " now.";
           if (cursor == 0) {
             break;
           }
@@ -669,7 +800,7 @@ class RedisTableOfTensors final : public LookupInterface {
 
   size_t size() const override {
     size_t size = 0;
-    const unsigned &storage_slice = redis_connection_params.storage_slice;
+    const unsigned storage_slice = redis_connection_params.storage_hashes();
     for (unsigned i = 0; i != storage_slice; ++i) {
       size += _table_instance->TableSizeInBucket(keys_prefix_name_slices[i]);
     }
@@ -678,27 +809,102 @@ class RedisTableOfTensors final : public LookupInterface {
 
   Status Find(OpKernelContext *ctx, const Tensor &keys, Tensor *values,
               const Tensor &default_value) override {
+    if (write_behind_ != nullptr && keys.NumElements() > 0) {
+      // The pending writes of accumulates only apply to the keys in Redis.
+      Tensor exists;
+      TF_RETURN_IF_ERROR(ctx->allocate_temp(
+          DT_BOOL, TensorShape({keys.NumElements()}), &exists));
+      return FindWithExists(ctx, keys, values, default_value, exists);
+    }
+    if (near_cache_ != nullptr && keys.NumElements() > 0) {
+      return FindThroughNearCache(ctx, keys, values, default_value, nullptr);
+    }
+    return FindInRedis(ctx, keys, values, default_value);
+  }
+
+  Status FindWithExists(OpKernelContext *ctx, const Tensor &keys,
+                        Tensor *values, const Tensor &default_value,
+                        Tensor &exists) {
+    if (near_cache_ != nullptr && keys.NumElements() > 0) {
+      TF_RETURN_IF_ERROR(
+          FindThroughNearCache(ctx, keys, values, default_value, &exists));
+    } else {
+      TF_RETURN_IF_ERROR(
+          FindWithExistsInRedis(ctx, keys, values, default_value, exists));
+    }
+    OverlayWriteBehind(ctx, keys, values, exists);
+    return Status::OK();
+  }
+
+  void FindAsync(OpKernelContext *ctx, const Tensor &keys, Tensor *values,
+                 const Tensor &default_value, Tensor *exists,
+                 AsyncOpKernel::DoneCallback done) override {
+    if (write_behind_ != nullptr && keys.NumElements() > 0) {
+      std::shared_ptr<Tensor> exists_buf;
+      if (exists == nullptr) {
+        exists_buf = std::make_shared<Tensor>();
+        Status statu = ctx->allocate_temp(
+            DT_BOOL, TensorShape({keys.NumElements()}), exists_buf.get());
+        if (!statu.ok()) {
+          ctx->SetStatus(statu);
+          done();
+          return;
+        }
+        exists = exists_buf.get();
+      }
+      const Tensor *keys_ptr = &keys;
+      AsyncOpKernel::DoneCallback find_done = std::move(done);
+      done = [this, ctx, keys_ptr, values, exists, exists_buf, find_done]() {
+        OverlayWriteBehind(ctx, *keys_ptr, values, *exists);
+        find_done();
+      };
+    }
+    if (near_cache_ != nullptr && keys.NumElements() > 0) {
+      FindThroughNearCacheAsync(ctx, keys, values, default_value, exists,
+                                std::move(done));
+      return;
+    }
+    FindInRedisAsync(ctx, keys, values, default_value, exists,
+                     std::move(done));
+  }
+
+  Status FindInRedis(OpKernelContext *ctx, const Tensor &keys, Tensor *values,
+                     const Tensor &default_value) {
+    profiler::TraceMe trace([&] {
+      return profiler::TraceMeEncode(
+          "RedisTableFind",
+          {{"keys", keys.NumElements()}, {"bytes", values->TotalBytes()}});
+    });
+    const uint64 start_micros = TableMetrics::NowMicros();
+    std::atomic<int64_t> misses(0);
     int64_t total = keys.NumElements();
     if (total > 0) {
       const int64_t Velems_per_flat2_dim0 = values->NumElements() / total;
 
       if (total < (multi_redis_cmd_max_argc - 1)) {
         launchFind(ctx, keys_prefix_name_slices, keys, values, default_value,
-                   total, Velems_per_flat2_dim0, threads_Find);
+                   total, Velems_per_flat2_dim0, threads_Find, &misses);
       } else {
         // redis commmand args > multi_redis_cmd_max_argc
         launchFind_parallel(ctx, keys_prefix_name_slices, keys, values,
                             default_value, total, Velems_per_flat2_dim0,
-                            threads_Find);
+                            threads_Find, &misses);
       }
     }
+    metrics_->RecordFind(total, misses.load(), start_micros);
 
     return Status::OK();
   }
 
-  Status FindWithExists(OpKernelContext *ctx, const Tensor &keys,
-                        Tensor *values, const Tensor &default_value,
-                        Tensor &exists) {
+  Status FindWithExistsInRedis(OpKernelContext *ctx, const Tensor &keys,
+                               Tensor *values, const Tensor &default_value,
+                               Tensor &exists) {
+    profiler::TraceMe trace([&] {
+      return profiler::TraceMeEncode(
+          "RedisTableFindWithExists",
+          {{"keys", keys.NumElements()}, {"bytes", values->TotalBytes()}});
+    });
+    const uint64 start_micros = TableMetrics::NowMicros();
     int64_t total = keys.NumElements();
     if (total > 0) {
       const int64_t Velems_per_flat2_dim0 = values->NumElements() / total;
@@ -714,16 +920,97 @@ class RedisTableOfTensors final : public LookupInterface {
                                       Velems_per_flat2_dim0, threads_Find);
       }
     }
+    const auto exists_flat = exists.flat<bool>();
+    metrics_->RecordFind(
+        total,
+        std::count(exists_flat.data(), exists_flat.data() + total, false),
+        start_micros);
     return Status::OK();
   }
 
+  void FindInRedisAsync(OpKernelContext *ctx, const Tensor &keys,
+                        Tensor *values, const Tensor &default_value,
+                        Tensor *exists, AsyncOpKernel::DoneCallback done) {
+    const int64_t total = keys.NumElements();
+    if (async_client_ == nullptr || total == 0) {
+      ctx->SetStatus(exists == nullptr
+                         ? FindInRedis(ctx, keys, values, default_value)
+                         : FindWithExistsInRedis(ctx, keys, values,
+                                                 default_value, *exists));
+      done();
+      return;
+    }
+    profiler::TraceMe trace([&] {
+      return profiler::TraceMeEncode(
+          "RedisTableFindAsync",
+          {{"keys", total}, {"bytes", values->TotalBytes()}});
+    });
+    const Tensor *keys_ptr = &keys;
+    const Tensor *default_value_ptr = &default_value;
+    const int64_t Velems_per_flat2_dim0 = values->NumElements() / total;
+    const bool is_full_default =
+        (values->NumElements() == default_value.NumElements());
+
+    std::shared_ptr<AsyncBatch> batch = std::make_shared<AsyncBatch>(
+        ctx, total, std::min(total, multi_redis_cmd_max_argc - 1),
+        redis_connection_params.storage_hashes());
+    batch->on_replies = [this, ctx, keys_ptr, values, default_value_ptr,
+                         exists, done](AsyncBatch *batch) {
+      if (batch->failed.load()) {
+        LOG(WARNING) << "Asynchronous lookup in Redis failed, retry it with "
+                        "the blocking client.";
+        ctx->SetStatus(
+            exists == nullptr
+                ? FindInRedis(ctx, *keys_ptr, values, *default_value_ptr)
+                : FindWithExistsInRedis(ctx, *keys_ptr, values,
+                                        *default_value_ptr, *exists));
+        done();
+        return;
+      }
+      // The replies were decoded into values and exists by the sinks as
+      // they were read.
+      int64_t misses = 0;
+      for (const auto &chunk_sinks : batch->sinks) {
+        for (const auto &sink : chunk_sinks) {
+          misses += sink->NilElements();
+        }
+      }
+      metrics_->RecordFind(batch->total, misses, batch->start_micros);
+      done();
+    };
+
+    std::vector<RedisAsyncClient::Request> requests;
+    for (size_t i = 0; i < batch->contexts.size(); ++i) {
+      std::vector<RedisCommandArgs> commands;
+      _table_instance->MgetCommandArgs(
+          keys, batch->contexts[i].get(), batch->Begin(i), batch->End(i),
+          Velems_per_flat2_dim0, keys_prefix_name_slices, &commands);
+      _table_instance->MgetTensorSinks(
+          values, default_value, exists, is_full_default,
+          batch->contexts[i].get(), batch->Begin(i), batch->End(i),
+          Velems_per_flat2_dim0, &batch->sinks[i]);
+      batch->AddRequests(i, commands, &requests);
+    }
+    batch->Send(async_client_.get(), &requests);
+  }
+
   Status DoInsert(bool clear, OpKernelContext *ctx, const Tensor &keys,
                   const Tensor &values) {
+    profiler::TraceMe trace([&] {
+      return profiler::TraceMeEncode(
+          "RedisTableInsert",
+          {{"keys", keys.NumElements()},
+           {"bytes", values.TotalBytes()},
+           {"clear", clear}});
+    });
+    const uint64 start_micros = TableMetrics::NowMicros();
     int64_t total = keys.NumElements();
     if (total > 0) {
       const int64_t Velems_per_flat2_dim0 = values.NumElements() / total;
       auto statu = Status::OK();
       if (clear) {
+        if (write_behind_ != nullptr) write_behind_->Clear();
+        if (near_cache_ != nullptr) near_cache_->Clear();
         for (auto keys_prefix_name_slice : keys_prefix_name_slices) {
           statu = _table_instance->RemoveHkeysInBuckets(keys_prefix_name_slice);
           if (statu != Status::OK()) {
@@ -731,7 +1018,10 @@ class RedisTableOfTensors final : public LookupInterface {
           }
         }
       }
-      if (total < (multi_redis_cmd_max_argc - 1)) {
+      if (write_behind_ != nullptr && !clear) {
+        write_behind_->Insert(keys.flat<K>().data(), values.flat<V>().data(),
+                              total);
+      } else if (total < (multi_redis_cmd_max_argc - 1)) {
         launchInsert(ctx, keys_prefix_name_slices, keys, values, total,
                      Velems_per_flat2_dim0, threads_Insert);
       } else {
@@ -740,16 +1030,34 @@ class RedisTableOfTensors final : public LookupInterface {
             Velems_per_flat2_dim0,
             threads_Insert);  // redis commmand args > multi_redis_cmd_max_argc
       }
+      if (write_behind_ == nullptr || clear) {
+        UpdateNearCache(ctx, keys, values);
+      }
     }
+    RecordInsert(total, start_micros);
     return Status::OK();
   }
 
   Status DoAccum(OpKernelContext *ctx, const Tensor &keys,
                  const Tensor &values_or_delta, const Tensor &exists) {
+    profiler::TraceMe trace([&] {
+      return profiler::TraceMeEncode(
+          "RedisTableAccum",
+          {{"keys", keys.NumElements()},
+           {"bytes", values_or_delta.TotalBytes()}});
+    });
+    const uint64 start_micros = TableMetrics::NowMicros();
     int64_t total = keys.NumElements();
     const int64_t Velems_per_flat2_dim0 =
         values_or_delta.NumElements() / keys.NumElements();
 
+    if (write_behind_ != nullptr) {
+      write_behind_->Accum(keys.flat<K>().data(),
+                           values_or_delta.flat<V>().data(),
+                           exists.flat<bool>().data(), total);
+      RecordInsert(total, start_micros);
+      return Status::OK();
+    }
     if (total < (multi_redis_cmd_max_argc - 1)) {
       launchAccum(ctx, keys_prefix_name_slices, keys, values_or_delta, exists,
                   total, Velems_per_flat2_dim0, threads_Insert);
@@ -759,6 +1067,8 @@ class RedisTableOfTensors final : public LookupInterface {
           Velems_per_flat2_dim0,
           threads_Insert);  // redis commmand args > multi_redis_cmd_max_argc
     }
+    EraseFromNearCache(keys);
+    RecordInsert(total, start_micros);
 
     return Status::OK();
   }
@@ -768,14 +1078,131 @@ class RedisTableOfTensors final : public LookupInterface {
     return DoInsert(false, ctx, keys, values);
   }
 
+  void InsertAsync(OpKernelContext *ctx, const Tensor &keys,
+                   const Tensor &values,
+                   AsyncOpKernel::DoneCallback done) override {
+    const int64_t total = keys.NumElements();
+    if (async_client_ == nullptr || total == 0 || write_behind_ != nullptr) {
+      ctx->SetStatus(DoInsert(false, ctx, keys, values));
+      done();
+      return;
+    }
+    profiler::TraceMe trace([&] {
+      return profiler::TraceMeEncode(
+          "RedisTableInsertAsync",
+          {{"keys", total}, {"bytes", values.TotalBytes()}});
+    });
+    const Tensor *keys_ptr = &keys;
+    const Tensor *values_ptr = &values;
+    const int64_t Velems_per_flat2_dim0 = values.NumElements() / total;
+
+    std::shared_ptr<AsyncBatch> batch = std::make_shared<AsyncBatch>(
+        ctx, total, std::min(total, multi_redis_cmd_max_argc - 1),
+        redis_connection_params.storage_hashes());
+    batch->on_replies = [this, ctx, keys_ptr, values_ptr,
+                         done](AsyncBatch *batch) {
+      if (batch->failed.load()) {
+        LOG(WARNING) << "Asynchronous insert into Redis failed, retry it "
+                        "with the blocking client.";
+        ctx->SetStatus(DoInsert(false, ctx, *keys_ptr, *values_ptr));
+      } else {
+        UpdateNearCache(ctx, *keys_ptr, *values_ptr);
+        RecordInsert(batch->total, batch->start_micros);
+      }
+      done();
+    };
+
+    std::vector<RedisAsyncClient::Request> requests;
+    for (size_t i = 0; i < batch->contexts.size(); ++i) {
+      std::vector<RedisCommandArgs> commands;
+      _table_instance->MsetCommandArgs(
+          keys, values, batch->contexts[i].get(), batch->Begin(i),
+          batch->End(i), Velems_per_flat2_dim0, keys_prefix_name_slices,
+          &batch->buffs[i], &commands);
+      batch->AddRequests(i, commands, &requests);
+    }
+    batch->Send(async_client_.get(), &requests);
+  }
+
   Status Accum(OpKernelContext *ctx, const Tensor &keys,
                const Tensor &values_or_delta, const Tensor &exists) {
     return DoAccum(ctx, keys, values_or_delta, exists);
   }
 
+  // Applies grads to the values of keys on the Redis servers with the
+  // optimizer command of the BPV2 module, updating the slots kept in the
+  // slot tables. Every slot table must share the storage slices of this one,
+  // so that a value and its slots are in the same slot of a cluster.
+  Status SparseApply(OpKernelContext *ctx, const std::string &command,
+                     const std::vector<RedisTableOfTensors<K, V> *> &slots,
+                     const Tensor &keys, const Tensor &grads,
+                     const std::vector<std::string> &hyperparams) {
+    std::vector<std::vector<std::string>> slot_slices;
+    slot_slices.reserve(slots.size());
+    for (const RedisTableOfTensors<K, V> *slot : slots) {
+      if (slot->value_shape_ != value_shape_ ||
+          slot->keys_prefix_name_slices.size() !=
+              keys_prefix_name_slices.size()) {
+        return errors::InvalidArgument(
+            "The slot table ", slot->embedding_name,
+            " must have the value shape and the storage_slice of ",
+            embedding_name);
+      }
+      for (size_t i = 0; i < keys_prefix_name_slices.size(); ++i) {
+        const std::string &slice = keys_prefix_name_slices[i];
+        const std::string &slot_slice = slot->keys_prefix_name_slices[i];
+        const std::size_t tag = slice.rfind('{');
+        const std::size_t slot_tag = slot_slice.rfind('{');
+        if (tag == std::string::npos || slot_tag == std::string::npos ||
+            slice.compare(tag, std::string::npos, slot_slice, slot_tag,
+                          std::string::npos) != 0) {
+          return errors::InvalidArgument(
+              "The slot table ", slot->embedding_name,
+              " must have the redis_hash_tags of ", embedding_name);
+        }
+      }
+      slot_slices.push_back(slot->keys_prefix_name_slices);
+    }
+    // The optimizer reads the values and slots in Redis, so their pending
+    // writes must be there first.
+    TF_RETURN_IF_ERROR(Flush());
+    for (RedisTableOfTensors<K, V> *slot : slots) {
+      TF_RETURN_IF_ERROR(slot->Flush());
+    }
+
+    profiler::TraceMe trace([&] {
+      return profiler::TraceMeEncode(
+          "RedisTableSparseApply",
+          {{"command", command},
+           {"keys", keys.NumElements()},
+           {"bytes", grads.TotalBytes()}});
+    });
+    const uint64 start_micros = TableMetrics::NowMicros();
+    const int64_t total = keys.NumElements();
+    if (total == 0) return Status::OK();
+    const int64_t Velems_per_flat2_dim0 = grads.NumElements() / total;
+    launchSparseApply(ctx, command, keys, grads, slot_slices, hyperparams,
+                      total, Velems_per_flat2_dim0);
+    EraseFromNearCache(keys);
+    for (RedisTableOfTensors<K, V> *slot : slots) {
+      slot->EraseFromNearCache(keys);
+    }
+    RecordInsert(total, start_micros);
+
+    return Status::OK();
+  }
+
   Status Remove(OpKernelContext *ctx, const Tensor &keys) override {
+    const uint64 start_micros = TableMetrics::NowMicros();
+    profiler::TraceMe trace([&] {
+      return profiler::TraceMeEncode(
+          "RedisTableRemove", {{"keys", keys.NumElements()}});
+    });
     int64_t total = keys.NumElements();
     if (total > 0) {
+      if (write_behind_ != nullptr) {
+        write_behind_->Erase(keys.flat<K>().data(), total);
+      }
       if (total < (multi_redis_cmd_max_argc - 1)) {
         launchDelete(ctx, keys_prefix_name_slices, keys, total, threads_Delete);
       } else {
@@ -783,11 +1210,21 @@ class RedisTableOfTensors final : public LookupInterface {
         launchDelete_parallel(ctx, keys_prefix_name_slices, keys, total,
                               threads_Delete);
       }
+      EraseFromNearCache(keys);
     }
+    metrics_->RecordRemove(total, start_micros);
     return Status::OK();
   }
 
+  // Writes the pending writes of the write-behind buffer to Redis.
+  Status Flush() {
+    if (write_behind_ == nullptr) return Status::OK();
+    return write_behind_->Flush();
+  }
+
   Status Clear(OpKernelContext *ctx) {
+    if (write_behind_ != nullptr) write_behind_->Clear();
+    if (near_cache_ != nullptr) near_cache_->Clear();
     auto statu = Status::OK();
     for (auto keys_prefix_name_slice : keys_prefix_name_slices) {
       statu = _table_instance->RemoveHkeysInBuckets(keys_prefix_name_slice);
@@ -831,9 +1268,16 @@ class RedisTableOfTensors final : public LookupInterface {
   }
 
   Status ImportValuesFromFiles(OpKernelContext *ctx) {
+    profiler::TraceMe trace([&] {
+      return profiler::TraceMeEncode(
+          "RedisTableImportFromFiles",
+          {{"storage_slice", redis_connection_params.storage_hashes()}});
+    });
     std::string file_path, folder_dir;
-    const unsigned &storage_slice = redis_connection_params.storage_slice;
+    const unsigned storage_slice = redis_connection_params.storage_hashes();
 
+    if (write_behind_ != nullptr) write_behind_->Clear();
+    if (near_cache_ != nullptr) near_cache_->Clear();
     IMPORT_content.resize(storage_slice);
     IMPORT_fds.clear();
     IMPORT_fds.reserve(storage_slice);
@@ -877,6 +1321,8 @@ class RedisTableOfTensors final : public LookupInterface {
   }
 
   Status ExportValues(OpKernelContext *ctx) override {
+    // The checkpoint must hold the pending writes as well.
+    TF_RETURN_IF_ERROR(Flush());
     if (redis_connection_params.table_store_mode == 0) {
       return ExportValuesToTensor(ctx);
     } else if (redis_connection_params.table_store_mode == 1) {
@@ -894,8 +1340,13 @@ class RedisTableOfTensors final : public LookupInterface {
   }
 
   Status ExportValuesToFiles(OpKernelContext *ctx) {
+    profiler::TraceMe trace([&] {
+      return profiler::TraceMeEncode(
+          "RedisTableExportToFiles",
+          {{"storage_slice", redis_connection_params.storage_hashes()}});
+    });
     std::string file_path, folder_dir;
-    const unsigned &storage_slice = redis_connection_params.storage_slice;
+    const unsigned storage_slice = redis_connection_params.storage_hashes();
     int tem_fd;
     auto statu = Status::OK();
 
@@ -960,78 +1411,133 @@ class RedisTableOfTensors final : public LookupInterface {
     return Status::OK();
   }
 
+  // The storage slices are counted and scanned in parallel, each into its
+  // own rows of the output from the offset given by the counts. A slice which
+  // shrank while it was scanned leaves a gap, closed before the output is set,
+  // and the rows of a slice which grew are dropped.
   Status ExportValuesToTensor(OpKernelContext *ctx) {
-    int64_t total_size = 0;
-    long long cursor = 0;
-    std::unique_ptr<redisReply, ::sw::redis::ReplyDeleter> hscan_reply;
-    const redisReply *kvs_reply;
-
-    for (size_t i = 0; i < keys_prefix_name_slices.size(); ++i) {
-      total_size +=
-          _table_instance->TableSizeInBucket(keys_prefix_name_slices[i]);
+    profiler::TraceMe trace("RedisTableExportToTensor");
+    const int64_t slices = keys_prefix_name_slices.size();
+    std::vector<int64_t> offsets(slices + 1, 0);
+    std::vector<Status> statuses(slices);
+    ForEachSlice(ctx, slices, [this, &offsets, &statuses](const int64_t i) {
+      try {
+        offsets[i + 1] =
+            _table_instance->TableSizeInBucket(keys_prefix_name_slices[i]);
+      } catch (const std::exception &err) {
+        statuses[i] = errors::Unknown(err.what());
+      }
+    });
+    for (int64_t i = 0; i < slices; ++i) {
+      TF_RETURN_IF_ERROR(statuses[i]);
+      offsets[i + 1] += offsets[i];
     }
+    const int64_t total_size = offsets[slices];
 
-    Tensor *keys;
-    TF_RETURN_IF_ERROR(
-        ctx->allocate_output("keys", TensorShape({total_size}), &keys));
-
-    Tensor *values;
-    TF_RETURN_IF_ERROR(ctx->allocate_output(
-        "values", TensorShape({total_size, runtime_value_dim_}), &values));
+    Tensor keys;
+    TF_RETURN_IF_ERROR(ctx->allocate_temp(DataTypeToEnum<K>::v(),
+                                          TensorShape({total_size}), &keys));
+    Tensor values;
+    TF_RETURN_IF_ERROR(ctx->allocate_temp(
+        DataTypeToEnum<V>::v(), TensorShape({total_size, runtime_value_dim_}),
+        &values));
 
     if (total_size == 0) {
       LOG(WARNING) << "There is no embedding table called " << keys_prefix_name
                    << " existing in the Redis service. "
                    << "Exporting values to Tensor failed.";
+      TF_RETURN_IF_ERROR(ctx->set_output("keys", keys));
+      TF_RETURN_IF_ERROR(ctx->set_output("values", values));
       return Status::OK();
     }
 
-    redisReply const *temp_reply;
-    const K *pk_raw = reinterpret_cast<const K *>(keys->tensor_data().data());
-    const V *pv_raw = reinterpret_cast<const V *>(values->tensor_data().data());
-    for (size_t i = 0; i < keys_prefix_name_slices.size(); ++i) {
-      cursor = 0;
-      while (true) {
-        hscan_reply.reset();
-        hscan_reply = _table_instance->HscanGetKeysValsInBucket(
-            keys_prefix_name_slices[i], &cursor, multi_redis_cmd_max_argc);
-        if (hscan_reply == nullptr) {
-          return errors::Unknown(
-              "Unknown errors happen when HscanGetKeysValsInBucket in "
-              "ExportValuesToTensor");
-        }
-        kvs_reply = hscan_reply->element[1];
-        // fill Tensor keys and values
-        for (size_t j = 0; j < kvs_reply->elements; ++j) {
-          temp_reply = kvs_reply->element[j];
-          if (temp_reply->type ==
-              REDIS_REPLY_STRING) {  // #define REDIS_REPLY_STRING 1
-            ReplyMemcpyToKeyTensor<K>(
-                pk_raw, temp_reply->str,
-                temp_reply->len);  // Direct access to Tensor data in TensorFlow
-          }
-          ++pk_raw;
-
-          ++j;
-          temp_reply = kvs_reply->element[j];
-          if (temp_reply->type ==
-              REDIS_REPLY_STRING) {  // #define REDIS_REPLY_STRING 1
-            ReplyMemcpyToValTensor<V>(
-                pv_raw, temp_reply->str,
-                runtime_value_dim_);  // Direct access to Tensor data in
-                                      // TensorFlow
-          }
-          pv_raw += runtime_value_dim_;
-        }
+    K *pk_raw = keys.flat<K>().data();
+    V *pv_raw = values.flat<V>().data();
+    std::vector<int64_t> counts(slices, 0);
+    ForEachSlice(ctx, slices,
+                 [this, &offsets, &counts, &statuses, pk_raw,
+                  pv_raw](const int64_t i) {
+                   statuses[i] = ScanSliceIntoTensors(
+                       keys_prefix_name_slices[i], pk_raw + offsets[i],
+                       pv_raw + offsets[i] * runtime_value_dim_,
+                       offsets[i + 1] - offsets[i], &counts[i]);
+                 });
+
+    int64_t exported = 0;
+    for (int64_t i = 0; i < slices; ++i) {
+      TF_RETURN_IF_ERROR(statuses[i]);
+      if (exported != offsets[i]) {
+        std::move(pk_raw + offsets[i], pk_raw + offsets[i] + counts[i],
+                  pk_raw + exported);
+        std::move(pv_raw + offsets[i] * runtime_value_dim_,
+                  pv_raw + (offsets[i] + counts[i]) * runtime_value_dim_,
+                  pv_raw + exported * runtime_value_dim_);
+      }
+      exported += counts[i];
+    }
+    LOG(INFO) << "Exported " << exported << " rows of " << keys_prefix_name
+              << " from " << slices << " storage slices to Tensor.";
+    TF_RETURN_IF_ERROR(ctx->set_output("keys", keys.Slice(0, exported)));
+    TF_RETURN_IF_ERROR(ctx->set_output("values", values.Slice(0, exported)));
+    return Status::OK();
+  }
 
-        LOG(INFO) << "The cursor of scanning " << keys_prefix_name_slices[i]
-                  << " in ExportValuesToTensor is " << cursor << " now.";
-        if (cursor == 0) {
-          break;
-        }
+  // Exports the rows found by one HSCAN of the storage slice slice from
+  // cursor with COUNT max_rows, so that a table too large for one tensor can
+  // be exported in batches. Outputs the slice and the cursor to scan next,
+  // and -1 as the slice after the last one.
+  Status ExportChunk(OpKernelContext *ctx, const int64_t slice,
+                     const int64_t cursor, const int64_t max_rows) {
+    profiler::TraceMe trace([&] {
+      return profiler::TraceMeEncode("RedisTableExportChunk",
+                                     {{"slice", slice}, {"cursor", cursor}});
+    });
+    if (max_rows <= 0) {
+      return errors::InvalidArgument("max_rows must be positive, got ",
+                                     max_rows);
+    }
+    // The exported rows must hold the pending writes as well.
+    TF_RETURN_IF_ERROR(Flush());
+    const int64_t slices = keys_prefix_name_slices.size();
+    std::unique_ptr<redisReply, ::sw::redis::ReplyDeleter> hscan_reply;
+    long long next_cursor = cursor;
+    int64_t rows = 0;
+    if (slice >= 0 && slice < slices) {
+      hscan_reply = _table_instance->HscanGetKeysValsInBucket(
+          keys_prefix_name_slices[slice], &next_cursor, max_rows);
+      if (hscan_reply == nullptr) {
+        return errors::Unknown(
+            "Unknown errors happen when HscanGetKeysValsInBucket in "
+            "ExportChunk");
       }
+      rows = HscanReplyRows(hscan_reply.get());
+    } else {
+      next_cursor = 0;
+    }
+
+    Tensor *keys;
+    TF_RETURN_IF_ERROR(
+        ctx->allocate_output("keys", TensorShape({rows}), &keys));
+    Tensor *values;
+    TF_RETURN_IF_ERROR(ctx->allocate_output(
+        "values", TensorShape({rows, runtime_value_dim_}), &values));
+    if (rows > 0) {
+      DecodeHscanReply(hscan_reply.get(), keys->flat<K>().data(),
+                       values->flat<V>().data(), rows);
     }
 
+    int64_t next_slice = slice;
+    if (next_cursor == 0) {
+      next_slice = slice >= 0 && slice + 1 < slices ? slice + 1 : -1;
+    }
+    Tensor *next_slice_t;
+    TF_RETURN_IF_ERROR(
+        ctx->allocate_output("next_slice", TensorShape({}), &next_slice_t));
+    next_slice_t->scalar<int64_t>()() = next_slice;
+    Tensor *next_cursor_t;
+    TF_RETURN_IF_ERROR(
+        ctx->allocate_output("next_cursor", TensorShape({}), &next_cursor_t));
+    next_cursor_t->scalar<int64_t>()() = next_cursor;
     return Status::OK();
   }
 
@@ -1048,12 +1554,384 @@ class RedisTableOfTensors final : public LookupInterface {
     ret = (int64_t)(size() * (sizeof(K) + sizeof(V)));
     return sizeof(RedisTableOfTensors) + ret;
   }
+
+ private:
+  // Runs fn(i) for each i in [0, n) on the CPU worker threads, one storage
+  // slice per shard so that their round trips to Redis overlap.
+  void ForEachSlice(OpKernelContext *ctx, const int64_t n,
+                    const std::function<void(int64_t)> &fn) {
+    auto shard = [&fn](int64_t begin, int64_t end) {
+      for (int64_t i = begin; i < end; ++i) {
+        fn(i);
+      }
+    };
+    auto &worker_threads = *ctx->device()->tensorflow_cpu_worker_threads();
+    Shard(n, worker_threads.workers, n, kSliceRoundTripCost, shard);
+  }
+
+  // The number of rows in the field and value pairs of an HSCAN reply.
+  static int64_t HscanReplyRows(const redisReply *hscan_reply) {
+    if (hscan_reply->type != REDIS_REPLY_ARRAY || hscan_reply->elements < 2 ||
+        hscan_reply->element[1]->type != REDIS_REPLY_ARRAY) {
+      return 0;
+    }
+    return hscan_reply->element[1]->elements / 2;
+  }
+
+  // Decodes the first rows of an HSCAN reply into keys and values.
+  void DecodeHscanReply(const redisReply *hscan_reply, K *pk_raw, V *pv_raw,
+                        const int64_t rows) {
+    const redisReply *kvs_reply = hscan_reply->element[1];
+    for (int64_t j = 0; j < rows; ++j) {
+      const redisReply *key_reply = kvs_reply->element[2 * j];
+      if (key_reply->type == REDIS_REPLY_STRING) {
+        ReplyMemcpyToKeyTensor<K>(pk_raw + j, key_reply->str, key_reply->len);
+      }
+      const redisReply *value_reply = kvs_reply->element[2 * j + 1];
+      if (value_reply->type == REDIS_REPLY_STRING) {
+        ReplyMemcpyToValTensor<V>(pv_raw + j * runtime_value_dim_,
+                                  value_reply->str, runtime_value_dim_);
+      }
+    }
+  }
+
+  // Scans the storage slice slice into at most capacity rows of keys and
+  // values, and sets count to the number of rows written.
+  Status ScanSliceIntoTensors(const std::string &slice, K *pk_raw, V *pv_raw,
+                              const int64_t capacity, int64_t *count) {
+    long long cursor = 0;
+    int64_t dropped = 0;
+    *count = 0;
+    do {
+      std::unique_ptr<redisReply, ::sw::redis::ReplyDeleter> hscan_reply =
+          _table_instance->HscanGetKeysValsInBucket(slice, &cursor,
+                                                    multi_redis_cmd_max_argc);
+      if (hscan_reply == nullptr) {
+        return errors::Unknown(
+            "Unknown errors happen when HscanGetKeysValsInBucket in "
+            "ExportValuesToTensor");
+      }
+      const int64_t rows = HscanReplyRows(hscan_reply.get());
+      const int64_t kept = std::min(rows, capacity - *count);
+      DecodeHscanReply(hscan_reply.get(), pk_raw + *count,
+                       pv_raw + *count * runtime_value_dim_, kept);
+      *count += kept;
+      dropped += rows - kept;
+    } while (cursor != 0);
+    if (dropped > 0) {
+      LOG(WARNING) << "Dropped " << dropped << " rows of " << slice
+                   << " which were inserted while it was exported.";
+    }
+    return Status::OK();
+  }
+
+  // The size of the table takes a round trip per storage slice, and is only
+  // read when the gauges are due.
+  void RecordInsert(int64_t keys, uint64 start_micros) {
+    metrics_->RecordInsert(keys, start_micros);
+    metrics_->MaybeRecordSize([this]() {
+      const int64 size = this->size();
+      return std::pair<int64, int64>(
+          size, size * (sizeof(K) + runtime_value_dim_ * sizeof(V)));
+    });
+  }
+
+  // The keys of a lookup which are not in the near cache, and the tensors
+  // the lookup of them in Redis fills. Their rows go to rows of the lookup.
+  // generations is taken before the cache and Redis are read, so that the
+  // rows of keys written meanwhile are not cached.
+  struct NearCacheMisses {
+    typename RedisNearCache<K, V>::Generations generations;
+    std::vector<int64_t> rows;
+    Tensor keys;
+    Tensor values;
+    Tensor default_value;
+    Tensor exists;
+  };
+
+  // Copies the rows of the keys found in the near cache into values and
+  // gathers the other keys into misses. exists may be null.
+  Status LookupNearCache(OpKernelContext *ctx, const Tensor &keys,
+                         Tensor *values, const Tensor &default_value,
+                         Tensor *exists, NearCacheMisses *misses) {
+    const int64_t total = keys.NumElements();
+    const int64_t Velems_per_flat2_dim0 = values->NumElements() / total;
+    const K *pk = keys.flat<K>().data();
+    std::unique_ptr<bool[]> hits_buf;
+    bool *hits = nullptr;
+    if (exists != nullptr) {
+      hits = exists->flat<bool>().data();
+    } else {
+      hits_buf.reset(new bool[total]);
+      hits = hits_buf.get();
+    }
+    misses->generations = near_cache_->GetGenerations();
+    const int64_t found =
+        near_cache_->Find(pk, total, values->flat<V>().data(), hits);
+    metrics_->RecordLookups(found);
+
+    misses->rows.reserve(total - found);
+    for (int64_t i = 0; i < total; ++i) {
+      if (!hits[i]) misses->rows.push_back(i);
+    }
+    const int64_t n = misses->rows.size();
+    if (n == 0) return Status::OK();
+
+    TF_RETURN_IF_ERROR(
+        ctx->allocate_temp(keys.dtype(), TensorShape({n}), &misses->keys));
+    TF_RETURN_IF_ERROR(ctx->allocate_temp(
+        values->dtype(), TensorShape({n, Velems_per_flat2_dim0}),
+        &misses->values));
+    TF_RETURN_IF_ERROR(
+        ctx->allocate_temp(DT_BOOL, TensorShape({n}), &misses->exists));
+    K *pmk = misses->keys.flat<K>().data();
+    for (int64_t j = 0; j < n; ++j) {
+      pmk[j] = pk[misses->rows[j]];
+    }
+    if (values->NumElements() == default_value.NumElements()) {
+      TF_RETURN_IF_ERROR(ctx->allocate_temp(
+          default_value.dtype(), TensorShape({n, Velems_per_flat2_dim0}),
+          &misses->default_value));
+      const V *pd = default_value.flat<V>().data();
+      V *pmd = misses->default_value.flat<V>().data();
+      for (int64_t j = 0; j < n; ++j) {
+        std::copy_n(pd + misses->rows[j] * Velems_per_flat2_dim0,
+                    Velems_per_flat2_dim0, pmd + j * Velems_per_flat2_dim0);
+      }
+    } else {
+      misses->default_value = default_value;
+    }
+    return Status::OK();
+  }
+
+  // Copies the rows read from Redis for the misses into values and exists,
+  // and caches those found there, unless their keys were written since the
+  // lookup began. Defaults are never cached.
+  void ScatterNearCacheMisses(const NearCacheMisses &misses, Tensor *values,
+                              Tensor *exists) {
+    const int64_t n = misses.rows.size();
+    const int64_t Velems_per_flat2_dim0 = misses.values.NumElements() / n;
+    const V *pmv = misses.values.flat<V>().data();
+    const bool *pme = misses.exists.flat<bool>().data();
+    V *pv = values->flat<V>().data();
+    for (int64_t j = 0; j < n; ++j) {
+      std::copy_n(pmv + j * Velems_per_flat2_dim0, Velems_per_flat2_dim0,
+                  pv + misses.rows[j] * Velems_per_flat2_dim0);
+    }
+    if (exists != nullptr) {
+      bool *pe = exists->flat<bool>().data();
+      for (int64_t j = 0; j < n; ++j) {
+        pe[misses.rows[j]] = pme[j];
+      }
+    }
+    near_cache_->Fill(misses.keys.flat<K>().data(), pmv, n, pme,
+                      misses.generations);
+  }
+
+  Status FindThroughNearCache(OpKernelContext *ctx, const Tensor &keys,
+                              Tensor *values, const Tensor &default_value,
+                              Tensor *exists) {
+    NearCacheMisses misses;
+    TF_RETURN_IF_ERROR(LookupNearCache(ctx, keys, values, default_value,
+                                       exists, &misses));
+    if (misses.rows.empty()) return Status::OK();
+    TF_RETURN_IF_ERROR(FindWithExistsInRedis(ctx, misses.keys, &misses.values,
+                                             misses.default_value,
+                                             misses.exists));
+    TF_RETURN_IF_ERROR(ctx->status());
+    ScatterNearCacheMisses(misses, values, exists);
+    return Status::OK();
+  }
+
+  void FindThroughNearCacheAsync(OpKernelContext *ctx, const Tensor &keys,
+                                 Tensor *values, const Tensor &default_value,
+                                 Tensor *exists,
+                                 AsyncOpKernel::DoneCallback done) {
+    std::shared_ptr<NearCacheMisses> misses =
+        std::make_shared<NearCacheMisses>();
+    Status statu = LookupNearCache(ctx, keys, values, default_value, exists,
+                                   misses.get());
+    if (!statu.ok() || misses->rows.empty()) {
+      ctx->SetStatus(statu);
+      done();
+      return;
+    }
+    FindInRedisAsync(ctx, misses->keys, &misses->values,
+                     misses->default_value, &misses->exists,
+                     [this, ctx, misses, values, exists, done]() {
+                       if (ctx->status().ok()) {
+                         ScatterNearCacheMisses(*misses, values, exists);
+                       }
+                       done();
+                     });
+  }
+
+  // Caches the rows just inserted, or drops the cached rows of their keys
+  // when near_cache_write_through is off or the insert failed.
+  void UpdateNearCache(OpKernelContext *ctx, const Tensor &keys,
+                       const Tensor &values) {
+    if (near_cache_ == nullptr) return;
+    if (redis_connection_params.near_cache_write_through &&
+        ctx->status().ok()) {
+      near_cache_->Insert(keys.flat<K>().data(), values.flat<V>().data(),
+                          keys.NumElements());
+    } else {
+      near_cache_->Erase(keys.flat<K>().data(), keys.NumElements());
+    }
+  }
+
+  void EraseFromNearCache(const Tensor &keys) {
+    if (near_cache_ == nullptr) return;
+    near_cache_->Erase(keys.flat<K>().data(), keys.NumElements());
+  }
+
+  void OverlayWriteBehind(OpKernelContext *ctx, const Tensor &keys,
+                          Tensor *values, Tensor &exists) {
+    if (write_behind_ == nullptr || !ctx->status().ok()) return;
+    write_behind_->Overlay(keys.flat<K>().data(), values->flat<V>().data(),
+                           exists.flat<bool>().data(), keys.NumElements());
+  }
+
+  // These write the flushes of write_behind_. They run on its flusher thread,
+  // out of any op, so they go through the blocking client a chunk at a time.
+  Status FlushInsert(const Tensor &keys, const Tensor &values) {
+    const int64_t total = keys.NumElements();
+    const int64_t Velems_per_flat2_dim0 = values.NumElements() / total;
+    const int64_t chunk_size = multi_redis_cmd_max_argc - 1;
+    for (int64_t begin = 0; begin < total; begin += chunk_size) {
+      TF_RETURN_IF_ERROR(launchInsertCore(
+          _table_instance, keys_prefix_name_slices, keys, values,
+          Velems_per_flat2_dim0, threads_Insert, threads_Insert_mutex, begin,
+          std::min(total, begin + chunk_size)));
+    }
+    if (near_cache_ != nullptr) {
+      if (redis_connection_params.near_cache_write_through) {
+        near_cache_->Insert(keys.flat<K>().data(), values.flat<V>().data(),
+                            total);
+      } else {
+        near_cache_->Erase(keys.flat<K>().data(), total);
+      }
+    }
+    return Status::OK();
+  }
+
+  Status FlushAccum(const Tensor &keys, const Tensor &values_or_delta,
+                    const Tensor &exists) {
+    const int64_t total = keys.NumElements();
+    const int64_t Velems_per_flat2_dim0 =
+        values_or_delta.NumElements() / total;
+    const int64_t chunk_size = multi_redis_cmd_max_argc - 1;
+    for (int64_t begin = 0; begin < total; begin += chunk_size) {
+      TF_RETURN_IF_ERROR(launchAccumCore(
+          _table_instance, keys_prefix_name_slices, keys, values_or_delta,
+          exists, Velems_per_flat2_dim0, threads_Insert, threads_Insert_mutex,
+          begin, std::min(total, begin + chunk_size)));
+    }
+    EraseFromNearCache(keys);
+    return Status::OK();
+  }
+
+  // The chunks of keys of one asynchronous op and the replies to their
+  // commands, or the sinks decoding them. The commands of all the chunks are
+  // sent at once, and the last reply to arrive runs on_replies on the CPU
+  // worker threads.
+  struct AsyncBatch : public std::enable_shared_from_this<AsyncBatch> {
+    AsyncBatch(OpKernelContext *ctx, const int64_t total,
+               const int64_t chunk_size, const unsigned storage_slice)
+        : total(total),
+          chunk_size(chunk_size),
+          start_micros(TableMetrics::NowMicros()),
+          workers(ctx->device()->tensorflow_cpu_worker_threads()->workers) {
+      const int64_t chunks = (total + chunk_size - 1) / chunk_size;
+      for (int64_t i = 0; i < chunks; ++i) {
+        contexts.emplace_back(new ThreadContext());
+      }
+      buffs.resize(chunks);
+      sinks.resize(chunks);
+      replies.resize(chunks);
+      for (auto &chunk_replies : replies) {
+        chunk_replies.resize(storage_slice);
+      }
+    }
+
+    int64_t Begin(const int64_t i) const { return i * chunk_size; }
+
+    int64_t End(const int64_t i) const {
+      return std::min(total, (i + 1) * chunk_size);
+    }
+
+    void AddRequests(const int64_t i,
+                     const std::vector<RedisCommandArgs> &commands,
+                     std::vector<RedisAsyncClient::Request> *requests) {
+      std::shared_ptr<AsyncBatch> self = shared_from_this();
+      for (const auto &command : commands) {
+        std::unique_ptr<redisReply, ::sw::redis::ReplyDeleter> *slot =
+            &replies[i][command.bucket];
+        RedisReplySink *sink =
+            sinks[i].empty() ? nullptr : sinks[i][command.bucket].get();
+        requests->push_back(
+            {command,
+             [self, slot, sink](
+                 std::unique_ptr<redisReply, ::sw::redis::ReplyDeleter> reply) {
+               self->OnReply(slot, sink, std::move(reply));
+             },
+             sink});
+      }
+    }
+
+    void Send(RedisAsyncClient *client,
+              std::vector<RedisAsyncClient::Request> *requests) {
+      pending.store(requests->size());
+      if (requests->empty()) {
+        Finish();
+      } else {
+        client->Send(requests);
+      }
+    }
+
+    // Runs on the loop threads of the client, several at once.
+    void OnReply(
+        std::unique_ptr<redisReply, ::sw::redis::ReplyDeleter> *slot,
+        const RedisReplySink *sink,
+        std::unique_ptr<redisReply, ::sw::redis::ReplyDeleter> reply) {
+      if (sink != nullptr ? !sink->Complete()
+                          : reply == nullptr ||
+                                reply->type == REDIS_REPLY_ERROR) {
+        failed.store(true);
+      }
+      *slot = std::move(reply);
+      if (pending.fetch_sub(1) == 1) Finish();
+    }
+
+    void Finish() {
+      std::shared_ptr<AsyncBatch> self = shared_from_this();
+      workers->Schedule([self]() { self->on_replies(self.get()); });
+    }
+
+    const int64_t total;
+    const int64_t chunk_size;
+    const uint64 start_micros;
+    thread::ThreadPool *workers;
+    std::vector<std::unique_ptr<ThreadContext>> contexts;
+    std::vector<std::vector<std::vector<char>>> buffs;
+    std::vector<std::vector<std::unique_ptr<RedisReplySink>>> sinks;
+    std::vector<
+        std::vector<std::unique_ptr<redisReply, ::sw::redis::ReplyDeleter>>>
+        replies;
+    std::atomic<int64_t> pending{0};
+    std::atomic<bool> failed{false};
+    std::function<void(AsyncBatch *)> on_replies;
+  };
+
+  std::unique_ptr<TableMetrics> metrics_;
 };
 
-class HashTableOpKernel : public OpKernel {
+// Kernel is OpKernel, or AsyncOpKernel for the ops which may wait on Redis.
+template <class Kernel>
+class HashTableOpKernelBase : public Kernel {
  public:
-  explicit HashTableOpKernel(OpKernelConstruction *ctx)
-      : OpKernel(ctx),
+  explicit HashTableOpKernelBase(OpKernelConstruction *ctx)
+      : Kernel(ctx),
         expected_input_0_(ctx->input_type(0) == DT_RESOURCE ? DT_RESOURCE
                                                             : DT_STRING_REF) {}
 
@@ -1112,20 +1990,28 @@ class HashTableOpKernel : public OpKernel {
   const DataType expected_input_0_;
 };
 
+using HashTableOpKernel = HashTableOpKernelBase<OpKernel>;
+using HashTableAsyncOpKernel = HashTableOpKernelBase<AsyncOpKernel>;
+
 // Table find op .
-class HashTableFindOp : public HashTableOpKernel {
+class HashTableFindOp : public HashTableAsyncOpKernel {
  public:
-  using HashTableOpKernel::HashTableOpKernel;
+  using HashTableAsyncOpKernel::HashTableAsyncOpKernel;
 
-  void Compute(OpKernelContext *ctx) override {
+  void ComputeAsync(OpKernelContext *ctx, DoneCallback done) override {
     LookupInterface *table;
-    OP_REQUIRES_OK(ctx, GetTable(ctx, &table));
-    core::ScopedUnref unref_me(table);
+    OP_REQUIRES_OK_ASYNC(ctx, GetTable(ctx, &table), done);
+    // The table is unreferenced when the lookup is done.
+    done = [table, done]() {
+      table->Unref();
+      done();
+    };
 
     DataTypeVector expected_inputs = {expected_input_0_, table->key_dtype(),
                                       table->value_dtype()};
     DataTypeVector expected_outputs = {table->value_dtype()};
-    OP_REQUIRES_OK(ctx, ctx->MatchSignature(expected_inputs, expected_outputs));
+    OP_REQUIRES_OK_ASYNC(
+        ctx, ctx->MatchSignature(expected_inputs, expected_outputs), done);
 
     const Tensor &key = ctx->input(1);
     const Tensor &default_value = ctx->input(2);
@@ -1134,22 +2020,35 @@ class HashTableFindOp : public HashTableOpKernel {
     output_shape.RemoveLastDims(table->key_shape().dims());
     output_shape.AppendShape(table->value_shape());
     Tensor *out;
-    OP_REQUIRES_OK(ctx, ctx->allocate_output("values", output_shape, &out));
-
-    OP_REQUIRES_OK(ctx, table->Find(ctx, key, out, default_value));
+    OP_REQUIRES_OK_ASYNC(
+        ctx, ctx->allocate_output("values", output_shape, &out), done);
+
+    AsyncLookupInterface *async_table =
+        dynamic_cast<AsyncLookupInterface *>(table);
+    if (async_table == nullptr) {
+      OP_REQUIRES_OK_ASYNC(ctx, table->Find(ctx, key, out, default_value),
+                           done);
+      done();
+      return;
+    }
+    async_table->FindAsync(ctx, key, out, default_value, nullptr, done);
   }
 };
 
 // Table find op with return exists tensor.
 template <class K, class V>
-class HashTableFindWithExistsOp : public HashTableOpKernel {
+class HashTableFindWithExistsOp : public HashTableAsyncOpKernel {
  public:
-  using HashTableOpKernel::HashTableOpKernel;
+  using HashTableAsyncOpKernel::HashTableAsyncOpKernel;
 
-  void Compute(OpKernelContext *ctx) override {
+  void ComputeAsync(OpKernelContext *ctx, DoneCallback done) override {
     LookupInterface *table;
-    OP_REQUIRES_OK(ctx, GetTable(ctx, &table));
-    core::ScopedUnref unref_me(table);
+    OP_REQUIRES_OK_ASYNC(ctx, GetTable(ctx, &table), done);
+    // The table is unreferenced when the lookup is done.
+    done = [table, done]() {
+      table->Unref();
+      done();
+    };
 
     redis_table::RedisTableOfTensors<K, V> *redis_table =
         dynamic_cast<redis_table::RedisTableOfTensors<K, V> *>(table);
@@ -1157,7 +2056,8 @@ class HashTableFindWithExistsOp : public HashTableOpKernel {
     DataTypeVector expected_inputs = {expected_input_0_, table->key_dtype(),
                                       table->value_dtype()};
     DataTypeVector expected_outputs = {table->value_dtype(), DT_BOOL};
-    OP_REQUIRES_OK(ctx, ctx->MatchSignature(expected_inputs, expected_outputs));
+    OP_REQUIRES_OK_ASYNC(
+        ctx, ctx->MatchSignature(expected_inputs, expected_outputs), done);
 
     const Tensor &key = ctx->input(1);
     const Tensor &default_value = ctx->input(2);
@@ -1168,41 +2068,55 @@ class HashTableFindWithExistsOp : public HashTableOpKernel {
 
     Tensor *values;
     Tensor *exists;
-    OP_REQUIRES_OK(ctx, ctx->allocate_output("values", output_shape, &values));
-    OP_REQUIRES_OK(ctx, ctx->allocate_output("exists", key.shape(), &exists));
+    OP_REQUIRES_OK_ASYNC(
+        ctx, ctx->allocate_output("values", output_shape, &values), done);
+    OP_REQUIRES_OK_ASYNC(
+        ctx, ctx->allocate_output("exists", key.shape(), &exists), done);
 
-    OP_REQUIRES_OK(ctx, redis_table->FindWithExists(ctx, key, values,
-                                                    default_value, *exists));
+    redis_table->FindAsync(ctx, key, values, default_value, exists, done);
   }
 };
 
 // Table insert op.
-class HashTableInsertOp : public HashTableOpKernel {
+class HashTableInsertOp : public HashTableAsyncOpKernel {
  public:
-  using HashTableOpKernel::HashTableOpKernel;
+  using HashTableAsyncOpKernel::HashTableAsyncOpKernel;
 
-  void Compute(OpKernelContext *ctx) override {
+  void ComputeAsync(OpKernelContext *ctx, DoneCallback done) override {
     LookupInterface *table;
-    OP_REQUIRES_OK(ctx, GetTable(ctx, &table));
-    core::ScopedUnref unref_me(table);
+    OP_REQUIRES_OK_ASYNC(ctx, GetTable(ctx, &table), done);
+
+    int64_t memory_used_before = 0;
+    if (ctx->track_allocations()) {
+      memory_used_before = table->MemoryUsed();
+    }
+    // The table is unreferenced when the insert is done.
+    done = [ctx, table, memory_used_before, done]() {
+      if (ctx->track_allocations()) {
+        ctx->record_persistent_memory_allocation(table->MemoryUsed() -
+                                                 memory_used_before);
+      }
+      table->Unref();
+      done();
+    };
 
     DataTypeVector expected_inputs = {expected_input_0_, table->key_dtype(),
                                       table->value_dtype()};
-    OP_REQUIRES_OK(ctx, ctx->MatchSignature(expected_inputs, {}));
+    OP_REQUIRES_OK_ASYNC(ctx, ctx->MatchSignature(expected_inputs, {}), done);
 
     const Tensor &keys = ctx->input(1);
     const Tensor &values = ctx->input(2);
-    OP_REQUIRES_OK(ctx, table->CheckKeyAndValueTensorsForInsert(keys, values));
-
-    int64_t memory_used_before = 0;
-    if (ctx->track_allocations()) {
-      memory_used_before = table->MemoryUsed();
-    }
-    OP_REQUIRES_OK(ctx, table->Insert(ctx, keys, values));
-    if (ctx->track_allocations()) {
-      ctx->record_persistent_memory_allocation(table->MemoryUsed() -
-                                               memory_used_before);
+    OP_REQUIRES_OK_ASYNC(
+        ctx, table->CheckKeyAndValueTensorsForInsert(keys, values), done);
+
+    AsyncLookupInterface *async_table =
+        dynamic_cast<AsyncLookupInterface *>(table);
+    if (async_table == nullptr) {
+      OP_REQUIRES_OK_ASYNC(ctx, table->Insert(ctx, keys, values), done);
+      done();
+      return;
     }
+    async_table->InsertAsync(ctx, keys, values, done);
   }
 };
 
@@ -1245,6 +2159,95 @@ class HashTableAccumOp : public HashTableOpKernel {
   }
 };
 
+// Table sparse apply op.
+template <class K, class V>
+class HashTableSparseApplyOp : public HashTableOpKernel {
+ public:
+  explicit HashTableSparseApplyOp(OpKernelConstruction *ctx)
+      : HashTableOpKernel(ctx) {
+    std::string optimizer;
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("optimizer", &optimizer));
+    if (optimizer == "sgd") {
+      command_ = "HMSGD";
+      slots_num_ = 0;
+      hyperparams_num_ = 1;
+    } else if (optimizer == "adagrad") {
+      command_ = "HMADAGRAD";
+      slots_num_ = 1;
+      hyperparams_num_ = 3;
+    } else {
+      command_ = "HMADAM";
+      slots_num_ = 2;
+      hyperparams_num_ = 4;
+    }
+  }
+
+  void Compute(OpKernelContext *ctx) override {
+    LookupInterface *table;
+    OP_REQUIRES_OK(ctx, GetTable(ctx, &table));
+    core::ScopedUnref unref_me(table);
+
+    OpInputList slot_handles;
+    OP_REQUIRES_OK(ctx, ctx->input_list("slot_handles", &slot_handles));
+    OP_REQUIRES(ctx, slot_handles.size() == slots_num_,
+                errors::InvalidArgument(command_, " takes ", slots_num_,
+                                        " slot tables, got ",
+                                        slot_handles.size()));
+    std::vector<RedisTableOfTensors<K, V> *> slots;
+    std::vector<std::unique_ptr<core::ScopedUnref>> unref_slots;
+    for (const Tensor &slot_handle : slot_handles) {
+      LookupInterface *slot;
+      OP_REQUIRES_OK(ctx, LookupResource(
+                              ctx, slot_handle.scalar<ResourceHandle>()(),
+                              &slot));
+      unref_slots.emplace_back(new core::ScopedUnref(slot));
+      OP_REQUIRES(ctx,
+                  slot->key_dtype() == table->key_dtype() &&
+                      slot->value_dtype() == table->value_dtype(),
+                  errors::InvalidArgument(
+                      "The slot tables must have the key and value types "
+                      "of the table."));
+      auto *redis_slot = dynamic_cast<RedisTableOfTensors<K, V> *>(slot);
+      OP_REQUIRES(ctx, redis_slot != nullptr,
+                  errors::InvalidArgument(
+                      "The slot tables of ", command_,
+                      " must be Redis tables."));
+      slots.push_back(redis_slot);
+    }
+
+    const Tensor &keys = ctx->input(slots_num_ + 1);
+    const Tensor &grads = ctx->input(slots_num_ + 2);
+    const Tensor &hyperparams = ctx->input(slots_num_ + 3);
+    OP_REQUIRES_OK(ctx, table->CheckKeyAndValueTensorsForInsert(keys, grads));
+    OP_REQUIRES(ctx, hyperparams.NumElements() == hyperparams_num_,
+                errors::InvalidArgument(command_, " takes ", hyperparams_num_,
+                                        " hyperparameters, got ",
+                                        hyperparams.NumElements()));
+
+    std::vector<std::string> hyperparams_str;
+    char buf[32];
+    auto hyperparams_flat = hyperparams.flat<V>();
+    for (int64_t i = 0; i < hyperparams_num_; ++i) {
+      snprintf(buf, sizeof(buf), "%.17g",
+               static_cast<double>(hyperparams_flat(i)));
+      hyperparams_str.emplace_back(buf);
+    }
+
+    RedisTableOfTensors<K, V> *redisTable =
+        dynamic_cast<RedisTableOfTensors<K, V> *>(table);
+    OP_REQUIRES(ctx, redisTable != nullptr,
+                errors::InvalidArgument(command_,
+                                        " only applies to Redis tables."));
+    OP_REQUIRES_OK(ctx, redisTable->SparseApply(ctx, command_, slots, keys,
+                                                grads, hyperparams_str));
+  }
+
+ private:
+  std::string command_;
+  int slots_num_;
+  int64_t hyperparams_num_;
+};
+
 // Table remove op.
 class HashTableRemoveOp : public HashTableOpKernel {
  public:
@@ -1299,6 +2302,43 @@ class HashTableClearOp : public HashTableOpKernel {
   }
 };
 
+// Table flush op.
+template <class K, class V>
+class HashTableFlushOp : public HashTableOpKernel {
+ public:
+  using HashTableOpKernel::HashTableOpKernel;
+
+  void Compute(OpKernelContext *ctx) override {
+    LookupInterface *table;
+    OP_REQUIRES_OK(ctx, GetTable(ctx, &table));
+    core::ScopedUnref unref_me(table);
+
+    redis_table::RedisTableOfTensors<K, V> *redis_table =
+        dynamic_cast<redis_table::RedisTableOfTensors<K, V> *>(table);
+    OP_REQUIRES_OK(ctx, redis_table->Flush());
+  }
+};
+
+// Op that outputs one batch of the keys and values of the given table.
+template <class K, class V>
+class HashTableExportChunkOp : public HashTableOpKernel {
+ public:
+  using HashTableOpKernel::HashTableOpKernel;
+
+  void Compute(OpKernelContext *ctx) override {
+    LookupInterface *table;
+    OP_REQUIRES_OK(ctx, GetTable(ctx, &table));
+    core::ScopedUnref unref_me(table);
+
+    redis_table::RedisTableOfTensors<K, V> *redis_table =
+        dynamic_cast<redis_table::RedisTableOfTensors<K, V> *>(table);
+    OP_REQUIRES_OK(ctx, redis_table->ExportChunk(
+                            ctx, ctx->input(1).scalar<int64_t>()(),
+                            ctx->input(2).scalar<int64_t>()(),
+                            ctx->input(3).scalar<int64_t>()()));
+  }
+};
+
 // Op that returns the size of the given table.
 class HashTableSizeOp : public HashTableOpKernel {
  public:
@@ -1391,6 +2431,18 @@ REGISTER_KERNEL_BUILDER(
           .TypeConstraint<key_dtype>("key_dtype")                           \
           .TypeConstraint<value_dtype>("value_dtype"),                      \
       redis_table::HashTableClearOp<key_dtype, value_dtype>);               \
+  REGISTER_KERNEL_BUILDER(                                                  \
+      Name(PREFIX_OP_NAME(RedisTableFlush))                                 \
+          .Device(DEVICE_CPU)                                               \
+          .TypeConstraint<key_dtype>("key_dtype")                           \
+          .TypeConstraint<value_dtype>("value_dtype"),                      \
+      redis_table::HashTableFlushOp<key_dtype, value_dtype>);               \
+  REGISTER_KERNEL_BUILDER(                                                  \
+      Name(PREFIX_OP_NAME(RedisTableExportChunk))                           \
+          .Device(DEVICE_CPU)                                               \
+          .TypeConstraint<key_dtype>("Tkeys")                               \
+          .TypeConstraint<value_dtype>("Tvalues"),                          \
+      redis_table::HashTableExportChunkOp<key_dtype, value_dtype>);         \
   REGISTER_KERNEL_BUILDER(                                                  \
       Name(PREFIX_OP_NAME(RedisTableAccum))                                 \
           .Device(DEVICE_CPU)                                               \
@@ -1424,6 +2476,21 @@ REGISTER_KERNEL(tstring, Eigen::half);
 
 #undef REGISTER_KERNEL
 
+#define REGISTER_KERNEL(key_dtype, value_dtype)        \
+  REGISTER_KERNEL_BUILDER(                             \
+      Name(PREFIX_OP_NAME(RedisTableSparseApply))      \
+          .Device(DEVICE_CPU)                          \
+          .TypeConstraint<key_dtype>("key_dtype")      \
+          .TypeConstraint<value_dtype>("value_dtype"), \
+      redis_table::HashTableSparseApplyOp<key_dtype, value_dtype>);
+
+REGISTER_KERNEL(int32, double);
+REGISTER_KERNEL(int32, float);
+REGISTER_KERNEL(int64_t, double);
+REGISTER_KERNEL(int64_t, float);
+
+#undef REGISTER_KERNEL
+
 }  // namespace redis_table
 }  // namespace recommenders_addons
 }  // namespace tensorflow
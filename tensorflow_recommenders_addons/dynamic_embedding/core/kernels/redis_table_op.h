@@ -61,6 +61,22 @@ using tensorflow::OpKernelContext;
 using tensorflow::lookup::CheckTableDataTypes;
 using tensorflow::lookup::LookupInterface;
 
+// Implemented by the tables which can serve lookups and inserts without
+// blocking the calling thread on the network. done is called once the op has
+// finished, possibly on another thread. exists may be nullptr.
+class AsyncLookupInterface {
+ public:
+  virtual ~AsyncLookupInterface() {}
+
+  virtual void FindAsync(OpKernelContext* ctx, const Tensor& keys,
+                         Tensor* values, const Tensor& default_value,
+                         Tensor* exists, AsyncOpKernel::DoneCallback done) = 0;
+
+  virtual void InsertAsync(OpKernelContext* ctx, const Tensor& keys,
+                           const Tensor& values,
+                           AsyncOpKernel::DoneCallback done) = 0;
+};
+
 template <class Container, class key_dtype, class value_dtype>
 class HashTableOp : public OpKernel {
  public:
@@ -8,6 +8,7 @@
 #include <atomic>
 #include <bitset>
 #include <cassert>
+#include <chrono>
 #include <cstdint>
 #include <cstdlib>
 #include <functional>
@@ -467,6 +468,29 @@ class cuckoohash_map {
     return max_num_worker_threads_.load(std::memory_order_acquire);
   }
 
+  /**
+   * Returns the number of lock stripes whose buckets still have to be moved
+   * out of the previous bucket array after the table doubled. Such stripes
+   * are migrated on demand by the first operation taking their lock, or in
+   * chunks by @ref rehash_pending.
+   *
+   * @return the number of stripes left to migrate
+   */
+  size_type pending_rehash_stripes() const {
+    return num_remaining_lazy_rehash_locks();
+  }
+
+  /**
+   * Returns the fraction of the lock stripes migrated since the table last
+   * doubled, or 1.0 if no migration is in progress.
+   */
+  double rehash_progress() const {
+    const size_type pending = pending_rehash_stripes();
+    if (pending == 0) return 1.0;
+    // Lazy migration only happens with the full lock array.
+    return 1.0 - static_cast<double>(pending) / kMaxNumLocks;
+  }
+
   /**@}*/
 
   /** @name Table Operations
@@ -491,12 +515,15 @@ class cuckoohash_map {
   template <typename K, typename F>
   bool find_fn(const K &key, F fn) const {
     const hash_value hv = hashed_key(key);
-    const auto b = snapshot_and_lock_two<normal_mode>(hv);
+    const auto b = snapshot_and_lock_two<normal_mode>(hv, /*for_write=*/false);
     const table_position pos = cuckoo_find(key, hv.partial, b.i1, b.i2);
+    lock_stats &stats = get_current_locks()[lock_ind(b.i1)].stats();
     if (pos.status == ok) {
+      ++stats.hits;
       fn(buckets_[pos.index].mapped(pos.slot));
       return true;
     } else {
+      ++stats.misses;
       return false;
     }
   }
@@ -687,7 +714,7 @@ class cuckoohash_map {
   template <typename K>
   mapped_type find(const K &key) const {
     const hash_value hv = hashed_key(key);
-    const auto b = snapshot_and_lock_two<normal_mode>(hv);
+    const auto b = snapshot_and_lock_two<normal_mode>(hv, /*for_write=*/false);
     const table_position pos = cuckoo_find(key, hv.partial, b.i1, b.i2);
     if (pos.status == ok) {
       return buckets_[pos.index].mapped(pos.slot);
@@ -773,6 +800,113 @@ class cuckoohash_map {
     return erase_fn(key, [](mapped_type &) { return true; });
   }
 
+  /**
+   * Samples elements uniformly at random, with replacement, by probing random
+   * slots of random buckets and keeping the occupied ones. Only the lock of
+   * the probed bucket is held, so the cost is proportional to the number of
+   * probes rather than to the size of the table, and concurrent operations
+   * keep running.
+   *
+   * @tparam URBG type of the random bit generator
+   * @tparam F type of the functor. It should implement the method
+   * <tt>void operator()(const key_type&, const mapped_type&)</tt>.
+   * @param n the number of elements to sample
+   * @param max_probes the number of probes after which to give up, which
+   * bounds the cost on a nearly empty table
+   * @param rng the random bit generator
+   * @param fn the functor invoked on every sampled element, with its bucket
+   * locked
+   * @return the number of elements sampled, which is @p n unless @p
+   * max_probes ran out first
+   */
+  template <typename URBG, typename F>
+  size_type sample_fn(size_type n, size_type max_probes, URBG &rng,
+                      F fn) const {
+    size_type sampled = 0;
+    for (size_type probe = 0; probe < max_probes && sampled < n; ++probe) {
+      const size_type hp = hashpower();
+      const size_type i = static_cast<size_type>(rng()) & hashmask(hp);
+      const size_type slot = static_cast<size_type>(rng()) % slot_per_bucket();
+      LockManager lock;
+      try {
+        lock = lock_one(hp, i, normal_mode(), /*for_write=*/false);
+      } catch (hashpower_changed &) {
+        continue;
+      }
+      const bucket &b = buckets_[i];
+      if (b.occupied(slot)) {
+        fn(b.key(slot), b.mapped(slot));
+        ++sampled;
+      }
+    }
+    return sampled;
+  }
+
+  /**
+   * Counters of the internals of the table, accumulated since it was built.
+   */
+  struct statistics {
+    // Acquisitions of the bucket locks, those which found the lock taken,
+    // and the spins they waited for it.
+    int64_t lock_acquisitions = 0;
+    int64_t contended_acquisitions = 0;
+    int64_t contended_spins = 0;
+    // The same per lock, when requested.
+    std::vector<int64_t> lock_acquisitions_per_lock;
+    std::vector<int64_t> contended_acquisitions_per_lock;
+    std::vector<int64_t> contended_spins_per_lock;
+    // Lookups which found their key, and those which did not.
+    int64_t hits = 0;
+    int64_t misses = 0;
+    // Inserts which found both their buckets full, by the number of elements
+    // moved to make room, and those which found no cuckoo path and resized.
+    std::vector<int64_t> cuckoo_path_depths;
+    int64_t cuckoo_failures = 0;
+    // Resizes of the bucket array, and the seconds they held the table.
+    int64_t resizes = 0;
+    double resize_seconds = 0;
+  };
+
+  /**
+   * Reads the counters of the table. The per lock counters are read without
+   * taking the locks, like @ref size, so operations running concurrently
+   * may or may not be counted.
+   *
+   * @param per_lock whether to also return the counters of every lock
+   * @return the counters
+   */
+  statistics get_statistics(bool per_lock) const {
+    statistics stats;
+    const locks_t &locks = get_current_locks();
+    if (per_lock) {
+      stats.lock_acquisitions_per_lock.reserve(locks.size());
+      stats.contended_acquisitions_per_lock.reserve(locks.size());
+      stats.contended_spins_per_lock.reserve(locks.size());
+    }
+    for (const spinlock &lock : locks) {
+      const lock_stats &l = lock.stats();
+      stats.lock_acquisitions += l.acquisitions;
+      stats.contended_acquisitions += l.contended;
+      stats.contended_spins += l.contended_spins;
+      stats.hits += l.hits;
+      stats.misses += l.misses;
+      if (per_lock) {
+        stats.lock_acquisitions_per_lock.push_back(l.acquisitions);
+        stats.contended_acquisitions_per_lock.push_back(l.contended);
+        stats.contended_spins_per_lock.push_back(l.contended_spins);
+      }
+    }
+    for (const auto &depth : cuckoo_path_depths_) {
+      stats.cuckoo_path_depths.push_back(
+          depth.load(std::memory_order_relaxed));
+    }
+    stats.cuckoo_failures = cuckoo_failures_.load(std::memory_order_relaxed);
+    stats.resizes = resizes_.load(std::memory_order_relaxed);
+    stats.resize_seconds =
+        resize_nanos_.load(std::memory_order_relaxed) / 1e9;
+    return stats;
+  }
+
   /**
    * Resizes the table to the given hashpower. If this hashpower is not larger
    * than the current hashpower, then it decreases the hashpower to the
@@ -795,11 +929,43 @@ class cuckoohash_map {
    */
   bool reserve(size_type n) { return cuckoo_reserve<normal_mode>(n); }
 
+  /**
+   * Migrates up to @p max_stripes lock stripes left over by the last doubling
+   * of the table, taking one stripe lock at a time, so that concurrent
+   * operations only wait for the stripe being moved. Calling this in the
+   * background finishes a resize without stalling the operations that would
+   * otherwise migrate the stripes they touch. It is safe to call concurrently
+   * with any other operation.
+   *
+   * @param max_stripes the maximum number of stripes to visit
+   * @return the number of stripes left to migrate
+   */
+  size_type rehash_pending(size_type max_stripes) {
+    for (size_type i = 0; i < max_stripes; ++i) {
+      if (num_remaining_lazy_rehash_locks() == 0) {
+        break;
+      }
+      const size_type hp = hashpower();
+      const size_type l =
+          rehash_cursor_.fetch_add(1, std::memory_order_relaxed) %
+          kMaxNumLocks;
+      try {
+        // Taking the lock migrates its stripe, within which the elements
+        // stay, so a snapshot does not need a copy of it yet.
+        lock_one(hp, l, normal_mode(), /*for_write=*/false);
+      } catch (hashpower_changed &) {
+        // Another doubling started, its stripes are handled the same way.
+      }
+    }
+    return num_remaining_lazy_rehash_locks();
+  }
+
   /**
    * Removes all elements in the table, calling their destructors.
    */
   void clear() {
     auto all_locks_manager = lock_all(normal_mode());
+    copy_all_to_snapshot();
     cuckoo_clear();
   }
 
@@ -811,6 +977,36 @@ class cuckoohash_map {
    */
   locked_table lock_table() { return locked_table(*this); }
 
+  class table_snapshot;
+
+  /**
+   * Starts a point-in-time snapshot of the table. All the locks are taken
+   * only to mark them; the elements guarded by each lock are copied right
+   * before the first operation after the snapshot acquires it to write, or
+   * when @ref table_snapshot::complete reaches it, whichever comes first.
+   * Lookups do not copy anything. Concurrent operations therefore keep
+   * running while the snapshot is read. Only one
+   * snapshot can be in progress at a time, further calls block until the
+   * previous one completes. The map must outlive the snapshot.
+   *
+   * @return the snapshot in progress
+   */
+  std::unique_ptr<table_snapshot> snapshot() {
+    std::unique_ptr<table_snapshot> snap(
+        new table_snapshot(*this, std::unique_lock<std::mutex>(
+                                      snapshot_mutex_)));
+    auto all_locks_manager = lock_all(normal_mode());
+    locks_t &locks = get_current_locks();
+    snap->state_.stripes.resize(locks.size());
+    snap->state_.size = 0;
+    for (spinlock &lock : locks) {
+      snap->state_.size += lock.elem_counter();
+      lock.in_snapshot() = true;
+    }
+    snapshot_.store(&snap->state_, std::memory_order_release);
+    return snap;
+  }
+
   /**@}*/
 
  private:
@@ -922,32 +1118,64 @@ class cuckoohash_map {
   // Instead, we'll mark all of the locks as not migrated. So anybody trying to
   // acquire the lock must also migrate the corresponding buckets if
   // !is_migrated.
+  //
+  // - in_snapshot: While a snapshot is taken, the elements under each lock
+  // are copied into the snapshot before anybody modifies them. All locks are
+  // marked when the snapshot starts, and anybody acquiring a lock with
+  // in_snapshot set must copy the corresponding buckets first.
+  // Counters kept per lock, only modified with the lock taken so that they
+  // cost no extra synchronization. They fit in the cache line of the lock.
+  struct lock_stats {
+    counter_type acquisitions = 0;
+    // Acquisitions which found the lock taken, and the spins they waited.
+    counter_type contended = 0;
+    counter_type contended_spins = 0;
+    // Lookups by find_fn, counted on the lock of their first bucket.
+    counter_type hits = 0;
+    counter_type misses = 0;
+  };
+
   LIBCUCKOO_SQUELCH_PADDING_WARNING
   class LIBCUCKOO_ALIGNAS(64) spinlock {
    public:
-    spinlock() : elem_counter_(0), is_migrated_(true) { lock_.clear(); }
+    spinlock() : elem_counter_(0), is_migrated_(true), in_snapshot_(false) {
+      lock_.clear();
+    }
 
     spinlock(const spinlock &other)
         : elem_counter_(other.elem_counter()),
-          is_migrated_(other.is_migrated()) {
+          is_migrated_(other.is_migrated()),
+          in_snapshot_(other.in_snapshot()),
+          stats_(other.stats()) {
       lock_.clear();
     }
 
     spinlock &operator=(const spinlock &other) {
       elem_counter() = other.elem_counter();
       is_migrated() = other.is_migrated();
+      in_snapshot() = other.in_snapshot();
+      stats() = other.stats();
       return *this;
     }
 
     void lock() noexcept {
-      while (lock_.test_and_set(std::memory_order_acq_rel))
-        ;
+      if (lock_.test_and_set(std::memory_order_acq_rel)) {
+        counter_type spins = 0;
+        do {
+          ++spins;
+        } while (lock_.test_and_set(std::memory_order_acq_rel));
+        ++stats_.contended;
+        stats_.contended_spins += spins;
+      }
+      ++stats_.acquisitions;
     }
 
     void unlock() noexcept { lock_.clear(std::memory_order_release); }
 
     bool try_lock() noexcept {
-      return !lock_.test_and_set(std::memory_order_acq_rel);
+      if (lock_.test_and_set(std::memory_order_acq_rel)) return false;
+      ++stats_.acquisitions;
+      return true;
     }
 
     counter_type &elem_counter() noexcept { return elem_counter_; }
@@ -956,10 +1184,18 @@ class cuckoohash_map {
     bool &is_migrated() noexcept { return is_migrated_; }
     bool is_migrated() const noexcept { return is_migrated_; }
 
+    bool &in_snapshot() noexcept { return in_snapshot_; }
+    bool in_snapshot() const noexcept { return in_snapshot_; }
+
+    lock_stats &stats() noexcept { return stats_; }
+    const lock_stats &stats() const noexcept { return stats_; }
+
    private:
     std::atomic_flag lock_;
     counter_type elem_counter_;
     bool is_migrated_;
+    bool in_snapshot_;
+    lock_stats stats_;
   };
 
   template <typename U>
@@ -1080,20 +1316,79 @@ class cuckoohash_map {
     }
   }
 
-  // locks the given bucket index.
+  // State of the snapshot in progress, see table_snapshot.
+  struct snapshot_state {
+    // The copied elements, indexed by lock.
+    std::vector<std::vector<std::pair<key_type, mapped_type>>> stripes;
+    // Number of elements in the table when the snapshot started.
+    size_type size;
+  };
+
+  // If the given lock is marked in_snapshot, copies the elements it guards
+  // into the snapshot in progress and clears the mark. Assumes the lock at
+  // the given index is taken.
+  void copy_lock_to_snapshot(size_type l) const {
+    spinlock &lock = get_current_locks()[l];
+    if (!lock.in_snapshot()) return;
+    rehash_lock<kIsLazy>(l);
+    auto &stripe = snapshot_.load(std::memory_order_acquire)->stripes[l];
+    for (size_type bucket_ind = l; bucket_ind < buckets_.size();
+         bucket_ind += kMaxNumLocks) {
+      const bucket &b = buckets_[bucket_ind];
+      for (size_type slot = 0; slot < slot_per_bucket(); ++slot) {
+        if (b.occupied(slot)) {
+          stripe.emplace_back(b.key(slot), b.mapped(slot));
+        }
+      }
+    }
+    lock.in_snapshot() = false;
+  }
+
+  // Copies every lock still marked in_snapshot into the snapshot in progress.
+  // Must be called with all the locks taken, before anything changes the
+  // bucket layout or the lock array.
+  void copy_all_to_snapshot() noexcept {
+    if (snapshot_.load(std::memory_order_acquire) == nullptr) return;
+    parallel_exec_noexcept(0, get_current_locks().size(),
+                           [this](size_type start, size_type end) {
+                             for (size_type i = start; i < end; ++i) {
+                               copy_lock_to_snapshot(i);
+                             }
+                           });
+  }
+
+  // Takes and releases the lock at the given index, which performs any
+  // pending migration or snapshot copy of its buckets.
+  void touch_lock(size_type l) const {
+    while (true) {
+      const size_type hp = hashpower();
+      try {
+        lock_one(hp, l, normal_mode());
+        return;
+      } catch (hashpower_changed &) {
+        continue;
+      }
+    }
+  }
+
+  // locks the given bucket index. Unless for_write is false, the elements
+  // it guards are copied into the snapshot in progress first.
   //
   // throws hashpower_changed if it changed after taking the lock.
-  LockManager lock_one(size_type, size_type, locked_table_mode) const {
+  LockManager lock_one(size_type, size_type, locked_table_mode,
+                       bool = true) const {
     return LockManager();
   }
 
-  LockManager lock_one(size_type hp, size_type i, normal_mode) const {
+  LockManager lock_one(size_type hp, size_type i, normal_mode,
+                       bool for_write = true) const {
     locks_t &locks = get_current_locks();
     const size_type l = lock_ind(i);
     spinlock &lock = locks[l];
     lock.lock();
     check_hashpower(hp, lock);
     rehash_lock<kIsLazy>(l);
+    if (for_write) copy_lock_to_snapshot(l);
     return LockManager(&lock);
   }
 
@@ -1102,12 +1397,12 @@ class cuckoohash_map {
   //
   // throws hashpower_changed if it changed after taking the lock.
   TwoBuckets lock_two(size_type, size_type i1, size_type i2,
-                      locked_table_mode) const {
+                      locked_table_mode, bool = true) const {
     return TwoBuckets(i1, i2, locked_table_mode());
   }
 
-  TwoBuckets lock_two(size_type hp, size_type i1, size_type i2,
-                      normal_mode) const {
+  TwoBuckets lock_two(size_type hp, size_type i1, size_type i2, normal_mode,
+                      bool for_write = true) const {
     size_type l1 = lock_ind(i1);
     size_type l2 = lock_ind(i2);
     if (l2 < l1) {
@@ -1121,6 +1416,10 @@ class cuckoohash_map {
     }
     rehash_lock<kIsLazy>(l1);
     rehash_lock<kIsLazy>(l2);
+    if (for_write) {
+      copy_lock_to_snapshot(l1);
+      copy_lock_to_snapshot(l2);
+    }
     return TwoBuckets(locks, i1, i2, normal_mode());
   }
 
@@ -1156,6 +1455,9 @@ class cuckoohash_map {
     rehash_lock<kIsLazy>(l[0]);
     rehash_lock<kIsLazy>(l[1]);
     rehash_lock<kIsLazy>(l[2]);
+    copy_lock_to_snapshot(l[0]);
+    copy_lock_to_snapshot(l[1]);
+    copy_lock_to_snapshot(l[2]);
     return std::make_pair(TwoBuckets(locks, i1, i2, normal_mode()),
                           LockManager((lock_ind(i3) == lock_ind(i1) ||
                                        lock_ind(i3) == lock_ind(i2))
@@ -1168,16 +1470,17 @@ class cuckoohash_map {
   // taken. Thus it ensures that the buckets and locks corresponding to the
   // hash value will stay correct as long as the locks are held. It returns
   // the bucket indices associated with the hash value and the current
-  // hashpower.
+  // hashpower. Callers which only read the buckets pass for_write false.
   template <typename TABLE_MODE>
-  TwoBuckets snapshot_and_lock_two(const hash_value &hv) const {
+  TwoBuckets snapshot_and_lock_two(const hash_value &hv,
+                                   bool for_write = true) const {
     while (true) {
       // Keep the current hashpower and locks we're using to compute the buckets
       const size_type hp = hashpower();
       const size_type i1 = index_hash(hp, hv.hash);
       const size_type i2 = alt_index(hp, hv.partial, i1);
       try {
-        return lock_two(hp, i1, i2, TABLE_MODE());
+        return lock_two(hp, i1, i2, TABLE_MODE(), for_write);
       } catch (hashpower_changed &) {
         // The hashpower changed while taking the locks. Try again.
         continue;
@@ -1483,10 +1786,12 @@ class cuckoohash_map {
         const int depth =
             cuckoopath_search<TABLE_MODE>(hp, cuckoo_path, b.i1, b.i2);
         if (depth < 0) {
+          cuckoo_failures_.fetch_add(1, std::memory_order_relaxed);
           break;
         }
 
         if (cuckoopath_move<TABLE_MODE>(hp, cuckoo_path, depth, b)) {
+          cuckoo_path_depths_[depth].fetch_add(1, std::memory_order_relaxed);
           insert_bucket = cuckoo_path[0].bucket;
           insert_slot = cuckoo_path[0].slot;
           assert(insert_bucket == b.i1 || insert_bucket == b.i2);
@@ -1784,6 +2089,22 @@ class cuckoohash_map {
       return cuckoo_expand_simple<TABLE_MODE, AUTO_RESIZE>(current_hp + 1);
     }
     const size_type new_hp = current_hp + 1;
+
+    // Allocate and initialize the new buckets before taking all the locks, so
+    // that other operations keep running meanwhile. Concurrent resizes are
+    // serialized first, so that only one of the threads which found the table
+    // full allocates. In locked_table_mode the caller already holds all the
+    // locks, and must not wait for a normal resize blocked on them.
+    std::unique_lock<std::mutex> resize_lock(resize_mutex_, std::defer_lock);
+    if (!std::is_same<TABLE_MODE, locked_table_mode>::value) {
+      resize_lock.lock();
+      if (hashpower() != current_hp) {
+        return failure_under_expansion;
+      }
+    }
+    const auto start = std::chrono::steady_clock::now();
+    buckets_t new_buckets(new_hp, get_allocator());
+
     auto all_locks_manager = lock_all(TABLE_MODE());
     cuckoo_status st = check_resize_validity<AUTO_RESIZE>(current_hp, new_hp);
     if (st != ok) {
@@ -1791,26 +2112,17 @@ class cuckoohash_map {
     }
 
     // Finish rehashing any un-rehashed buckets, so that we can move out any
-    // remaining data in old_buckets_.  We should be running cuckoo_fast_double
-    // only after trying to cuckoo for a while, which should mean we've tried
-    // going through most of the table and thus done a lot of rehashing
-    // already. So this shouldn't be too expensive.
-    //
-    // We restrict ourselves to the current thread because we want to avoid
-    // possibly spawning extra threads in this function, unless the
-    // circumstances are predictable (i.e. data is nothrow move constructible,
-    // we're in locked_table mode and must keep the buckets_ container
-    // up-to-date, etc).
+    // remaining data in old_buckets_. Usually nothing is left, since the
+    // stripes are migrated on demand and by rehash_pending, but stripes which
+    // nobody touched since the last doubling are moved here in parallel, as
+    // the data is known to be nothrow move constructible.
     //
     // If we have fewer than kNumLocks buckets, there shouldn't be any buckets
     // left to rehash, so this should be a no-op.
-    {
-      locks_t &current_locks = get_current_locks();
-      for (size_t i = 0; i < current_locks.size(); ++i) {
-        rehash_lock<kIsNotLazy>(i);
-      }
-      num_remaining_lazy_rehash_locks(0);
+    if (num_remaining_lazy_rehash_locks() > 0) {
+      rehash_with_workers();
     }
+    copy_all_to_snapshot();
 
     // Resize the locks array if necessary. This is done before we update the
     // hashpower so that other threads don't grab the new hashpower and the old
@@ -1818,11 +2130,11 @@ class cuckoohash_map {
     maybe_resize_locks(size_type(1) << new_hp);
     locks_t &current_locks = get_current_locks();
 
-    // Move the current buckets into old_buckets_, and create a new empty
-    // buckets container, which will become the new current one. The
-    // old_buckets_ data will be destroyed when move-assigning to buckets_.
+    // Move the current buckets into old_buckets_, and make the new empty
+    // buckets container the current one. The released old_buckets_ container
+    // ends up in new_buckets, which is destroyed after the locks are released.
     old_buckets_.swap(buckets_);
-    buckets_ = buckets_t(new_hp, get_allocator());
+    buckets_.swap(new_buckets);
 
     // If we have less than kMaxNumLocks buckets, we do a full rehash in the
     // current thread. On-demand rehashing wouldn't be very easy with less than
@@ -1854,9 +2166,19 @@ class cuckoohash_map {
         rehash_with_workers();
       }
     }
+    count_resize(start);
     return ok;
   }
 
+  // Counts a resize which started at the given time.
+  void count_resize(std::chrono::steady_clock::time_point start) {
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    resizes_.fetch_add(1, std::memory_order_relaxed);
+    resize_nanos_.fetch_add(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(),
+        std::memory_order_relaxed);
+  }
+
   void move_bucket(buckets_t &old_buckets, buckets_t &new_buckets,
                    size_type old_bucket_ind) const noexcept {
     const size_t old_hp = old_buckets.hashpower();
@@ -1963,6 +2285,7 @@ class cuckoohash_map {
   // maximum hashpower, and we have an actual limit.
   template <typename TABLE_MODE, typename AUTO_RESIZE>
   cuckoo_status cuckoo_expand_simple(size_type new_hp) {
+    const auto start = std::chrono::steady_clock::now();
     auto all_locks_manager = lock_all(TABLE_MODE());
     const size_type hp = hashpower();
     cuckoo_status st = check_resize_validity<AUTO_RESIZE>(hp, new_hp);
@@ -1972,6 +2295,7 @@ class cuckoohash_map {
 
     // Finish rehashing any data into buckets_.
     rehash_with_workers();
+    copy_all_to_snapshot();
 
     // Creates a new hash table with hashpower new_hp and adds all the elements
     // from buckets_ and old_buckets_. Allow this map to spawn extra threads if
@@ -2007,6 +2331,7 @@ class cuckoohash_map {
     maybe_resize_locks(new_map.bucket_count());
     buckets_.swap(new_map.buckets_);
 
+    count_resize(start);
     return ok;
   }
 
@@ -2145,7 +2470,7 @@ class cuckoohash_map {
   }
 
   void num_remaining_lazy_rehash_locks(size_type n) const {
-    return num_remaining_lazy_rehash_locks_.store(n, std::memory_order_release);
+    num_remaining_lazy_rehash_locks_.store(n, std::memory_order_release);
     if (n == 0) {
       old_buckets_.clear_and_deallocate();
     }
@@ -2219,6 +2544,29 @@ class cuckoohash_map {
   // operations.
   std::atomic<size_type> max_num_worker_threads_;
 
+  // Serializes automatic doublings, so that only one thread allocates the
+  // new buckets while the others wait and retry on the doubled table.
+  std::mutex resize_mutex_;
+
+  // The next stripe visited by rehash_pending.
+  std::atomic<size_type> rehash_cursor_{0};
+
+  // Held by the snapshot in progress, if any.
+  std::mutex snapshot_mutex_;
+
+  // The snapshot in progress. Only dereferenced with all the locks taken, or
+  // with a lock still marked in_snapshot taken.
+  mutable std::atomic<snapshot_state *> snapshot_{nullptr};
+
+  // Inserts which found both their buckets full, by the number of elements
+  // moved along the cuckoo path they used, and those which found no path.
+  std::array<std::atomic<size_type>, MAX_BFS_PATH_LEN> cuckoo_path_depths_{};
+  std::atomic<size_type> cuckoo_failures_{0};
+
+  // Resizes of the bucket array, and the time they held the table.
+  std::atomic<size_type> resizes_{0};
+  std::atomic<int64_t> resize_nanos_{0};
+
  public:
   /**
    * An ownership wrapper around a @ref cuckoohash_map table instance. When
@@ -2779,6 +3127,9 @@ class cuckoohash_map {
     locked_table(cuckoohash_map &map) noexcept
         : map_(map), all_locks_manager_(map.lock_all(normal_mode())) {
       map.rehash_with_workers();
+      // Operations through the locked_table do not take the locks, so any
+      // snapshot in progress has to be completed now.
+      map.copy_all_to_snapshot();
     }
 
     // Dispatchers for methods on cuckoohash_map
@@ -2834,6 +3185,62 @@ class cuckoohash_map {
       return is;
     }
   };
+
+  /**
+   * A point-in-time view of a @ref cuckoohash_map, created by @ref
+   * cuckoohash_map::snapshot. The elements of the map at the time the
+   * snapshot started are read with @ref complete, while the map keeps being
+   * modified.
+   */
+  class table_snapshot {
+   public:
+    ~table_snapshot() {
+      if (!completed_) {
+        complete([](const key_type &, const mapped_type &) {});
+      }
+    }
+
+    /**
+     * Returns the number of elements in the snapshot.
+     */
+    size_type size() const { return state_.size; }
+
+    /**
+     * Visits every element of the snapshot and releases it from the map.
+     * Locks whose elements were not copied yet by concurrent operations are
+     * copied one at a time, and copies are freed as soon as they are visited.
+     * Must be called only once.
+     *
+     * @param visit called as visit(key, mapped) for every element
+     */
+    template <typename F>
+    void complete(F visit) {
+      assert(!completed_);
+      for (size_type l = 0; l < state_.stripes.size(); ++l) {
+        map_.touch_lock(l);
+        auto &stripe = state_.stripes[l];
+        for (const auto &kv : stripe) {
+          visit(kv.first, kv.second);
+        }
+        std::vector<std::pair<key_type, mapped_type>>().swap(stripe);
+      }
+      // No lock is marked in_snapshot anymore, so nobody reads snapshot_.
+      map_.snapshot_.store(nullptr, std::memory_order_release);
+      completed_ = true;
+      lock_.unlock();
+    }
+
+   private:
+    table_snapshot(cuckoohash_map &map, std::unique_lock<std::mutex> lock)
+        : map_(map), lock_(std::move(lock)), completed_(false) {}
+
+    cuckoohash_map &map_;
+    std::unique_lock<std::mutex> lock_;
+    snapshot_state state_;
+    bool completed_;
+
+    friend class cuckoohash_map;
+  };
 };
 namespace std {
 
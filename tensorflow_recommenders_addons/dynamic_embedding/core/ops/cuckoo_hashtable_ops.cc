@@ -227,6 +227,103 @@ REGISTER_OP(PREFIX_OP_NAME(CuckooHashTableClear))
     .Attr("key_dtype: type")
     .Attr("value_dtype: type");
 
+REGISTER_OP(PREFIX_OP_NAME(CuckooHashTableShrink))
+    .Input("table_handle: resource")
+    .Output("shrunk: bool")
+    .Attr("key_dtype: type")
+    .Attr("value_dtype: type")
+    .Attr("max_load_factor: float = 0.5")
+    .SetShapeFn(ScalarAndTwoElementVectorInputsAndScalarOutputs);
+
+REGISTER_OP(PREFIX_OP_NAME(CuckooHashTableRehashProgress))
+    .Input("table_handle: resource")
+    .Output("progress: float")
+    .Attr("key_dtype: type")
+    .Attr("value_dtype: type")
+    .SetShapeFn(ScalarAndTwoElementVectorInputsAndScalarOutputs);
+
+REGISTER_OP(PREFIX_OP_NAME(CuckooHashTableDrainChangeLog))
+    .Input("table_handle: resource")
+    .Input("filepath: string")
+    .Output("first_sequence: int64")
+    .Output("count: int64")
+    .Output("dropped: int64")
+    .Attr("key_dtype: type")
+    .Attr("value_dtype: type")
+    .SetShapeFn([](InferenceContext* c) {
+      ShapeHandle handle;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(1), 0, &handle));
+      c->set_output(0, c->Scalar());
+      c->set_output(1, c->Scalar());
+      c->set_output(2, c->Scalar());
+      return Status::OK();
+    });
+
+REGISTER_OP(PREFIX_OP_NAME(CuckooHashTableReplayChangeLog))
+    .Input("table_handle: resource")
+    .Input("filepath: string")
+    .Output("last_sequence: int64")
+    .Output("missing: int64")
+    .Attr("key_dtype: type")
+    .Attr("value_dtype: type")
+    .SetShapeFn([](InferenceContext* c) {
+      ShapeHandle handle;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(1), 0, &handle));
+      c->set_output(0, c->Scalar());
+      c->set_output(1, c->Scalar());
+      return Status::OK();
+    });
+
+REGISTER_OP(PREFIX_OP_NAME(CuckooHashTableSample))
+    .Input("table_handle: resource")
+    .Input("n: int64")
+    .Input("seed: int64")
+    .Output("keys: key_dtype")
+    .Output("values: value_dtype")
+    .Attr("key_dtype: type")
+    .Attr("value_dtype: type")
+    .Attr("with_values: bool = true")
+    .SetShapeFn([](InferenceContext* c) {
+      ShapeHandle handle;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(0), 0, &handle));
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(1), 0, &handle));
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(2), 0, &handle));
+      ShapeHandle keys = c->UnknownShapeOfRank(1);
+      ShapeAndType value_shape_and_type;
+      TF_RETURN_IF_ERROR(ValidateTableResourceHandle(
+          c,
+          /*keys=*/keys,
+          /*key_dtype_attr=*/"key_dtype",
+          /*value_dtype_attr=*/"value_dtype",
+          /*is_lookup=*/false, &value_shape_and_type));
+      c->set_output(0, keys);
+      c->set_output(1, value_shape_and_type.shape);
+      return Status::OK();
+    });
+
+REGISTER_OP(PREFIX_OP_NAME(CuckooHashTableStats))
+    .Input("table_handle: resource")
+    .Output("names: string")
+    .Output("values: double")
+    .Output("cuckoo_path_depths: int64")
+    .Output("lock_acquisitions: int64")
+    .Output("contended_acquisitions: int64")
+    .Output("contended_spins: int64")
+    .Attr("key_dtype: type")
+    .Attr("value_dtype: type")
+    .Attr("per_lock: bool = false")
+    .Attr("reset: bool = false")
+    .SetIsStateful()
+    .SetShapeFn([](InferenceContext* c) {
+      ShapeHandle handle;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(0), 0, &handle));
+      ShapeHandle names = c->Vector(c->UnknownDim());
+      c->set_output(0, names);
+      c->set_output(1, names);
+      for (int i = 2; i < 6; ++i) c->set_output(i, c->Vector(c->UnknownDim()));
+      return Status::OK();
+    });
+
 REGISTER_OP(PREFIX_OP_NAME(CuckooHashTableSize))
     .Input("table_handle: resource")
     .Output("size: int64")
@@ -259,7 +356,8 @@ REGISTER_OP(PREFIX_OP_NAME(CuckooHashTableSaveToHDFS))
     .Input("filepath: string")
     .Attr("key_dtype: type")
     .Attr("value_dtype: type")
-    .Attr("buffer_size: int >= 1");
+    .Attr("buffer_size: int >= 1")
+    .Attr("compression: string = ''");
 
 REGISTER_OP(PREFIX_OP_NAME(CuckooHashTableImport))
     .Input("table_handle: resource")
@@ -284,6 +382,29 @@ REGISTER_OP(PREFIX_OP_NAME(CuckooHashTableLoadFromHDFS))
     .Attr("value_dtype: type")
     .Attr("buffer_size: int >= 1");
 
+REGISTER_OP(PREFIX_OP_NAME(CuckooHashTableReshard))
+    .Input("input_files: string")
+    .Input("output_prefix: string")
+    .Output("output_files: string")
+    .Output("counts: int64")
+    .Attr("key_dtype: type")
+    .Attr("value_dtype: type")
+    .Attr("value_dim: int >= 1")
+    .Attr("num_shards: int >= 1")
+    .Attr("partition: string = 'mod'")
+    .Attr("compression: string = ''")
+    .Attr("buffer_size: int >= 1 = 4194304")
+    .SetShapeFn([](InferenceContext* c) {
+      ShapeHandle handle;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(0), 1, &handle));
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(1), 0, &handle));
+      int64 num_shards;
+      TF_RETURN_IF_ERROR(c->GetAttr("num_shards", &num_shards));
+      c->set_output(0, c->Vector(num_shards));
+      c->set_output(1, c->Vector(num_shards));
+      return Status::OK();
+    });
+
 REGISTER_OP(PREFIX_OP_NAME(CuckooHashTableOfTensors))
     .Output("table_handle: resource")
     .Attr("container: string = ''")
@@ -293,6 +414,64 @@ REGISTER_OP(PREFIX_OP_NAME(CuckooHashTableOfTensors))
     .Attr("value_dtype: type")
     .Attr("value_shape: shape = {}")
     .Attr("init_size: int = 0")
+    .Attr("change_log_capacity: int = 0")
+    .Attr("hot_swap: bool = false")
+    .Attr("memory_budget: int = 0")
+    .SetIsStateful()
+    .SetShapeFn([](InferenceContext* c) {
+      PartialTensorShape value_p;
+      TF_RETURN_IF_ERROR(c->GetAttr("value_shape", &value_p));
+      ShapeHandle value_s;
+      TF_RETURN_IF_ERROR(c->MakeShapeFromPartialTensorShape(value_p, &value_s));
+      return CuckooHashTableShape(c, /*key=*/c->Scalar(), /*value=*/value_s);
+    });
+
+REGISTER_OP(PREFIX_OP_NAME(FrozenHashTableFindWithExists))
+    .Input("table_handle: resource")
+    .Input("keys: Tin")
+    .Input("default_value: Tout")
+    .Output("values: Tout")
+    .Output("exists: bool")
+    .Attr("Tin: type")
+    .Attr("Tout: type")
+    .SetShapeFn([](InferenceContext* c) {
+      ShapeHandle handle;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(0), 0, &handle));
+
+      ShapeAndType value_shape_and_type;
+      TF_RETURN_IF_ERROR(ValidateTableResourceHandle(
+          c,
+          /*keys=*/c->input(1),
+          /*key_dtype_attr=*/"Tin",
+          /*value_dtype_attr=*/"Tout",
+          /*is_lookup=*/true, &value_shape_and_type));
+      c->set_output(0, value_shape_and_type.shape);
+      c->set_output(1, c->input(1));
+
+      return Status::OK();
+    });
+
+REGISTER_OP(PREFIX_OP_NAME(FrozenHashTableLoad))
+    .Input("table_handle: resource")
+    .Input("filepath: string")
+    .Attr("key_dtype: type")
+    .Attr("value_dtype: type");
+
+REGISTER_OP(PREFIX_OP_NAME(FrozenHashTableSave))
+    .Input("table_handle: resource")
+    .Input("filepath: string")
+    .Attr("key_dtype: type")
+    .Attr("value_dtype: type");
+
+REGISTER_OP(PREFIX_OP_NAME(FrozenHashTableOfTensors))
+    .Output("table_handle: resource")
+    .Attr("container: string = ''")
+    .Attr("shared_name: string = ''")
+    .Attr("use_node_name_sharing: bool = false")
+    .Attr("key_dtype: type")
+    .Attr("value_dtype: type")
+    .Attr("value_shape: shape = {}")
+    .Attr("load_factor: float = 0.95")
     .SetIsStateful()
     .SetShapeFn([](InferenceContext* c) {
       PartialTensorShape value_p;
@@ -190,6 +190,40 @@ REGISTER_OP(PREFIX_OP_NAME(RedisTableAccum))
       return Status::OK();
     });
 
+REGISTER_OP(PREFIX_OP_NAME(RedisTableSparseApply))
+    .Input("table_handle: resource")
+    .Input("slot_handles: num_slots * resource")
+    .Input("keys: key_dtype")
+    .Input("grads: value_dtype")
+    .Input("hyperparams: value_dtype")
+    .Attr("optimizer: {'sgd', 'adagrad', 'adam'}")
+    .Attr("num_slots: int >= 0")
+    .Attr("key_dtype: {int32, int64}")
+    .Attr("value_dtype: {float, double}")
+    .SetShapeFn([](InferenceContext *c) {
+      ShapeHandle handle;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(0), 0, &handle));
+      int num_slots;
+      TF_RETURN_IF_ERROR(c->GetAttr("num_slots", &num_slots));
+      for (int i = 1; i <= num_slots; ++i) {
+        TF_RETURN_IF_ERROR(c->WithRank(c->input(i), 0, &handle));
+      }
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(num_slots + 3), 1, &handle));
+
+      // The grads are one value per key, so keys must be a prefix of them.
+      ShapeHandle keys = c->input(num_slots + 1);
+      ShapeHandle grads = c->input(num_slots + 2);
+      TF_RETURN_IF_ERROR(c->WithRankAtLeast(keys, 1, &keys));
+      if (c->RankKnown(keys)) {
+        const int keys_rank = c->Rank(keys);
+        TF_RETURN_IF_ERROR(c->WithRankAtLeast(grads, keys_rank, &grads));
+        ShapeHandle grads_prefix;
+        TF_RETURN_IF_ERROR(c->Subshape(grads, 0, keys_rank, &grads_prefix));
+        TF_RETURN_IF_ERROR(c->Merge(keys, grads_prefix, &handle));
+      }
+      return Status::OK();
+    });
+
 REGISTER_OP(PREFIX_OP_NAME(RedisTableRemove))
     .Input("table_handle: resource")
     .Input("keys: Tin")
@@ -208,6 +242,11 @@ REGISTER_OP(PREFIX_OP_NAME(RedisTableClear))
     .Attr("key_dtype: type")
     .Attr("value_dtype: type");
 
+REGISTER_OP(PREFIX_OP_NAME(RedisTableFlush))
+    .Input("table_handle: resource")
+    .Attr("key_dtype: type")
+    .Attr("value_dtype: type");
+
 REGISTER_OP(PREFIX_OP_NAME(RedisTableSize))
     .Input("table_handle: resource")
     .Output("size: int64")
@@ -235,6 +274,38 @@ REGISTER_OP(PREFIX_OP_NAME(RedisTableExport))
       return Status::OK();
     });
 
+REGISTER_OP(PREFIX_OP_NAME(RedisTableExportChunk))
+    .Input("table_handle: resource")
+    .Input("slice: int64")
+    .Input("cursor: int64")
+    .Input("max_rows: int64")
+    .Output("keys: Tkeys")
+    .Output("values: Tvalues")
+    .Output("next_slice: int64")
+    .Output("next_cursor: int64")
+    .Attr("Tkeys: type")
+    .Attr("Tvalues: type")
+    .SetShapeFn([](InferenceContext *c) {
+      ShapeHandle handle;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(0), 0, &handle));
+      for (int i = 1; i <= 3; ++i) {
+        TF_RETURN_IF_ERROR(c->WithRank(c->input(i), 0, &handle));
+      }
+      ShapeHandle keys = c->UnknownShapeOfRank(1);
+      ShapeAndType value_shape_and_type;
+      TF_RETURN_IF_ERROR(ValidateTableResourceHandle(
+          c,
+          /*keys=*/keys,
+          /*key_dtype_attr=*/"Tkeys",
+          /*value_dtype_attr=*/"Tvalues",
+          /*is_lookup=*/false, &value_shape_and_type));
+      c->set_output(0, keys);
+      c->set_output(1, value_shape_and_type.shape);
+      c->set_output(2, c->Scalar());
+      c->set_output(3, c->Scalar());
+      return Status::OK();
+    });
+
 REGISTER_OP(PREFIX_OP_NAME(RedisTableImport))
     .Input("table_handle: resource")
     .Input("keys: Tin")
@@ -0,0 +1,186 @@
+/* Copyright 2021 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TFRA_TABLE_METRICS_H_
+#define TFRA_TABLE_METRICS_H_
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "tensorflow/core/framework/node_def_util.h"
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/lib/monitoring/counter.h"
+#include "tensorflow/core/lib/monitoring/gauge.h"
+#include "tensorflow/core/lib/monitoring/sampler.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/mutex.h"
+
+namespace tensorflow {
+namespace recommenders_addons {
+namespace table_metrics_internal {
+
+// The metrics of all the tables of one backend, exported as
+// /tensorflow/recommenders_addons/<backend>/<metric>. Every backend is built
+// into its own op library, and the monitoring registry refuses two metrics
+// with one name, so each backend gets its own metric names.
+struct Families {
+  explicit Families(const string& backend) {
+    const string prefix = "/tensorflow/recommenders_addons/" + backend + "/";
+    lookups.reset(monitoring::Counter<1>::New(
+        prefix + "lookups", "Keys looked up in the table.", "table"));
+    misses.reset(monitoring::Counter<1>::New(
+        prefix + "misses", "Keys looked up but not found in the table.",
+        "table"));
+    inserts.reset(monitoring::Counter<1>::New(
+        prefix + "inserts", "Keys inserted or accumulated into the table.",
+        "table"));
+    removes.reset(monitoring::Counter<1>::New(
+        prefix + "removes", "Keys removed from the table.", "table"));
+    latency.reset(monitoring::Sampler<2>::New(
+        {prefix + "latency_micros", "Latency of calls to the table.", "table",
+         "op"},
+        monitoring::Buckets::Exponential(1.0, 2.0, 32)));
+    size.reset(monitoring::Gauge<int64, 1>::New(
+        prefix + "size", "Number of keys in the table.", "table"));
+    bytes.reset(monitoring::Gauge<int64, 1>::New(
+        prefix + "bytes", "Bytes of memory held by the table.", "table"));
+  }
+
+  std::unique_ptr<monitoring::Counter<1>> lookups;
+  std::unique_ptr<monitoring::Counter<1>> misses;
+  std::unique_ptr<monitoring::Counter<1>> inserts;
+  std::unique_ptr<monitoring::Counter<1>> removes;
+  std::unique_ptr<monitoring::Sampler<2>> latency;
+  std::unique_ptr<monitoring::Gauge<int64, 1>> size;
+  std::unique_ptr<monitoring::Gauge<int64, 1>> bytes;
+
+  // Live TableMetrics per table label. Tables sharing a label share its
+  // cells, so the gauges are only cleared when the last of them goes.
+  mutex mu;
+  std::unordered_map<string, int> users TF_GUARDED_BY(mu);
+};
+
+inline Families* GetFamilies(const string& backend) {
+  static mutex* mu = new mutex;
+  static auto* families = new std::unordered_map<string, Families*>;
+  mutex_lock l(*mu);
+  Families*& f = (*families)[backend];
+  if (f == nullptr) f = new Families(backend);
+  return f;
+}
+
+}  // namespace table_metrics_internal
+
+// Monitoring metrics of one table, labelled by the name of the table: keys
+// looked up, missed, inserted and removed, the latency of each call, and
+// the size and memory of the table.
+class TableMetrics {
+ public:
+  TableMetrics(const string& backend, const string& table_name)
+      : families_(table_metrics_internal::GetFamilies(backend)),
+        table_name_(table_name),
+        lookups_(families_->lookups->GetCell(table_name)),
+        misses_(families_->misses->GetCell(table_name)),
+        inserts_(families_->inserts->GetCell(table_name)),
+        removes_(families_->removes->GetCell(table_name)),
+        find_latency_(families_->latency->GetCell(table_name, "find")),
+        insert_latency_(families_->latency->GetCell(table_name, "insert")),
+        remove_latency_(families_->latency->GetCell(table_name, "remove")),
+        size_(families_->size->GetCell(table_name)),
+        bytes_(families_->bytes->GetCell(table_name)) {
+    mutex_lock l(families_->mu);
+    ++families_->users[table_name_];
+  }
+
+  ~TableMetrics() {
+    mutex_lock l(families_->mu);
+    auto it = families_->users.find(table_name_);
+    if (--it->second > 0) return;
+    families_->users.erase(it);
+    size_->Set(0);
+    bytes_->Set(0);
+  }
+
+  static uint64 NowMicros() { return Env::Default()->NowMicros(); }
+
+  // Records a call started at start_micros, as returned by NowMicros.
+  void RecordFind(int64 keys, int64 misses, uint64 start_micros) {
+    lookups_->IncrementBy(keys);
+    misses_->IncrementBy(misses);
+    find_latency_->Add(NowMicros() - start_micros);
+  }
+
+  // Records keys looked up without a call to the backend, such as the ones
+  // found in a cache in front of it.
+  void RecordLookups(int64 keys) { lookups_->IncrementBy(keys); }
+
+  void RecordInsert(int64 keys, uint64 start_micros) {
+    inserts_->IncrementBy(keys);
+    insert_latency_->Add(NowMicros() - start_micros);
+  }
+
+  void RecordRemove(int64 keys, uint64 start_micros) {
+    removes_->IncrementBy(keys);
+    remove_latency_->Add(NowMicros() - start_micros);
+  }
+
+  // Sets the size and bytes gauges from size_and_bytes(), which returns a
+  // pair of them. Reading them may cost a pass over the table, so they are
+  // refreshed at most every kGaugeIntervalMicros.
+  template <typename Fn>
+  void MaybeRecordSize(const Fn& size_and_bytes) {
+    const uint64 now = NowMicros();
+    uint64 last = last_gauge_micros_.load(std::memory_order_relaxed);
+    if (now - last < kGaugeIntervalMicros && last != 0) return;
+    if (!last_gauge_micros_.compare_exchange_strong(last, now)) return;
+    const std::pair<int64, int64> value = size_and_bytes();
+    size_->Set(value.first);
+    bytes_->Set(value.second);
+  }
+
+ private:
+  static constexpr uint64 kGaugeIntervalMicros = 1000000;
+
+  table_metrics_internal::Families* families_;
+  const string table_name_;
+  monitoring::CounterCell* lookups_;
+  monitoring::CounterCell* misses_;
+  monitoring::CounterCell* inserts_;
+  monitoring::CounterCell* removes_;
+  monitoring::SamplerCell* find_latency_;
+  monitoring::SamplerCell* insert_latency_;
+  monitoring::SamplerCell* remove_latency_;
+  monitoring::GaugeCell<int64>* size_;
+  monitoring::GaugeCell<int64>* bytes_;
+  std::atomic<uint64> last_gauge_micros_{0};
+};
+
+// Name labelling the metrics of the table created by kernel: its
+// shared_name, or the name of the node when it has none.
+inline string TableMetricsName(const OpKernel& kernel) {
+  string name;
+  if (GetNodeAttr(kernel.def(), "shared_name", &name).ok() && !name.empty()) {
+    return name;
+  }
+  return kernel.name();
+}
+
+}  // namespace recommenders_addons
+}  // namespace tensorflow
+
+#endif  // TFRA_TABLE_METRICS_H_
@@ -18,12 +18,19 @@ from __future__ import absolute_import
 from __future__ import division
 from __future__ import print_function
 
+import os
+import struct
 import sys
+import threading
 
+import numpy as np
 from tensorflow_recommenders_addons import dynamic_embedding as de
 
 from tensorflow.core.protobuf import config_pb2
+from tensorflow.python.eager import context
+from tensorflow.python.framework import constant_op
 from tensorflow.python.framework import dtypes
+from tensorflow.python.framework import errors_impl
 from tensorflow.python.framework import test_util
 from tensorflow.python.platform import test
 
@@ -95,6 +102,541 @@ class CuckooHashtableTest(test.TestCase):
         self.assertAllEqual(np_keys, load_keys)
         self.assertAllEqual(np_values, load_values)
 
+  @test_util.run_in_graph_and_eager_modes()
+  def test_numa_partitioned_hashtable(self):
+    os.environ["TFRA_HASHTABLE_NUMA_PARTITIONS"] = "3"
+    try:
+      dim = 4
+      np_keys = np.arange(0, 3000, 3, dtype=np.int64)
+      np_values = np.random.rand(1000, dim).astype(np.float32)
+      with self.session(use_gpu=False, config=default_config):
+        with self.captureWritesToStream(sys.stderr) as printed:
+          table = de.CuckooHashTable(dtypes.int64,
+                                     dtypes.float32,
+                                     default_value=[-1.0] * dim,
+                                     name="numa_t1",
+                                     checkpoint=False)
+          self.evaluate(table.insert(np_keys, np_values))
+        self.assertTrue("partitioned into 3 parts" in printed.contents())
+        self.assertAllEqual(1000, self.evaluate(table.size()))
+
+        query = constant_op.constant([0, 1, 2997], dtype=dtypes.int64)
+        values, exists = self.evaluate(table.lookup(query, return_exists=True))
+        self.assertAllEqual([True, False, True], exists)
+        self.assertAllClose(np_values[0], values[0])
+        self.assertAllClose([-1.0] * dim, values[1])
+        self.assertAllClose(np_values[999], values[2])
+
+        self.evaluate(table.remove(constant_op.constant([0], dtypes.int64)))
+        load_keys, load_values = self.evaluate(table.export())
+        sort_idx = load_keys.argsort()
+        self.assertAllEqual(np_keys[1:], load_keys[sort_idx])
+        self.assertAllClose(np_values[1:], load_values[sort_idx])
+    finally:
+      del os.environ["TFRA_HASHTABLE_NUMA_PARTITIONS"]
+
+  @test_util.run_in_graph_and_eager_modes()
+  def test_incremental_rehash(self):
+    dim = 4
+    num = 600000
+    np_keys = np.arange(0, num, dtype=np.int64)
+    np_values = np.random.rand(num, dim).astype(np.float32)
+    with self.session(use_gpu=False, config=default_config):
+      table = de.CuckooHashTable(dtypes.int64,
+                                 dtypes.float32,
+                                 default_value=[-1.0] * dim,
+                                 init_size=1024,
+                                 name="rehash_t1",
+                                 checkpoint=False)
+      for i in range(0, num, 100000):
+        self.evaluate(
+            table.insert(np_keys[i:i + 100000], np_values[i:i + 100000]))
+      progress = self.evaluate(table.rehash_progress())
+      self.assertTrue(0.0 <= progress <= 1.0)
+      self.assertAllEqual(num, self.evaluate(table.size()))
+      values = self.evaluate(table.lookup(np_keys))
+      self.assertAllClose(np_values, values)
+
+  @test_util.run_in_graph_and_eager_modes()
+  def test_shrink_to_fit(self):
+    dim = 4
+    num = 100000
+    np_keys = np.arange(0, num, dtype=np.int64)
+    np_values = np.random.rand(num, dim).astype(np.float32)
+    with self.session(use_gpu=False, config=default_config):
+      table = de.CuckooHashTable(dtypes.int64,
+                                 dtypes.float32,
+                                 default_value=[-1.0] * dim,
+                                 init_size=1024,
+                                 name="shrink_t1",
+                                 checkpoint=False)
+      self.evaluate(table.insert(np_keys, np_values))
+      self.evaluate(table.remove(np_keys[100:]))
+      self.assertTrue(self.evaluate(table.shrink_to_fit()))
+      self.assertFalse(self.evaluate(table.shrink_to_fit()))
+      self.assertAllEqual(100, self.evaluate(table.size()))
+      values, exists = self.evaluate(
+          table.lookup(np_keys[:200], return_exists=True))
+      self.assertAllEqual([True] * 100 + [False] * 100, exists)
+      self.assertAllClose(np_values[:100], values[:100])
+
+  @test_util.run_in_graph_and_eager_modes()
+  def test_export_while_inserting(self):
+    if not context.executing_eagerly():
+      self.skipTest('Test in eager mode only.')
+    dim = 2
+    chunk = 1000
+    chunks = 200
+    np_keys = np.arange(0, chunk * chunks, dtype=np.int64)
+    np_values = np.stack([np_keys, -np_keys], axis=1).astype(np.float32)
+    with self.session(use_gpu=False, config=default_config):
+      table = de.CuckooHashTable(dtypes.int64,
+                                 dtypes.float32,
+                                 default_value=[-1.0] * dim,
+                                 init_size=1024,
+                                 name="export_while_inserting_t1",
+                                 checkpoint=False)
+      self.evaluate(table.insert(np_keys[:chunk], np_values[:chunk]))
+
+      def insert_chunks():
+        for i in range(1, chunks):
+          table.insert(np_keys[i * chunk:(i + 1) * chunk],
+                       np_values[i * chunk:(i + 1) * chunk])
+
+      writer = threading.Thread(target=insert_chunks)
+      writer.start()
+      exports = []
+      while writer.is_alive():
+        exports.append(self.evaluate(table.export()))
+      writer.join()
+      exports.append(self.evaluate(table.export()))
+
+      for keys, values in exports:
+        # The chunks are inserted one after another, so an export taken at
+        # one point in time holds every chunk before the last one it sees.
+        self.assertEqual(keys.size, np.unique(keys).size)
+        inserted = np.bincount(keys // chunk, minlength=chunks)
+        last = np.max(np.nonzero(inserted)[0])
+        self.assertAllEqual([chunk] * last, inserted[:last])
+        self.assertAllClose(np_values[keys], values)
+      self.assertAllEqual(chunk * chunks, exports[-1][0].size)
+
+  @test_util.run_in_graph_and_eager_modes()
+  def test_change_log_replay(self):
+    dim = 2
+    np_keys = np.arange(0, 100, dtype=np.int64)
+    np_values = np.random.rand(100, dim).astype(np.float32)
+    np_deltas = np.ones((10, dim), dtype=np.float32)
+
+    def export_sorted(table):
+      keys, values = self.evaluate(table.export())
+      order = keys.argsort()
+      return keys[order], values[order]
+
+    with self.session(use_gpu=False, config=default_config):
+      config = de.CuckooHashTableConfig(change_log_capacity=1000)
+      train = de.CuckooHashTable(dtypes.int64,
+                                 dtypes.float32,
+                                 default_value=[-1.0] * dim,
+                                 name="change_log_t1",
+                                 checkpoint=False,
+                                 config=config)
+      serve = de.CuckooHashTable(dtypes.int64,
+                                 dtypes.float32,
+                                 default_value=[-1.0] * dim,
+                                 name="change_log_t2",
+                                 checkpoint=False)
+      self.evaluate(train.insert(np_keys, np_values))
+      self.evaluate(train.remove(np_keys[:10]))
+      self.evaluate(train.accum(np_keys[10:20], np_deltas, [True] * 10))
+
+      filepath = os.path.join(self.get_temp_dir(), "change_log_1")
+      self.assertAllEqual([1, 120, 0],
+                          self.evaluate(train.drain_change_log(filepath)))
+      for _ in range(2):
+        self.assertAllEqual([120, 0],
+                            self.evaluate(serve.replay_change_log(filepath)))
+        train_keys, train_values = export_sorted(train)
+        serve_keys, serve_values = export_sorted(serve)
+        self.assertAllEqual(train_keys, serve_keys)
+        self.assertAllClose(train_values, serve_values)
+
+      # Overflowing the ring drops the oldest records.
+      more_keys = np.arange(100, 2100, dtype=np.int64)
+      more_values = np.random.rand(2000, dim).astype(np.float32)
+      self.evaluate(train.insert(more_keys, more_values))
+      filepath = os.path.join(self.get_temp_dir(), "change_log_2")
+      self.assertAllEqual([1121, 1000, 1000],
+                          self.evaluate(train.drain_change_log(filepath)))
+      self.assertAllEqual([2120, 1000],
+                          self.evaluate(serve.replay_change_log(filepath)))
+
+  @test_util.run_in_graph_and_eager_modes()
+  def test_change_log_overflow_with_pending_records(self):
+    dim = 2
+    with self.session(use_gpu=False, config=default_config):
+      config = de.CuckooHashTableConfig(change_log_capacity=1000)
+      table = de.CuckooHashTable(dtypes.int64,
+                                 dtypes.float32,
+                                 default_value=[-1.0] * dim,
+                                 name="change_log_t3",
+                                 checkpoint=False,
+                                 config=config)
+      self.evaluate(
+          table.insert(np.arange(0, 10, dtype=np.int64),
+                       np.ones((10, dim), dtype=np.float32)))
+      # A batch larger than the ring also overwrites the 10 pending records.
+      self.evaluate(
+          table.insert(np.arange(10, 2010, dtype=np.int64),
+                       np.ones((2000, dim), dtype=np.float32)))
+      filepath = os.path.join(self.get_temp_dir(), "change_log_3")
+      self.assertAllEqual([1011, 1000, 1010],
+                          self.evaluate(table.drain_change_log(filepath)))
+
+  @test_util.run_in_graph_and_eager_modes()
+  def test_change_log_rejects_corrupt_count(self):
+    dim = 2
+    with self.session(use_gpu=False, config=default_config):
+      table = de.CuckooHashTable(dtypes.int64,
+                                 dtypes.float32,
+                                 default_value=[-1.0] * dim,
+                                 name="change_log_t4",
+                                 checkpoint=False)
+      filepath = os.path.join(self.get_temp_dir(), "change_log_4")
+      # A header claiming far more records than the file holds.
+      with open(filepath, "wb") as f:
+        f.write(
+            struct.pack("<8sIIQQQ", b"TFRACDC1", 8, 4 * dim, 1, 1 << 60, 0))
+        f.write(b"\x01" + b"\x00" * 8)
+      with self.assertRaises(errors_impl.DataLossError):
+        self.evaluate(table.replay_change_log(filepath))
+
+  @test_util.run_in_graph_and_eager_modes()
+  def test_hot_swap_import(self):
+    dim = 2
+    old_keys = np.arange(0, 100, dtype=np.int64)
+    new_keys = np.arange(50, 150, dtype=np.int64)
+    old_values = np.random.rand(100, dim).astype(np.float32)
+    new_values = np.random.rand(100, dim).astype(np.float32)
+    with self.session(use_gpu=False, config=default_config):
+      table = de.CuckooHashTable(dtypes.int64,
+                                 dtypes.float32,
+                                 default_value=[-1.0] * dim,
+                                 name="hot_swap_t1",
+                                 config=de.CuckooHashTableConfig(hot_swap=True))
+      self.evaluate(table.insert(old_keys, old_values))
+      old_lookup = table.lookup(old_keys)
+      self.assertAllClose(old_values, self.evaluate(old_lookup))
+
+      self.evaluate(
+          table.saveable.restore([
+              constant_op.constant(new_keys),
+              constant_op.constant(new_values)
+          ], None))
+      self.assertAllEqual(100, self.evaluate(table.size()))
+      values, exists = self.evaluate(
+          table.lookup(old_keys, return_exists=True))
+      self.assertAllEqual([False] * 50 + [True] * 50, exists)
+      self.assertAllClose(new_values[:50], values[50:])
+
+  @test_util.run_in_graph_and_eager_modes()
+  def test_sample(self):
+    dim = 2
+    np_keys = np.arange(0, 10000, dtype=np.int64)
+    np_values = np.stack([np_keys, -np_keys], axis=1).astype(np.float32)
+    with self.session(use_gpu=False, config=default_config):
+      table = de.CuckooHashTable(dtypes.int64,
+                                 dtypes.float32,
+                                 default_value=[-1.0] * dim,
+                                 name="sample_t1",
+                                 checkpoint=False)
+      keys, values = self.evaluate(table.sample(100))
+      self.assertAllEqual([0, dim], [keys.size, values.shape[1]])
+
+      self.evaluate(table.insert(np_keys, np_values))
+      self.evaluate(table.remove(np_keys[5000:]))
+      keys, values = self.evaluate(table.sample(4000, seed=7))
+      self.assertEqual(4000, keys.size)
+      self.assertTrue(np.all(keys < 5000))
+      self.assertAllClose(np_values[keys], values)
+      # Both halves of the remaining keys are sampled alike.
+      self.assertNear(0.5, np.mean(keys < 2500), 0.05)
+      self.assertAllEqual(keys, self.evaluate(table.sample(4000, seed=7))[0])
+
+      keys, values = self.evaluate(table.sample(10, with_values=False))
+      self.assertAllEqual([10, 0, dim], [keys.size] + list(values.shape))
+
+  @test_util.run_in_graph_and_eager_modes()
+  def test_stats(self):
+    dim = 2
+    np_keys = np.arange(0, 1000, dtype=np.int64)
+    np_values = np.ones((1000, dim), dtype=np.float32)
+    with self.session(use_gpu=False, config=default_config):
+      table = de.CuckooHashTable(dtypes.int64,
+                                 dtypes.float32,
+                                 default_value=[-1.0] * dim,
+                                 name="stats_t1",
+                                 checkpoint=False,
+                                 init_size=64)
+
+      def read_stats(**kwargs):
+        names, values, depths, acquisitions, contended, spins = self.evaluate(
+            table.stats(**kwargs))
+        stats = dict(zip([n.decode() for n in names], values))
+        return stats, depths, acquisitions, contended, spins
+
+      self.evaluate(table.insert(np_keys, np_values))
+      stats, depths, acquisitions, _, spins = read_stats(reset=True)
+      self.assertEqual(1000, stats["size"])
+      self.assertNear(stats["size"] / stats["capacity"], stats["load_factor"],
+                      1e-6)
+      self.assertEqual(stats["capacity"], 4 * stats["bucket_count"])
+      self.assertGreater(stats["resizes"], 0)
+      self.assertGreaterEqual(stats["lock_acquisitions"], 1000)
+      self.assertLessEqual(np.sum(depths), 1000)
+      self.assertEqual(0, acquisitions.size)
+      self.assertEqual(0, spins.size)
+
+      self.evaluate(table.lookup(np_keys[:300]))
+      self.evaluate(table.lookup(np_keys[:100] + 1000))
+      stats, _, acquisitions, contended, spins = read_stats(per_lock=True)
+      self.assertEqual(300, stats["hits"])
+      self.assertEqual(100, stats["misses"])
+      self.assertNear(0.75, stats["hit_ratio"], 1e-6)
+      self.assertEqual(0, stats["resizes"])
+      self.assertEqual(acquisitions.size, contended.size)
+      self.assertEqual(stats["lock_acquisitions"], np.sum(acquisitions))
+      self.assertEqual(acquisitions.size, spins.size)
+      self.assertEqual(stats["contended_spins"], np.sum(spins))
+
+      stats, _, _, _, _ = read_stats(reset=True)
+      self.assertEqual(300, stats["hits"])
+      stats, _, _, _, _ = read_stats()
+      self.assertEqual(0, stats["hits"])
+      self.assertEqual(0, stats["misses"])
+
+  @test_util.run_in_graph_and_eager_modes()
+  def test_reshard_table_files(self):
+    dim = 3
+    record = np.dtype([("key", np.int64), ("value", np.float32, (dim,))])
+    records = np.zeros(3000, dtype=record)
+    records["key"] = np.random.permutation(np.arange(-1000, 2000))
+    records["value"] = np.random.rand(3000, dim)
+    input_files = []
+    for i, part in enumerate(np.array_split(records, 3)):
+      filepath = os.path.join(self.get_temp_dir(), "reshard_in_%d" % i)
+      part.tofile(filepath)
+      input_files.append(filepath)
+
+    def read_sorted(files):
+      merged = np.concatenate([np.fromfile(f, dtype=record) for f in files])
+      return merged[merged["key"].argsort()]
+
+    with self.session(use_gpu=False, config=default_config):
+      prefix = os.path.join(self.get_temp_dir(), "reshard_out")
+      files, counts = self.evaluate(
+          de.reshard_table_files(input_files,
+                                 prefix,
+                                 4,
+                                 dtypes.int64,
+                                 dtypes.float32,
+                                 dim,
+                                 buffer_size=1000))
+      files = [f.decode() for f in files]
+      self.assertEqual("%s-00003-of-00004" % prefix, files[3])
+      self.assertAllEqual([750] * 4, counts)
+      for m, f in enumerate(files):
+        self.assertAllEqual(m, np.fromfile(f, dtype=record)["key"] % 4)
+      expected = records[records["key"].argsort()]
+      resharded = read_sorted(files)
+      self.assertAllEqual(expected["key"], resharded["key"])
+      self.assertAllClose(expected["value"], resharded["value"])
+
+      # Through compressed files, back to raw ones.
+      zlib_files, _ = self.evaluate(
+          de.reshard_table_files(files,
+                                 prefix + "_zlib",
+                                 3,
+                                 dtypes.int64,
+                                 dtypes.float32,
+                                 dim,
+                                 compression="zlib"))
+      raw_files, counts = self.evaluate(
+          de.reshard_table_files(zlib_files, prefix + "_raw", 2, dtypes.int64,
+                                 dtypes.float32, dim))
+      self.assertAllEqual([1500, 1500], counts)
+      resharded = read_sorted([f.decode() for f in raw_files])
+      self.assertAllEqual(expected["key"], resharded["key"])
+      self.assertAllClose(expected["value"], resharded["value"])
+
+  @test_util.run_in_graph_and_eager_modes()
+  def test_compressed_snapshot_codecs(self):
+    dim = 4
+    record = np.dtype([("key", np.int64), ("value", np.float32, (dim,))])
+    records = np.zeros(100000, dtype=record)
+    records["key"] = np.random.permutation(np.arange(-50000, 50000))
+    records["value"] = np.random.rand(100000, dim)
+    raw_file = os.path.join(self.get_temp_dir(), "codec_in")
+    records.tofile(raw_file)
+    expected = records[records["key"].argsort()]
+
+    with self.session(use_gpu=False, config=default_config):
+      for compression in ["snappy", "zlib"]:
+        prefix = os.path.join(self.get_temp_dir(), "codec_" + compression)
+        try:
+          files, _ = self.evaluate(
+              de.reshard_table_files([raw_file],
+                                     prefix,
+                                     1,
+                                     dtypes.int64,
+                                     dtypes.float32,
+                                     dim,
+                                     compression=compression))
+        except errors_impl.UnimplementedError:
+          continue
+        compressed_file = files[0].decode()
+        with open(compressed_file, "rb") as f:
+          content = f.read()
+        self.assertEqual(b"TFRACBLK", content[:8])
+        self.assertLess(len(content), records.nbytes)
+
+        raw_files, counts = self.evaluate(
+            de.reshard_table_files([compressed_file], prefix + "_raw", 1,
+                                   dtypes.int64, dtypes.float32, dim))
+        self.assertAllEqual([100000], counts)
+        loaded = np.fromfile(raw_files[0].decode(), dtype=record)
+        loaded = loaded[loaded["key"].argsort()]
+        self.assertAllEqual(expected["key"], loaded["key"])
+        self.assertAllEqual(expected["value"], loaded["value"])
+
+        # A block length past the end of the file, a flipped payload byte
+        # and a truncated file all fail as data loss.
+        header_bytes = 24
+        oversized = bytearray(content)
+        oversized[header_bytes + 4:header_bytes + 8] = b"\xf0\xff\xff\xff"
+        flipped = bytearray(content)
+        flipped[header_bytes + 40] ^= 0xff
+        truncated = content[:len(content) // 2]
+        for i, corrupt in enumerate([oversized, flipped, truncated]):
+          corrupt_file = "%s_corrupt_%d" % (prefix, i)
+          with open(corrupt_file, "wb") as f:
+            f.write(corrupt)
+          with self.assertRaises(errors_impl.DataLossError):
+            self.evaluate(
+                de.reshard_table_files([corrupt_file],
+                                       "%s_out_%d" % (prefix, i), 1,
+                                       dtypes.int64, dtypes.float32, dim))
+
+  @test_util.run_in_graph_and_eager_modes()
+  def test_memory_budget(self):
+    dim = 32
+    np_keys = np.arange(0, 200000, dtype=np.int64)
+    np_values = np.random.rand(200000, dim).astype(np.float32)
+    with self.session(use_gpu=False, config=default_config):
+      table = de.CuckooHashTable(
+          dtypes.int64,
+          dtypes.float32,
+          default_value=[-1.0] * dim,
+          name="budget_t1",
+          checkpoint=False,
+          init_size=1024,
+          config=de.CuckooHashTableConfig(memory_budget=16 * 1024 * 1024))
+      self.evaluate(table.insert(np_keys[:1000], np_values[:1000]))
+      with self.assertRaises(errors_impl.ResourceExhaustedError):
+        self.evaluate(table.insert(np_keys, np_values))
+      self.assertAllEqual(1000, self.evaluate(table.size()))
+
+      # Updating the keys already in the table needs no more memory.
+      self.evaluate(table.insert(np_keys[:1000], np_values[1000:2000]))
+      self.assertAllClose(np_values[1000:2000],
+                          self.evaluate(table.lookup(np_keys[:1000])))
+
+  @test_util.run_in_graph_and_eager_modes()
+  def test_hashtable_allocators(self):
+    dim = 8
+    np_keys = np.arange(0, 100000, dtype=np.int64)
+    np_values = np.random.rand(100000, dim).astype(np.float32)
+    for allocator in ["default", "thp", "hugepage_2m", "tf"]:
+      os.environ["TFRA_HASHTABLE_ALLOCATOR"] = allocator
+      try:
+        with self.session(use_gpu=False, config=default_config):
+          with self.captureWritesToStream(sys.stderr) as printed:
+            table = de.CuckooHashTable(dtypes.int64,
+                                       dtypes.float32,
+                                       default_value=[-1.0] * dim,
+                                       name="alloc_t_" + allocator,
+                                       checkpoint=False)
+            self.evaluate(table.insert(np_keys, np_values))
+          self.assertTrue("allocator=" + allocator in printed.contents())
+          self.assertAllEqual(100000, self.evaluate(table.size()))
+          query = constant_op.constant([0, 99999, 100000], dtypes.int64)
+          values = self.evaluate(table.lookup(query))
+          self.assertAllClose(np_values[0], values[0])
+          self.assertAllClose(np_values[99999], values[1])
+          self.assertAllClose([-1.0] * dim, values[2])
+      finally:
+        del os.environ["TFRA_HASHTABLE_ALLOCATOR"]
+
+  @test_util.run_in_graph_and_eager_modes()
+  def test_frozen_hashtable(self):
+    dim = 4
+    num = 1000
+    np_keys = np.arange(0, num * 3, 3, dtype=np.int64)
+    np_values = np.random.rand(num, dim).astype(np.float32)
+    query = constant_op.constant([0, 1, 3, 2997, 3000], dtype=dtypes.int64)
+    expected_exists = [True, False, True, True, False]
+
+    with self.session(use_gpu=False, config=default_config):
+      table = de.FrozenHashTable(dtypes.int64,
+                                 dtypes.float32,
+                                 default_value=[-1.0] * dim,
+                                 name="frozen_t1",
+                                 checkpoint=False)
+      self.evaluate(table.build(np_keys, np_values))
+      self.assertAllEqual(num, self.evaluate(table.size()))
+
+      values, exists = self.evaluate(table.lookup(query, return_exists=True))
+      self.assertAllEqual(expected_exists, exists)
+      self.assertAllClose(np_values[0], values[0])
+      self.assertAllClose([-1.0] * dim, values[1])
+      self.assertAllClose(np_values[999], values[3])
+
+      filepath = os.path.join(self.get_temp_dir(), "frozen_t1.img")
+      self.evaluate(table.save(filepath))
+      mapped = de.FrozenHashTable(dtypes.int64,
+                                  dtypes.float32,
+                                  default_value=[-1.0] * dim,
+                                  name="frozen_t2",
+                                  checkpoint=False)
+      self.evaluate(mapped.load(filepath))
+      mapped_values = self.evaluate(mapped.lookup(query))
+      self.assertAllClose(values, mapped_values)
+
+      load_keys, load_values = self.evaluate(mapped.export())
+      sort_idx = load_keys.argsort()
+      self.assertAllEqual(np_keys, load_keys[sort_idx])
+      self.assertAllClose(np_values, load_values[sort_idx])
+
+      # Built straight from a file of raw records.
+      record = np.dtype([("key", np.int64), ("value", np.float32, (dim,))])
+      records = np.zeros(num, dtype=record)
+      records["key"] = np_keys
+      records["value"] = np_values
+      records_path = os.path.join(self.get_temp_dir(), "frozen_t1.records")
+      records.tofile(records_path)
+      self.evaluate(mapped.load(records_path))
+      self.assertAllClose(values, self.evaluate(mapped.lookup(query)))
+
+      # An image whose capacity runs past its end is rejected.
+      with open(filepath, "rb") as f:
+        image = bytearray(f.read())
+      image[32:40] = np.array([1 << 40], dtype=np.uint64).tobytes()
+      corrupt_path = os.path.join(self.get_temp_dir(), "frozen_t1.corrupt")
+      with open(corrupt_path, "wb") as f:
+        f.write(image)
+      with self.assertRaises(errors_impl.DataLossError):
+        self.evaluate(mapped.load(corrupt_path))
+
 
 if __name__ == "__main__":
   test.main()
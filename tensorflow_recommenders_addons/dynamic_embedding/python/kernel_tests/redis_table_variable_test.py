@@ -29,6 +29,7 @@ import platform
 import six
 import sys
 import tempfile
+import time
 
 from tensorflow_recommenders_addons import dynamic_embedding as de
 from tensorflow_recommenders_addons.utils.check_platform import is_windows, is_macos, is_arm64, is_linux, is_raspi_arm
@@ -38,6 +39,7 @@ from tensorflow.python.client import session
 from tensorflow.python.eager import context
 from tensorflow.python.framework import constant_op
 from tensorflow.python.framework import dtypes
+from tensorflow.python.framework import errors_impl
 from tensorflow.python.framework import ops
 from tensorflow.python.framework import sparse_tensor
 from tensorflow.python.framework import test_util
@@ -312,6 +314,66 @@ def _redis_health_check(redis_host_ip="127.0.0.1", redis_host_port=6379):
   return ping_return == 'PONG\n'
 
 
+def _redis_cli(command):
+  return os.popen('redis-cli -h ' + redis_config_params["redis_host_ip"][0] +
+                  ' -p ' + str(redis_config_params["redis_host_port"][0]) +
+                  ' ' + command).read()
+
+
+def _redis_hash_rows(pattern):
+  """Counts the fields of the Redis hashes whose names match pattern."""
+  return int(
+      _redis_cli('EVAL "local n = 0 '
+                 'for _, k in ipairs(redis.call(\'KEYS\', ARGV[1])) do '
+                 'if redis.call(\'TYPE\', k).ok == \'hash\' then '
+                 'n = n + redis.call(\'HLEN\', k) end end '
+                 'return n" 0 \'' + pattern + '\''))
+
+
+def _redis_delete_keys(pattern):
+  _redis_cli('EVAL "for _, k in ipairs(redis.call(\'KEYS\', ARGV[1])) do '
+             'redis.call(\'DEL\', k) end" 0 \'' + pattern + '\'')
+
+
+def _redis_cli_at(host, port, command):
+  return os.popen('redis-cli -h ' + host + ' -p ' + str(port) + ' ' +
+                  command).read()
+
+
+def _redis_cluster_masters():
+  """Returns (node id, host, port, slot ranges) of the masters of the Redis
+  cluster named by TFRA_REDIS_CLUSTER as "host:port[,host:port...]"."""
+  nodes = os.environ.get('TFRA_REDIS_CLUSTER', '')
+  if not nodes:
+    return []
+  host, port = nodes.split(',')[0].rsplit(':', 1)
+  masters = []
+  for line in _redis_cli_at(host, port, 'CLUSTER NODES').splitlines():
+    fields = line.split()
+    if len(fields) < 8 or 'master' not in fields[2].split(','):
+      continue
+    node_host, node_port = fields[1].split('@')[0].rsplit(':', 1)
+    ranges = []
+    for slots in fields[8:]:
+      if slots.startswith('['):
+        continue
+      first, _, last = slots.partition('-')
+      ranges.append((int(first), int(last or first)))
+    masters.append((fields[0], node_host, int(node_port), ranges))
+  return masters
+
+
+def _redis_config_with(**params):
+  """Returns a RedisTableConfig of redis_config_params updated by params."""
+  config_params = copy.deepcopy(redis_config_params)
+  config_params.update(params)
+  config_path = os.path.join(
+      tempfile.mkdtemp(dir=os.environ.get('TEST_TMPDIR')), "redis_config.json")
+  with open(config_path, 'w', encoding='utf-8') as f:
+    f.write(json.dumps(config_params, indent=2, ensure_ascii=True))
+  return de.RedisTableConfig(redis_config_abs_dir=config_path)
+
+
 @test_util.run_all_in_graph_and_eager_modes
 class RedisVariableTest(test.TestCase):
 
@@ -1867,6 +1929,556 @@ class RedisVariableTest(test.TestCase):
         self.evaluate(table.size())
 
 
+  def test_async_client_matches_blocking(self):
+    if _redis_health_check(redis_config_params["redis_host_ip"][0],
+                           redis_config_params["redis_host_port"][0]) == False:
+      self.skipTest('skip redis test when unable to access the redis service.')
+    dim = 8
+    keys = constant_op.constant(np.arange(0, 2000, 2, dtype=np.int64),
+                                dtypes.int64)
+    values = constant_op.constant(
+        np.arange(1000 * dim, dtype=np.float32).reshape(1000, dim),
+        dtypes.float32)
+    lookup_keys = constant_op.constant(np.arange(2000, dtype=np.int64),
+                                       dtypes.int64)
+    results = []
+    for async_client in [False, True]:
+      with self.session(config=default_config, use_gpu=False):
+        config = _redis_config_with(storage_slice=4,
+                                    redis_async_client=async_client,
+                                    redis_async_client_threads=2)
+        table = de.get_variable('tAsync-' + str(async_client) +
+                                '_test_async_client_matches_blocking',
+                                dtypes.int64,
+                                dtypes.float32,
+                                initializer=-1.0,
+                                dim=dim,
+                                devices=["/CPU:0"],
+                                kv_creator=de.RedisTableCreator(config=config))
+        self.evaluate(table.clear())
+        self.evaluate(table.upsert(keys, values))
+        self.assertAllEqual(1000, self.evaluate(table.size()))
+        results.append(
+            self.evaluate(table.lookup(lookup_keys, return_exists=True)))
+        self.evaluate(table.clear())
+        del table
+
+    blocking_values, blocking_exists = results[0]
+    async_values, async_exists = results[1]
+    self.assertAllEqual(blocking_values, async_values)
+    self.assertAllEqual(blocking_exists, async_exists)
+    self.assertAllEqual(np.arange(2000) % 2 == 0, async_exists)
+
+  def _skip_without_packed_commands(self):
+    if _redis_health_check(redis_config_params["redis_host_ip"][0],
+                           redis_config_params["redis_host_port"][0]) == False:
+      self.skipTest('skip redis test when unable to access the redis service.')
+    if 'BPV2' not in _redis_cli('MODULE LIST'):
+      self.skipTest('skip packed command test when the BPV2 module of '
+                    'third_party/redis_module is not loaded.')
+
+  def test_packed_commands_round_trip(self):
+    self._skip_without_packed_commands()
+    dim = 4
+    keys = constant_op.constant(np.arange(100, dtype=np.int64), dtypes.int64)
+    values = np.arange(100 * dim, dtype=np.float32).reshape(100, dim)
+    lookup_keys = constant_op.constant(np.arange(200, dtype=np.int64),
+                                       dtypes.int64)
+    with self.session(config=default_config, use_gpu=False):
+      config = _redis_config_with(storage_slice=2, using_packed_commands=True)
+      table = de.get_variable('tPacked_test_packed_commands_round_trip',
+                              dtypes.int64,
+                              dtypes.float32,
+                              initializer=-1.0,
+                              dim=dim,
+                              devices=["/CPU:0"],
+                              kv_creator=de.RedisTableCreator(config=config))
+      self.evaluate(table.clear())
+      self.evaluate(
+          table.upsert(keys, constant_op.constant(values, dtypes.float32)))
+      found, exists = self.evaluate(
+          table.lookup(lookup_keys, return_exists=True))
+      self.assertAllEqual(values, found[:100])
+      self.assertAllEqual(np.full((100, dim), -1, dtype=np.float32),
+                          found[100:])
+      self.assertAllEqual(np.arange(200) < 100, exists)
+      self.evaluate(table.clear())
+      del table
+
+  def test_packed_commands_accum(self):
+    self._skip_without_packed_commands()
+    dim = 4
+    keys = constant_op.constant(np.arange(4, dtype=np.int64), dtypes.int64)
+    values = np.arange(4 * dim, dtype=np.float32).reshape(4, dim)
+    deltas = np.ones((4, dim), dtype=np.float32)
+    with self.session(config=default_config, use_gpu=False):
+      config = _redis_config_with(storage_slice=2, using_packed_commands=True)
+      table = de.get_variable('tPacked_test_packed_commands_accum',
+                              dtypes.int64,
+                              dtypes.float32,
+                              initializer=-1.0,
+                              dim=dim,
+                              devices=["/CPU:0"],
+                              kv_creator=de.RedisTableCreator(config=config))
+      self.evaluate(table.clear())
+      self.evaluate(
+          table.upsert(keys[:2], constant_op.constant(values[:2],
+                                                      dtypes.float32)))
+      # Rows 0 and 1 exist and take the deltas, rows 2 and 3 are inserted
+      # with them.
+      self.evaluate(table.tables[0].accum(
+          keys, constant_op.constant(deltas, dtypes.float32),
+          constant_op.constant([True, True, False, False], dtypes.bool)))
+      self.assertAllEqual(np.concatenate([values[:2] + 1, deltas[2:]]),
+                          self.evaluate(table.lookup(keys)))
+      self.evaluate(table.clear())
+      del table
+
+  def test_packed_commands_reject_malformed_sizes(self):
+    self._skip_without_packed_commands()
+    key = 'tPacked_test_packed_commands_reject_malformed_sizes'
+    self.assertIn('Invalid field_bytes or value_bytes',
+                  _redis_cli('HMGETPACKED ' + key + ' 4 0 abcd'))
+    self.assertIn('Invalid field_bytes or value_bytes',
+                  _redis_cli('HMGETPACKED ' + key + ' 0 4 abcd'))
+    self.assertIn('Invalid fields length',
+                  _redis_cli('HMGETPACKED ' + key + ' 4 4 abcdef'))
+    # n * value_bytes does not fit in a size_t.
+    self.assertIn(
+        'Invalid field_bytes or value_bytes',
+        _redis_cli('HMGETPACKED ' + key + ' 1 9223372036854775807 ab'))
+    self.assertIn('Invalid fields length',
+                  _redis_cli('HMSETPACKED ' + key + ' 4 4 abcdef 12345678'))
+    self.assertIn('Invalid values length',
+                  _redis_cli('HMSETPACKED ' + key + ' 4 4 abcd 123'))
+    self.assertIn(
+        'Invalid values length',
+        _redis_cli('HMSETPACKED ' + key + ' 1 9223372036854775807 ab c'))
+    self.assertIn(
+        'Invalid exists length',
+        _redis_cli('HMACCUMPACKED ' + key + ' float 4 4 abcd 1234 xy'))
+    self.assertIn(
+        'Invalid values length',
+        _redis_cli('HMACCUMPACKED ' + key +
+                   ' float 1 9223372036854775807 ab c xy'))
+    self.assertEqual('0\n', _redis_cli('EXISTS ' + key))
+
+  def test_near_cache(self):
+    if _redis_health_check(redis_config_params["redis_host_ip"][0],
+                           redis_config_params["redis_host_port"][0]) == False:
+      self.skipTest('skip redis test when unable to access the redis service.')
+    dim = 4
+    name = 'tNearCache_test_near_cache'
+    keys = constant_op.constant(np.arange(4, dtype=np.int64), dtypes.int64)
+    values = np.arange(4 * dim, dtype=np.float32).reshape(4, dim)
+    missing = np.full((4, dim), -1, dtype=np.float32)
+    with self.session(config=default_config, use_gpu=False):
+      config = _redis_config_with(near_cache_capacity=1024,
+                                  near_cache_ttl_in_seconds=1)
+      table = de.get_variable(name,
+                              dtypes.int64,
+                              dtypes.float32,
+                              initializer=-1.0,
+                              dim=dim,
+                              devices=["/CPU:0"],
+                              kv_creator=de.RedisTableCreator(config=config))
+      self.evaluate(table.clear())
+      self.evaluate(
+          table.upsert(keys, constant_op.constant(values, dtypes.float32)))
+      self.assertAllEqual(values, self.evaluate(table.lookup(keys)))
+
+      # The rows are now served by the near cache, even once Redis has lost
+      # them.
+      _redis_delete_keys('*' + name + '*')
+      self.assertAllEqual(values, self.evaluate(table.lookup(keys)))
+
+      # An accum drops its rows from the near cache. They do not exist in
+      # Redis any more, so it does not insert them either.
+      self.evaluate(table.tables[0].accum(
+          keys[:2], constant_op.constant(np.ones((2, dim), dtype=np.float32)),
+          constant_op.constant([True, True], dtypes.bool)))
+      self.assertAllEqual(np.concatenate([missing[:2], values[2:]]),
+                          self.evaluate(table.lookup(keys)))
+
+      # The other rows expire after near_cache_ttl_in_seconds.
+      time.sleep(2)
+      self.assertAllEqual(missing, self.evaluate(table.lookup(keys)))
+      self.evaluate(table.clear())
+      del table
+
+  def test_write_behind(self):
+    if _redis_health_check(redis_config_params["redis_host_ip"][0],
+                           redis_config_params["redis_host_port"][0]) == False:
+      self.skipTest('skip redis test when unable to access the redis service.')
+    dim = 4
+    name = 'tWriteBehind_test_write_behind'
+    keys = constant_op.constant(np.arange(4, dtype=np.int64), dtypes.int64)
+    expected = np.array([[0] * dim, [10] * dim, [3] * dim, [3] * dim],
+                        dtype=np.float32)
+    with self.session(config=default_config, use_gpu=False):
+      # Long enough that only flush writes the buffer to Redis.
+      config = _redis_config_with(using_write_behind=True,
+                                  write_behind_interval_in_ms=3600000)
+      table = de.get_variable(name,
+                              dtypes.int64,
+                              dtypes.float32,
+                              initializer=-1.0,
+                              dim=dim,
+                              devices=["/CPU:0"],
+                              kv_creator=de.RedisTableCreator(config=config))
+      self.evaluate(table.clear())
+      self.evaluate(
+          table.upsert(
+              keys[:3],
+              constant_op.constant([[0] * dim, [1] * dim, [2] * dim],
+                                   dtypes.float32)))
+      # Coalesced with the rows buffered above.
+      self.evaluate(
+          table.upsert(keys[1:2], constant_op.constant([[10] * dim],
+                                                       dtypes.float32)))
+      self.evaluate(table.tables[0].accum(
+          keys[2:], constant_op.constant([[1] * dim, [3] * dim],
+                                         dtypes.float32),
+          constant_op.constant([True, False], dtypes.bool)))
+
+      # Lookups see the buffered rows before Redis holds any of them.
+      self.assertEqual(0, _redis_hash_rows('*' + name + '*'))
+      self.assertAllEqual(expected, self.evaluate(table.lookup(keys)))
+
+      self.evaluate(table.tables[0].flush())
+      self.assertEqual(4, _redis_hash_rows('*' + name + '*'))
+      # Each accum is applied once, whether it was still buffered or not.
+      self.assertAllEqual(expected, self.evaluate(table.lookup(keys)))
+
+      exported_keys, exported_values = self.evaluate(table.export())
+      order = np.argsort(exported_keys)
+      self.assertAllEqual(np.arange(4), exported_keys[order])
+      self.assertAllEqual(expected, exported_values[order])
+      self.evaluate(table.clear())
+      del table
+
+  def test_write_behind_delta_after_missing_value(self):
+    if _redis_health_check(redis_config_params["redis_host_ip"][0],
+                           redis_config_params["redis_host_port"][0]) == False:
+      self.skipTest('skip redis test when unable to access the redis service.')
+    dim = 2
+    name = 'tWriteBehind_test_write_behind_delta_after_missing_value'
+    keys = constant_op.constant([0, 1], dtypes.int64)
+    # Key 0 is in Redis and takes only the delta, key 1 is missing and takes
+    # the value and the delta.
+    expected = np.array([[6] * dim, [8] * dim], dtype=np.float32)
+    with self.session(config=default_config, use_gpu=False):
+      config = _redis_config_with(using_write_behind=True,
+                                  write_behind_interval_in_ms=3600000)
+      table = de.get_variable(name,
+                              dtypes.int64,
+                              dtypes.float32,
+                              initializer=-1.0,
+                              dim=dim,
+                              devices=["/CPU:0"],
+                              kv_creator=de.RedisTableCreator(config=config))
+      self.evaluate(table.clear())
+      self.evaluate(
+          table.upsert(keys[:1], constant_op.constant([[5] * dim],
+                                                      dtypes.float32)))
+      self.evaluate(table.tables[0].flush())
+      self.evaluate(table.tables[0].accum(
+          keys, constant_op.constant([[7] * dim, [7] * dim], dtypes.float32),
+          constant_op.constant([False, False], dtypes.bool)))
+      self.evaluate(table.tables[0].accum(
+          keys, constant_op.constant([[1] * dim, [1] * dim], dtypes.float32),
+          constant_op.constant([True, True], dtypes.bool)))
+
+      self.assertAllEqual(expected, self.evaluate(table.lookup(keys)))
+      self.evaluate(table.tables[0].flush())
+      self.assertAllEqual(expected, self.evaluate(table.lookup(keys)))
+      self.evaluate(table.clear())
+      del table
+
+  def _sparse_apply_table(self, name, config, dim):
+    table = de.get_variable(name,
+                            dtypes.int64,
+                            dtypes.float32,
+                            initializer=-1.0,
+                            dim=dim,
+                            devices=["/CPU:0"],
+                            kv_creator=de.RedisTableCreator(config=config))
+    self.evaluate(table.clear())
+    return table
+
+  def _check_sparse_apply(self, optimizer, reference, slot_names,
+                          hyperparams):
+    """Runs two steps of sparse_apply against reference on dense rows."""
+    self._skip_without_packed_commands()
+    if not context.executing_eagerly():
+      self.skipTest('Test in eager mode only.')
+    dim = 3
+    init = np.random.rand(4, dim).astype(np.float32)
+    # Key 3 joins in the second step, when the slots of the others exist.
+    # Key 9 is not in the table and is left out.
+    steps = [[0, 1, 2, 9], [0, 1, 3, 9]]
+    name = 'tSparseApply_' + optimizer
+    config = _redis_config_with(storage_slice=2)
+    with self.session(config=default_config, use_gpu=False):
+      table = self._sparse_apply_table(name, config, dim)
+      slots = [
+          self._sparse_apply_table(name + '_' + slot, config, dim)
+          for slot in slot_names
+      ]
+      self.evaluate(
+          table.upsert(constant_op.constant(np.arange(4), dtypes.int64),
+                       constant_op.constant(init, dtypes.float32)))
+      var = variables.Variable(init)
+      for t, step_keys in enumerate(steps, 1):
+        grads = np.random.rand(len(step_keys), dim).astype(np.float32)
+        dense_grads = np.zeros((4, dim), dtype=np.float32)
+        for key, grad in zip(step_keys, grads):
+          if key < 4:
+            dense_grads[key] = grad
+        reference.apply_gradients([(constant_op.constant(dense_grads), var)])
+        self.evaluate(table.tables[0].sparse_apply(
+            constant_op.constant(step_keys, dtypes.int64),
+            constant_op.constant(grads, dtypes.float32),
+            optimizer,
+            hyperparams(t),
+            slots=[slot.tables[0] for slot in slots]))
+
+      lookup_keys = constant_op.constant([0, 1, 2, 3, 9], dtypes.int64)
+      values, exists = self.evaluate(
+          table.lookup(lookup_keys, return_exists=True))
+      self.assertAllEqual([True] * 4 + [False], exists)
+      self.assertAllClose(self.evaluate(var), values[:4], rtol=1e-5, atol=1e-6)
+      for slot, slot_name in zip(slots, slot_names):
+        slot_values, slot_exists = self.evaluate(
+            slot.lookup(lookup_keys, return_exists=True))
+        self.assertAllEqual([True] * 4 + [False], slot_exists)
+        self.assertAllClose(self.evaluate(reference.get_slot(var, slot_name)),
+                            slot_values[:4],
+                            rtol=1e-5,
+                            atol=1e-6)
+      for created in [table] + slots:
+        self.evaluate(created.clear())
+
+  def test_sparse_apply_sgd(self):
+    self._check_sparse_apply('sgd', optimizer_v2.gradient_descent.SGD(0.1),
+                             [], lambda t: [0.1])
+
+  def test_sparse_apply_adagrad(self):
+    self._check_sparse_apply(
+        'adagrad',
+        optimizer_v2.adagrad.Adagrad(0.1,
+                                     initial_accumulator_value=0.2,
+                                     epsilon=1e-7), ['accumulator'],
+        lambda t: [0.1, 0.2, 1e-7])
+
+  def test_sparse_apply_adam(self):
+    lr, beta1, beta2, epsilon = 0.1, 0.9, 0.999, 1e-7
+
+    def hyperparams(t):
+      return [
+          lr * math.sqrt(1 - beta2**t) / (1 - beta1**t), beta1, beta2, epsilon
+      ]
+
+    self._check_sparse_apply(
+        'adam',
+        optimizer_v2.adam.Adam(lr,
+                               beta_1=beta1,
+                               beta_2=beta2,
+                               epsilon=epsilon), ['m', 'v'], hyperparams)
+
+  def test_sparse_apply_rejects_mismatched_slots(self):
+    self._skip_without_packed_commands()
+    keys = constant_op.constant([0, 1], dtypes.int64)
+    grads = constant_op.constant(np.ones((2, 2)), dtypes.float32)
+    with self.session(config=default_config, use_gpu=False):
+      name = 'tSparseApply_test_sparse_apply_rejects_mismatched_slots'
+      config = _redis_config_with(storage_slice=2)
+      table = self._sparse_apply_table(name, config, 2)
+      # Another storage_slice, then another value shape.
+      for slot_slice, slot_dim in [(4, 2), (2, 3)]:
+        slot = self._sparse_apply_table(
+            name + '_' + str(slot_slice) + '_' + str(slot_dim),
+            _redis_config_with(storage_slice=slot_slice), slot_dim)
+        with self.assertRaises(errors_impl.InvalidArgumentError):
+          self.evaluate(table.tables[0].sparse_apply(
+              keys, grads, 'adagrad', [0.1, 0.1, 1e-7],
+              slots=[slot.tables[0]]))
+        self.evaluate(slot.clear())
+        del slot
+      self.evaluate(table.clear())
+
+  def test_cluster_slot_migration(self):
+    if not context.executing_eagerly():
+      self.skipTest('Test in eager mode only.')
+    masters = _redis_cluster_masters()
+    if len(masters) < 2:
+      self.skipTest('skip slot migration test without a Redis cluster of two '
+                    'masters or more in TFRA_REDIS_CLUSTER.')
+    name = 'tCluster_test_cluster_slot_migration'
+    dim = 2
+    keys = constant_op.constant(np.arange(1000, dtype=np.int64), dtypes.int64)
+    values = np.stack([np.arange(1000), -np.arange(1000)],
+                      axis=1).astype(np.float32)
+    with self.session(config=default_config, use_gpu=False):
+      config = _redis_config_with(
+          redis_connection_mode=0,
+          redis_host_ip=[master[1] for master in masters],
+          redis_host_port=[master[2] for master in masters],
+          storage_slice=4,
+          redis_pipeline_per_node=True)
+      table = de.get_variable(name,
+                              dtypes.int64,
+                              dtypes.float32,
+                              initializer=-1.0,
+                              dim=dim,
+                              devices=["/CPU:0"],
+                              kv_creator=de.RedisTableCreator(config=config))
+      self.evaluate(table.clear())
+
+      def write_and_read(scale):
+        self.evaluate(
+            table.upsert(keys, constant_op.constant(values * scale,
+                                                    dtypes.float32)))
+        found, exists = self.evaluate(table.lookup(keys, return_exists=True))
+        self.assertAllEqual(values * scale, found)
+        self.assertTrue(np.all(exists))
+
+      write_and_read(1)
+      hash_name, source = next(
+          (hash_name, master) for master in masters
+          for hash_name in _redis_cli_at(master[1], master[2], "KEYS '*" +
+                                         name + "*'").split())
+      target = next(master for master in masters if master[0] != source[0])
+      slot = int(
+          _redis_cli_at(source[1], source[2],
+                        "CLUSTER KEYSLOT '" + hash_name + "'"))
+
+      # The hash is still on the source, which serves it.
+      _redis_cli_at(target[1], target[2],
+                    'CLUSTER SETSLOT %d IMPORTING %s' % (slot, source[0]))
+      _redis_cli_at(source[1], source[2],
+                    'CLUSTER SETSLOT %d MIGRATING %s' % (slot, target[0]))
+      write_and_read(2)
+
+      # The hash is on the target, and the source answers ASK for it.
+      _redis_cli_at(
+          source[1], source[2], "MIGRATE %s %d \"\" 0 5000 KEYS '%s'" %
+          (target[1], target[2], hash_name))
+      write_and_read(3)
+
+      # The slot belongs to the target, and the source answers MOVED.
+      for master in masters:
+        _redis_cli_at(master[1], master[2],
+                      'CLUSTER SETSLOT %d NODE %s' % (slot, target[0]))
+      write_and_read(4)
+      self.evaluate(table.clear())
+      del table
+
+  def test_export_chunks(self):
+    if _redis_health_check(redis_config_params["redis_host_ip"][0],
+                           redis_config_params["redis_host_port"][0]) == False:
+      self.skipTest('skip redis test when unable to access the redis service.')
+    if not context.executing_eagerly():
+      self.skipTest('Test in eager mode only.')
+    keys = np.arange(1000, dtype=np.int64)
+    values = np.stack([keys, -keys], axis=1).astype(np.float32)
+    with self.session(config=default_config, use_gpu=False):
+      config = _redis_config_with(storage_slice=4)
+      table = de.get_variable('tExportChunks_test_export_chunks',
+                              dtypes.int64,
+                              dtypes.float32,
+                              initializer=-1.0,
+                              dim=2,
+                              devices=["/CPU:0"],
+                              kv_creator=de.RedisTableCreator(config=config))
+      self.evaluate(table.clear())
+      self.evaluate(
+          table.upsert(constant_op.constant(keys, dtypes.int64),
+                       constant_op.constant(values, dtypes.float32)))
+
+      chunk_keys, chunk_values = [], []
+      for exported_keys, exported_values in table.tables[0].export_chunks(
+          max_rows=64):
+        chunk_keys.append(exported_keys.numpy())
+        chunk_values.append(exported_values.numpy())
+      exported_keys = np.concatenate(chunk_keys)
+      exported_values = np.concatenate(chunk_values)
+      # Every row once, in some order.
+      self.assertEqual(1000, len(exported_keys))
+      order = np.argsort(exported_keys)
+      self.assertAllEqual(keys, exported_keys[order])
+      self.assertAllEqual(values, exported_values[order])
+      self.evaluate(table.clear())
+      del table
+
+  def test_storage_mode_migration(self):
+    if _redis_health_check(redis_config_params["redis_host_ip"][0],
+                           redis_config_params["redis_host_port"][0]) == False:
+      self.skipTest('skip redis test when unable to access the redis service.')
+    if not context.executing_eagerly():
+      self.skipTest('Test in eager mode only.')
+    name = 'tStorageMode_test_storage_mode_migration'
+    dim = 2
+    keys = np.arange(500, dtype=np.int64)
+    values = np.stack([keys, -keys], axis=1).astype(np.float32)
+    lookup_keys = constant_op.constant(np.arange(1000, dtype=np.int64),
+                                       dtypes.int64)
+    _redis_delete_keys('*' + name + '*')
+
+    def _table(storage_mode):
+      config = _redis_config_with(storage_slice=2,
+                                  storage_mode=storage_mode,
+                                  storage_sub_slice=4)
+      # The same name each time, so that the table finds its hashes.
+      return de.Variable(key_dtype=dtypes.int64,
+                         value_dtype=dtypes.float32,
+                         dim=dim,
+                         name=name,
+                         initializer=-1.0,
+                         devices=["/CPU:0"],
+                         kv_creator=de.RedisTableCreator(config=config))
+
+    def _hashes():
+      return sorted(_redis_cli("KEYS '*" + name + "*'").split())
+
+    with self.session(config=default_config, use_gpu=False):
+      table = _table(0)
+      self.evaluate(
+          table.upsert(constant_op.constant(keys, dtypes.int64),
+                       constant_op.constant(values, dtypes.float32)))
+      hashes = _hashes()
+      self.assertEqual(2, len(hashes))
+      self.assertFalse(any('#' in h for h in hashes))
+      del table
+
+      # Every storage slice becomes 4 hashes, each with its own hash tag.
+      table = _table(1)
+      hashes = _hashes()
+      self.assertEqual(8, len(hashes))
+      self.assertTrue(all('#' in h for h in hashes))
+      tags = set(h[h.index('{'):h.index('}')] for h in hashes)
+      self.assertEqual(8, len(tags))
+      self.assertEqual(500, _redis_hash_rows('*' + name + '*'))
+      found, exists = self.evaluate(
+          table.lookup(lookup_keys, return_exists=True))
+      self.assertAllEqual(values, found[:500])
+      self.assertAllEqual(np.arange(1000) < 500, exists)
+      del table
+
+      # And back into one hash per storage slice.
+      table = _table(0)
+      hashes = _hashes()
+      self.assertEqual(2, len(hashes))
+      self.assertFalse(any('#' in h for h in hashes))
+      found, exists = self.evaluate(
+          table.lookup(lookup_keys, return_exists=True))
+      self.assertAllEqual(values, found[:500])
+      self.assertAllEqual(np.arange(1000) < 500, exists)
+      self.evaluate(table.clear())
+      del table
+    _redis_delete_keys('*' + name + '*')
+
+
 if __name__ == "__main__":
   if is_windows() == False:
     if os.popen("which redis-server").read() == '':
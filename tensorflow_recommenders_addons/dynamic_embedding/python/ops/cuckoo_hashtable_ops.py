@@ -76,6 +76,7 @@ class CuckooHashTable(LookupInterface):
             is shared using the table node name.
           init_size: initial size for the Variable and initial size of each hash
             tables will be int(init_size / N), N is the number of the devices.
+          config: An optional `CuckooHashTableConfig`.
 
         Returns:
           A `CuckooHashTable` object.
@@ -91,6 +92,9 @@ class CuckooHashTable(LookupInterface):
     self._value_dtype = value_dtype
     self._init_size = init_size
     self._name = name
+    self._change_log_capacity = getattr(config, "change_log_capacity", 0)
+    self._hot_swap = getattr(config, "hot_swap", False)
+    self._memory_budget = getattr(config, "memory_budget", 0)
 
     self._shared_name = None
     if context.executing_eagerly():
@@ -130,6 +134,9 @@ class CuckooHashTable(LookupInterface):
         value_dtype=self._value_dtype,
         value_shape=self._default_value.get_shape(),
         init_size=self._init_size,
+        change_log_capacity=self._change_log_capacity,
+        hot_swap=self._hot_swap,
+        memory_budget=self._memory_budget,
         name=self._name,
     )
 
@@ -156,6 +163,106 @@ class CuckooHashTable(LookupInterface):
       with ops.colocate_with(self.resource_handle):
         return cuckoo_ops.tfra_cuckoo_hash_table_size(self.resource_handle)
 
+  def shrink_to_fit(self, max_load_factor=0.5, name=None):
+    """Rehashes the table into a smaller bucket array, releasing memory.
+
+        The table is resized to the smallest bucket array keeping the load
+        factor at or below `max_load_factor`, but never below its `init_size`.
+        Useful after `remove` or `restrict` dropped a large part of the keys.
+        Setting the environment variable 'TFRA_HASHTABLE_SHRINK_LOAD_FACTOR'
+        (in [0, 0.5)) shrinks tables automatically whenever a removal leaves
+        them below the given load factor, to half of their bucket array or
+        less.
+
+        Args:
+          max_load_factor: the highest load factor allowed after shrinking,
+            in (0, 1].
+          name: A name for the operation (optional).
+
+        Returns:
+          A scalar bool tensor, True if the table shrank.
+        """
+    with ops.name_scope(name, "%s_shrink_to_fit" % self.name,
+                        [self.resource_handle]):
+      with ops.colocate_with(self.resource_handle):
+        return cuckoo_ops.tfra_cuckoo_hash_table_shrink(
+            self.resource_handle,
+            key_dtype=self._key_dtype,
+            value_dtype=self._value_dtype,
+            max_load_factor=max_load_factor)
+
+  def rehash_progress(self, name=None):
+    """Returns the progress of the migration started by the last resize.
+
+        When the table grows, its entries are moved to the larger bucket array
+        in the background and by the operations touching them, without
+        blocking lookups and inserts on the whole table.
+
+        Args:
+          name: A name for the operation (optional).
+
+        Returns:
+          A scalar float tensor with the migrated fraction, 1.0 when no
+            migration is in progress.
+        """
+    with ops.name_scope(name, "%s_rehash_progress" % self.name,
+                        [self.resource_handle]):
+      with ops.colocate_with(self.resource_handle):
+        return cuckoo_ops.tfra_cuckoo_hash_table_rehash_progress(
+            self.resource_handle,
+            key_dtype=self._key_dtype,
+            value_dtype=self._value_dtype)
+
+  def drain_change_log(self, filepath, name=None):
+    """Moves the changes recorded since the last drain to a file.
+
+        The table must be created with a positive `change_log_capacity` in its
+        `CuckooHashTableConfig`. Records are numbered by a sequence which
+        continues across drains.
+
+        Args:
+          filepath: The file to write, on any file system TensorFlow supports.
+          name: A name for the operation (optional).
+
+        Returns:
+          A tuple of scalar int64 tensors `(first_sequence, count, dropped)`,
+            where `dropped` counts the records overwritten in the ring since
+            the last drain. Replicas have to be rebuilt from a full export
+            when it is not zero.
+        """
+    with ops.name_scope(name, "%s_drain_change_log" % self.name,
+                        [self.resource_handle]):
+      with ops.colocate_with(self.resource_handle):
+        return cuckoo_ops.tfra_cuckoo_hash_table_drain_change_log(
+            self.resource_handle,
+            filepath,
+            key_dtype=self._key_dtype,
+            value_dtype=self._value_dtype)
+
+  def replay_change_log(self, filepath, name=None):
+    """Applies a file written by `drain_change_log` to this table.
+
+        Files must be replayed in the order they were drained. Records already
+        applied by an earlier replay are skipped.
+
+        Args:
+          filepath: A file written by `drain_change_log`.
+          name: A name for the operation (optional).
+
+        Returns:
+          A tuple of scalar int64 tensors `(last_sequence, missing)`, where
+            `missing` counts the records lost between the previous replay and
+            this file.
+        """
+    with ops.name_scope(name, "%s_replay_change_log" % self.name,
+                        [self.resource_handle]):
+      with ops.colocate_with(self.resource_handle):
+        return cuckoo_ops.tfra_cuckoo_hash_table_replay_change_log(
+            self.resource_handle,
+            filepath,
+            key_dtype=self._key_dtype,
+            value_dtype=self._value_dtype)
+
   def remove(self, keys, name=None):
     """Removes `keys` and its associated values from the table.
 
@@ -338,7 +445,74 @@ class CuckooHashTable(LookupInterface):
             self.resource_handle, self._key_dtype, self._value_dtype)
     return keys, values
 
-  def save_to_hdfs(self, filepath, buffer_size=4194304, name=None):
+  def sample(self, n, seed=0, with_values=True, name=None):
+    """Returns tensors of `n` entries sampled uniformly from the table.
+
+        The entries are sampled with replacement by probing random buckets of
+        the live table, so the cost grows with `n` rather than with the size
+        of the table, and concurrent updates keep running.
+
+        Args:
+          n: Number of entries to sample.
+          seed: A seed making the sample reproducible on an unchanged table,
+            or 0 for a fresh sample on every run.
+          with_values: Whether to return the values of the sampled keys.
+          name: A name for the operation (optional).
+
+        Returns:
+          A pair of tensors with the sampled keys and their values. Fewer
+            than `n` entries are returned when the table is empty or nearly
+            so, and the values tensor has no rows if `with_values` is False.
+        """
+    with ops.name_scope(name, "%s_lookup_table_sample" % self.name,
+                        [self.resource_handle]):
+      with ops.colocate_with(self.resource_handle):
+        keys, values = cuckoo_ops.tfra_cuckoo_hash_table_sample(
+            self.resource_handle,
+            ops.convert_to_tensor(n, dtype=dtypes.int64),
+            ops.convert_to_tensor(seed, dtype=dtypes.int64),
+            key_dtype=self._key_dtype,
+            value_dtype=self._value_dtype,
+            with_values=with_values)
+    return keys, values
+
+  def stats(self, per_lock=False, reset=False, name=None):
+    """Returns tensors with counters of the internals of the table.
+
+        Counters cover the time since the last reset, or since the table was
+        replaced by an import or load with `hot_swap`. The size, capacity,
+        bucket_count, load_factor and memory_bytes describe the table now.
+
+        Args:
+          per_lock: Whether to return the counters of every lock stripe.
+          reset: Whether to start the counters over after reading them.
+          name: A name for the operation (optional).
+
+        Returns:
+          A tuple of tensors `(names, values, cuckoo_path_depths,
+            lock_acquisitions, contended_acquisitions, contended_spins)`.
+            `values` are the doubles named by `names`, such as "hits",
+            "misses", "hit_ratio", "contended_spins", "resizes" or
+            "resize_seconds". `cuckoo_path_depths` counts the inserts which
+            found both their buckets full by the number of entries moved to
+            make room. The last three have one element per lock stripe if
+            `per_lock` is set, and none otherwise.
+        """
+    with ops.name_scope(name, "%s_lookup_table_stats" % self.name,
+                        [self.resource_handle]):
+      with ops.colocate_with(self.resource_handle):
+        return cuckoo_ops.tfra_cuckoo_hash_table_stats(
+            self.resource_handle,
+            key_dtype=self._key_dtype,
+            value_dtype=self._value_dtype,
+            per_lock=per_lock,
+            reset=reset)
+
+  def save_to_hdfs(self,
+                   filepath,
+                   buffer_size=4194304,
+                   compression=None,
+                   name=None):
     """
     Returns an operation to save the keys and values in table to
     filepath. The keys and values will be stored in HDFS, appended to the filepath.
@@ -346,6 +520,11 @@ class CuckooHashTable(LookupInterface):
       filepath: A path to save the table.
       name: Name for the operation.
       buffer_size: Number of kv pairs buffer write to file.
+      compression: None to write raw key/value records, or "snappy" or
+        "zlib" to write blocks of key-sorted, delta encoded and compressed
+        records, which are compressed in parallel. Only integer keys and
+        fixed size values can be compressed. `load_from_hdfs` reads both
+        formats.
     Returns:
       An operation to save the table.
     """
@@ -357,7 +536,8 @@ class CuckooHashTable(LookupInterface):
             filepath,
             key_dtype=self._key_dtype,
             value_dtype=self._value_dtype,
-            buffer_size=buffer_size)
+            buffer_size=buffer_size,
+            compression=compression or "")
 
   def load_from_hdfs(self, filepath, buffer_size=4194304, name=None):
     """
@@ -419,4 +599,52 @@ class CuckooHashTable(LookupInterface):
           )
 
 
+def reshard_table_files(input_files,
+                        output_prefix,
+                        num_shards,
+                        key_dtype,
+                        value_dtype,
+                        dim,
+                        partition="mod",
+                        compression=None,
+                        buffer_size=4194304,
+                        name=None):
+  """
+  Returns an operation redistributing the files saved by `save_to_hdfs` from
+  the shards of a table into `num_shards` files, for restoring the table on a
+  different number of shards without loading it. The files are streamed, so
+  memory stays bounded by `buffer_size` per reading thread whatever the size
+  of the table.
+  Args:
+    input_files: A list of files saved by `save_to_hdfs`, raw or compressed.
+    output_prefix: The output files are named
+      `<output_prefix>-<shard>-of-<num_shards>`, with 5 digits numbers.
+    num_shards: Number of output files.
+    key_dtype: The key data type of the table, an integer type.
+    value_dtype: The value data type of the table.
+    dim: The embedding dimension of the table.
+    partition: "mod" for keys mod num_shards, as `default_partition_fn` does,
+      or "mod_int32" for (keys & 0x7fffffff) mod num_shards, as it does for
+      int64 keys on GPU.
+    compression: None, "snappy" or "zlib", as for `save_to_hdfs`.
+    buffer_size: Bytes buffered to read every input file and to group the
+      records for the outputs.
+    name: Name for the operation.
+  Returns:
+    A tuple of the output file names and the number of records in each.
+  """
+  with ops.name_scope(name, "reshard_table_files",
+                      [input_files, output_prefix]):
+    return cuckoo_ops.tfra_cuckoo_hash_table_reshard(
+        input_files,
+        output_prefix,
+        key_dtype=key_dtype,
+        value_dtype=value_dtype,
+        value_dim=dim,
+        num_shards=num_shards,
+        partition=partition,
+        compression=compression or "",
+        buffer_size=buffer_size)
+
+
 ops.NotDifferentiable(prefix_op_name("CuckooHashTableOfTensors"))
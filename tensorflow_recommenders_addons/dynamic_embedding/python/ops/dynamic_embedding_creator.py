@@ -57,10 +57,33 @@ class KVCreator(object, metaclass=ABCMeta):
 
 class CuckooHashTableConfig(object):
 
-  def __init__(self):
-    """ CuckooHashTableConfig include nothing for parameter default satisfied.
+  def __init__(self, change_log_capacity=0, hot_swap=False, memory_budget=0):
+    """ CuckooHashTableConfig holds the optional properties of CPU tables.
+
+    Args:
+      change_log_capacity: If positive, every table records its inserts,
+        accumulations, removals and clears in a ring of this many records,
+        which `CuckooHashTable.drain_change_log` writes to files for
+        `CuckooHashTable.replay_change_log` to apply on serving replicas.
+        Only fixed size keys and values are supported.
+      hot_swap: If True, restoring a checkpoint into a table or loading a file
+        with `CuckooHashTable.load_from_hdfs` builds the next version of the
+        table aside and then swaps it in, so concurrent lookups keep seeing
+        the previous version instead of a partially loaded table. A loaded
+        file then replaces the contents of the table, as a restore does.
+        Inserts, accumulations and removals made while the next version is
+        built are not carried over to it. The old version is freed once the
+        lookups using it finish, and memory peaks at both versions
+        meanwhile.
+      memory_budget: If positive, the bytes every table may use. Inserts and
+        accumulations that could take a table over it, including the bucket
+        arrays alive while the table doubles, fail with
+        `ResourceExhaustedError` and leave the table unchanged, rather than
+        exhausting the memory of the host.
     """
-    pass
+    self.change_log_capacity = change_log_capacity
+    self.hot_swap = hot_swap
+    self.memory_budget = memory_budget
 
 
 class CuckooHashTableCreator(KVCreator):
@@ -81,7 +104,7 @@ class CuckooHashTableCreator(KVCreator):
     self.name = name
     self.checkpoint = checkpoint
     self.init_size = init_size
-    self.config = config
+    self.config = config or self.config
 
     return de.CuckooHashTable(
         key_dtype=key_dtype,
@@ -90,7 +113,7 @@ class CuckooHashTableCreator(KVCreator):
         name=name,
         checkpoint=checkpoint,
         init_size=init_size,
-        config=config,
+        config=self.config,
     )
 
   def get_config(self):
@@ -139,6 +162,8 @@ class RedisTableConfig(object):
     "redis_sentinel_socket_timeout": 1000,
     "storage_slice_import": 1,
     "storage_slice": 1,
+    "storage_mode": 0,
+    "storage_sub_slice": 16,
     "using_hash_storage_slice": False,
     "keys_sending_size": 1024,
     "using_md5_prefix_name": False,
@@ -149,7 +174,17 @@ class RedisTableConfig(object):
     "redis_hash_tags_runtime": [],
     "expire_model_tag_in_seconds": 604800,
     "table_store_mode": 1,
-    "model_lib_abs_dir": "/tmp/"
+    "model_lib_abs_dir": "/tmp/",
+    "redis_async_client": False,
+    "redis_async_client_threads": 4,
+    "redis_pipeline_per_node": False,
+    "using_packed_commands": False,
+    "near_cache_capacity": 0,
+    "near_cache_ttl_in_seconds": 60,
+    "near_cache_write_through": True,
+    "using_write_behind": False,
+    "write_behind_interval_in_ms": 100,
+    "write_behind_max_keys": 65536
   }
   ```
   Refer to the [Redis table config guide](https://github.com/tensorflow/recommenders-addons/blob/master/docs/api_docs/tfra/dynamic_embedding/RedisBackend.md)
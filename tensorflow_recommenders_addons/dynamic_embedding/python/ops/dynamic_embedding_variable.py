@@ -188,6 +188,19 @@ class Variable(base.Trackable):
         The environment variables 'TF_HASHTABLE_INIT_SIZE' can be used to set the
         inital size of each tables, which can help reduce rehash times.
         The default initial table size is 8,192
+        The environment variable 'TFRA_HASHTABLE_NUMA_PARTITIONS' splits each
+        CPU table into sub-tables served by a thread pool pinned to their NUMA
+        node, one per node shared by all the tables: a negative value uses one partition per NUMA node, a positive value
+        forces that many partitions, and 0 (default) disables partitioning.
+        The environment variable 'TFRA_HASHTABLE_ALLOCATOR' selects where the
+        buckets of CPU tables live: "default", "thp" (transparent huge pages),
+        "hugepage_2m" or "hugepage_1g" (reserved huge pages, falling back to
+        "thp" when none are available) or "tf" (TensorFlow's CPU allocator).
+        The environment variable 'TFRA_HASHTABLE_REHASH_THREADS' sets how many
+        extra threads a CPU table spawns for a full rehash (6 by default).
+        The environment variable 'TFRA_HASHTABLE_SHRINK_LOAD_FACTOR' makes CPU
+        tables shrink after removals leave their load factor below it, in
+        [0, 0.5); 0 (default) disables automatic shrinking.
 
         Args:
           key_dtype: the type of the key tensors.
@@ -0,0 +1,304 @@
+# Copyright 2021 The TensorFlow Authors. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+# ==============================================================================
+"""Frozen (read-only) hash table operations for serving."""
+# pylint: disable=g-bad-name
+from __future__ import absolute_import
+from __future__ import division
+from __future__ import print_function
+
+import functools
+
+from tensorflow.python.eager import context
+from tensorflow.python.framework import ops
+from tensorflow.python.ops.lookup_ops import LookupInterface
+from tensorflow.python.training.saver import BaseSaverBuilder
+
+from tensorflow_recommenders_addons.utils.resource_loader import LazySO
+from tensorflow_recommenders_addons.utils.resource_loader import prefix_op_name
+
+cuckoo_ops = LazySO("dynamic_embedding/core/_cuckoo_hashtable_ops.so").ops
+
+
+class FrozenHashTable(LookupInterface):
+  """An immutable hash table for inference.
+
+    Keys and values are stored contiguously in an open-addressing layout at a
+    high load factor, and lookups take no per-key locks. The content can only
+    be replaced as a whole, from the output of `export()` of another table or
+    from a file. Files written by `save` are mapped read-only by `load`, so
+    several serving processes on one host share the same pages.
+
+    Only fixed size key (`int32`, `int64`) and value types are supported.
+
+    Example usage:
+
+    ```python
+    keys, values = training_table.export()
+    table = tfra.dynamic_embedding.FrozenHashTable(key_dtype=tf.int64,
+                                                   value_dtype=tf.float32,
+                                                   default_value=[0.] * 8)
+    sess.run(table.build(keys, values))
+    sess.run(table.save("/path/to/frozen_table"))
+    out = table.lookup(query_keys)
+    ```
+    """
+
+  def __init__(
+      self,
+      key_dtype,
+      value_dtype,
+      default_value,
+      name="FrozenHashTable",
+      checkpoint=True,
+      load_factor=0.95,
+  ):
+    """Creates an empty `FrozenHashTable` object.
+
+        Args:
+          key_dtype: the type of the key tensors.
+          value_dtype: the type of the value tensors.
+          default_value: The value to use if a key is missing in the table.
+          name: A name for the operation (optional).
+          checkpoint: if True, the contents of the table are restored from
+            checkpoints written by a mutable table with the same name.
+          load_factor: the target ratio of keys to slots, in (0, 1].
+
+        Returns:
+          A `FrozenHashTable` object.
+        """
+    self._default_value = ops.convert_to_tensor(default_value,
+                                                dtype=value_dtype)
+    self._value_shape = self._default_value.get_shape()
+    self._checkpoint = checkpoint
+    self._key_dtype = key_dtype
+    self._value_dtype = value_dtype
+    self._load_factor = load_factor
+    self._name = name
+
+    self._shared_name = None
+    if context.executing_eagerly():
+      self._shared_name = "table_%d" % (ops.uid(),)
+    super(FrozenHashTable, self).__init__(key_dtype, value_dtype)
+
+    self._resource_handle = self._create_resource()
+    if checkpoint:
+      _ = FrozenHashTable._Saveable(self, name)
+      if not context.executing_eagerly():
+        self.saveable = FrozenHashTable._Saveable(
+            self,
+            name=self._resource_handle.op.name,
+            full_name=self._resource_handle.op.name,
+        )
+        ops.add_to_collection(ops.GraphKeys.SAVEABLE_OBJECTS, self.saveable)
+      else:
+        self.saveable = FrozenHashTable._Saveable(self,
+                                                  name=name,
+                                                  full_name=name)
+
+  def _create_resource(self):
+    use_node_name_sharing = self._checkpoint and self._shared_name is None
+
+    table_ref = cuckoo_ops.tfra_frozen_hash_table_of_tensors(
+        shared_name=self._shared_name,
+        use_node_name_sharing=use_node_name_sharing,
+        key_dtype=self._key_dtype,
+        value_dtype=self._value_dtype,
+        value_shape=self._default_value.get_shape(),
+        load_factor=self._load_factor,
+        name=self._name,
+    )
+
+    if context.executing_eagerly():
+      self._table_name = None
+    else:
+      self._table_name = table_ref.op.name.split("/")[-1]
+    return table_ref
+
+  @property
+  def name(self):
+    return self._table_name
+
+  def size(self, name=None):
+    """Compute the number of elements in this table.
+
+        Args:
+          name: A name for the operation (optional).
+
+        Returns:
+          A scalar tensor containing the number of elements in this table.
+        """
+    with ops.name_scope(name, "%s_Size" % self.name, [self.resource_handle]):
+      with ops.colocate_with(self.resource_handle):
+        return cuckoo_ops.tfra_cuckoo_hash_table_size(self.resource_handle)
+
+  def lookup(self,
+             keys,
+             dynamic_default_values=None,
+             return_exists=False,
+             name=None):
+    """Looks up `keys` in a table, outputs the corresponding values.
+
+      The `default_value` is used for keys not present in the table.
+
+      Args:
+        keys: Keys to look up. Can be a tensor of any shape. Must match the
+          table's key_dtype.
+        dynamic_default_values: The values to use if a key is missing in the
+          table. If None (by default), the static default_value
+          `self._default_value` will be used.
+        return_exists: if True, will return a additional Tensor which indicates
+          if or not keys are existing in the table.
+        name: A name for the operation (optional).
+
+      Returns:
+        A tensor containing the values in the same shape as `keys` using the
+          table's value type.
+        exists:
+          A bool type Tensor of the same shape as `keys` which indicates
+            if keys are existing in the table.
+            Only provided if `return_exists` is True.
+    """
+    with ops.name_scope(
+        name,
+        "%s_lookup_table_find" % self.name,
+        (self.resource_handle, keys, self._default_value),
+    ):
+      keys = ops.convert_to_tensor(keys, dtype=self._key_dtype, name="keys")
+      default_values = (dynamic_default_values if dynamic_default_values
+                        is not None else self._default_value)
+      with ops.colocate_with(self.resource_handle, ignore_existing=True):
+        if return_exists:
+          values, exists = cuckoo_ops.tfra_frozen_hash_table_find_with_exists(
+              self.resource_handle, keys, default_values)
+        else:
+          values = cuckoo_ops.tfra_cuckoo_hash_table_find(
+              self.resource_handle, keys, default_values)
+    return (values, exists) if return_exists else values
+
+  def build(self, keys, values, name=None):
+    """Replaces the content of the table with `keys` and `values`.
+
+        Args:
+          keys: A 1-D tensor of keys, e.g. the first output of `export()`.
+          values: A 2-D tensor of values, e.g. the second output of
+            `export()`.
+          name: A name for the operation (optional).
+
+        Returns:
+          The created Operation.
+        """
+    with ops.name_scope(name, "%s_lookup_table_build" % self.name,
+                        [self.resource_handle, keys, values]):
+      keys = ops.convert_to_tensor(keys, self._key_dtype, name="keys")
+      values = ops.convert_to_tensor(values, self._value_dtype, name="values")
+      with ops.colocate_with(self.resource_handle, ignore_existing=True):
+        return cuckoo_ops.tfra_cuckoo_hash_table_import(self.resource_handle,
+                                                        keys, values)
+
+  def export(self, name=None):
+    """Returns tensors of all keys and values in the table.
+
+        Args:
+          name: A name for the operation (optional).
+
+        Returns:
+          A pair of tensors with the first tensor containing all keys and the
+            second tensors containing all values in the table.
+        """
+    with ops.name_scope(name, "%s_lookup_table_export_values" % self.name,
+                        [self.resource_handle]):
+      with ops.colocate_with(self.resource_handle):
+        keys, values = cuckoo_ops.tfra_cuckoo_hash_table_export(
+            self.resource_handle, self._key_dtype, self._value_dtype)
+    return keys, values
+
+  def save(self, filepath, name=None):
+    """
+    Returns an operation to write the table image to `filepath`. The file can
+    be mapped by `load` without copying.
+    Args:
+      filepath: A path to save the table.
+      name: Name for the operation.
+    Returns:
+      An operation to save the table.
+    """
+    with ops.name_scope(name, "%s_save_table" % self.name,
+                        [self.resource_handle]):
+      with ops.colocate_with(None, ignore_existing=True):
+        return cuckoo_ops.tfra_frozen_hash_table_save(
+            self.resource_handle,
+            filepath,
+            key_dtype=self._key_dtype,
+            value_dtype=self._value_dtype)
+
+  def load(self, filepath, name=None):
+    """
+    Returns an operation to replace the table content from `filepath`. The file
+    is either an image written by `save`, which is mapped read-only, or a file
+    written by `CuckooHashTable.save_to_hdfs`.
+    Args:
+      filepath: A file path stored the table.
+      name: Name for the operation.
+    Returns:
+      An operation to load the table.
+    """
+    with ops.name_scope(name, "%s_load_table" % self.name,
+                        [self.resource_handle]):
+      with ops.colocate_with(None, ignore_existing=True):
+        return cuckoo_ops.tfra_frozen_hash_table_load(
+            self.resource_handle,
+            filepath,
+            key_dtype=self._key_dtype,
+            value_dtype=self._value_dtype)
+
+  def _gather_saveables_for_checkpoint(self):
+    """For object-based checkpointing."""
+    full_name = self._table_name
+    return {
+        "table":
+            functools.partial(
+                FrozenHashTable._Saveable,
+                table=self,
+                name=self._name,
+                full_name=full_name,
+            )
+    }
+
+  class _Saveable(BaseSaverBuilder.SaveableObject):
+    """SaveableObject implementation for FrozenHashTable."""
+
+    def __init__(self, table, name, full_name=""):
+      tensors = table.export()
+      specs = [
+          BaseSaverBuilder.SaveSpec(tensors[0], "", name + "-keys"),
+          BaseSaverBuilder.SaveSpec(tensors[1], "", name + "-values"),
+      ]
+      # pylint: disable=protected-access
+      super(FrozenHashTable._Saveable, self).__init__(table, specs, name)
+      self._restore_name = table._name
+
+    def restore(self, restored_tensors, restored_shapes, name=None):
+      del restored_shapes  # unused
+      # pylint: disable=protected-access
+      with ops.name_scope(name, "%s_table_restore" % self._restore_name):
+        with ops.colocate_with(self.op.resource_handle):
+          return cuckoo_ops.tfra_cuckoo_hash_table_import(
+              self.op.resource_handle,
+              restored_tensors[0],
+              restored_tensors[1],
+          )
+
+
+ops.NotDifferentiable(prefix_op_name("FrozenHashTableOfTensors"))
@@ -86,6 +86,13 @@ class RedisTable(LookupInterface):
           -1,  # If storage_slice_import is not equal to storage_slice, rehash will happen. Equaling -1 means same as storage_slice.
       "storage_slice":
           1,  # For deciding bucket number, which usually is how many Redis instance may be used in the trainning.
+      "storage_mode": 0,
+      # 0 keeps each storage slice in one Redis hash. 1 splits each storage
+      # slice over storage_sub_slice hashes with hash tags of their own, so
+      # that no single hash of a large table is a hotspot for HSCAN, DUMP,
+      # RESTORE or expiry and the hashes spread over the cluster. A table
+      # stored in the other mode is moved into this one.
+      "storage_sub_slice": 16,  # Hashes per storage slice in storage_mode 1.
       "using_hash_storage_slice":
           False,  # If True, IDs will be calculated hash(CRC32) value and then MOD to decide which bucket number they belong to. If False, only calculate the remainder.
       "keys_sending_size":
@@ -108,9 +115,44 @@ class RedisTable(LookupInterface):
       # Saving and restoring table into ensor in TF savedmodel variable file, table_store_mode = 0;
       # Saving and restoring table into redis rdb file in model_lib_abs_dir, table_store_mode = 1;
       # Saving and restoring nothing, keeping data in redis servers, table_store_mode = 2.
-      "model_lib_abs_dir": "/tmp/"
+      "model_lib_abs_dir": "/tmp/",
       # if table_store_mode equals 1, then it will try to save or resoter table
       # from model_lib_abs_dir which has been mounted in system
+      "redis_async_client": False,
+      # If True, find and insert pipeline their commands over one non-blocking
+      # connection per Redis node instead of blocking a thread per command.
+      "redis_async_client_threads": 4,
+      # The event loops of the asynchronous client, each with its own
+      # connection per Redis node. They also parse the replies.
+      "redis_pipeline_per_node": False,
+      # If True, in cluster mode the commands of all the storage slices
+      # served by one Redis master are pipelined on one connection, so an op
+      # waits one round trip per master rather than one per storage slice.
+      "using_packed_commands": False,
+      # If True, find, insert and accum send the keys and values of each
+      # storage slice packed into one argument each, with HMGETPACKED,
+      # HMSETPACKED and HMACCUMPACKED. Every Redis server must have loaded the
+      # module in third_party/redis_module.
+      "near_cache_capacity": 0,
+      # Rows of the table kept in the memory of the process in front of
+      # Redis, so that find only reads the missing keys from Redis.
+      # 0 disables the cache.
+      "near_cache_ttl_in_seconds": 60,
+      # Age after which a cached row is read from Redis again, which bounds
+      # how stale a row updated by another worker may be.
+      # It will not take effect if it is less than or equal to zero.
+      "near_cache_write_through": True,
+      # If True, insert also updates the cached rows of its keys. If False,
+      # it drops them and the next find reads them again from Redis.
+      "using_write_behind": False,
+      # If True, insert and accum are buffered in the process, repeated keys
+      # coalesced, and written to Redis in the background. Find in this
+      # process sees the buffered writes, other processes see them once
+      # flushed. Export and sparse_apply flush them first.
+      "write_behind_interval_in_ms": 100,
+      # How often the buffered writes are flushed to Redis.
+      "write_behind_max_keys": 65536
+      # Number of buffered keys which makes a flush start at once.
   }
 
   def __init__(
@@ -333,6 +375,25 @@ class RedisTable(LookupInterface):
 
     return op
 
+  def flush(self, name=None):
+    """
+      Writes the inserts and accums buffered by using_write_behind to Redis.
+      Does nothing when using_write_behind is off.
+
+      Args:
+        name: A name for the operation (optional).
+
+      Returns:
+        The created Operation.
+    """
+    with ops.name_scope(name, "%s_lookup_table_flush" % self.name,
+                        (self.resource_handle,)):
+      op = redis_table_ops.tfra_redis_table_flush(self.resource_handle,
+                                                  key_dtype=self._key_dtype,
+                                                  value_dtype=self._value_dtype)
+
+    return op
+
   def lookup(self,
              keys,
              dynamic_default_values=None,
@@ -453,6 +514,62 @@ class RedisTable(LookupInterface):
                                                     values_or_deltas, exists)
     return op
 
+  def sparse_apply(self,
+                   keys,
+                   grads,
+                   optimizer,
+                   hyperparams,
+                   slots=(),
+                   name=None):
+    """Applies `grads` to the values of `keys` on the Redis servers.
+
+      The optimizer runs as a command of the module in
+      third_party/redis_module, which every Redis server must have loaded, so
+      only the keys and the gradients are sent, and the values and the slots
+      never leave Redis. Keys not in the table are left out, so new keys must
+      be inserted first.
+
+      Args:
+        keys: Keys to update. Must be a tensor of int32 or int64 matching the
+          table's key type.
+        grads: Gradients of the values of `keys`. Must be a tensor of the
+          same shape as the values of `keys` and match the table's value
+          type, which must be float32 or float64.
+        optimizer: One of 'sgd', 'adagrad' and 'adam'.
+        hyperparams: A list of the hyperparameters of `optimizer`:
+          'sgd': [learning_rate]
+          'adagrad': [learning_rate, initial_accumulator_value, epsilon]
+          'adam': [learning_rate, beta1, beta2, epsilon], where learning_rate
+            is already multiplied by sqrt(1 - beta2^t) / (1 - beta1^t).
+        slots: A list of the `RedisTable`s keeping the slots of `optimizer`:
+          none for 'sgd', the accumulator for 'adagrad', and m and v for
+          'adam'. They must share the storage_slice and the redis_hash_tags
+          of this table.
+        name: A name for the operation (optional).
+
+      Returns:
+        The created Operation.
+    """
+    with ops.name_scope(
+        name,
+        "%s_lookup_table_sparse_apply" % self.name,
+        [self.resource_handle, keys, grads],
+    ):
+      keys = ops.convert_to_tensor(keys, self._key_dtype, name="keys")
+      grads = ops.convert_to_tensor(grads, self._value_dtype, name="grads")
+      hyperparams = ops.convert_to_tensor(hyperparams,
+                                          self._value_dtype,
+                                          name="hyperparams")
+      with ops.colocate_with(self.resource_handle):
+        # pylint: disable=protected-access
+        op = redis_table_ops.tfra_redis_table_sparse_apply(
+            self.resource_handle, [slot.resource_handle for slot in slots],
+            keys,
+            grads,
+            hyperparams,
+            optimizer=optimizer)
+    return op
+
   def export(self, name=None):
     """
       Returns nothing in Redis Implement. It will dump some binary files
@@ -476,6 +593,53 @@ class RedisTable(LookupInterface):
                                                     self._value_dtype)
     return exported_keys, exported_values
 
+  def export_chunk(self, slice_index, cursor, max_rows, name=None):
+    """
+      Returns the keys and values found by one HSCAN of a storage slice of the
+      table, so that a table too large for one tensor can be exported in
+      batches. Start from slice 0 and cursor 0, then pass the next slice and
+      cursor returned, until the next slice is -1.
+
+      Args:
+        slice_index: The storage slice to scan, a scalar int64.
+        cursor: The HSCAN cursor in the storage slice, a scalar int64.
+        max_rows: The COUNT of the HSCAN. Redis may return a few more rows,
+          or all the rows of a small storage slice.
+        name: A name for the operation (optional).
+
+      Returns:
+        A tuple of the keys, the values, the next storage slice and the next
+        cursor.
+    """
+    with ops.name_scope(name, "%s_lookup_table_export_chunk" % self.name,
+                        [self.resource_handle]):
+      with ops.colocate_with(self.resource_handle):
+        return redis_table_ops.tfra_redis_table_export_chunk(
+            self.resource_handle,
+            slice_index,
+            cursor,
+            max_rows,
+            Tkeys=self._key_dtype,
+            Tvalues=self._value_dtype)
+
+  def export_chunks(self, max_rows=65536):
+    """
+      Yields the keys and values of the table in batches of about `max_rows`,
+      with `export_chunk`. Only in eager mode.
+
+      Args:
+        max_rows: The COUNT of each HSCAN.
+
+      Yields:
+        A pair of tensors with the keys and the values of a batch.
+    """
+    slice_index, cursor = 0, 0
+    while slice_index >= 0:
+      keys, values, slice_index, cursor = self.export_chunk(
+          slice_index, cursor, max_rows)
+      slice_index, cursor = int(slice_index), int(cursor)
+      yield keys, values
+
   def _gather_saveables_for_checkpoint(self):
     """For object-based checkpointing."""
     # full_name helps to figure out the name-based Saver's name for this saveable.
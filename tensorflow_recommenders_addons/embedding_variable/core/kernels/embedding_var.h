@@ -20,6 +20,7 @@ limitations under the License.
 #include "tensorflow/core/framework/resource_op_kernel.h"
 #include "tensorflow/core/framework/typed_allocator.h"
 #include "tensorflow/core/lib/core/status.h"
+#include "tensorflow_recommenders_addons/dynamic_embedding/core/utils/table_metrics.h"
 
 namespace tensorflow {
 namespace {
@@ -28,7 +29,11 @@ template <class K, class V>
 class EmbeddingVar : public ResourceBase {
  public:
   EmbeddingVar(const string& name, Allocator* alloc = cpu_allocator())
-      : name_(name), value_len_(0), default_value_(NULL), alloc_(alloc) {}
+      : name_(name),
+        value_len_(0),
+        default_value_(NULL),
+        alloc_(alloc),
+        metrics_("embedding_variable", name) {}
 
   Status Init(const Tensor& default_tensor, const Tensor& empty_key_tensor) {
     dense_hash_map_.max_load_factor(0.8);
@@ -69,9 +74,13 @@ class EmbeddingVar : public ResourceBase {
     return typename TTypes<V>::Flat(val, dims);
   }
 
-  V* LookupOrCreate(K key, V* default_v, int64 global_step = -1) {
+  // Sets created, if given, when key was missing and is inserted with the
+  // value default_v.
+  V* LookupOrCreate(K key, V* default_v, int64 global_step = -1,
+                    bool* created = nullptr) {
     V* val = NULL;
     Status s = DoLookup(key, &val);
+    if (created != nullptr) *created = !s.ok();
     if (!s.ok()) {
       V* new_val = TypedAllocator::Allocate<V>(alloc_, value_len_,
                                                AllocationAttributes());
@@ -123,6 +132,17 @@ class EmbeddingVar : public ResourceBase {
 
   mutex* mu() { return &mu_; }
 
+  recommenders_addons::TableMetrics* metrics() { return &metrics_; }
+
+  // Refreshes the size gauges of the metrics when they are due.
+  void MaybeRecordSize() {
+    metrics_.MaybeRecordSize([this]() {
+      const int64 size = Size();
+      return std::pair<int64, int64>(
+          size, size * (sizeof(K) + sizeof(V*) + value_len_ * sizeof(V)));
+    });
+  }
+
  private:
   std::string name_;
   mutable mutex mu_;
@@ -132,6 +152,7 @@ class EmbeddingVar : public ResourceBase {
   V* default_value_;
   Allocator* alloc_;
   bool is_initialized_ = false;
+  recommenders_addons::TableMetrics metrics_;
 
   ~EmbeddingVar() override {}
   TF_DISALLOW_COPY_AND_ASSIGN(EmbeddingVar);
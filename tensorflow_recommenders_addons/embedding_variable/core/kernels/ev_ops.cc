@@ -17,6 +17,8 @@ limitations under the License.
 #include "tensorflow/core/framework/resource_mgr.h"
 #include "tensorflow/core/framework/resource_op_kernel.h"
 #include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/profiler/lib/traceme.h"
+#include "tensorflow/core/profiler/lib/traceme_encode.h"
 #include "tensorflow/core/util/work_sharder.h"
 #include "tensorflow_recommenders_addons/embedding_variable/core/kernels/embedding_var.h"
 #include "tensorflow_recommenders_addons/embedding_variable/core/kernels/ev_op_helpers.h"
@@ -87,9 +89,10 @@ class InitializeEVOp : public OpKernel {
     OP_REQUIRES_OK(context,
                    LookupOrCreateResource<EmbeddingVar<TKey, TValue>>(
                        context, HandleFromInput(context, 0), &embedding_var,
-                       [this, default_values,
+                       [this, &context, default_values,
                         invalid_key](EmbeddingVar<TKey, TValue>** ptr) {
-                         *ptr = new EmbeddingVar<TKey, TValue>("EmbeddingVar");
+                         *ptr = new EmbeddingVar<TKey, TValue>(
+                             HandleFromInput(context, 0).name());
                          return (*ptr)->Init(default_values, invalid_key);
                        }));
     core::ScopedUnref unref_me(embedding_var);
@@ -172,6 +175,10 @@ class EVGatherOp : public OpKernel {
     OP_REQUIRES_OK(context, context->allocate_output(0, result_shape, &out));
 
     if (N > 0) {
+      profiler::TraceMe trace([&] {
+        return profiler::TraceMeEncode(
+            "EVGather", {{"keys", N}, {"bytes", out->TotalBytes()}});
+      });
       auto out_flat = out->shaped<TValue, 2>({N, out->NumElements() / N});
       TValue* out_base = &out_flat(0, 0);
 
@@ -184,13 +191,21 @@ class EVGatherOp : public OpKernel {
               "hashmap's value_len should same with output's dimension(1)",
               std::to_string(slice_elems), std::to_string(ev_dim_size)));
 
+      const uint64 start_micros =
+          recommenders_addons::TableMetrics::NowMicros();
       const size_t slice_bytes = slice_elems * sizeof(TValue);
+      int64 misses = 0;
       for (int64 i = 0; i < indices_size; i++) {
         TValue* default_v = &default_values_matrix(i, 0);
-        TValue* mem_val =
-            embedding_var->LookupOrCreate(indices_flat(i), default_v);
+        bool created = false;
+        TValue* mem_val = embedding_var->LookupOrCreate(
+            indices_flat(i), default_v, /*global_step=*/-1, &created);
         memcpy(out_base + i * slice_elems, mem_val, slice_bytes);
+        misses += created;
       }
+      embedding_var->metrics()->RecordFind(indices_size, misses,
+                                           start_micros);
+      embedding_var->MaybeRecordSize();
     }
   }
 };
@@ -265,6 +280,13 @@ class EVSparseApplyGradientDescentOp : public OpKernel {
             "grad must be the same size as indices in the first dimension."));
 
     if (N > 0) {
+      profiler::TraceMe trace([&] {
+        return profiler::TraceMeEncode(
+            "EVSparseApplyGradientDescent",
+            {{"keys", N}, {"bytes", grad.TotalBytes()}});
+      });
+      const uint64 start_micros =
+          recommenders_addons::TableMetrics::NowMicros();
       auto indices_vec = indices.vec<TKey>();
       TValue lr_scalar = lr.scalar<TValue>()();
       TStep global_step_scalar = global_step.scalar<TStep>()();
@@ -279,6 +301,8 @@ class EVSparseApplyGradientDescentOp : public OpKernel {
           v -= g.constant(lr_scalar) * g;
         }
       }
+      embedding_var->metrics()->RecordInsert(N, start_micros);
+      embedding_var->MaybeRecordSize();
     }
   }
 
@@ -358,6 +382,13 @@ class EVSparseApplyAdagradOp : public OpKernel {
                     "Inner dimension should be greater than zero."));
 
     if (N > 0) {
+      profiler::TraceMe trace([&] {
+        return profiler::TraceMeEncode(
+            "EVSparseApplyAdagrad",
+            {{"keys", N}, {"bytes", grad.TotalBytes()}});
+      });
+      const uint64 start_micros =
+          recommenders_addons::TableMetrics::NowMicros();
       if (inner_dim > 0) {
         auto indices_vec = indices.vec<TKey>();
         auto grad_flat = grad.flat_outer_dims<TValue>();
@@ -375,6 +406,8 @@ class EVSparseApplyAdagradOp : public OpKernel {
           v -= g.constant(lr_scalar) * g * a.rsqrt();
         }
       }
+      var->metrics()->RecordInsert(N, start_micros);
+      var->MaybeRecordSize();
     }
   }
 
@@ -473,6 +506,12 @@ class EVSparseApplyAdamOp : public OpKernel {
             "grad must be the same size as indices in the first dimension."));
 
     if (N > 0) {
+      profiler::TraceMe trace([&] {
+        return profiler::TraceMeEncode(
+            "EVSparseApplyAdam", {{"keys", N}, {"bytes", grad.TotalBytes()}});
+      });
+      const uint64 start_micros =
+          recommenders_addons::TableMetrics::NowMicros();
       TValue beta1_power_scalar = beta1_power.scalar<TValue>()();
       TValue beta2_power_scalar = beta2_power.scalar<TValue>()();
       TValue lr_scalar = lr.scalar<TValue>()();
@@ -494,6 +533,12 @@ class EVSparseApplyAdamOp : public OpKernel {
 
           TStep gs = global_step.scalar<TStep>()();
 
+          profiler::TraceMe trace(
+              [&] {
+                return profiler::TraceMeEncode(
+                    "EVSparseApplyAdamShard", {{"keys", limit_i - start_i}});
+              },
+              profiler::TraceMeLevel::kInfo);
           for (int64 i = static_cast<int64>(start_i);
                i < static_cast<int64>(limit_i); i++) {
             const TKey index = indices_vec(i);
@@ -514,6 +559,8 @@ class EVSparseApplyAdamOp : public OpKernel {
       auto worker_threads = *(ctx->device()->tensorflow_cpu_worker_threads());
       Shard(worker_threads.num_threads, worker_threads.workers, N, cost,
             DoWork);
+      var->metrics()->RecordInsert(N, start_micros);
+      var->MaybeRecordSize();
     }
   }
 
@@ -549,7 +596,11 @@ class EVExportOp : public OpKernel {
     OP_REQUIRES_OK(ctx, LookupResource(ctx, HandleFromInput(ctx, 0), &ev));
     std::vector<TKey> key_list;
     std::vector<TValue*> valueptr_list;
-    int64 total_size = ev->GetSnapshot(&key_list, &valueptr_list);
+    int64 total_size = 0;
+    {
+      profiler::TraceMe trace("EVSnapshot");
+      total_size = ev->GetSnapshot(&key_list, &valueptr_list);
+    }
 
     Tensor* key = nullptr;
     Tensor* val = nullptr;
@@ -558,6 +609,10 @@ class EVExportOp : public OpKernel {
     OP_REQUIRES_OK(
         ctx, ctx->allocate_output(1, TensorShape({total_size, ev->ValueLen()}),
                                   &val));
+    profiler::TraceMe trace([&] {
+      return profiler::TraceMeEncode(
+          "EVExport", {{"keys", total_size}, {"bytes", val->TotalBytes()}});
+    });
     auto key_flat = key->flat<TKey>();
     auto val_matrix = val->matrix<TValue>();
     for (size_t i = 0; i < total_size; ++i) {
@@ -598,12 +653,20 @@ class EVImportOp : public OpKernel {
     OP_REQUIRES_OK(ctx, LookupResource(ctx, HandleFromInput(ctx, 0), &ev));
     Tensor key = ctx->input(1);
     Tensor val = ctx->input(2);
+    profiler::TraceMe trace([&] {
+      return profiler::TraceMeEncode(
+          "EVImport",
+          {{"keys", key.NumElements()}, {"bytes", val.TotalBytes()}});
+    });
+    const uint64 start_micros = recommenders_addons::TableMetrics::NowMicros();
     auto key_flat = key.flat<TKey>();
     auto val_matrix = val.matrix<TValue>();
     for (size_t i = 0; i < key.NumElements(); ++i) {
       auto value = &val_matrix(i, 0);
       ev->LookupOrCreate(key_flat(i), value);
     }
+    ev->metrics()->RecordInsert(key.NumElements(), start_micros);
+    ev->MaybeRecordSize();
   }
 };
 
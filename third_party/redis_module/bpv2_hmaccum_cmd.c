@@ -15,6 +15,8 @@ limitations under the License.
 
 #include "bpv2_hmaccum_cmd.h"
 
+#include <math.h>
+#include <stdint.h>
 #include <string.h>
 
 #include "avx.h"
@@ -31,12 +33,9 @@ enum valueType getValueType(RedisModuleString *typeStr) {
   return DT_INVALID;
 }
 
-int TensorValueAccump(RedisModuleCtx *ctx, RedisModuleString *old,
-                      RedisModuleString *delta, enum valueType type) {
-  size_t valLen = 0, deltaLen = 0;
-  const char *oldData = RedisModule_StringPtrLen(old, &valLen);
-  const char *deltaData = RedisModule_StringPtrLen(delta, &deltaLen);
-
+int TensorBufferAccump(RedisModuleCtx *ctx, char *oldData, size_t valLen,
+                       const char *deltaData, size_t deltaLen,
+                       enum valueType type) {
   if (valLen != deltaLen) {
     RedisModule_Log(ctx, "warning",
                     "mismatched tensor shape oldvalLen = %ld, delta = %ld",
@@ -46,23 +45,23 @@ int TensorValueAccump(RedisModuleCtx *ctx, RedisModuleString *old,
 
   switch (type) {
     case DT_FLOAT: {
-      accumulatefloat(oldData, deltaData, valLen);
+      accumulatefloat(oldData, (char *)deltaData, valLen);
       break;
     }
     case DT_DOUBLE: {
-      accumulatedouble(oldData, deltaData, valLen);
+      accumulatedouble(oldData, (char *)deltaData, valLen);
       break;
     }
     case DT_INT32: {
-      accumulateint32(oldData, deltaData, valLen);
+      accumulateint32(oldData, (char *)deltaData, valLen);
       break;
     }
     case DT_INT64: {
-      accumulateint64(oldData, deltaData, valLen);
+      accumulateint64(oldData, (char *)deltaData, valLen);
       break;
     }
     case DT_INT8: {
-      accumulateint8(oldData, deltaData, valLen);
+      accumulateint8(oldData, (char *)deltaData, valLen);
       break;
     }
     default: {
@@ -73,6 +72,15 @@ int TensorValueAccump(RedisModuleCtx *ctx, RedisModuleString *old,
   return OP_SUCCESS;
 }
 
+int TensorValueAccump(RedisModuleCtx *ctx, RedisModuleString *old,
+                      RedisModuleString *delta, enum valueType type) {
+  size_t valLen = 0, deltaLen = 0;
+  const char *oldData = RedisModule_StringPtrLen(old, &valLen);
+  const char *deltaData = RedisModule_StringPtrLen(delta, &deltaLen);
+  return TensorBufferAccump(ctx, (char *)oldData, valLen, deltaData, deltaLen,
+                            type);
+}
+
 int CustomHmaccumCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
                          int argc) {
   /* Use automatic memory management */
@@ -124,6 +132,397 @@ int CustomHmaccumCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
   return REDISMODULE_OK;
 }
 
+/* Tells whether n values of valueBytes each, plus one byte, fit in a size_t,
+ * so that the size of a packed buffer cannot wrap around. */
+int PackedBytesFit(size_t n, long long valueBytes) {
+  return n == 0 || (unsigned long long)valueBytes <= (SIZE_MAX - 1) / n;
+}
+
+/* HMGETPACKED key field_bytes value_bytes fields
+ *
+ * fields holds n fields of field_bytes each, back to back. The reply is an
+ * array of two bulk strings: a bitmap in which bit i % 8 of byte i / 8 tells
+ * whether field i exists, and the n values of value_bytes each, back to
+ * back, with zeros for the missing fields. A value which is not value_bytes
+ * long counts as missing. */
+int CustomHmgetpackedCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
+                             int argc) {
+  /* Use automatic memory management */
+  RedisModule_AutoMemory(ctx);
+
+  if (argc != 5) return RedisModule_WrongArity(ctx);
+
+  RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+  int keyType = RedisModule_KeyType(key);
+  if (keyType != REDISMODULE_KEYTYPE_HASH &&
+      keyType != REDISMODULE_KEYTYPE_EMPTY) {
+    return RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+  }
+
+  long long fieldBytes = 0, valueBytes = 0;
+  if (RedisModule_StringToLongLong(argv[2], &fieldBytes) != REDISMODULE_OK ||
+      RedisModule_StringToLongLong(argv[3], &valueBytes) != REDISMODULE_OK ||
+      fieldBytes <= 0 || valueBytes <= 0) {
+    return RedisModule_ReplyWithError(ctx, BPV2_ERRORMSG_INVALIDBYTES);
+  }
+
+  size_t fieldsLen = 0;
+  const char *fields = RedisModule_StringPtrLen(argv[4], &fieldsLen);
+  if (fieldsLen % fieldBytes != 0) {
+    return RedisModule_ReplyWithError(ctx, BPV2_ERRORMSG_INVALIDFIELDSLENGTH);
+  }
+
+  size_t n = fieldsLen / fieldBytes, existsLen = (n + 7) / 8, i = 0;
+  if (!PackedBytesFit(n, valueBytes)) {
+    return RedisModule_ReplyWithError(ctx, BPV2_ERRORMSG_INVALIDBYTES);
+  }
+  char *exists = RedisModule_Calloc(existsLen + 1, 1);
+  char *values = RedisModule_Calloc(n * valueBytes + 1, 1);
+
+  RedisModuleString *field, *val;
+  size_t valLen = 0;
+  const char *valData;
+  for (; i < n; i++) {
+    field = RedisModule_CreateString(ctx, fields + i * fieldBytes, fieldBytes);
+    RedisModule_HashGet(key, REDISMODULE_HASH_NONE, field, &val, NULL);
+    if (val) {
+      valData = RedisModule_StringPtrLen(val, &valLen);
+      if (valLen == (size_t)valueBytes) {
+        memcpy(values + i * valueBytes, valData, valLen);
+        exists[i / 8] |= (char)(1 << (i % 8));
+      }
+      /* Free as we go, or a large n would hold every value until the end */
+      RedisModule_FreeString(ctx, val);
+    }
+    RedisModule_FreeString(ctx, field);
+  }
+
+  RedisModule_ReplyWithArray(ctx, 2);
+  RedisModule_ReplyWithStringBuffer(ctx, exists, existsLen);
+  RedisModule_ReplyWithStringBuffer(ctx, values, n * valueBytes);
+  RedisModule_Free(exists);
+  RedisModule_Free(values);
+  return REDISMODULE_OK;
+}
+
+/* Reads the field_bytes and value_bytes arguments at argv[0] and argv[1],
+ * and checks that fields and values hold the same number n of fields and
+ * values of those sizes. Replies with an error and returns OP_FAILURE if
+ * they do not. */
+int ParsePackedArgs(RedisModuleCtx *ctx, RedisModuleString **argv,
+                    long long *fieldBytes, long long *valueBytes,
+                    const char **fields, const char **values, size_t *n) {
+  if (RedisModule_StringToLongLong(argv[0], fieldBytes) != REDISMODULE_OK ||
+      RedisModule_StringToLongLong(argv[1], valueBytes) != REDISMODULE_OK ||
+      *fieldBytes <= 0 || *valueBytes <= 0) {
+    RedisModule_ReplyWithError(ctx, BPV2_ERRORMSG_INVALIDBYTES);
+    return OP_FAILURE;
+  }
+
+  size_t fieldsLen = 0, valuesLen = 0;
+  *fields = RedisModule_StringPtrLen(argv[2], &fieldsLen);
+  *values = RedisModule_StringPtrLen(argv[3], &valuesLen);
+  if (fieldsLen % *fieldBytes != 0) {
+    RedisModule_ReplyWithError(ctx, BPV2_ERRORMSG_INVALIDFIELDSLENGTH);
+    return OP_FAILURE;
+  }
+  *n = fieldsLen / *fieldBytes;
+  if (!PackedBytesFit(*n, *valueBytes) ||
+      valuesLen != *n * (size_t)*valueBytes) {
+    RedisModule_ReplyWithError(ctx, BPV2_ERRORMSG_INVALIDVALUESLENGTH);
+    return OP_FAILURE;
+  }
+  return OP_SUCCESS;
+}
+
+/* HMSETPACKED key field_bytes value_bytes fields values
+ *
+ * fields holds n fields of field_bytes each and values the n values of
+ * value_bytes each, back to back. Sets every field to its value and replies
+ * with n. */
+int CustomHmsetpackedCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
+                             int argc) {
+  /* Use automatic memory management */
+  RedisModule_AutoMemory(ctx);
+
+  if (argc != 6) return RedisModule_WrongArity(ctx);
+
+  RedisModuleKey *key =
+      RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+  int keyType = RedisModule_KeyType(key);
+  if (keyType != REDISMODULE_KEYTYPE_HASH &&
+      keyType != REDISMODULE_KEYTYPE_EMPTY) {
+    return RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+  }
+
+  long long fieldBytes = 0, valueBytes = 0;
+  const char *fields, *values;
+  size_t n = 0, i = 0;
+  if (!ParsePackedArgs(ctx, argv + 2, &fieldBytes, &valueBytes, &fields,
+                       &values, &n)) {
+    return REDISMODULE_OK;
+  }
+
+  RedisModuleString *field, *value;
+  for (; i < n; i++) {
+    field = RedisModule_CreateString(ctx, fields + i * fieldBytes, fieldBytes);
+    value = RedisModule_CreateString(ctx, values + i * valueBytes, valueBytes);
+    RedisModule_HashSet(key, REDISMODULE_HASH_NONE, field, value, NULL);
+    RedisModule_FreeString(ctx, field);
+    RedisModule_FreeString(ctx, value);
+  }
+
+  RedisModule_ReplyWithLongLong(ctx, i);
+  return REDISMODULE_OK;
+}
+
+/* HMACCUMPACKED key valueType field_bytes value_bytes fields values exists
+ *
+ * Like HMACCUM, with the fields and the values or deltas packed as in
+ * HMSETPACKED, and exists holding one byte per field. The delta of a field
+ * is added straight from the values argument to a copy of the old value,
+ * which is then set back, since hash fields cannot be reached with
+ * RedisModule_StringDMA. Replies with n. */
+int CustomHmaccumpackedCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
+                               int argc) {
+  /* Use automatic memory management */
+  RedisModule_AutoMemory(ctx);
+
+  if (argc != 8) return RedisModule_WrongArity(ctx);
+
+  RedisModuleKey *key =
+      RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+  int keyType = RedisModule_KeyType(key);
+  if (keyType != REDISMODULE_KEYTYPE_HASH &&
+      keyType != REDISMODULE_KEYTYPE_EMPTY) {
+    return RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+  }
+
+  enum valueType value_dtype = getValueType(argv[2]);
+  if (DT_INVALID == value_dtype) {
+    RedisModule_Log(ctx, "warning", "not supported valueType");
+    return RedisModule_ReplyWithError(ctx, BPV2_ERRORMSG_VALUETYPENOTSUPPORTED);
+  }
+
+  long long fieldBytes = 0, valueBytes = 0;
+  const char *fields, *values;
+  size_t n = 0, i = 0, existLen = 0;
+  if (!ParsePackedArgs(ctx, argv + 3, &fieldBytes, &valueBytes, &fields,
+                       &values, &n)) {
+    return REDISMODULE_OK;
+  }
+  const char *exists = RedisModule_StringPtrLen(argv[7], &existLen);
+  if (n != existLen) {
+    return RedisModule_ReplyWithError(ctx, BPV2_ERRORMSG_INVALIDEXISTSLENGTH);
+  }
+
+  RedisModuleString *field, *oldval, *newval;
+  size_t valLen = 0;
+  const char *valData, *delta;
+  char *accum = n > 0 ? RedisModule_Alloc(valueBytes) : NULL;
+  for (; i < n; i++) {
+    field = RedisModule_CreateString(ctx, fields + i * fieldBytes, fieldBytes);
+    delta = values + i * valueBytes;
+    RedisModule_HashGet(key, REDISMODULE_HASH_NONE, field, &oldval, NULL);
+    if (oldval) {
+      if (exists[i]) {
+        valData = RedisModule_StringPtrLen(oldval, &valLen);
+        if (valLen == (size_t)valueBytes) memcpy(accum, valData, valLen);
+        if (TensorBufferAccump(ctx, accum, valLen, delta, valueBytes,
+                               value_dtype)) {
+          newval = RedisModule_CreateString(ctx, accum, valueBytes);
+          RedisModule_HashSet(key, REDISMODULE_HASH_NONE, field, newval, NULL);
+          RedisModule_FreeString(ctx, newval);
+        }
+      }
+      RedisModule_FreeString(ctx, oldval);
+    } else if (0 == exists[i]) {
+      oldval = RedisModule_CreateString(ctx, delta, valueBytes);
+      RedisModule_HashSet(key, REDISMODULE_HASH_NONE, field, oldval, NULL);
+      RedisModule_FreeString(ctx, oldval);
+    }
+    RedisModule_FreeString(ctx, field);
+  }
+  if (accum) RedisModule_Free(accum);
+
+  RedisModule_ReplyWithLongLong(ctx, i);
+  return REDISMODULE_OK;
+}
+
+/* Applies one step of the optimizer to a value of n elements of type T, with
+ * its slots and gradient, on the hyperparameters hp:
+ *   OPT_SGD: lr
+ *   OPT_ADAGRAD: lr, initial_accumulator_value, epsilon
+ *   OPT_ADAM: lr, beta1, beta2, epsilon, the lr being bias-corrected already */
+#define DEFINE_APPLY_OPTIMIZER(T)                                          \
+  void ApplyOptimizer_##T(enum optimizerType opt, T *var, T *slot0,        \
+                          T *slot1, const T *grad, size_t n,               \
+                          const double *hp) {                              \
+    size_t i = 0;                                                          \
+    switch (opt) {                                                         \
+      case OPT_SGD: {                                                      \
+        for (; i < n; i++) var[i] -= (T)hp[0] * grad[i];                   \
+        break;                                                             \
+      }                                                                    \
+      case OPT_ADAGRAD: {                                                  \
+        for (; i < n; i++) {                                               \
+          slot0[i] += grad[i] * grad[i];                                   \
+          var[i] -= (T)hp[0] * grad[i] / (sqrt(slot0[i]) + (T)hp[2]);      \
+        }                                                                  \
+        break;                                                             \
+      }                                                                    \
+      case OPT_ADAM: {                                                     \
+        for (; i < n; i++) {                                               \
+          slot0[i] += ((T)1 - (T)hp[1]) * (grad[i] - slot0[i]);            \
+          slot1[i] += ((T)1 - (T)hp[2]) * (grad[i] * grad[i] - slot1[i]);  \
+          var[i] -= (T)hp[0] * slot0[i] / (sqrt(slot1[i]) + (T)hp[3]);     \
+        }                                                                  \
+        break;                                                             \
+      }                                                                    \
+    }                                                                      \
+  }
+
+DEFINE_APPLY_OPTIMIZER(float)
+DEFINE_APPLY_OPTIMIZER(double)
+
+#undef DEFINE_APPLY_OPTIMIZER
+
+/* HMSGD key valueType field_bytes value_bytes fields grads lr
+ * HMADAGRAD key accum_key valueType field_bytes value_bytes fields grads
+ *           lr initial_accumulator_value epsilon
+ * HMADAM key m_key v_key valueType field_bytes value_bytes fields grads
+ *        lr beta1 beta2 epsilon
+ *
+ * Applies the gradients in grads, packed as the values of HMSETPACKED, to
+ * the values of fields in key and to their slots in the slot keys, which
+ * must be in the same slot of a cluster. A field missing from key is left
+ * out, and a slot missing for a field starts at initial_accumulator_value
+ * for HMADAGRAD and at zero for HMADAM. Only float and double values are
+ * supported. Replies with the number of fields updated. */
+int SparseApplyCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
+                       int argc, enum optimizerType opt) {
+  /* Use automatic memory management */
+  RedisModule_AutoMemory(ctx);
+
+  const int slotsNum = opt == OPT_SGD ? 0 : (opt == OPT_ADAGRAD ? 1 : 2);
+  const int hpNum = opt == OPT_SGD ? 1 : (opt == OPT_ADAGRAD ? 3 : 4);
+  if (argc != 7 + slotsNum + hpNum) return RedisModule_WrongArity(ctx);
+
+  RedisModuleKey *keys[3];
+  int k = 0, keyType;
+  for (; k <= slotsNum; k++) {
+    keys[k] = RedisModule_OpenKey(ctx, argv[1 + k],
+                                  REDISMODULE_READ | REDISMODULE_WRITE);
+    keyType = RedisModule_KeyType(keys[k]);
+    if (keyType != REDISMODULE_KEYTYPE_HASH &&
+        keyType != REDISMODULE_KEYTYPE_EMPTY) {
+      return RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+    }
+  }
+
+  RedisModuleString **args = argv + 2 + slotsNum;
+  enum valueType value_dtype = getValueType(args[0]);
+  if (DT_FLOAT != value_dtype && DT_DOUBLE != value_dtype) {
+    RedisModule_Log(ctx, "warning", "not supported valueType");
+    return RedisModule_ReplyWithError(ctx, BPV2_ERRORMSG_VALUETYPENOTSUPPORTED);
+  }
+  const size_t elemBytes =
+      DT_FLOAT == value_dtype ? sizeof(float) : sizeof(double);
+
+  long long fieldBytes = 0, valueBytes = 0;
+  const char *fields, *grads;
+  size_t n = 0, i = 0, updated = 0;
+  if (!ParsePackedArgs(ctx, args + 1, &fieldBytes, &valueBytes, &fields,
+                       &grads, &n)) {
+    return REDISMODULE_OK;
+  }
+  if (valueBytes % elemBytes != 0) {
+    return RedisModule_ReplyWithError(ctx, BPV2_ERRORMSG_INVALIDBYTES);
+  }
+
+  double hp[4];
+  for (k = 0; k < hpNum; k++) {
+    if (RedisModule_StringToDouble(args[5 + k], &hp[k]) != REDISMODULE_OK) {
+      return RedisModule_ReplyWithError(ctx, BPV2_ERRORMSG_INVALIDHYPERPARAMS);
+    }
+  }
+  const double slotInit = opt == OPT_ADAGRAD ? hp[1] : 0.0;
+
+  /* The rows are updated in module buffers and then set as new strings,
+   * since the buffers of the strings read from Redis must not be written. */
+  RedisModuleString *field, *val;
+  size_t valLen = 0, j;
+  const char *valData;
+  char *data[3] = {NULL, NULL, NULL};
+  for (k = 0; n > 0 && k <= slotsNum; k++) {
+    data[k] = RedisModule_Alloc(valueBytes);
+  }
+  for (; i < n; i++) {
+    field = RedisModule_CreateString(ctx, fields + i * fieldBytes, fieldBytes);
+    for (k = 0; k <= slotsNum; k++) {
+      RedisModule_HashGet(keys[k], REDISMODULE_HASH_NONE, field, &val, NULL);
+      valLen = 0;
+      if (val) {
+        valData = RedisModule_StringPtrLen(val, &valLen);
+        if (valLen == (size_t)valueBytes) memcpy(data[k], valData, valLen);
+        RedisModule_FreeString(ctx, val);
+      }
+      if (valLen == (size_t)valueBytes) continue;
+      if (k == 0) break;
+      /* A missing slot starts from its initial value */
+      for (j = 0; j < (size_t)valueBytes / elemBytes; j++) {
+        if (DT_FLOAT == value_dtype) {
+          ((float *)data[k])[j] = (float)slotInit;
+        } else {
+          ((double *)data[k])[j] = slotInit;
+        }
+      }
+    }
+
+    if (k > slotsNum) {
+      if (DT_FLOAT == value_dtype) {
+        ApplyOptimizer_float(opt, (float *)data[0], (float *)data[1],
+                             (float *)data[2],
+                             (const float *)(grads + i * valueBytes),
+                             valueBytes / elemBytes, hp);
+      } else {
+        ApplyOptimizer_double(opt, (double *)data[0], (double *)data[1],
+                              (double *)data[2],
+                              (const double *)(grads + i * valueBytes),
+                              valueBytes / elemBytes, hp);
+      }
+      for (k = 0; k <= slotsNum; k++) {
+        val = RedisModule_CreateString(ctx, data[k], valueBytes);
+        RedisModule_HashSet(keys[k], REDISMODULE_HASH_NONE, field, val, NULL);
+        RedisModule_FreeString(ctx, val);
+      }
+      updated++;
+    }
+    RedisModule_FreeString(ctx, field);
+  }
+  for (k = 0; k <= slotsNum; k++) {
+    if (data[k]) RedisModule_Free(data[k]);
+  }
+
+  RedisModule_ReplyWithLongLong(ctx, updated);
+  return REDISMODULE_OK;
+}
+
+int CustomHmsgdCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
+                       int argc) {
+  return SparseApplyCommand(ctx, argv, argc, OPT_SGD);
+}
+
+int CustomHmadagradCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
+                           int argc) {
+  return SparseApplyCommand(ctx, argv, argc, OPT_ADAGRAD);
+}
+
+int CustomHmadamCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
+                        int argc) {
+  return SparseApplyCommand(ctx, argv, argc, OPT_ADAM);
+}
+
 int RedisModule_OnLoad(RedisModuleCtx *ctx, RedisModuleString **argv,
                        int argc) {
   REDISMODULE_NOT_USED(argv);
@@ -134,6 +533,40 @@ int RedisModule_OnLoad(RedisModuleCtx *ctx, RedisModuleString **argv,
     return REDISMODULE_ERR;
   }
 
-  return RedisModule_CreateCommand(ctx, BPV2_HMACCUM_CMD, CustomHmaccumCommand,
-                                   "readonly", 1, 1, 1);
+  if (RedisModule_CreateCommand(ctx, BPV2_HMACCUM_CMD, CustomHmaccumCommand,
+                                "readonly", 1, 1, 1) == REDISMODULE_ERR) {
+    return REDISMODULE_ERR;
+  }
+
+  if (RedisModule_CreateCommand(ctx, BPV2_HMGETPACKED_CMD,
+                                CustomHmgetpackedCommand, "readonly", 1, 1,
+                                1) == REDISMODULE_ERR) {
+    return REDISMODULE_ERR;
+  }
+
+  if (RedisModule_CreateCommand(ctx, BPV2_HMSETPACKED_CMD,
+                                CustomHmsetpackedCommand, "write", 1, 1,
+                                1) == REDISMODULE_ERR) {
+    return REDISMODULE_ERR;
+  }
+
+  if (RedisModule_CreateCommand(ctx, BPV2_HMACCUMPACKED_CMD,
+                                CustomHmaccumpackedCommand, "write", 1, 1,
+                                1) == REDISMODULE_ERR) {
+    return REDISMODULE_ERR;
+  }
+
+  if (RedisModule_CreateCommand(ctx, BPV2_HMSGD_CMD, CustomHmsgdCommand,
+                                "write", 1, 1, 1) == REDISMODULE_ERR) {
+    return REDISMODULE_ERR;
+  }
+
+  if (RedisModule_CreateCommand(ctx, BPV2_HMADAGRAD_CMD,
+                                CustomHmadagradCommand, "write", 1, 2,
+                                1) == REDISMODULE_ERR) {
+    return REDISMODULE_ERR;
+  }
+
+  return RedisModule_CreateCommand(ctx, BPV2_HMADAM_CMD, CustomHmadamCommand,
+                                   "write", 1, 3, 1);
 }
@@ -23,9 +23,19 @@ limitations under the License.
 
 #define BPV2_ERRORMSG_VALUETYPENOTSUPPORTED "Not supported valueType"
 #define BPV2_ERRORMSG_INVALIDEXISTSLENGTH "Invalid exists length"
+#define BPV2_ERRORMSG_INVALIDBYTES "Invalid field_bytes or value_bytes"
+#define BPV2_ERRORMSG_INVALIDFIELDSLENGTH "Invalid fields length"
+#define BPV2_ERRORMSG_INVALIDVALUESLENGTH "Invalid values length"
+#define BPV2_ERRORMSG_INVALIDHYPERPARAMS "Invalid hyperparameters"
 
 // COMMAND TYPE
 #define BPV2_HMACCUM_CMD "HMACCUM"
+#define BPV2_HMGETPACKED_CMD "HMGETPACKED"
+#define BPV2_HMSETPACKED_CMD "HMSETPACKED"
+#define BPV2_HMACCUMPACKED_CMD "HMACCUMPACKED"
+#define BPV2_HMSGD_CMD "HMSGD"
+#define BPV2_HMADAGRAD_CMD "HMADAGRAD"
+#define BPV2_HMADAM_CMD "HMADAM"
 
 // MODULE INFO
 
@@ -41,4 +51,10 @@ enum valueType {
   DT_INVALID
 };
 
+enum optimizerType {
+  OPT_SGD,     /* var -= lr * grad */
+  OPT_ADAGRAD, /* one slot: accum */
+  OPT_ADAM     /* two slots: m and v */
+};
+
 #endif